@@ -0,0 +1,414 @@
+/*
+ *   hidraw transport test
+ *
+ *   Creates a virtual DeathAdder Chroma with uhid and runs the
+ *   feature report exchange of the driver through the hidraw
+ *   transport. The uhid side checks the reports byte by byte.
+ *
+ *   Copyright (C) 2026 Michael Buesch <m@bues.ch>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation; either version 2
+ *   of the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "librazer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+
+#define UHID_PATH		"/dev/uhid"
+#define TEST_VENDOR		0x1532
+#define TEST_PRODUCT		0x0043	/* DeathAdder Chroma */
+#define TEST_SERIAL		"UHIDTEST0001"
+#define TEST_FW_MAJOR		0x01
+#define TEST_FW_MINOR		0x05
+
+/* The Chroma report. uhid passes the report ID 0 in front of it. */
+#define REPORT_SIZE		90
+#define REPORT_STATUS		0
+#define REPORT_MAGIC		1
+#define REPORT_SIZE_BYTE	5
+#define REPORT_REQUEST		6
+#define REPORT_VALUE		8
+#define REPORT_CHECKSUM		88
+
+#define CHROMA_SUCCESS		0x02
+#define CHROMA_GET_FIRMWARE	0x0087
+#define CHROMA_GET_SERIAL_NO	0x0082
+#define CHROMA_SET_RESOLUTION	0x0405
+
+/* One vendor defined feature report of 90 bytes without report ID. */
+static const uint8_t report_descriptor[] = {
+	0x06, 0x00, 0xFF,	/* Usage Page (Vendor Defined 0xFF00) */
+	0x09, 0x01,		/* Usage (0x01) */
+	0xA1, 0x01,		/* Collection (Application) */
+	0x15, 0x00,		/*   Logical Minimum (0) */
+	0x26, 0xFF, 0x00,	/*   Logical Maximum (255) */
+	0x75, 0x08,		/*   Report Size (8) */
+	0x95, REPORT_SIZE,	/*   Report Count (90) */
+	0x09, 0x02,		/*   Usage (0x02) */
+	0xB1, 0x02,		/*   Feature (Data, Variable, Absolute) */
+	0xC0,			/* End Collection */
+};
+
+struct uhid_mouse {
+	int fd;
+	pthread_t thread;
+	volatile bool stop;
+
+	pthread_mutex_t lock;
+	/* The last report written by the driver. */
+	uint8_t report[REPORT_SIZE];
+	bool have_report;
+	/* The last SET_RESOLUTION report. */
+	uint8_t resolution[REPORT_SIZE];
+	bool have_resolution;
+	/* Protocol errors seen by the uhid thread. */
+	unsigned int nr_errors;
+};
+
+static void logerr(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+}
+
+static void test_error(unsigned int *nr_errors, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fprintf(stderr, "FAIL: ");
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	(*nr_errors)++;
+}
+
+static uint8_t report_checksum(const uint8_t *r)
+{
+	unsigned int i, len;
+	uint8_t sum = 0;
+
+	/* The size byte, the request and the value bytes. */
+	len = 3 + r[REPORT_SIZE_BYTE];
+	for (i = 0; i < len; i++)
+		sum ^= r[REPORT_SIZE_BYTE + i];
+
+	return sum;
+}
+
+static uint16_t report_request(const uint8_t *r)
+{
+	return (r[REPORT_REQUEST] << 8) | r[REPORT_REQUEST + 1];
+}
+
+static int uhid_write(int fd, const struct uhid_event *ev)
+{
+	ssize_t res;
+
+	res = write(fd, ev, sizeof(*ev));
+	if (res < 0)
+		return -errno;
+	if (res != sizeof(*ev))
+		return -EFAULT;
+
+	return 0;
+}
+
+/* The driver wrote a report with HIDIOCSFEATURE. */
+static void handle_set_report(struct uhid_mouse *um,
+			      const struct uhid_set_report_req *req)
+{
+	struct uhid_event ev;
+	const uint8_t *r = req->data + 1;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_SET_REPORT_REPLY;
+	ev.u.set_report_reply.id = req->id;
+
+	pthread_mutex_lock(&um->lock);
+	if (req->rtype != UHID_FEATURE_REPORT || req->rnum != 0) {
+		test_error(&um->nr_errors, "SET_REPORT type %u number %u "
+			   "(expected feature report 0)\n",
+			   req->rtype, req->rnum);
+		ev.u.set_report_reply.err = EIO;
+	} else if (req->size != REPORT_SIZE + 1 || req->data[0] != 0) {
+		test_error(&um->nr_errors,
+			   "SET_REPORT of %u bytes (expected %u)\n",
+			   req->size, REPORT_SIZE + 1);
+		ev.u.set_report_reply.err = EIO;
+	} else if (r[REPORT_MAGIC] != 0xFF ||
+		   r[REPORT_CHECKSUM] != report_checksum(r)) {
+		test_error(&um->nr_errors,
+			   "SET_REPORT %04X has a bad magic or checksum\n",
+			   report_request(r));
+		ev.u.set_report_reply.err = EIO;
+	} else {
+		memcpy(um->report, r, REPORT_SIZE);
+		um->have_report = 1;
+		if (report_request(r) == CHROMA_SET_RESOLUTION) {
+			memcpy(um->resolution, r, REPORT_SIZE);
+			um->have_resolution = 1;
+		}
+	}
+	pthread_mutex_unlock(&um->lock);
+
+	uhid_write(um->fd, &ev);
+}
+
+/* The driver reads the response with HIDIOCGFEATURE.
+ * Answer like the device: Echo the last report with the values. */
+static void handle_get_report(struct uhid_mouse *um,
+			      const struct uhid_get_report_req *req)
+{
+	struct uhid_event ev;
+	uint8_t *r = ev.u.get_report_reply.data + 1;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_GET_REPORT_REPLY;
+	ev.u.get_report_reply.id = req->id;
+
+	pthread_mutex_lock(&um->lock);
+	if (req->rtype != UHID_FEATURE_REPORT || req->rnum != 0) {
+		test_error(&um->nr_errors, "GET_REPORT type %u number %u "
+			   "(expected feature report 0)\n",
+			   req->rtype, req->rnum);
+		ev.u.get_report_reply.err = EIO;
+	} else if (!um->have_report) {
+		test_error(&um->nr_errors, "GET_REPORT without a request\n");
+		ev.u.get_report_reply.err = EIO;
+	} else {
+		memcpy(r, um->report, REPORT_SIZE);
+		r[REPORT_STATUS] = CHROMA_SUCCESS;
+		switch (report_request(r)) {
+		case CHROMA_GET_FIRMWARE:
+			r[REPORT_VALUE] = TEST_FW_MAJOR;
+			r[REPORT_VALUE + 1] = 0;
+			r[REPORT_VALUE + 2] = TEST_FW_MINOR;
+			break;
+		case CHROMA_GET_SERIAL_NO:
+			memcpy(&r[REPORT_VALUE], TEST_SERIAL, strlen(TEST_SERIAL));
+			break;
+		}
+		r[REPORT_CHECKSUM] = report_checksum(r);
+		ev.u.get_report_reply.size = REPORT_SIZE + 1;
+	}
+	pthread_mutex_unlock(&um->lock);
+
+	uhid_write(um->fd, &ev);
+}
+
+static void * uhid_thread(void *arg)
+{
+	struct uhid_mouse *um = arg;
+	struct uhid_event ev;
+	struct pollfd pfd = { .fd = um->fd, .events = POLLIN, };
+
+	while (!um->stop) {
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+		if (read(um->fd, &ev, sizeof(ev)) <= 0)
+			continue;
+		switch (ev.type) {
+		case UHID_SET_REPORT:
+			handle_set_report(um, &ev.u.set_report);
+			break;
+		case UHID_GET_REPORT:
+			handle_get_report(um, &ev.u.get_report);
+			break;
+		default:
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static int uhid_mouse_create(struct uhid_mouse *um)
+{
+	struct uhid_event ev;
+	int err;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_CREATE2;
+	strcpy((char *)ev.u.create2.name, "Razer DeathAdder Chroma (uhid test)");
+	strcpy((char *)ev.u.create2.uniq, TEST_SERIAL);
+	memcpy(ev.u.create2.rd_data, report_descriptor, sizeof(report_descriptor));
+	ev.u.create2.rd_size = sizeof(report_descriptor);
+	ev.u.create2.bus = BUS_USB;
+	ev.u.create2.vendor = TEST_VENDOR;
+	ev.u.create2.product = TEST_PRODUCT;
+	err = uhid_write(um->fd, &ev);
+	if (err)
+		return err;
+
+	pthread_mutex_init(&um->lock, NULL);
+	err = pthread_create(&um->thread, NULL, uhid_thread, um);
+	if (err) {
+		pthread_mutex_destroy(&um->lock);
+		return -err;
+	}
+
+	return 0;
+}
+
+static void uhid_mouse_destroy(struct uhid_mouse *um)
+{
+	struct uhid_event ev;
+
+	um->stop = 1;
+	pthread_join(um->thread, NULL);
+	pthread_mutex_destroy(&um->lock);
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = UHID_DESTROY;
+	uhid_write(um->fd, &ev);
+}
+
+/* The hidraw node appears asynchronously. */
+static struct razer_mouse * find_test_mouse(void)
+{
+	struct razer_mouse *m;
+	unsigned int i;
+
+	for (i = 0; i < 50; i++) {
+		for (m = razer_rescan_mice(); m; m = m->next) {
+			if (strstr(m->idstr, TEST_SERIAL))
+				break;
+		}
+		if (m) {
+			/* Claiming waits for the initial configuration. */
+			if (m->claim(m))
+				return NULL;
+			m->release(m);
+			return m;
+		}
+		usleep(100 * 1000);
+	}
+
+	return NULL;
+}
+
+/* Returns the number of failures. */
+static unsigned int run_test(struct uhid_mouse *um)
+{
+	struct razer_mouse_dpimapping *mappings;
+	struct razer_mouse_profile *profile;
+	struct razer_mouse *m;
+	enum razer_mouse_res res;
+	const uint8_t *r;
+	unsigned int failures = 0;
+	int fw, count, err;
+
+	m = find_test_mouse();
+	if (!m) {
+		test_error(&failures, "The uhid mouse was not found\n");
+		return failures;
+	}
+
+	/* GET_REPORT: The values of the response reach the driver. */
+	fw = m->get_fw_version(m);
+	if (fw != ((TEST_FW_MAJOR << 8) | TEST_FW_MINOR)) {
+		test_error(&failures, "Firmware version 0x%04X (expected 0x%04X)\n",
+			   fw, (TEST_FW_MAJOR << 8) | TEST_FW_MINOR);
+	}
+
+	/* SET_REPORT: The committed setting reaches the device. */
+	count = m->supported_dpimappings(m, &mappings);
+	profile = m->get_profiles(m);
+	if (count < 1 || !profile) {
+		test_error(&failures, "No DPI mappings\n");
+		return failures;
+	}
+	res = mappings[count - 1].res[RAZER_DIM_X];
+	err = m->claim(m);
+	if (!err) {
+		err = profile->set_dpimapping(profile, NULL, &mappings[count - 1]);
+		if (m->release(m) && !err)
+			err = -EIO;
+	}
+	if (err) {
+		test_error(&failures, "Failed to set the DPI mapping (%d)\n", err);
+		return failures;
+	}
+	pthread_mutex_lock(&um->lock);
+	r = um->resolution;
+	if (!um->have_resolution) {
+		test_error(&failures, "No SET_RESOLUTION report\n");
+	} else if (r[REPORT_SIZE_BYTE] != 0x07 || r[REPORT_VALUE] != 0 ||
+		   ((r[REPORT_VALUE + 1] << 8) | r[REPORT_VALUE + 2]) != (int)res ||
+		   ((r[REPORT_VALUE + 3] << 8) | r[REPORT_VALUE + 4]) != (int)res) {
+		test_error(&failures, "SET_RESOLUTION report does not carry %u DPI\n",
+			   (unsigned int)res);
+	}
+	pthread_mutex_unlock(&um->lock);
+
+	return failures;
+}
+
+int main(void)
+{
+	struct uhid_mouse um;
+	unsigned int failures;
+	int err;
+
+	memset(&um, 0, sizeof(um));
+	um.fd = open(UHID_PATH, O_RDWR | O_CLOEXEC);
+	if (um.fd < 0) {
+		printf("SKIPPED: %s is not accessible (%s)\n",
+		       UHID_PATH, strerror(errno));
+		return 0;
+	}
+
+	razer_set_logging(NULL, logerr, NULL);
+	err = razer_set_transport("hidraw");
+	if (!err)
+		err = razer_init(0);
+	if (!err)
+		err = razer_set_state_cache("");
+	if (err) {
+		logerr("Failed to initialize librazer (%d)\n", err);
+		close(um.fd);
+		return 1;
+	}
+
+	err = uhid_mouse_create(&um);
+	if (err) {
+		logerr("Failed to create the uhid device (%d)\n", err);
+		razer_exit();
+		close(um.fd);
+		return 1;
+	}
+	failures = run_test(&um);
+	razer_exit();
+	uhid_mouse_destroy(&um);
+	close(um.fd);
+	failures += um.nr_errors;
+
+	printf("%s: %u failure%s\n", failures ? "FAILED" : "PASSED",
+	       failures, failures == 1 ? "" : "s");
+
+	return failures ? 1 : 0;
+}
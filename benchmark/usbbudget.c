@@ -0,0 +1,501 @@
+/*
+ *   USB transaction budget check
+ *
+ *   Runs the librazer operations of every driver against simulated
+ *   devices and compares the USB traffic to a budget.
+ *
+ *   Copyright (C) 2026 Michael Buesch <m@bues.ch>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation; either version 2
+ *   of the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "librazer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <getopt.h>
+
+
+#define ARRAY_SIZE(x)	(sizeof(x) / sizeof((x)[0]))
+
+/* The simulated bus has no latency and no firmware reboots,
+ * so the numbers only depend on the drivers. */
+#define SIM_SPEC	"sim:latency=0,reconnect=0"
+
+/* Sleep times depend on the wall clock through the event spacing.
+ * New budgets get some headroom for them. */
+#define SLEEP_HEADROOM(msec)	((msec) + (msec) / 10 + 5)
+
+struct bench_device {
+	uint16_t vendor;
+	uint16_t product;
+};
+
+static const struct bench_device bench_devices[] = {
+	{ 0x1532, 0x0003, },	/* Krait */
+	{ 0x1532, 0x0005, },	/* Boomslang CE */
+	{ 0x1532, 0x0007, },	/* DeathAdder classic */
+	{ 0x1532, 0x000C, },	/* Lachesis */
+	{ 0x1532, 0x0015, },	/* Naga */
+	{ 0x1532, 0x0016, },	/* DeathAdder 3500 */
+	{ 0x1532, 0x0017, },	/* Imperator */
+	{ 0x1532, 0x001F, },	/* Naga Epic */
+	{ 0x1532, 0x0029, },	/* DeathAdder Black */
+	{ 0x1532, 0x002E, },	/* Naga 2012 */
+	{ 0x1532, 0x0034, },	/* Taipan */
+	{ 0x1532, 0x0036, },	/* Naga Hex */
+	{ 0x1532, 0x0037, },	/* DeathAdder 2013 */
+	{ 0x1532, 0x0038, },	/* DeathAdder 1800 */
+	{ 0x1532, 0x0040, },	/* Naga 2014 */
+	{ 0x1532, 0x0041, },	/* Naga Hex 2014 */
+	{ 0x1532, 0x0043, },	/* DeathAdder Chroma */
+	{ 0x1532, 0x0046, },	/* Mamba TE */
+	{ 0x1532, 0x004C, },	/* Diamondback Chroma */
+	{ 0x1532, 0x0101, },	/* Copperhead */
+};
+
+struct bench_operation {
+	const char *name;
+	/* Change a setting. Returns -EOPNOTSUPP, if the device
+	 * does not have the setting. */
+	int (*run)(struct razer_mouse *m);
+};
+
+struct budget {
+	struct budget *next;
+	char device[16];
+	char operation[32];
+	unsigned long transfers;
+	unsigned long bytes;
+	unsigned long sleep_msec;
+	bool used;
+};
+
+static struct {
+	const char *budget_file;
+	bool write_budget;
+	bool verbose;
+} cmdargs;
+
+static struct budget *budgets;
+
+
+static void logerr(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+}
+
+static struct razer_mouse_profile * bench_profile(struct razer_mouse *m)
+{
+	if (m->get_active_profile)
+		return m->get_active_profile(m);
+	if (m->get_profiles)
+		return m->get_profiles(m);
+	return NULL;
+}
+
+static int op_commit(struct razer_mouse *m)
+{
+	if (!m->commit)
+		return -EOPNOTSUPP;
+	return m->commit(m, 1);
+}
+
+static int op_set_dpi(struct razer_mouse *m)
+{
+	struct razer_mouse_profile *p = bench_profile(m);
+	struct razer_mouse_dpimapping *list, *cur;
+	int i, count;
+
+	if (!p || !p->get_dpimapping || !p->set_dpimapping ||
+	    !m->supported_dpimappings)
+		return -EOPNOTSUPP;
+	count = m->supported_dpimappings(m, &list);
+	if (count <= 1)
+		return -EOPNOTSUPP;
+	cur = p->get_dpimapping(p, NULL);
+	for (i = 0; i < count; i++) {
+		if (&list[i] != cur)
+			return p->set_dpimapping(p, NULL, &list[i]);
+	}
+
+	return -EOPNOTSUPP;
+}
+
+static int op_set_freq(struct razer_mouse *m)
+{
+	struct razer_mouse_profile *p = bench_profile(m);
+	const enum razer_mouse_freq *list;
+	enum razer_mouse_freq cur, new_freq;
+	int i, count, err;
+
+	if (!m->supported_freqs)
+		return -EOPNOTSUPP;
+	if (p && p->get_freq && p->set_freq)
+		cur = p->get_freq(p);
+	else if (m->global_get_freq && m->global_set_freq)
+		cur = m->global_get_freq(m);
+	else
+		return -EOPNOTSUPP;
+	count = m->supported_freqs(m, &list);
+	if (count <= 1)
+		return -EOPNOTSUPP;
+	new_freq = list[0];
+	for (i = 0; i < count; i++) {
+		if (list[i] != cur) {
+			new_freq = list[i];
+			break;
+		}
+	}
+
+	if (p && p->set_freq)
+		err = p->set_freq(p, new_freq);
+	else
+		err = m->global_set_freq(m, new_freq);
+
+	return err;
+}
+
+static int op_set_led(struct razer_mouse *m)
+{
+	struct razer_mouse_profile *p = bench_profile(m);
+	struct razer_led *leds = NULL;
+	int count, err;
+
+	if (p && p->get_leds)
+		count = p->get_leds(p, &leds);
+	else if (m->global_get_leds)
+		count = m->global_get_leds(m, &leds);
+	else
+		return -EOPNOTSUPP;
+	if (count <= 0 || !leds->toggle_state) {
+		razer_free_leds(leds);
+		return -EOPNOTSUPP;
+	}
+	err = leds->toggle_state(leds, leds->state == RAZER_LED_ON ?
+					RAZER_LED_OFF : RAZER_LED_ON);
+	razer_free_leds(leds);
+
+	return err;
+}
+
+static int op_switch_profile(struct razer_mouse *m)
+{
+	struct razer_mouse_profile *profiles, *cur;
+
+	if (m->nr_profiles <= 1 || !m->get_profiles ||
+	    !m->get_active_profile || !m->set_active_profile)
+		return -EOPNOTSUPP;
+	profiles = m->get_profiles(m);
+	cur = m->get_active_profile(m);
+
+	return m->set_active_profile(m, &profiles[(cur->nr + 1) % m->nr_profiles]);
+}
+
+/* The operations after init. Each runs from claim to release,
+ * so the commit on release is part of it. */
+static const struct bench_operation bench_operations[] = {
+	{ "commit",		op_commit, },
+	{ "set_dpi",		op_set_dpi, },
+	{ "set_freq",		op_set_freq, },
+	{ "set_led",		op_set_led, },
+	{ "switch_profile",	op_switch_profile, },
+};
+
+static struct budget * budget_find(const char *device, const char *operation)
+{
+	struct budget *b;
+
+	for (b = budgets; b; b = b->next) {
+		if (strcmp(b->device, device) == 0 &&
+		    strcmp(b->operation, operation) == 0)
+			return b;
+	}
+
+	return NULL;
+}
+
+static int budget_load(const char *path)
+{
+	struct budget *b;
+	char line[256], *s;
+	unsigned int lineno = 0;
+	FILE *fd;
+
+	fd = fopen(path, "r");
+	if (!fd) {
+		logerr("Failed to open budget file %s: %s\n",
+		       path, strerror(errno));
+		return -errno;
+	}
+	while (fgets(line, sizeof(line), fd)) {
+		lineno++;
+		s = line + strspn(line, " \t");
+		if (*s == '#' || *s == '\n' || *s == '\0')
+			continue;
+		b = calloc(1, sizeof(*b));
+		if (!b) {
+			fclose(fd);
+			return -ENOMEM;
+		}
+		if (sscanf(s, "%15s %31s %lu %lu %lu", b->device, b->operation,
+			   &b->transfers, &b->bytes, &b->sleep_msec) != 5) {
+			logerr("%s:%u: Invalid budget line\n", path, lineno);
+			free(b);
+			fclose(fd);
+			return -EINVAL;
+		}
+		b->next = budgets;
+		budgets = b;
+	}
+	fclose(fd);
+
+	return 0;
+}
+
+static void budget_free(void)
+{
+	struct budget *b, *next;
+
+	for (b = budgets; b; b = next) {
+		next = b->next;
+		free(b);
+	}
+	budgets = NULL;
+}
+
+/* Report one measurement. Returns true, if it is within the budget.
+ * Transfers and bytes are deterministic and must match the budget
+ * exactly. A lower count means the budget file is stale. */
+static bool report(const char *device, const char *operation,
+		   const struct razer_usb_stats *st)
+{
+	unsigned long transfers = st->control_transfers + st->bulk_transfers;
+	struct budget *b;
+	const char *status;
+	bool ok;
+
+	if (cmdargs.write_budget) {
+		printf("%-12s %-16s %8lu %8lu %8lu\n", device, operation,
+		       transfers, st->bytes, SLEEP_HEADROOM(st->sleep_msec));
+		return 1;
+	}
+
+	b = budget_find(device, operation);
+	if (!b) {
+		printf("%-12s %-16s %8lu %8lu %8lu   NO BUDGET\n", device, operation,
+		       transfers, st->bytes, st->sleep_msec);
+		return 0;
+	}
+	b->used = 1;
+	if (transfers > b->transfers || st->bytes > b->bytes ||
+	    st->sleep_msec > b->sleep_msec)
+		status = "OVER BUDGET";
+	else if (transfers < b->transfers || st->bytes < b->bytes)
+		status = "STALE BUDGET";
+	else
+		status = NULL;
+	ok = !status;
+	if (!ok || cmdargs.verbose) {
+		printf("%-12s %-16s %8lu %8lu %8lu   %s (budget %lu %lu %lu)\n",
+		       device, operation, transfers, st->bytes, st->sleep_msec,
+		       ok ? "ok" : status,
+		       b->transfers, b->bytes, b->sleep_msec);
+	}
+
+	return ok;
+}
+
+static struct razer_mouse * bench_find_mouse(void)
+{
+	struct razer_mouse *m;
+
+	/* Claiming waits for the initial configuration. */
+	m = razer_rescan_mice();
+	if (!m)
+		return NULL;
+	if (m->claim(m))
+		return NULL;
+	m->release(m);
+
+	return m;
+}
+
+/* Run all operations on one device. Returns the number of failures. */
+static int bench_device(const struct bench_device *dev)
+{
+	char spec[128], device[16];
+	struct razer_usb_stats st;
+	struct razer_mouse *m;
+	unsigned int i;
+	int err, failures = 0;
+
+	snprintf(device, sizeof(device), "%04X:%04X", dev->vendor, dev->product);
+	snprintf(spec, sizeof(spec), SIM_SPEC ",dev=%04X:%04X",
+		 dev->vendor, dev->product);
+
+	err = razer_set_transport(spec);
+	if (!err)
+		err = razer_init(0);
+	if (!err)
+		err = razer_set_state_cache("");
+	if (err) {
+		logerr("%s: Failed to initialize librazer (%d)\n", device, err);
+		return 1;
+	}
+
+	razer_reset_usb_stats();
+	m = bench_find_mouse();
+	razer_get_usb_stats(&st);
+	if (!m) {
+		logerr("%s: Failed to initialize the device\n", device);
+		failures++;
+		goto out;
+	}
+	if (!report(device, "init", &st))
+		failures++;
+
+	for (i = 0; i < ARRAY_SIZE(bench_operations); i++) {
+		razer_reset_usb_stats();
+		err = m->claim(m);
+		if (err) {
+			logerr("%s: Failed to claim (%d)\n", device, err);
+			failures++;
+			break;
+		}
+		err = bench_operations[i].run(m);
+		if (m->release(m) && !err)
+			err = -EIO;
+		razer_get_usb_stats(&st);
+		if (err == -EOPNOTSUPP)
+			continue;
+		if (err) {
+			logerr("%s: %s failed (%d)\n", device,
+			       bench_operations[i].name, err);
+			failures++;
+			continue;
+		}
+		if (st.errors) {
+			logerr("%s: %s had %lu failed transfers\n", device,
+			       bench_operations[i].name, st.errors);
+			failures++;
+		}
+		if (!report(device, bench_operations[i].name, &st))
+			failures++;
+	}
+out:
+	razer_exit();
+
+	return failures;
+}
+
+static void usage(FILE *fd)
+{
+	fprintf(fd, "Usage: razer-usbbudget [OPTIONS] BUDGETFILE\n");
+	fprintf(fd, "\n");
+	fprintf(fd, "Runs the librazer operations of every driver against simulated\n");
+	fprintf(fd, "devices and fails, if an operation exceeds its budget of USB\n");
+	fprintf(fd, "transfers, bytes or sleep time, or if it uses fewer transfers\n");
+	fprintf(fd, "or bytes than budgeted.\n");
+	fprintf(fd, "\n");
+	fprintf(fd, "  -w|--write       Write a new budget to stdout instead of checking\n");
+	fprintf(fd, "  -v|--verbose     Print all measurements\n");
+	fprintf(fd, "  -h|--help        Print this help text\n");
+}
+
+static int parse_args(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{ "help", no_argument, 0, 'h', },
+		{ "write", no_argument, 0, 'w', },
+		{ "verbose", no_argument, 0, 'v', },
+		{ 0, },
+	};
+	int c, idx;
+
+	while (1) {
+		c = getopt_long(argc, argv, "hwv", long_options, &idx);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'h':
+			usage(stdout);
+			return 1;
+		case 'w':
+			cmdargs.write_budget = 1;
+			break;
+		case 'v':
+			cmdargs.verbose = 1;
+			break;
+		default:
+			return -1;
+		}
+	}
+	if (optind < argc)
+		cmdargs.budget_file = argv[optind++];
+	if (optind < argc || (!cmdargs.budget_file && !cmdargs.write_budget)) {
+		usage(stderr);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct budget *b;
+	unsigned int i;
+	int err, failures = 0;
+
+	err = parse_args(argc, argv);
+	if (err > 0)
+		return 0;
+	if (err)
+		return 1;
+
+	razer_set_logging(NULL, logerr, NULL);
+	if (!cmdargs.write_budget) {
+		if (budget_load(cmdargs.budget_file))
+			return 1;
+	} else {
+		printf("# USB transaction budget per device and operation.\n");
+		printf("# Generated by razer-usbbudget -w\n");
+		printf("#\n");
+		printf("# %-10s %-16s %8s %8s %8s\n", "device", "operation",
+		       "xfers", "bytes", "sleep");
+	}
+
+	for (i = 0; i < ARRAY_SIZE(bench_devices); i++)
+		failures += bench_device(&bench_devices[i]);
+
+	for (b = budgets; b; b = b->next) {
+		if (!b->used) {
+			printf("%-12s %-16s   NOT MEASURED\n", b->device, b->operation);
+			failures++;
+		}
+	}
+	budget_free();
+
+	if (!cmdargs.write_budget) {
+		printf("%s: %d failure%s\n", failures ? "FAILED" : "PASSED",
+		       failures, failures == 1 ? "" : "s");
+	}
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+/*
+ *   Lowlevel hardware access for the
+ *   Razer Chroma 90 byte report protocol
+ *
+ *   Important notice:
+ *   This hardware driver is based on reverse engineering, only.
+ *
+ *   Copyright (C) 2026 Michael Buesch <m@bues.ch>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation; either version 2
+ *   of the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "chroma.h"
+#include "util.h"
+
+#include <errno.h>
+#include <string.h>
+
+
+enum chroma_constants {
+	CHROMA_USB_SETUP_PACKET_VALUE	= 0x300,
+	CHROMA_SUCCESS_STATUS		= 0x02,
+	CHROMA_PACKET_SPACING_MS	= 35,
+
+	/*
+	 * Experiments suggest that the value in the 'magic' byte of the
+	 * command does not necessarily matter (e.g. the commands work
+	 * when the 'magic' byte equals 0x77). The value used by the
+	 * Synapse driver is used.
+	 */
+	CHROMA_MAGIC_BYTE		= 0xFF,
+};
+
+static uint8_t chroma_checksum(const struct razer_chroma_report *r)
+{
+	size_t control_size;
+
+	control_size = sizeof(r->size) + sizeof(r->request);
+
+	return razer_xor8_checksum(&r->size, control_size + r->size);
+}
+
+static int chroma_usb_action(struct razer_chroma *c,
+			     enum libusb_endpoint_direction direction,
+			     enum libusb_standard_request request,
+			     struct razer_chroma_report *r)
+{
+	int err;
+
+	razer_event_spacing_enter(&c->packet_spacing);
+	err = razer_usb_control(c->m->usb_ctx,
+				direction |
+				LIBUSB_REQUEST_TYPE_CLASS |
+				LIBUSB_RECIPIENT_INTERFACE,
+				request, CHROMA_USB_SETUP_PACKET_VALUE, 0,
+				(unsigned char *)r, sizeof(*r),
+				RAZER_USB_TIMEOUT);
+	razer_event_spacing_leave(&c->packet_spacing);
+	if (err != sizeof(*r)) {
+		razer_error("%s: USB %s 0x%01X 0x%02X failed with %d\n",
+			    c->name,
+			    direction == LIBUSB_ENDPOINT_IN ? "read" : "write",
+			    request, CHROMA_USB_SETUP_PACKET_VALUE, err);
+		return err;
+	}
+
+	return 0;
+}
+
+/* Send a report and receive the response into it. */
+static int chroma_send_report(struct razer_chroma *c,
+			      struct razer_chroma_report *r)
+{
+	uint16_t request = be16_to_cpu(r->request);
+	uint8_t size = r->size;
+	uint8_t checksum;
+	int err;
+
+	r->checksum = chroma_checksum(r);
+	err = chroma_usb_action(c, LIBUSB_ENDPOINT_OUT,
+				LIBUSB_REQUEST_SET_CONFIGURATION, r);
+	if (err)
+		return err;
+	err = chroma_usb_action(c, LIBUSB_ENDPOINT_IN,
+				LIBUSB_REQUEST_CLEAR_FEATURE, r);
+	if (err)
+		return err;
+
+	checksum = chroma_checksum(r);
+	if (checksum != r->checksum) {
+		razer_error("%s: Command %02X %04X bad response checksum %02X "
+			    "(expected %02X)\n",
+			    c->name, size, request, checksum, r->checksum);
+		return -EBADMSG;
+	}
+	if (be16_to_cpu(r->request) != request || r->size != size) {
+		razer_error("%s: Command %02X %04X got response %02X %04X\n",
+			    c->name, size, request,
+			    r->size, be16_to_cpu(r->request));
+		return -EBADMSG;
+	}
+	if (r->status != CHROMA_SUCCESS_STATUS) {
+		razer_error("%s: Command %02X %04X failed with %02X\n",
+			    c->name, size, request, r->status);
+	}
+
+	return 0;
+}
+
+void razer_chroma_init(struct razer_chroma *c, struct razer_mouse *m,
+		       const char *name)
+{
+	BUILD_BUG_ON(sizeof(struct razer_chroma_report) != 90);
+
+	memset(c, 0, sizeof(*c));
+	c->m = m;
+	c->name = name;
+	razer_event_spacing_init(&c->packet_spacing, CHROMA_PACKET_SPACING_MS);
+}
+
+/** razer_chroma_report_init - Initialize a report for a command.
+ * The arguments are all zero.
+ */
+void razer_chroma_report_init(struct razer_chroma_report *r,
+			      const struct razer_chroma_cmd *cmd)
+{
+	memset(r, 0, sizeof(*r));
+	r->magic = CHROMA_MAGIC_BYTE;
+	r->size = cmd->size;
+	r->request = cpu_to_be16(cmd->request);
+}
+
+/** razer_chroma_run - Send a report now and receive the response into it.
+ * The queued writes are sent first.
+ */
+int razer_chroma_run(struct razer_chroma *c, struct razer_chroma_report *r)
+{
+	int err;
+
+	err = razer_chroma_flush(c);
+	if (err)
+		return err;
+
+	return chroma_send_report(c, r);
+}
+
+/** razer_chroma_queue - Queue a write request for the next flush.
+ * If the mouse is not claimed, nobody flushes the queue.
+ * The request is sent immediately then.
+ */
+int razer_chroma_queue(struct razer_chroma *c,
+		       const struct razer_chroma_cmd *cmd,
+		       const struct razer_chroma_report *r)
+{
+	struct razer_chroma_report tmp;
+	unsigned int i;
+	int err;
+
+	if (!c->m->claim_count) {
+		tmp = *r;
+		return chroma_send_report(c, &tmp);
+	}
+
+	for (i = 0; i < c->nr_queued; i++) {
+		if (c->queue_cmds[i]->request == cmd->request &&
+		    c->queue_cmds[i]->key_len == cmd->key_len &&
+		    memcmp(c->queue[i].bvalue, r->bvalue, cmd->key_len) == 0) {
+			/* The new request overrides the queued one. */
+			c->queue[i] = *r;
+			c->queue_cmds[i] = cmd;
+			return 0;
+		}
+	}
+	if (c->nr_queued >= ARRAY_SIZE(c->queue)) {
+		err = razer_chroma_flush(c);
+		if (err)
+			return err;
+	}
+	c->queue[c->nr_queued] = *r;
+	c->queue_cmds[c->nr_queued] = cmd;
+	c->nr_queued++;
+
+	return 0;
+}
+
+/** razer_chroma_flush - Send all queued write requests.
+ * Returns the first error. The queue is empty afterwards.
+ */
+int razer_chroma_flush(struct razer_chroma *c)
+{
+	unsigned int i;
+	int err = 0, res;
+
+	for (i = 0; i < c->nr_queued; i++) {
+		res = chroma_send_report(c, &c->queue[i]);
+		if (res && !err)
+			err = res;
+	}
+	c->nr_queued = 0;
+
+	return err;
+}
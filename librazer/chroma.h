@@ -0,0 +1,72 @@
+#ifndef RAZER_CHROMA_H_
+#define RAZER_CHROMA_H_
+
+#include "razer_private.h"
+
+#include <stdint.h>
+
+
+/* A 90 byte report of the Chroma protocol.
+ * The device echoes the report with the status and the read values. */
+struct razer_chroma_report {
+	uint8_t status;
+	uint8_t magic;
+	uint8_t padding0[3];
+	uint8_t size;
+	be16_t request;
+
+	union {
+		uint8_t bvalue[80];
+		struct {
+			uint8_t padding1;
+			be16_t value[38];
+			uint8_t padding2;
+		} _packed;
+	} _packed;
+
+	uint8_t checksum;
+	uint8_t padding3;
+} _packed;
+
+/** struct razer_chroma_cmd - Command descriptor
+ * @request: The request code.
+ * @size: The size byte of the report.
+ *	For read requests this is the size of the value to read.
+ * @key_len: Number of leading bvalue bytes that select the target
+ *	of a write request (e.g. the LED ID). A queued write replaces
+ *	an earlier queued write with the same request and key.
+ */
+struct razer_chroma_cmd {
+	uint16_t request;
+	uint8_t size;
+	uint8_t key_len;
+};
+
+#define RAZER_CHROMA_MAX_QUEUED		16
+
+struct razer_chroma {
+	struct razer_mouse *m;
+	/* Name for log messages */
+	const char *name;
+	struct razer_event_spacing packet_spacing;
+	/* Write requests to send on the next flush */
+	struct razer_chroma_report queue[RAZER_CHROMA_MAX_QUEUED];
+	const struct razer_chroma_cmd *queue_cmds[RAZER_CHROMA_MAX_QUEUED];
+	unsigned int nr_queued;
+};
+
+void razer_chroma_init(struct razer_chroma *c, struct razer_mouse *m,
+		       const char *name);
+
+void razer_chroma_report_init(struct razer_chroma_report *r,
+			      const struct razer_chroma_cmd *cmd);
+
+int razer_chroma_run(struct razer_chroma *c, struct razer_chroma_report *r);
+
+int razer_chroma_queue(struct razer_chroma *c,
+		       const struct razer_chroma_cmd *cmd,
+		       const struct razer_chroma_report *r);
+
+int razer_chroma_flush(struct razer_chroma *c);
+
+#endif /* RAZER_CHROMA_H_ */
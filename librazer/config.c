@@ -107,6 +107,57 @@ void config_for_each_section(struct config_file *f,
 	}
 }
 
+static bool section_has_item(struct config_file *f,
+			     const char *section,
+			     const char *item,
+			     const char *value)
+{
+	struct config_section *s;
+	struct config_item *i;
+
+	if (!f || !section)
+		return 0;
+	for (s = f->sections; s; s = s->next) {
+		if (strcmp(s->name, section) != 0)
+			continue;
+		for (i = s->items; i; i = i->next) {
+			if (strcasecmp(i->name, item) == 0 &&
+			    strcmp(i->value, value) == 0)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+void config_for_each_changed_item(struct config_file *old_f,
+				  const char *old_section,
+				  struct config_file *new_f,
+				  const char *new_section,
+				  void *context, void *data,
+				  bool (*func)(struct config_file *f,
+					       void *context, void *data,
+					       const char *section,
+					       const char *item,
+					       const char *value))
+{
+	struct config_section *s;
+	struct config_item *i;
+
+	if (!new_f || !new_section)
+		return;
+	for (s = new_f->sections; s; s = s->next) {
+		if (strcmp(s->name, new_section) != 0)
+			continue;
+		for (i = s->items; i; i = i->next) {
+			if (section_has_item(old_f, old_section, i->name, i->value))
+				continue;
+			if (!func(new_f, context, data, s->name, i->name, i->value))
+				return;
+		}
+	}
+}
+
 const char * config_get(struct config_file *f,
 			const char *section,
 			const char *item,
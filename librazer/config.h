@@ -52,6 +52,20 @@ void config_for_each_section(struct config_file *f,
 			     		  void *context, void *data,
 			     		  const char *section));
 
+/* Call func for each item of new_section in new_f that does not have an
+ * identical name=value counterpart in old_section of old_f.
+ * If old_f or old_section is NULL, all items of new_section are visited. */
+void config_for_each_changed_item(struct config_file *old_f,
+				  const char *old_section,
+				  struct config_file *new_f,
+				  const char *new_section,
+				  void *context, void *data,
+				  bool (*func)(struct config_file *f,
+					       void *context, void *data,
+					       const char *section,
+					       const char *item,
+					       const char *value));
+
 const char * config_get(struct config_file *f,
 			const char *section,
 			const char *item,
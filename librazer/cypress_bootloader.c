@@ -47,6 +47,10 @@ struct cypress_status {
 #define CYPRESS_STAT_INVALCMD	0x80 /* Invalid command error */
 #define CYPRESS_STAT_ALL	0xFF
 
+/* The time to wait for a status report and for stale reports. */
+#define CYPRESS_STATUS_TIMEOUT_MSEC	RAZER_USB_TIMEOUT
+#define CYPRESS_FLUSH_TIMEOUT_MSEC	50
+
 
 static void cypress_print_one_status(int *ctx, char *buf, const char *message)
 {
@@ -92,32 +96,59 @@ static void cmd_checksum(struct cypress_command *_cmd)
 	cmd[45] = sum & 0xFF;
 }
 
-static int cypress_send_command(struct cypress *c,
-				struct cypress_command *command,
-				size_t command_size, uint8_t status_mask)
+static int cypress_submit_command(struct cypress *c,
+				  struct cypress_command *command,
+				  size_t command_size)
 {
-	struct cypress_status status;
 	int err, transferred;
-	uint8_t stat;
 
 	cmd_checksum(command);
 
-razer_dump("cypress command", command, sizeof(*command));
-	err = libusb_bulk_transfer(c->usb.h, c->ep_out,
-				   (unsigned char *)command, command_size,
-				   &transferred, RAZER_USB_TIMEOUT);
+	err = razer_usb_bulk(&c->usb, c->ep_out,
+			     (unsigned char *)command, command_size,
+			     &transferred, RAZER_USB_TIMEOUT);
 	if (err || transferred < 0 || (size_t)transferred != command_size) {
 		razer_error("cypress: Failed to send command 0x%02X\n",
 			    be16_to_cpu(command->command));
-		return -1;
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/* Wait for the status report of a submitted command.
+ * The bootloader does not answer the IN transfer before it finished
+ * processing the command. So the report arrives as soon as the command
+ * is done. A timed out transfer is cancelled and might lose the report.
+ * So wait with one transfer and only retry on short reports. */
+static int cypress_wait_status(struct cypress *c, uint16_t command,
+			       uint8_t status_mask)
+{
+	struct cypress_status status;
+	struct timeval now, deadline;
+	int err, transferred, msec;
+	uint8_t stat;
+
+	gettimeofday(&deadline, NULL);
+	razer_timeval_add_msec(&deadline, CYPRESS_STATUS_TIMEOUT_MSEC);
+	while (1) {
+		gettimeofday(&now, NULL);
+		msec = razer_timeval_msec_diff(&deadline, &now);
+		if (msec <= 0) {
+			err = LIBUSB_ERROR_TIMEOUT;
+			break;
+		}
+		err = razer_usb_bulk(&c->usb, c->ep_in,
+				     (unsigned char *)&status, sizeof(status),
+				     &transferred, msec);
+		if (err || transferred == sizeof(status))
+			break;
+		razer_debug("cypress: Dropping short status report (%d bytes)\n",
+			    transferred);
 	}
-	razer_msleep(100);
-	err = libusb_bulk_transfer(c->usb.h, c->ep_in,
-				   (unsigned char *)&status, sizeof(status),
-				   &transferred, RAZER_USB_TIMEOUT);
-	if (err || transferred != sizeof(status)) {
+	if (err) {
 		razer_error("cypress: Failed to receive status report\n");
-		return -1;
+		return -EIO;
 	}
 	status_mask |= CYPRESS_STAT_BLMODE; /* Always check the blmode bit */
 	status_mask &= ~CYPRESS_STAT_BOOTOK; /* Always ignore the bootok bit */
@@ -125,15 +156,42 @@ razer_dump("cypress command", command, sizeof(*command));
 	if (stat != CYPRESS_STAT_BLMODE) {
 		razer_error("cypress: Command 0x%04X failed with "
 			    "status0=0x%02X status1=0x%02X\n",
-			    be16_to_cpu(command->command),
-			    status.status0, status.status1);
+			    command, status.status0, status.status1);
 		cypress_print_status(stat, 1);
-		return -1;
+		return -EIO;
 	}
 
 	return 0;
 }
 
+/* Drop stale status reports of aborted pipelined commands. */
+static void cypress_flush_status(struct cypress *c)
+{
+	struct cypress_status status;
+	int err, transferred;
+
+	do {
+		err = razer_usb_bulk(&c->usb, c->ep_in,
+				     (unsigned char *)&status, sizeof(status),
+				     &transferred, CYPRESS_FLUSH_TIMEOUT_MSEC);
+	} while (!err && transferred);
+}
+
+static int cypress_send_command(struct cypress *c,
+				struct cypress_command *command,
+				size_t command_size, uint8_t status_mask)
+{
+	int err;
+
+razer_dump("cypress command", command, sizeof(*command));
+	err = cypress_submit_command(c, command, command_size);
+	if (err)
+		return err;
+
+	return cypress_wait_status(c, be16_to_cpu(command->command),
+				   status_mask);
+}
+
 static void cypress_assign_default_key(uint8_t *key)
 {
 	unsigned int i;
@@ -191,28 +249,61 @@ static int cypress_cmd_updatechksum(struct cypress *c)
 				    CYPRESS_STAT_ALL);
 }
 
+static void cypress_build_writefl(struct cypress *c,
+				  struct cypress_command *cmd,
+				  uint16_t blocknr, uint8_t segment,
+				  const char *data)
+{
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->command = CYPRESS_CMD_WRITEFL;
+	c->assign_key(cmd->key);
+
+	cmd->payload[0] = blocknr >> 8;
+	cmd->payload[1] = blocknr;
+	cmd->payload[2] = segment;
+	memcpy(&cmd->payload[3], data, 32);
+}
+
 static int cypress_cmd_writefl(struct cypress *c, uint16_t blocknr,
 			       uint8_t segment, const char *data)
 {
 	struct cypress_command cmd;
 
-	memset(&cmd, 0, sizeof(cmd));
-	cmd.command = CYPRESS_CMD_WRITEFL;
-	c->assign_key(cmd.key);
-
-	cmd.payload[0] = blocknr >> 8;
-	cmd.payload[1] = blocknr;
-	cmd.payload[2] = segment;
-	memcpy(&cmd.payload[3], data, 32);
+	cypress_build_writefl(c, &cmd, blocknr, segment, data);
 
 	return cypress_send_command(c, &cmd, sizeof(cmd),
 				    CYPRESS_STAT_ALL);
 }
 
+/* Write both segments of a block back to back and collect
+ * the two status reports afterwards. */
+static int cypress_writefl_pipelined(struct cypress *c, uint16_t blocknr,
+				     const char *data)
+{
+	struct cypress_command cmd[2];
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < ARRAY_SIZE(cmd); i++) {
+		cypress_build_writefl(c, &cmd[i], blocknr, i, data + i * 32);
+		err = cypress_submit_command(c, &cmd[i], sizeof(cmd[i]));
+		if (err)
+			return err;
+	}
+	for (i = 0; i < ARRAY_SIZE(cmd); i++) {
+		err = cypress_wait_status(c, be16_to_cpu(cmd[i].command),
+					  CYPRESS_STAT_ALL);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
 static int cypress_writeflash(struct cypress *c,
 			      const char *image, size_t len)
 {
-	unsigned int block;
+	unsigned int block, nr_blocks = len / 64;
 	int err;
 
 	if (len % 64) {
@@ -220,7 +311,24 @@ static int cypress_writeflash(struct cypress *c,
 		return -EINVAL;
 	}
 
-	for (block = 0; block < len / 64; block++) {
+	for (block = 0; block < nr_blocks; block++) {
+		err = razer_flash_report(c->mouse, RAZER_FLASH_WRITE,
+					 block, nr_blocks);
+		if (err)
+			return err;
+		if (c->pipeline) {
+			err = cypress_writefl_pipelined(c, block, image);
+			if (!err) {
+				image += 64;
+				continue;
+			}
+			/* Rewriting the block is harmless. So fall back
+			 * to one command at a time for the rest. */
+			razer_info("cypress: Bootloader does not support "
+				   "pipelined writes. Disabling.\n");
+			c->pipeline = 0;
+			cypress_flush_status(c);
+		}
 		/* First 32 bytes */
 		err = cypress_cmd_writefl(c, block, 0, image);
 		if (err) {
@@ -238,6 +346,7 @@ static int cypress_writeflash(struct cypress *c,
 		}
 		image += 32;
 	}
+	razer_flash_report(c->mouse, RAZER_FLASH_WRITE, nr_blocks, nr_blocks);
 
 	return 0;
 }
@@ -271,6 +380,7 @@ return -1; //FIXME: Does not work, yet.
 	/* EP numbers are hardcoded */
 	c->ep_in = 0x81;
 	c->ep_out = 0x02;
+	c->pipeline = 1;
 
 	return 0;
 }
@@ -301,17 +411,25 @@ razer_dump("image", image, len);
 		goto out;
 	}
 	err = cypress_writeflash(c, image, len);
+	if (err == -ECANCELED) {
+		/* Nothing was written, yet. */
+		cypress_cmd_exitbl(c);
+		result = err;
+		goto out;
+	}
 	if (err) {
 		razer_error("cypress: Failed to write flash image\n");
 		result = err;
 		goto out;
 	}
+	razer_flash_report(c->mouse, RAZER_FLASH_VERIFY, 0, 1);
 	err = cypress_cmd_verifyfl(c);
 	if (err) {
 		razer_error("cypress: Failed to verify the flash\n");
 		result = err;
 		goto out;
 	}
+	razer_flash_report(c->mouse, RAZER_FLASH_FINISH, 0, 1);
 	err = cypress_cmd_updatechksum(c);
 	if (err) {
 		razer_error("cypress: Failed to update the checksum\n");
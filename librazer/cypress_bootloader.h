@@ -9,6 +9,8 @@ struct cypress {
 	unsigned int ep_in;
 	unsigned int ep_out;
 	void (*assign_key)(uint8_t *key);
+	bool pipeline; /* Submit the segments of a block back to back */
+	struct razer_mouse *mouse; /* For progress reports. May be NULL. */
 };
 
 #define CYPRESS_BOOT_VENDORID	0x04B4
@@ -35,7 +37,9 @@ int cypress_open(struct cypress *c, struct libusb_device *dev,
 void cypress_close(struct cypress *c);
 
 /** cypress_upload_image - Upload a firmware image to the device.
- * The device must be opened. */
+ * The device must be opened. Progress is reported to the mouse
+ * assigned to c->mouse. Returns -ECANCELED, if the upload was
+ * cancelled before the first block was written. */
 int cypress_upload_image(struct cypress *c,
 			 const char *image, size_t len);
 
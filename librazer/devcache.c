@@ -0,0 +1,324 @@
+/*
+ *   Persistent device state cache
+ *
+ *   Copyright (C) 2026 Michael Buesch <m@bues.ch>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation; either version 2
+ *   of the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "devcache.h"
+#include "razer_private.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/* The cache file is a header followed by an array of fixed size entries.
+ * All fields are little endian. The file is only read through mmap and
+ * is replaced atomically on update. */
+
+#define DEVCACHE_MAGIC		0x31434452 /* "RDC1" */
+#define DEVCACHE_VERSION	1
+#define DEVCACHE_MAX_ENTRIES	32
+
+struct devcache_header {
+	le32_t magic;
+	le32_t version;
+	le32_t entry_size;
+	le32_t nr_entries;
+} _packed;
+
+struct devcache_entry {
+	char driver[16];
+	char serial[64];
+	le16_t fw_version;
+	le16_t data_len;
+	le16_t checksum;
+	uint8_t data[RAZER_DEVCACHE_DATA_MAX];
+} _packed;
+
+static char *devcache_path;
+static bool devcache_disabled;
+static pthread_mutex_t devcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+int razer_devcache_set_path(const char *path)
+{
+	char *p = NULL;
+
+	if (path && strlen(path)) {
+		p = strdup(path);
+		if (!p)
+			return -ENOMEM;
+	}
+	pthread_mutex_lock(&devcache_lock);
+	free(devcache_path);
+	devcache_path = p;
+	devcache_disabled = (path && !strlen(path));
+	pthread_mutex_unlock(&devcache_lock);
+
+	return 0;
+}
+
+static const char * devcache_get_path(void)
+{
+	if (devcache_disabled)
+		return NULL;
+	return devcache_path ? devcache_path : RAZER_DEFAULT_STATE_CACHE;
+}
+
+static bool devcache_entry_matches(const struct devcache_entry *e,
+				   const char *driver, const char *serial,
+				   uint16_t fw_version)
+{
+	return strncmp(e->driver, driver, sizeof(e->driver)) == 0 &&
+	       strncmp(e->serial, serial, sizeof(e->serial)) == 0 &&
+	       le16_to_cpu(e->fw_version) == fw_version;
+}
+
+/* Map the cache file. Returns the number of valid entries or
+ * a negative error code. */
+static int devcache_map(const char *path, void **map, size_t *map_size)
+{
+	const struct devcache_header *hdr;
+	struct stat st;
+	unsigned int nr_entries;
+	void *m;
+	int fd;
+
+	*map = NULL;
+	*map_size = 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return -EINVAL;
+	}
+	m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED)
+		return -errno;
+
+	hdr = m;
+	nr_entries = le32_to_cpu(hdr->nr_entries);
+	if (le32_to_cpu(hdr->magic) != DEVCACHE_MAGIC ||
+	    le32_to_cpu(hdr->version) != DEVCACHE_VERSION ||
+	    le32_to_cpu(hdr->entry_size) != sizeof(struct devcache_entry) ||
+	    nr_entries > DEVCACHE_MAX_ENTRIES ||
+	    (size_t)st.st_size < sizeof(*hdr) +
+				 nr_entries * sizeof(struct devcache_entry)) {
+		razer_debug("devcache: Ignoring invalid cache file %s\n", path);
+		munmap(m, st.st_size);
+		return -EINVAL;
+	}
+	*map = m;
+	*map_size = st.st_size;
+
+	return nr_entries;
+}
+
+static inline const struct devcache_entry * devcache_entries(const void *map)
+{
+	return (const struct devcache_entry *)((const uint8_t *)map +
+					       sizeof(struct devcache_header));
+}
+
+int razer_devcache_load(const char *driver, const char *serial,
+			uint16_t fw_version,
+			void *data, size_t len)
+{
+	const struct devcache_entry *e;
+	const char *path;
+	void *map;
+	size_t map_size;
+	int i, count, err = -ENOENT;
+
+	if (!serial || !strlen(serial) || len > RAZER_DEVCACHE_DATA_MAX)
+		return -EINVAL;
+
+	pthread_mutex_lock(&devcache_lock);
+	path = devcache_get_path();
+	if (!path) {
+		pthread_mutex_unlock(&devcache_lock);
+		return -ENOENT;
+	}
+	count = devcache_map(path, &map, &map_size);
+	pthread_mutex_unlock(&devcache_lock);
+	if (count < 0)
+		return -ENOENT;
+
+	for (i = 0; i < count; i++) {
+		e = &devcache_entries(map)[i];
+		if (!devcache_entry_matches(e, driver, serial, fw_version))
+			continue;
+		if (le16_to_cpu(e->data_len) != len ||
+		    razer_xor16_checksum(e->data, len) != e->checksum) {
+			razer_debug("devcache: Invalid entry for %s\n", serial);
+			break;
+		}
+		memcpy(data, e->data, len);
+		err = 0;
+		break;
+	}
+	munmap(map, map_size);
+
+	return err;
+}
+
+static int devcache_write(const char *path,
+			  const struct devcache_entry *entries,
+			  unsigned int nr_entries)
+{
+	struct devcache_header hdr;
+	char *tmppath, *dir;
+	size_t size;
+	ssize_t res;
+	int fd, err = 0;
+
+	size = strlen(path) + 5;
+	tmppath = malloc(size);
+	if (!tmppath)
+		return -ENOMEM;
+	snprintf(tmppath, size, "%s.tmp", path);
+
+	/* Create the cache directory, if it does not exist. */
+	dir = strdup(path);
+	if (dir) {
+		mkdir(dirname(dir), 0755);
+		free(dir);
+	}
+
+	fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		err = -errno;
+		goto out;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = cpu_to_le32(DEVCACHE_MAGIC);
+	hdr.version = cpu_to_le32(DEVCACHE_VERSION);
+	hdr.entry_size = cpu_to_le32(sizeof(*entries));
+	hdr.nr_entries = cpu_to_le32(nr_entries);
+	res = write(fd, &hdr, sizeof(hdr));
+	if (res == (ssize_t)sizeof(hdr)) {
+		size = nr_entries * sizeof(*entries);
+		res = size ? write(fd, entries, size) : 0;
+		if (res != (ssize_t)size)
+			err = -EIO;
+	} else
+		err = -EIO;
+	if (close(fd) && !err)
+		err = -EIO;
+	if (!err && rename(tmppath, path))
+		err = -errno;
+	if (err)
+		unlink(tmppath);
+out:
+	free(tmppath);
+
+	return err;
+}
+
+/* Replace the entry of a device, or delete it, if data is NULL. */
+static int devcache_update(const char *driver, const char *serial,
+			   uint16_t fw_version,
+			   const void *data, size_t len)
+{
+	struct devcache_entry *entries, *e;
+	const char *path;
+	void *map = NULL;
+	size_t map_size;
+	int i, count, match = -1, nr = 0, err = 0;
+
+	entries = calloc(DEVCACHE_MAX_ENTRIES, sizeof(*entries));
+	if (!entries)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&devcache_lock);
+	path = devcache_get_path();
+	if (!path)
+		goto out_unlock;
+
+	count = devcache_map(path, &map, &map_size);
+	for (i = 0; i < count; i++) {
+		if (devcache_entry_matches(&devcache_entries(map)[i],
+					   driver, serial, fw_version)) {
+			match = i;
+			break;
+		}
+	}
+	if (!data && match < 0)
+		goto out_unmap; /* Nothing to delete */
+
+	/* Copy all other entries. New entries are appended, so the
+	 * first entry is the oldest one. It is dropped, if the cache
+	 * is full and there is no entry to replace. */
+	for (i = 0; i < count; i++) {
+		if (i == match)
+			continue;
+		if (data && match < 0 && i == 0 &&
+		    count >= DEVCACHE_MAX_ENTRIES)
+			continue;
+		entries[nr++] = devcache_entries(map)[i];
+	}
+
+	if (data) {
+		e = &entries[nr++];
+		razer_strlcpy(e->driver, driver, sizeof(e->driver));
+		razer_strlcpy(e->serial, serial, sizeof(e->serial));
+		e->fw_version = cpu_to_le16(fw_version);
+		e->data_len = cpu_to_le16(len);
+		memcpy(e->data, data, len);
+		e->checksum = razer_xor16_checksum(e->data, len);
+	}
+
+	err = devcache_write(path, entries, nr);
+	if (err) {
+		razer_debug("devcache: Failed to write %s (%d)\n",
+			    path, err);
+	}
+out_unmap:
+	if (map)
+		munmap(map, map_size);
+out_unlock:
+	pthread_mutex_unlock(&devcache_lock);
+	free(entries);
+
+	return err;
+}
+
+int razer_devcache_store(const char *driver, const char *serial,
+			 uint16_t fw_version,
+			 const void *data, size_t len)
+{
+	if (!serial || !strlen(serial) || len > RAZER_DEVCACHE_DATA_MAX)
+		return -EINVAL;
+
+	return devcache_update(driver, serial, fw_version, data, len);
+}
+
+int razer_devcache_delete(const char *driver, const char *serial,
+			  uint16_t fw_version)
+{
+	if (!serial || !strlen(serial))
+		return -EINVAL;
+
+	return devcache_update(driver, serial, fw_version, NULL, 0);
+}
@@ -0,0 +1,21 @@
+#ifndef RAZER_DEVCACHE_H_
+#define RAZER_DEVCACHE_H_
+
+#include "razer_private.h"
+
+
+/* Maximum size of the driver data of one cache entry. */
+#define RAZER_DEVCACHE_DATA_MAX		1024
+
+int razer_devcache_set_path(const char *path);
+
+int razer_devcache_load(const char *driver, const char *serial,
+			uint16_t fw_version,
+			void *data, size_t len);
+int razer_devcache_store(const char *driver, const char *serial,
+			 uint16_t fw_version,
+			 const void *data, size_t len);
+int razer_devcache_delete(const char *driver, const char *serial,
+			  uint16_t fw_version);
+
+#endif /* RAZER_DEVCACHE_H_ */
@@ -225,8 +225,8 @@ static int boomslangce_usb_write(struct boomslangce_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_OTHER,
 		request, command, index,
@@ -247,8 +247,8 @@ static int boomslangce_usb_read(struct boomslangce_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_OTHER,
 		request, command, index,
@@ -532,42 +532,32 @@ static int boomslangce_set_active_profile(struct razer_mouse *m,
 	return 0;
 }
 
-static int boomslangce_supported_resolutions(struct razer_mouse *m,
-					    enum razer_mouse_res **res_list)
-{
-	enum razer_mouse_res *list;
-	const int count = 3;
-
-	list = zalloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
+static const enum razer_mouse_res boomslangce_resolutions[] = {
+	RAZER_MOUSE_RES_400DPI,
+	RAZER_MOUSE_RES_800DPI,
+	RAZER_MOUSE_RES_1800DPI,
+};
 
-	list[0] = RAZER_MOUSE_RES_400DPI;
-	list[1] = RAZER_MOUSE_RES_800DPI;
-	list[2] = RAZER_MOUSE_RES_1800DPI;
+static const enum razer_mouse_freq boomslangce_freqs[] = {
+	RAZER_MOUSE_FREQ_125HZ,
+	RAZER_MOUSE_FREQ_500HZ,
+	RAZER_MOUSE_FREQ_1000HZ,
+};
 
-	*res_list = list;
+static int boomslangce_supported_resolutions(struct razer_mouse *m,
+					    const enum razer_mouse_res **res_list)
+{
+	*res_list = boomslangce_resolutions;
 
-	return count;
+	return ARRAY_SIZE(boomslangce_resolutions);
 }
 
 static int boomslangce_supported_freqs(struct razer_mouse *m,
-				      enum razer_mouse_freq **freq_list)
+				      const enum razer_mouse_freq **freq_list)
 {
-	enum razer_mouse_freq *list;
-	const int count = 3;
+	*freq_list = boomslangce_freqs;
 
-	list = zalloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
-
-	list[0] = RAZER_MOUSE_FREQ_125HZ;
-	list[1] = RAZER_MOUSE_FREQ_500HZ;
-	list[2] = RAZER_MOUSE_FREQ_1000HZ;
-
-	*freq_list = list;
-
-	return count;
+	return ARRAY_SIZE(boomslangce_freqs);
 }
 
 static enum razer_mouse_freq boomslangce_get_freq(struct razer_mouse_profile *p)
@@ -750,8 +740,7 @@ static int boomslangce_set_button_function(struct razer_mouse_profile *p,
 	return 0;
 }
 
-int razer_boomslangce_init(struct razer_mouse *m,
-			  struct libusb_device *usbdev)
+int razer_boomslangce_init(struct razer_mouse *m)
 {
 	struct boomslangce_private *priv;
 	unsigned int i;
@@ -822,7 +811,7 @@ int razer_boomslangce_init(struct razer_mouse *m,
 	}
 
 	m->type = RAZER_MOUSETYPE_BOOMSLANGCE;
-	razer_generic_usb_gen_idstr(usbdev, NULL, "Boomslang-CE", 1,
+	razer_generic_usb_gen_idstr(m->usb_ctx, "Boomslang-CE", 1,
 				    NULL, m->idstr);
 
 	m->get_fw_version = boomslangce_get_fw_version;
@@ -838,11 +827,8 @@ int razer_boomslangce_init(struct razer_mouse *m,
 	m->supported_buttons = boomslangce_supported_buttons;
 	m->supported_button_functions = boomslangce_supported_button_functions;
 
-	err = boomslangce_do_commit(priv);
-	if (err) {
-		razer_error("hw_boomslangce: Failed to commit initial config\n");
-		goto err_release;
-	}
+	/* The initial settings are committed by the config job. */
+	priv->commit_pending = 1;
 
 	m->release(m);
 
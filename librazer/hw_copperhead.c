@@ -67,6 +67,14 @@ struct copperhead_buttons {
 	struct razer_buttonmapping mapping[NR_COPPERHEAD_PHYSBUT];
 };
 
+/* The settings as they are known to be on the device. */
+struct copperhead_hwstate {
+	unsigned int profile;
+	enum razer_mouse_res res[COPPERHEAD_NR_PROFILES];
+	enum razer_mouse_freq freq[COPPERHEAD_NR_PROFILES];
+	struct copperhead_buttons buttons[COPPERHEAD_NR_PROFILES];
+};
+
 struct copperhead_private {
 	struct razer_mouse *m;
 
@@ -88,6 +96,16 @@ struct copperhead_private {
 	/* The active button mapping; per profile. */
 	struct copperhead_buttons buttons[COPPERHEAD_NR_PROFILES];
 
+	/* The profiles that were read from the device.
+	 * The other profiles are read on first access. */
+	bool prof_loaded[COPPERHEAD_NR_PROFILES];
+	/* Whether the device state read so far is exactly representable. */
+	bool hw_exact;
+
+	/* Used to skip commits that would not change anything. */
+	struct copperhead_hwstate hwstate;
+	bool hwstate_valid;
+
 	bool commit_pending;
 	struct razer_event_spacing commit_spacing;
 };
@@ -129,8 +147,8 @@ static int copperhead_usb_write(struct copperhead_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_OTHER,
 		request, command, index,
@@ -151,8 +169,8 @@ static int copperhead_usb_read(struct copperhead_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_OTHER,
 		request, command, index,
@@ -182,6 +200,26 @@ static int copperhead_read_fw_ver(struct copperhead_private *priv)
 	return ver;
 }
 
+static void copperhead_get_profile_hwstate(struct copperhead_private *priv,
+					   unsigned int i,
+					   struct copperhead_hwstate *state)
+{
+	state->res[i] = priv->cur_dpimapping[i]->res[RAZER_DIM_0];
+	state->freq[i] = priv->cur_freq[i];
+	state->buttons[i] = priv->buttons[i];
+}
+
+static void copperhead_get_hwstate(struct copperhead_private *priv,
+				   struct copperhead_hwstate *state)
+{
+	unsigned int i;
+
+	memset(state, 0, sizeof(*state));
+	state->profile = priv->cur_profile->nr;
+	for (i = 0; i < COPPERHEAD_NR_PROFILES; i++)
+		copperhead_get_profile_hwstate(priv, i, state);
+}
+
 static int copperhead_do_commit(struct copperhead_private *priv)
 {
 	union {
@@ -279,13 +317,28 @@ out:
 	return err;
 }
 
-static int copperhead_read_config_from_hw(struct copperhead_private *priv)
+static bool copperhead_all_profiles_loaded(struct copperhead_private *priv)
 {
-	struct copperhead_profcfg_cmd profcfg;
 	unsigned int i;
+
+	for (i = 0; i < COPPERHEAD_NR_PROFILES; i++) {
+		if (!priv->prof_loaded[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Read the active profile number. The profiles are read
+ * later by copperhead_load_profile(). */
+static int copperhead_read_config_from_hw(struct copperhead_private *priv)
+{
 	unsigned char value;
 	int err;
 
+	priv->hw_exact = 1;
+	priv->hwstate_valid = 0;
+
 	/* Read the current profile number. */
 	err = copperhead_usb_read(priv, LIBUSB_REQUEST_CLEAR_FEATURE,
 				  0x01, 0, &value, sizeof(value));
@@ -295,88 +348,169 @@ static int copperhead_read_config_from_hw(struct copperhead_private *priv)
 		razer_error("hw_copperhead: Got invalid profile number: %u\n",
 			    (unsigned int)value);
 		value = 1;
+		priv->hw_exact = 0;
 	}
 	priv->cur_profile = &priv->profiles[value - 1];
+	priv->hwstate.profile = priv->cur_profile->nr;
 
-	/* Read the profiles config */
-	for (i = 0; i < COPPERHEAD_NR_PROFILES; i++) {
-		BUILD_BUG_ON(0x156 + 6 != sizeof(profcfg));
+	return 0;
+}
 
-		/* Request profile config */
-		value = i + 1;
-		err = copperhead_usb_write(priv, LIBUSB_REQUEST_SET_CONFIGURATION,
-					   0x02, 3, &value, sizeof(value));
-		if (err)
-			return err;
-		/* Read profile config */
-		memset(&profcfg, 0, sizeof(profcfg));
-		err = copperhead_usb_read(priv, LIBUSB_REQUEST_CLEAR_FEATURE,
-					  0x01, 0, ((uint8_t *)&profcfg) + 6,
-					  sizeof(profcfg) - 6);
-		if (err)
-			return err;
-		if (razer_xor16_checksum(&profcfg, sizeof(profcfg))) {
-			razer_error("hw_copperhead: Read profile data checksum mismatch\n");
+/* Read a profile config from the device. The device must be claimed. */
+static int copperhead_load_profile(struct copperhead_private *priv, unsigned int i)
+{
+	struct copperhead_profcfg_cmd profcfg;
+	unsigned char value;
+	int err;
+	/* Whether the profile is exactly representable. */
+	bool exact = 1;
+
+	BUILD_BUG_ON(0x156 + 6 != sizeof(profcfg));
+
+	/* Request profile config */
+	value = i + 1;
+	err = copperhead_usb_write(priv, LIBUSB_REQUEST_SET_CONFIGURATION,
+				   0x02, 3, &value, sizeof(value));
+	if (err)
+		return err;
+	/* Read profile config */
+	memset(&profcfg, 0, sizeof(profcfg));
+	err = copperhead_usb_read(priv, LIBUSB_REQUEST_CLEAR_FEATURE,
+				  0x01, 0, ((uint8_t *)&profcfg) + 6,
+				  sizeof(profcfg) - 6);
+	if (err)
+		return err;
+	if (razer_xor16_checksum(&profcfg, sizeof(profcfg))) {
+		razer_error("hw_copperhead: Read profile data checksum mismatch\n");
+		exact = 0;
+		goto out;
+	}
+	if (le16_to_cpu(profcfg.reply_profilenr) != i + 1) {
+		razer_error("hw_copperhead: Got invalid profile nr in "
+			    "profile config: %u\n",
+			    (unsigned int)le16_to_cpu(profcfg.reply_profilenr));
+	}
+	switch (profcfg.dpisel) {
+	case 4:
+		priv->cur_dpimapping[i] = razer_mouse_get_dpimapping_by_res(
+				priv->dpimappings, ARRAY_SIZE(priv->dpimappings),
+				RAZER_DIM_0, RAZER_MOUSE_RES_400DPI);
+		break;
+	case 3:
+		priv->cur_dpimapping[i] = razer_mouse_get_dpimapping_by_res(
+				priv->dpimappings, ARRAY_SIZE(priv->dpimappings),
+				RAZER_DIM_0, RAZER_MOUSE_RES_800DPI);
+		break;
+	case 2:
+		priv->cur_dpimapping[i] = razer_mouse_get_dpimapping_by_res(
+				priv->dpimappings, ARRAY_SIZE(priv->dpimappings),
+				RAZER_DIM_0, RAZER_MOUSE_RES_1600DPI);
+		break;
+	case 1:
+		priv->cur_dpimapping[i] = razer_mouse_get_dpimapping_by_res(
+				priv->dpimappings, ARRAY_SIZE(priv->dpimappings),
+				RAZER_DIM_0, RAZER_MOUSE_RES_2000DPI);
+		break;
+	default:
+		razer_error("hw_copperhead: Got invalid DPI mapping selection\n");
+		exact = 0;
+		break;
+	}
+	if (!priv->cur_dpimapping[i]) {
+		razer_error("hw_copperhead: Internal error: No dpimapping\n");
+		return -ENODEV;
+	}
+	switch (profcfg.freq) {
+	case 3:
+		priv->cur_freq[i] = RAZER_MOUSE_FREQ_125HZ;
+		break;
+	case 2:
+		priv->cur_freq[i] = RAZER_MOUSE_FREQ_500HZ;
+		break;
+	case 1:
+		priv->cur_freq[i] = RAZER_MOUSE_FREQ_1000HZ;
+		break;
+	default:
+		razer_error("hw_copperhead: Got invalid frequency selection\n");
+		exact = 0;
+		break;
+	}
+	err = razer_parse_buttonmap(profcfg.buttonmap, sizeof(profcfg.buttonmap),
+				    priv->buttons[i].mapping,
+				    ARRAY_SIZE(priv->buttons[i].mapping), 46);
+	if (err) {
+		razer_error("hw_copperhead: Failed to parse button map\n");
+		exact = 0;
+	}
+out:
+	priv->prof_loaded[i] = 1;
+	if (exact)
+		copperhead_get_profile_hwstate(priv, i, &priv->hwstate);
+	else
+		priv->hw_exact = 0;
+	/* The hwstate is complete with the last profile. */
+	if (priv->hw_exact && copperhead_all_profiles_loaded(priv))
+		priv->hwstate_valid = 1;
+
+	return 0;
+}
+
+/* Read all profiles, that were not read, yet. The device must be claimed. */
+static int copperhead_load_profiles(struct copperhead_private *priv)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < COPPERHEAD_NR_PROFILES; i++) {
+		if (priv->prof_loaded[i])
 			continue;
-		}
-		if (le16_to_cpu(profcfg.reply_profilenr) != i + 1) {
-			razer_error("hw_copperhead: Got invalid profile nr in "
-				    "profile config: %u\n",
-				    (unsigned int)le16_to_cpu(profcfg.reply_profilenr));
-		}
-		switch (profcfg.dpisel) {
-		case 4:
-			priv->cur_dpimapping[i] = razer_mouse_get_dpimapping_by_res(
-					priv->dpimappings, ARRAY_SIZE(priv->dpimappings),
-					RAZER_DIM_0, RAZER_MOUSE_RES_400DPI);
-			break;
-		case 3:
-			priv->cur_dpimapping[i] = razer_mouse_get_dpimapping_by_res(
-					priv->dpimappings, ARRAY_SIZE(priv->dpimappings),
-					RAZER_DIM_0, RAZER_MOUSE_RES_800DPI);
-			break;
-		case 2:
-			priv->cur_dpimapping[i] = razer_mouse_get_dpimapping_by_res(
-					priv->dpimappings, ARRAY_SIZE(priv->dpimappings),
-					RAZER_DIM_0, RAZER_MOUSE_RES_1600DPI);
-			break;
-		case 1:
-			priv->cur_dpimapping[i] = razer_mouse_get_dpimapping_by_res(
-					priv->dpimappings, ARRAY_SIZE(priv->dpimappings),
-					RAZER_DIM_0, RAZER_MOUSE_RES_2000DPI);
-			break;
-		default:
-			razer_error("hw_copperhead: Got invalid DPI mapping selection\n");
-			break;
-		}
-		if (!priv->cur_dpimapping[i]) {
-			razer_error("hw_copperhead: Internal error: No dpimapping\n");
-			return -ENODEV;
-		}
-		switch (profcfg.freq) {
-		case 3:
-			priv->cur_freq[i] = RAZER_MOUSE_FREQ_125HZ;
-			break;
-		case 2:
-			priv->cur_freq[i] = RAZER_MOUSE_FREQ_500HZ;
-			break;
-		case 1:
-			priv->cur_freq[i] = RAZER_MOUSE_FREQ_1000HZ;
-			break;
-		default:
-			razer_error("hw_copperhead: Got invalid frequency selection\n");
-			break;
-		}
-		err = razer_parse_buttonmap(profcfg.buttonmap, sizeof(profcfg.buttonmap),
-					    priv->buttons[i].mapping,
-					    ARRAY_SIZE(priv->buttons[i].mapping), 46);
+		err = copperhead_load_profile(priv, i);
 		if (err)
-			razer_error("hw_copperhead: Failed to parse button map\n");
+			return err;
 	}
 
 	return 0;
 }
 
+/** copperhead_need_profile - Make sure a profile was read from the device.
+ * The device is claimed, if it is not claimed by the caller.
+ * Claiming waits for the config job, which reads all profiles.
+ */
+static int copperhead_need_profile(struct copperhead_private *priv, unsigned int i)
+{
+	struct razer_mouse *m = priv->m;
+	int err;
+
+	if (priv->prof_loaded[i])
+		return 0;
+	err = m->claim(m);
+	if (err)
+		return err;
+	if (!priv->prof_loaded[i]) {
+		err = copperhead_load_profile(priv, i);
+		if (err) {
+			razer_error("hw_copperhead: Failed to read profile %u "
+				    "from hardware\n", i + 1);
+		}
+	}
+	m->release(m);
+
+	return err;
+}
+
+static int copperhead_late_init(struct razer_mouse *m)
+{
+	struct copperhead_private *priv = m->drv_data;
+	int err;
+
+	/* Read the remaining profiles in the background. */
+	err = copperhead_load_profiles(priv);
+	if (err)
+		razer_error("hw_copperhead: Failed to read config from hardware\n");
+
+	return err;
+}
+
 static int copperhead_get_fw_version(struct razer_mouse *m)
 {
 	struct copperhead_private *priv = m->drv_data;
@@ -387,14 +521,30 @@ static int copperhead_get_fw_version(struct razer_mouse *m)
 static int copperhead_commit(struct razer_mouse *m, int force)
 {
 	struct copperhead_private *priv = m->drv_data;
+	struct copperhead_hwstate state;
 	int err = 0;
 
 	if (!m->claim_count)
 		return -EBUSY;
 	if (priv->commit_pending || force) {
+		/* All profiles are written. */
+		err = copperhead_load_profiles(priv);
+		if (err)
+			return err;
+		copperhead_get_hwstate(priv, &state);
+		if (!force && priv->hwstate_valid &&
+		    memcmp(&state, &priv->hwstate, sizeof(state)) == 0) {
+			razer_debug("hw_copperhead: Settings unchanged. "
+				    "Nothing to commit.\n");
+			priv->commit_pending = 0;
+			return 0;
+		}
 		err = copperhead_do_commit(priv);
-		if (!err)
+		if (!err) {
 			priv->commit_pending = 0;
+			priv->hwstate = state;
+		}
+		priv->hwstate_valid = !err;
 	}
 
 	return err;
@@ -428,43 +578,33 @@ static int copperhead_set_active_profile(struct razer_mouse *m,
 	return 0;
 }
 
-static int copperhead_supported_resolutions(struct razer_mouse *m,
-					    enum razer_mouse_res **res_list)
-{
-	enum razer_mouse_res *list;
-	const int count = 4;
-
-	list = zalloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
+static const enum razer_mouse_res copperhead_resolutions[] = {
+	RAZER_MOUSE_RES_400DPI,
+	RAZER_MOUSE_RES_800DPI,
+	RAZER_MOUSE_RES_1600DPI,
+	RAZER_MOUSE_RES_2000DPI,
+};
 
-	list[0] = RAZER_MOUSE_RES_400DPI;
-	list[1] = RAZER_MOUSE_RES_800DPI;
-	list[2] = RAZER_MOUSE_RES_1600DPI;
-	list[3] = RAZER_MOUSE_RES_2000DPI;
+static const enum razer_mouse_freq copperhead_freqs[] = {
+	RAZER_MOUSE_FREQ_125HZ,
+	RAZER_MOUSE_FREQ_500HZ,
+	RAZER_MOUSE_FREQ_1000HZ,
+};
 
-	*res_list = list;
+static int copperhead_supported_resolutions(struct razer_mouse *m,
+					    const enum razer_mouse_res **res_list)
+{
+	*res_list = copperhead_resolutions;
 
-	return count;
+	return ARRAY_SIZE(copperhead_resolutions);
 }
 
 static int copperhead_supported_freqs(struct razer_mouse *m,
-				      enum razer_mouse_freq **freq_list)
+				      const enum razer_mouse_freq **freq_list)
 {
-	enum razer_mouse_freq *list;
-	const int count = 3;
+	*freq_list = copperhead_freqs;
 
-	list = zalloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
-
-	list[0] = RAZER_MOUSE_FREQ_125HZ;
-	list[1] = RAZER_MOUSE_FREQ_500HZ;
-	list[2] = RAZER_MOUSE_FREQ_1000HZ;
-
-	*freq_list = list;
-
-	return count;
+	return ARRAY_SIZE(copperhead_freqs);
 }
 
 static enum razer_mouse_freq copperhead_get_freq(struct razer_mouse_profile *p)
@@ -473,6 +613,8 @@ static enum razer_mouse_freq copperhead_get_freq(struct razer_mouse_profile *p)
 
 	if (p->nr >= ARRAY_SIZE(priv->cur_freq))
 		return -EINVAL;
+	if (copperhead_need_profile(priv, p->nr))
+		return -EIO;
 
 	return priv->cur_freq[p->nr];
 }
@@ -481,11 +623,15 @@ static int copperhead_set_freq(struct razer_mouse_profile *p,
 			       enum razer_mouse_freq freq)
 {
 	struct copperhead_private *priv = p->mouse->drv_data;
+	int err;
 
 	if (!priv->m->claim_count)
 		return -EBUSY;
 	if (p->nr >= ARRAY_SIZE(priv->cur_freq))
 		return -EINVAL;
+	err = copperhead_need_profile(priv, p->nr);
+	if (err)
+		return err;
 
 	priv->cur_freq[p->nr] = freq;
 	priv->commit_pending = 1;
@@ -510,6 +656,8 @@ static struct razer_mouse_dpimapping * copperhead_get_dpimapping(struct razer_mo
 
 	if (p->nr >= ARRAY_SIZE(priv->cur_dpimapping))
 		return NULL;
+	if (copperhead_need_profile(priv, p->nr))
+		return NULL;
 
 	return priv->cur_dpimapping[p->nr];
 }
@@ -519,11 +667,15 @@ static int copperhead_set_dpimapping(struct razer_mouse_profile *p,
 				     struct razer_mouse_dpimapping *d)
 {
 	struct copperhead_private *priv = p->mouse->drv_data;
+	int err;
 
 	if (!priv->m->claim_count)
 		return -EBUSY;
 	if (p->nr >= ARRAY_SIZE(priv->cur_dpimapping))
 		return -EINVAL;
+	err = copperhead_need_profile(priv, p->nr);
+	if (err)
+		return err;
 
 	priv->cur_dpimapping[p->nr] = d;
 	priv->commit_pending = 1;
@@ -553,6 +705,8 @@ static struct razer_button_function * copperhead_get_button_function(struct raze
 
 	if (p->nr > ARRAY_SIZE(priv->buttons))
 		return NULL;
+	if (copperhead_need_profile(priv, p->nr))
+		return NULL;
 	buttons = &priv->buttons[p->nr];
 
 	return razer_get_buttonfunction_by_button(
@@ -568,11 +722,15 @@ static int copperhead_set_button_function(struct razer_mouse_profile *p,
 	struct copperhead_private *priv = p->mouse->drv_data;
 	struct copperhead_buttons *buttons;
 	struct razer_buttonmapping *mapping;
+	int err;
 
 	if (!priv->m->claim_count)
 		return -EBUSY;
 	if (p->nr > ARRAY_SIZE(priv->buttons))
 		return -EINVAL;
+	err = copperhead_need_profile(priv, p->nr);
+	if (err)
+		return err;
 	buttons = &priv->buttons[p->nr];
 
 	mapping = razer_get_buttonmapping_by_physid(
@@ -587,8 +745,7 @@ static int copperhead_set_button_function(struct razer_mouse_profile *p,
 	return 0;
 }
 
-int razer_copperhead_init(struct razer_mouse *m,
-			  struct libusb_device *usbdev)
+int razer_copperhead_init(struct razer_mouse *m)
 {
 	struct copperhead_private *priv;
 	unsigned int i;
@@ -665,12 +822,20 @@ int razer_copperhead_init(struct razer_mouse *m,
 		razer_error("hw_copperhead: Failed to read config from hardware\n");
 		goto err_release;
 	}
+	/* The config job reads the other profiles
+	 * after the device was published. */
+	err = copperhead_load_profile(priv, priv->cur_profile->nr);
+	if (err) {
+		razer_error("hw_copperhead: Failed to read config from hardware\n");
+		goto err_release;
+	}
 
 	m->type = RAZER_MOUSETYPE_COPPERHEAD;
-	razer_generic_usb_gen_idstr(usbdev, NULL, "Copperhead", 1,
+	razer_generic_usb_gen_idstr(m->usb_ctx, "Copperhead", 1,
 				    NULL, m->idstr);
 
 	m->get_fw_version = copperhead_get_fw_version;
+	m->late_init = copperhead_late_init;
 	m->commit = copperhead_commit;
 	m->nr_profiles = COPPERHEAD_NR_PROFILES;
 	m->get_profiles = copperhead_get_profiles;
@@ -682,11 +847,8 @@ int razer_copperhead_init(struct razer_mouse *m,
 	m->supported_buttons = copperhead_supported_buttons;
 	m->supported_button_functions = copperhead_supported_button_functions;
 
-	err = copperhead_do_commit(priv);
-	if (err) {
-		razer_error("hw_copperhead: Failed to commit initial config\n");
-		goto err_release;
-	}
+	/* The initial settings are committed by the config job. */
+	priv->commit_pending = 1;
 
 	m->release(m);
 
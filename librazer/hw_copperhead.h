@@ -4,8 +4,7 @@
 #include "razer_private.h"
 
 
-int razer_copperhead_init(struct razer_mouse *m,
-			  struct libusb_device *udev);
+int razer_copperhead_init(struct razer_mouse *m);
 void razer_copperhead_release(struct razer_mouse *m);
 
 #endif /* RAZER_HW_COPPERHEAD_H_ */
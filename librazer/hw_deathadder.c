@@ -79,6 +79,7 @@ struct deathadder_private {
 
 #define DADD_FW(major, minor)		(((major) << 8) | (minor))
 #define DEATHADDER_FW_IMAGE_SIZE	0x4000
+#define DEATHADDER_BOOTLOADER_TIMEOUT	5000 /* msec */
 
 static int deathadder_usb_write(struct deathadder_private *priv,
 				int request, int command,
@@ -91,8 +92,8 @@ static int deathadder_usb_write(struct deathadder_private *priv,
 		return 0;
 	}
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, 0,
@@ -119,8 +120,8 @@ static int deathadder_usb_read(struct deathadder_private *priv,
 		return 0;
 	}
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, 0,
@@ -451,23 +452,18 @@ static int deathadder_get_leds(struct razer_mouse *m,
 	return DEATHADDER_NR_LEDS;
 }
 
+static const enum razer_mouse_freq deathadder_freqs[] = {
+	RAZER_MOUSE_FREQ_125HZ,
+	RAZER_MOUSE_FREQ_500HZ,
+	RAZER_MOUSE_FREQ_1000HZ,
+};
+
 static int deathadder_supported_freqs(struct razer_mouse *m,
-				      enum razer_mouse_freq **freq_list)
+				      const enum razer_mouse_freq **freq_list)
 {
-	enum razer_mouse_freq *list;
-	const int count = 3;
-
-	list = zalloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
-
-	list[0] = RAZER_MOUSE_FREQ_125HZ;
-	list[1] = RAZER_MOUSE_FREQ_500HZ;
-	list[2] = RAZER_MOUSE_FREQ_1000HZ;
-
-	*freq_list = list;
+	*freq_list = deathadder_freqs;
 
-	return count;
+	return ARRAY_SIZE(deathadder_freqs);
 }
 
 static enum razer_mouse_freq deathadder_get_freq(struct razer_mouse_profile *p)
@@ -491,26 +487,24 @@ static int deathadder_set_freq(struct razer_mouse_profile *p,
 	return 0;
 }
 
+static const enum razer_mouse_res deathadder_resolutions[] = {
+	RAZER_MOUSE_RES_450DPI,
+	RAZER_MOUSE_RES_900DPI,
+	RAZER_MOUSE_RES_1800DPI,
+	RAZER_MOUSE_RES_3500DPI,
+};
+
 static int deathadder_supported_resolutions(struct razer_mouse *m,
-					    enum razer_mouse_res **res_list)
+					    const enum razer_mouse_res **res_list)
 {
 	struct deathadder_private *priv = m->drv_data;
-	enum razer_mouse_res *list;
-	const int count = (priv->type == DEATHADDER_CLASSIC) ? 3 : 4;
-
-	list = zalloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
-
-	list[0] = RAZER_MOUSE_RES_450DPI;
-	list[1] = RAZER_MOUSE_RES_900DPI;
-	list[2] = RAZER_MOUSE_RES_1800DPI;
-	if (priv->type != DEATHADDER_CLASSIC)
-		list[3] = RAZER_MOUSE_RES_3500DPI;
 
-	*res_list = list;
+	*res_list = deathadder_resolutions;
+	/* The classic DeathAdder does not support 3500 DPI. */
+	if (priv->type == DEATHADDER_CLASSIC)
+		return ARRAY_SIZE(deathadder_resolutions) - 1;
 
-	return count;
+	return ARRAY_SIZE(deathadder_resolutions);
 }
 
 //TODO
@@ -553,6 +547,7 @@ static int deathadder_flash_firmware(struct razer_mouse *m,
 	int err;
 	char value;
 	struct libusb_device *cydev;
+	struct razer_usb_location loc;
 	struct cypress cy;
 
 	if (magic_number != RAZER_FW_FLASH_MAGIC)
@@ -568,11 +563,26 @@ static int deathadder_flash_firmware(struct razer_mouse *m,
 		return -EINVAL;
 	}
 
+	err = razer_flash_report(m, RAZER_FLASH_PREPARE, 0, 1);
+	if (err)
+		return err;
+
 	razer_msleep(50);
 	if (priv->in_bootloader) {
 		/* We're already inside of the bootloader */
-		cydev = m->usb_ctx->dev;
+		if (!m->usb_ctx->dev)
+			return -EOPNOTSUPP;
+		cydev = libusb_ref_device(m->usb_ctx->dev);
 	} else {
+		/* The bootloader re-enumerates on the port of the mouse.
+		 * Remember it, so that we don't pick up the bootloader
+		 * of another mouse. */
+		err = razer_usb_get_location(m->usb_ctx->dev, &loc);
+		if (err) {
+			razer_error("razer-deathadder: Unknown USB location. "
+				    "Can't find the bootloader.\n");
+			return -EOPNOTSUPP;
+		}
 		/* Enter bootloader mode */
 		value = 0;
 		err = deathadder_usb_write(priv, LIBUSB_REQUEST_SET_CONFIGURATION,
@@ -582,20 +592,25 @@ static int deathadder_flash_firmware(struct razer_mouse *m,
 			return err;
 		}
 		/* Wait for the cypress device to appear. */
-//TODO	cydev = wait_for_usbdev(priv->usb.dev, CYPRESS_BOOT_VENDORID, CYPRESS_BOOT_PRODUCTID);
-cydev=NULL;
+		razer_flash_report(m, RAZER_FLASH_REENUM, 0, 1);
+		cydev = razer_usb_wait_for_device(CYPRESS_BOOT_VENDORID,
+						  CYPRESS_BOOT_PRODUCTID,
+						  &loc,
+						  DEATHADDER_BOOTLOADER_TIMEOUT);
 		if (!cydev) {
 			razer_error("razer-deathadder: Cypress device didn't appear.\n");
-			return -1;
+			return -ENODEV;
 		}
 	}
-	razer_msleep(100);
 
 	err = cypress_open(&cy, cydev, NULL);
 	if (err)
-		return err;
+		goto out_unref;
+	cy.mouse = m;
 	err = cypress_upload_image(&cy, data, len);
 	cypress_close(&cy);
+out_unref:
+	libusb_unref_device(cydev);
 	if (err)
 		return err;
 
@@ -646,8 +661,7 @@ static int deathadder_set_dpimapping(struct razer_mouse_profile *p,
 	return 0;
 }
 
-int razer_deathadder_init(struct razer_mouse *m,
-			  struct libusb_device *usbdev)
+int razer_deathadder_init(struct razer_mouse *m)
 {
 	struct deathadder_private *priv;
 	struct libusb_device_descriptor desc;
@@ -655,11 +669,7 @@ int razer_deathadder_init(struct razer_mouse *m,
 	int err, fwver;
 	const char *devname = "";
 
-	err = libusb_get_device_descriptor(usbdev, &desc);
-	if (err) {
-		razer_error("hw_deathadder: Failed to get device descriptor\n");
-		return -EIO;
-	}
+	desc = m->usb_ctx->desc;
 
 	priv = zalloc(sizeof(struct deathadder_private));
 	if (!priv)
@@ -682,7 +692,6 @@ int razer_deathadder_init(struct razer_mouse *m,
 			razer_error("hw_deathadder: Failed to reinit USB device\n");
 			goto err_free;
 		}
-		usbdev = m->usb_ctx->dev;
 	}
 
 	err = m->claim(m);
@@ -763,7 +772,7 @@ int razer_deathadder_init(struct razer_mouse *m,
 		devname = "DeathAdder Black Edition";
 		break;
 	}
-	razer_generic_usb_gen_idstr(usbdev, m->usb_ctx->h, devname, 0,
+	razer_generic_usb_gen_idstr(m->usb_ctx, devname, 0,
 				    NULL, m->idstr);
 
 	m->get_fw_version = deathadder_get_fw_version;
@@ -775,11 +784,8 @@ int razer_deathadder_init(struct razer_mouse *m,
 	m->supported_freqs = deathadder_supported_freqs;
 	m->supported_dpimappings = deathadder_supported_dpimappings;
 
-	err = deathadder_do_commit(priv);
-	if (err) {
-		razer_error("hw_deathadder: Failed to commit initial settings\n");
-		goto err_release;
-	}
+	/* The initial settings are committed by the config job. */
+	priv->commit_pending = 1;
 
 	m->release(m);
 
@@ -84,12 +84,12 @@ static int deathadder2013_usb_write(struct deathadder2013_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(priv->m->usb_ctx->h,
-				      LIBUSB_ENDPOINT_OUT |
-				      LIBUSB_REQUEST_TYPE_CLASS |
-				      LIBUSB_RECIPIENT_INTERFACE, request,
-				      command, 0, (unsigned char *)buf, size,
-				      RAZER_USB_TIMEOUT);
+	err = razer_usb_control(priv->m->usb_ctx,
+				LIBUSB_ENDPOINT_OUT |
+				LIBUSB_REQUEST_TYPE_CLASS |
+				LIBUSB_RECIPIENT_INTERFACE, request,
+				command, 0, (unsigned char *)buf, size,
+				RAZER_USB_TIMEOUT);
 	if (err < 0 || (size_t)err != size) {
 		razer_error("razer-deathadder2013: "
 			    "USB write 0x%02X 0x%02X failed: %d\n",
@@ -106,12 +106,12 @@ static int deathadder2013_usb_read(struct deathadder2013_private *priv,
 	int err, try;
 
 	for (try = 0; try < 3; try++) {
-		err = libusb_control_transfer(priv->m->usb_ctx->h,
-					      LIBUSB_ENDPOINT_IN |
-					      LIBUSB_REQUEST_TYPE_CLASS |
-					      LIBUSB_RECIPIENT_INTERFACE,
-					      request, command, 0, buf, size,
-					      RAZER_USB_TIMEOUT);
+		err = razer_usb_control(priv->m->usb_ctx,
+					LIBUSB_ENDPOINT_IN |
+					LIBUSB_REQUEST_TYPE_CLASS |
+					LIBUSB_RECIPIENT_INTERFACE,
+					request, command, 0, buf, size,
+					RAZER_USB_TIMEOUT);
 		if (err >= 0 && (size_t)err == size)
 			break;
 	}
@@ -354,24 +354,18 @@ static int deathadder2013_get_leds(struct razer_mouse *m,
 	return DEATHADDER2013_NR_LEDS;
 }
 
+static const enum razer_mouse_freq deathadder2013_freqs[] = {
+	RAZER_MOUSE_FREQ_125HZ,
+	RAZER_MOUSE_FREQ_500HZ,
+	RAZER_MOUSE_FREQ_1000HZ,
+};
+
 static int deathadder2013_supported_freqs(struct razer_mouse *m,
-					  enum razer_mouse_freq **freq_list)
+					  const enum razer_mouse_freq **freq_list)
 {
-	enum razer_mouse_freq *list;
-	const int count = 3;
-
-	list = zalloc(sizeof(*list) * count);
-
-	if (!list)
-		return -ENOMEM;
-
-	list[0] = RAZER_MOUSE_FREQ_125HZ;
-	list[1] = RAZER_MOUSE_FREQ_500HZ;
-	list[2] = RAZER_MOUSE_FREQ_1000HZ;
+	*freq_list = deathadder2013_freqs;
 
-	*freq_list = list;
-
-	return count;
+	return ARRAY_SIZE(deathadder2013_freqs);
 }
 
 static enum razer_mouse_freq deathadder2013_get_freq(struct razer_mouse_profile
@@ -407,23 +401,13 @@ static int deathadder2013_supported_axes(struct razer_mouse *m,
 }
 
 static int deathadder2013_supported_resolutions(struct razer_mouse *m,
-						enum razer_mouse_res **res_list)
+						const enum razer_mouse_res **res_list)
 {
-	enum razer_mouse_res *list;
-	unsigned int i;
-	const unsigned int count = DEATHADDER2013_NR_DPIMAPPINGS;
-
-	list = zalloc(sizeof(*list) * count);
-
-	if (!list)
-		return -ENOMEM;
-
-	for (i = 0; i < count; i++)
-		list[i] = (i + 1) * 100;
+	BUILD_BUG_ON(DEATHADDER2013_NR_DPIMAPPINGS > RAZER_NR_RES_STEPS_100DPI);
 
-	*res_list = list;
+	*res_list = razer_res_steps_100dpi;
 
-	return count;
+	return DEATHADDER2013_NR_DPIMAPPINGS;
 }
 
 static struct razer_mouse_profile *deathadder2013_get_profiles(struct
@@ -490,8 +474,7 @@ static int deathadder2013_set_dpimapping(struct razer_mouse_profile *p,
 	return 0;
 }
 
-int razer_deathadder2013_init(struct razer_mouse *m,
-			      struct libusb_device *usbdev)
+int razer_deathadder2013_init(struct razer_mouse *m)
 {
 	struct deathadder2013_private *priv;
 	unsigned int i;
@@ -553,8 +536,7 @@ int razer_deathadder2013_init(struct razer_mouse *m,
 			"Y", RAZER_AXIS_INDEPENDENT_DPIMAPPING, "Scroll", 0);
 
 	m->type = RAZER_MOUSETYPE_DEATHADDER;
-	razer_generic_usb_gen_idstr(usbdev, m->usb_ctx->h,
-				    "DeathAdder 2013 Edition", 1, NULL,
+	razer_generic_usb_gen_idstr(m->usb_ctx, "DeathAdder 2013 Edition", 1, NULL,
 				    m->idstr);
 
 	m->get_fw_version = deathadder2013_get_fw_version;
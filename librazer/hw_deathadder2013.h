@@ -3,8 +3,7 @@
 
 #include "razer_private.h"
 
-int razer_deathadder2013_init(struct razer_mouse *m,
-			      struct libusb_device *udev);
+int razer_deathadder2013_init(struct razer_mouse *m);
 
 void razer_deathadder2013_release(struct razer_mouse *m);
 
@@ -19,6 +19,7 @@
 
 #include "hw_deathadder_chroma.h"
 #include "razer_private.h"
+#include "chroma.h"
 
 #include <errno.h>
 #include <stdlib.h>
@@ -26,7 +27,7 @@
 #include <stdint.h>
 #include <string.h>
 
-static enum razer_mouse_freq deathadder_chroma_freqs_list[] = {
+static const enum razer_mouse_freq deathadder_chroma_freqs_list[] = {
     RAZER_MOUSE_FREQ_125HZ, RAZER_MOUSE_FREQ_500HZ, RAZER_MOUSE_FREQ_1000HZ};
 
 static enum razer_mouse_res deathadder_chroma_resolution_stages_list[] = {
@@ -53,6 +54,17 @@ enum deathadder_chroma_led_state {
 	DEATHADDER_CHROMA_LED_STATE_ON = 0x01
 };
 
+enum deathadder_chroma_cmd_id {
+	DEATHADDER_CHROMA_CMD_INIT,
+	DEATHADDER_CHROMA_CMD_SET_RESOLUTION,
+	DEATHADDER_CHROMA_CMD_GET_FIRMWARE,
+	DEATHADDER_CHROMA_CMD_GET_SERIAL_NO,
+	DEATHADDER_CHROMA_CMD_SET_FREQUENCY,
+	DEATHADDER_CHROMA_CMD_SET_LED_STATE,
+	DEATHADDER_CHROMA_CMD_SET_LED_MODE,
+	DEATHADDER_CHROMA_CMD_SET_LED_COLOR
+};
+
 /*
  * The 6th byte of DeathAdder Chroma's command seems to be the size of arguments
  * (size of arguments to read in case of read operations). It's not necessarily
@@ -60,28 +72,23 @@ enum deathadder_chroma_led_state {
  * of the arguments).
  * Experiments suggest that the value given in the 'size' byte does not matter.
  * I chose to go with the values used by the Synapse driver.
+ * The LED commands are keyed by ARG0 and the LED ID.
  */
-enum deathadder_chroma_request_size {
-	DEATHADDER_CHROMA_REQUEST_SIZE_INIT = 0x02,
-	DEATHADDER_CHROMA_REQUEST_SIZE_SET_RESOLUTION = 0x07,
-	DEATHADDER_CHROMA_REQUEST_SIZE_GET_FIRMWARE = 0x04,
-	DEATHADDER_CHROMA_REQUEST_SIZE_GET_SERIAL_NO = 0x16,
-	DEATHADDER_CHROMA_REQUEST_SIZE_SET_FREQUENCY = 0x01,
-	DEATHADDER_CHROMA_REQUEST_SIZE_SET_LED_STATE = 0x03,
-	DEATHADDER_CHROMA_REQUEST_SIZE_SET_LED_MODE = 0x03,
-	DEATHADDER_CHROMA_REQUEST_SIZE_SET_LED_COLOR = 0x05
-};
-
-enum deathadder_chroma_request {
-	DEATHADDER_CHROMA_REQUEST_INIT = 0x0004,
-	DEATHADDER_CHROMA_REQUEST_SET_RESOLUTION = 0x0405,
-	DEATHADDER_CHROMA_REQUEST_GET_FIRMWARE = 0x0087,
-	DEATHADDER_CHROMA_REQUEST_GET_SERIAL_NO = 0x0082,
-	DEATHADDER_CHROMA_REQUEST_SET_FREQUENCY = 0x0005,
-	DEATHADDER_CHROMA_REQUEST_SET_LED_STATE = 0x0300,
-	DEATHADDER_CHROMA_REQUEST_SET_LED_MODE = 0x0302,
-	DEATHADDER_CHROMA_REQUEST_SET_LED_COLOR = 0x0301
-};
+static const struct razer_chroma_cmd deathadder_chroma_cmds[] = {
+    [DEATHADDER_CHROMA_CMD_INIT] = {.request = 0x0004, .size = 0x02},
+    [DEATHADDER_CHROMA_CMD_SET_RESOLUTION] = {.request = 0x0405, .size = 0x07},
+    [DEATHADDER_CHROMA_CMD_GET_FIRMWARE] = {.request = 0x0087, .size = 0x04},
+    [DEATHADDER_CHROMA_CMD_GET_SERIAL_NO] = {.request = 0x0082, .size = 0x16},
+    [DEATHADDER_CHROMA_CMD_SET_FREQUENCY] = {.request = 0x0005, .size = 0x01},
+    [DEATHADDER_CHROMA_CMD_SET_LED_STATE] = {.request = 0x0300,
+					     .size = 0x03,
+					     .key_len = 2},
+    [DEATHADDER_CHROMA_CMD_SET_LED_MODE] = {.request = 0x0302,
+					    .size = 0x03,
+					    .key_len = 2},
+    [DEATHADDER_CHROMA_CMD_SET_LED_COLOR] = {.request = 0x0301,
+					     .size = 0x05,
+					     .key_len = 2}};
 
 enum deathadder_chroma_constants {
 	DEATHADDER_CHROMA_MAX_FREQUENCY = RAZER_MOUSE_FREQ_1000HZ,
@@ -95,17 +102,7 @@ enum deathadder_chroma_constants {
 	DEATHADDER_CHROMA_DPIMAPPINGS_NUM =
 	    ARRAY_SIZE(deathadder_chroma_resolution_stages_list),
 
-	DEATHADDER_CHROMA_USB_SETUP_PACKET_VALUE = 0x300,
-	DEATHADDER_CHROMA_SUCCESS_STATUS = 0x02,
-	DEATHADDER_CHROMA_PACKET_SPACING_MS = 35,
-
-	/*
-	 * Experiments suggest that the value in the 'magic' byte of the command
-	 * does not necessarily matter (e.g. the commands work when the 'magic'
-	 * byte equals 0x77). I chose to go with the value used by the Synapse
-	 * driver.
-	 */
-	DEATHADDER_CHROMA_MAGIC_BYTE = 0xFF,
+	DEATHADDER_CHROMA_SERIAL_NO_LEN = 0x16,
 
 	/*
 	 * These specific arg0 bytes are used by the Synapse driver for their
@@ -118,35 +115,6 @@ enum deathadder_chroma_constants {
 	DEATHADDER_CHROMA_RESOLUTION_ARG0 = 0x00
 };
 
-struct deathadder_chroma_command
-{
-	uint8_t status;
-	uint8_t magic;
-	uint8_t padding0[3];
-	uint8_t size;
-	be16_t request;
-
-	union
-	{
-		uint8_t bvalue[80];
-		struct
-		{
-			uint8_t padding1;
-			be16_t value[38];
-			uint8_t padding2;
-		} _packed;
-	} _packed;
-
-	uint8_t checksum;
-	uint8_t padding3;
-} _packed;
-
-#define DEATHADDER_CHROMA_COMMAND_INIT                                         \
-	(struct deathadder_chroma_command)                                     \
-	{                                                                      \
-		.magic = DEATHADDER_CHROMA_MAGIC_BYTE                          \
-	}
-
 struct deathadder_chroma_rgb_color
 {
 	uint8_t r;
@@ -164,7 +132,7 @@ struct deathadder_chroma_led
 
 struct deathadder_chroma_driver_data
 {
-	struct razer_event_spacing packet_spacing;
+	struct razer_chroma chroma;
 	struct razer_mouse_profile profile;
 	struct razer_mouse_dpimapping *current_dpimapping;
 	enum razer_mouse_freq current_freq;
@@ -174,18 +142,9 @@ struct deathadder_chroma_driver_data
 	    dpimappings[DEATHADDER_CHROMA_DPIMAPPINGS_NUM];
 	struct razer_axis axes[DEATHADDER_CHROMA_AXES_NUM];
 	uint16_t fw_version;
-	char serial[DEATHADDER_CHROMA_REQUEST_SIZE_GET_SERIAL_NO + 1];
+	char serial[DEATHADDER_CHROMA_SERIAL_NO_LEN + 1];
 };
 
-static uint8_t deathadder_chroma_checksum(struct deathadder_chroma_command *cmd)
-{
-	size_t control_size;
-
-	control_size = sizeof(cmd->size) + sizeof(cmd->request);
-	return razer_xor8_checksum((uint8_t *)&cmd->size,
-				   control_size + cmd->size);
-}
-
 static int deathadder_chroma_translate_frequency(enum razer_mouse_freq freq)
 {
 	switch (freq) {
@@ -202,101 +161,58 @@ static int deathadder_chroma_translate_frequency(enum razer_mouse_freq freq)
 	}
 }
 
-static int deathadder_chroma_usb_action(
-    struct razer_mouse *m, enum libusb_endpoint_direction direction,
-    enum libusb_standard_request request, uint16_t command,
-    struct deathadder_chroma_command *cmd)
+static void deathadder_chroma_report_init(struct razer_chroma_report *r,
+					  enum deathadder_chroma_cmd_id id)
+{
+	razer_chroma_report_init(r, &deathadder_chroma_cmds[id]);
+}
+
+static int deathadder_chroma_run(struct razer_mouse *m,
+				 struct razer_chroma_report *r)
 {
-	int err;
 	struct deathadder_chroma_driver_data *drv_data;
 
 	drv_data = m->drv_data;
-
-	razer_event_spacing_enter(&drv_data->packet_spacing);
-	err = libusb_control_transfer(m->usb_ctx->h,
-				      direction | LIBUSB_REQUEST_TYPE_CLASS |
-					  LIBUSB_RECIPIENT_INTERFACE,
-				      request, command, 0, (unsigned char *)cmd,
-				      sizeof(*cmd), RAZER_USB_TIMEOUT);
-	razer_event_spacing_leave(&drv_data->packet_spacing);
-
-	if (err != sizeof(*cmd)) {
-		razer_error("razer-deathadder-chroma: "
-			    "USB %s 0x%01X 0x%02X failed with %d\n",
-			    direction == LIBUSB_ENDPOINT_IN ? "read" : "write",
-			    request, command, err);
-		return err;
-	}
-
-	return 0;
+	return razer_chroma_run(&drv_data->chroma, r);
 }
 
-static int deathadder_chroma_send_command(struct razer_mouse *m,
-					  struct deathadder_chroma_command *cmd)
+static int deathadder_chroma_queue(struct razer_mouse *m,
+				   enum deathadder_chroma_cmd_id id,
+				   const struct razer_chroma_report *r)
 {
-	int err;
-	uint8_t checksum;
-
-	cmd->checksum = deathadder_chroma_checksum(cmd);
-	err = deathadder_chroma_usb_action(
-	    m, LIBUSB_ENDPOINT_OUT, LIBUSB_REQUEST_SET_CONFIGURATION,
-	    DEATHADDER_CHROMA_USB_SETUP_PACKET_VALUE, cmd);
-	if (err)
-		return err;
-
-	err = deathadder_chroma_usb_action(
-	    m, LIBUSB_ENDPOINT_IN, LIBUSB_REQUEST_CLEAR_FEATURE,
-	    DEATHADDER_CHROMA_USB_SETUP_PACKET_VALUE, cmd);
-	if (err)
-		return err;
-
-	checksum = deathadder_chroma_checksum(cmd);
-	if (checksum != cmd->checksum) {
-		razer_error("razer-deathadder-chroma: "
-			    "Command %02X %04X bad response checksum %02X "
-			    "(expected %02X)\n",
-			    cmd->size, be16_to_cpu(cmd->request), checksum,
-			    cmd->checksum);
-
-		return -EBADMSG;
-	}
-
-	if (cmd->status != DEATHADDER_CHROMA_SUCCESS_STATUS)
-		razer_error("razer-deathadder-chroma: "
-			    "Command %02X %04X failed with %02X\n",
-			    cmd->size, be16_to_cpu(cmd->request), cmd->status);
+	struct deathadder_chroma_driver_data *drv_data;
 
-	return 0;
+	drv_data = m->drv_data;
+	return razer_chroma_queue(&drv_data->chroma,
+				  &deathadder_chroma_cmds[id], r);
 }
 
 static int deathadder_chroma_send_init_command(struct razer_mouse *m)
 {
-	struct deathadder_chroma_command cmd;
+	struct razer_chroma_report cmd;
 
-	cmd = DEATHADDER_CHROMA_COMMAND_INIT;
-	cmd.size = DEATHADDER_CHROMA_REQUEST_SIZE_INIT;
-	cmd.request = cpu_to_be16(DEATHADDER_CHROMA_REQUEST_INIT);
+	deathadder_chroma_report_init(&cmd, DEATHADDER_CHROMA_CMD_INIT);
 	cmd.bvalue[0] = DEATHADDER_CHROMA_INIT_ARG0;
-	return deathadder_chroma_send_command(m, &cmd);
+	return deathadder_chroma_queue(m, DEATHADDER_CHROMA_CMD_INIT, &cmd);
 }
 
 static int deathadder_chroma_send_set_resolution_command(struct razer_mouse *m)
 {
 	enum razer_mouse_res res_x, res_y;
-	struct deathadder_chroma_command cmd;
+	struct razer_chroma_report cmd;
 	struct deathadder_chroma_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 	res_x = drv_data->current_dpimapping->res[RAZER_DIM_X];
 	res_y = drv_data->current_dpimapping->res[RAZER_DIM_Y];
 
-	cmd = DEATHADDER_CHROMA_COMMAND_INIT;
-	cmd.size = DEATHADDER_CHROMA_REQUEST_SIZE_SET_RESOLUTION;
-	cmd.request = cpu_to_be16(DEATHADDER_CHROMA_REQUEST_SET_RESOLUTION);
+	deathadder_chroma_report_init(&cmd,
+				      DEATHADDER_CHROMA_CMD_SET_RESOLUTION);
 	cmd.bvalue[0] = DEATHADDER_CHROMA_RESOLUTION_ARG0;
 	cmd.value[0] = cpu_to_be16(res_x);
 	cmd.value[1] = cpu_to_be16(res_y);
-	return deathadder_chroma_send_command(m, &cmd);
+	return deathadder_chroma_queue(m, DEATHADDER_CHROMA_CMD_SET_RESOLUTION,
+				       &cmd);
 }
 
 static int deathadder_chroma_send_get_firmware_command(struct razer_mouse *m)
@@ -304,16 +220,14 @@ static int deathadder_chroma_send_get_firmware_command(struct razer_mouse *m)
 	int err;
 	uint8_t fw_major;
 	uint16_t fw_minor;
-	struct deathadder_chroma_command cmd;
+	struct razer_chroma_report cmd;
 	struct deathadder_chroma_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 
-	cmd = DEATHADDER_CHROMA_COMMAND_INIT;
-	cmd.size = DEATHADDER_CHROMA_REQUEST_SIZE_GET_FIRMWARE;
-	cmd.request = cpu_to_be16(DEATHADDER_CHROMA_REQUEST_GET_FIRMWARE);
+	deathadder_chroma_report_init(&cmd, DEATHADDER_CHROMA_CMD_GET_FIRMWARE);
 
-	err = deathadder_chroma_send_command(m, &cmd);
+	err = deathadder_chroma_run(m, &cmd);
 	if (err)
 		return err;
 
@@ -327,22 +241,21 @@ static int deathadder_chroma_send_get_firmware_command(struct razer_mouse *m)
 static int deathadder_chroma_send_get_serial_no_command(struct razer_mouse *m)
 {
 	int err;
-	struct deathadder_chroma_command cmd;
+	struct razer_chroma_report cmd;
 	struct deathadder_chroma_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 
-	cmd = DEATHADDER_CHROMA_COMMAND_INIT;
-	cmd.size = DEATHADDER_CHROMA_REQUEST_SIZE_GET_SERIAL_NO;
-	cmd.request = cpu_to_be16(DEATHADDER_CHROMA_REQUEST_GET_SERIAL_NO);
+	deathadder_chroma_report_init(&cmd,
+				      DEATHADDER_CHROMA_CMD_GET_SERIAL_NO);
 
-	err = deathadder_chroma_send_command(m, &cmd);
+	err = deathadder_chroma_run(m, &cmd);
 	if (err)
 		return err;
 
 	strncpy(drv_data->serial, (const char *)cmd.bvalue,
-		DEATHADDER_CHROMA_REQUEST_SIZE_GET_SERIAL_NO);
-	drv_data->serial[DEATHADDER_CHROMA_REQUEST_SIZE_GET_SERIAL_NO] = '\0';
+		DEATHADDER_CHROMA_SERIAL_NO_LEN);
+	drv_data->serial[DEATHADDER_CHROMA_SERIAL_NO_LEN] = '\0';
 
 	return 0;
 }
@@ -350,20 +263,20 @@ static int deathadder_chroma_send_get_serial_no_command(struct razer_mouse *m)
 static int deathadder_chroma_send_set_frequency_command(struct razer_mouse *m)
 {
 	int tfreq;
-	struct deathadder_chroma_command cmd;
+	struct razer_chroma_report cmd;
 	struct deathadder_chroma_driver_data *drv_data;
 
 	drv_data = m->drv_data;
-	cmd = DEATHADDER_CHROMA_COMMAND_INIT;
 
 	tfreq = deathadder_chroma_translate_frequency(drv_data->current_freq);
 	if (tfreq < 0)
 		return tfreq;
 
-	cmd.size = DEATHADDER_CHROMA_REQUEST_SIZE_SET_FREQUENCY;
-	cmd.request = cpu_to_be16(DEATHADDER_CHROMA_REQUEST_SET_FREQUENCY);
+	deathadder_chroma_report_init(&cmd,
+				      DEATHADDER_CHROMA_CMD_SET_FREQUENCY);
 	cmd.bvalue[0] = tfreq;
-	return deathadder_chroma_send_command(m, &cmd);
+	return deathadder_chroma_queue(m, DEATHADDER_CHROMA_CMD_SET_FREQUENCY,
+				       &cmd);
 }
 
 static struct deathadder_chroma_led *
@@ -384,47 +297,88 @@ static int
 deathadder_chroma_send_set_led_state_command(struct razer_mouse *m,
 					     struct deathadder_chroma_led *led)
 {
-	struct deathadder_chroma_command cmd;
+	struct razer_chroma_report cmd;
 
-	cmd = DEATHADDER_CHROMA_COMMAND_INIT;
-	cmd.size = DEATHADDER_CHROMA_REQUEST_SIZE_SET_LED_STATE;
-	cmd.request = cpu_to_be16(DEATHADDER_CHROMA_REQUEST_SET_LED_STATE);
+	deathadder_chroma_report_init(&cmd,
+				      DEATHADDER_CHROMA_CMD_SET_LED_STATE);
 	cmd.bvalue[0] = DEATHADDER_CHROMA_LED_ARG0;
 	cmd.bvalue[1] = led->id;
 	cmd.bvalue[2] = led->state;
-	return deathadder_chroma_send_command(m, &cmd);
+	return deathadder_chroma_queue(m, DEATHADDER_CHROMA_CMD_SET_LED_STATE,
+				       &cmd);
 }
 
 static int
 deathadder_chroma_send_set_led_mode_command(struct razer_mouse *m,
 					    struct deathadder_chroma_led *led)
 {
-	struct deathadder_chroma_command cmd;
+	struct razer_chroma_report cmd;
 
-	cmd = DEATHADDER_CHROMA_COMMAND_INIT;
-	cmd.size = DEATHADDER_CHROMA_REQUEST_SIZE_SET_LED_MODE;
-	cmd.request = cpu_to_be16(DEATHADDER_CHROMA_REQUEST_SET_LED_MODE);
+	deathadder_chroma_report_init(&cmd, DEATHADDER_CHROMA_CMD_SET_LED_MODE);
 	cmd.bvalue[0] = DEATHADDER_CHROMA_LED_ARG0;
 	cmd.bvalue[1] = led->id;
 	cmd.bvalue[2] = led->mode;
-	return deathadder_chroma_send_command(m, &cmd);
+	return deathadder_chroma_queue(m, DEATHADDER_CHROMA_CMD_SET_LED_MODE,
+				       &cmd);
 }
 
 static int
 deathadder_chroma_send_set_led_color_command(struct razer_mouse *m,
 					     struct deathadder_chroma_led *led)
 {
-	struct deathadder_chroma_command cmd;
+	struct razer_chroma_report cmd;
 
-	cmd = DEATHADDER_CHROMA_COMMAND_INIT;
-	cmd.size = DEATHADDER_CHROMA_REQUEST_SIZE_SET_LED_COLOR;
-	cmd.request = cpu_to_be16(DEATHADDER_CHROMA_REQUEST_SET_LED_COLOR);
+	deathadder_chroma_report_init(&cmd,
+				      DEATHADDER_CHROMA_CMD_SET_LED_COLOR);
 	cmd.bvalue[0] = DEATHADDER_CHROMA_LED_ARG0;
 	cmd.bvalue[1] = led->id;
 	cmd.bvalue[2] = led->color.r;
 	cmd.bvalue[3] = led->color.g;
 	cmd.bvalue[4] = led->color.b;
-	return deathadder_chroma_send_command(m, &cmd);
+	return deathadder_chroma_queue(m, DEATHADDER_CHROMA_CMD_SET_LED_COLOR,
+				       &cmd);
+}
+
+static int deathadder_chroma_queue_settings(struct razer_mouse *m)
+{
+	int err;
+	struct deathadder_chroma_driver_data *drv_data;
+	struct deathadder_chroma_led *scroll_led, *logo_led;
+
+	drv_data = m->drv_data;
+	scroll_led = &drv_data->scroll_led;
+	logo_led = &drv_data->logo_led;
+
+	if ((err = deathadder_chroma_send_set_resolution_command(m)) ||
+	    (err = deathadder_chroma_send_set_frequency_command(m)) ||
+	    (err =
+		 deathadder_chroma_send_set_led_state_command(m, scroll_led)) ||
+	    (err =
+		 deathadder_chroma_send_set_led_mode_command(m, scroll_led)) ||
+	    (err =
+		 deathadder_chroma_send_set_led_color_command(m, scroll_led)) ||
+	    (err = deathadder_chroma_send_set_led_state_command(m, logo_led)) ||
+	    (err = deathadder_chroma_send_set_led_mode_command(m, logo_led)) ||
+	    (err = deathadder_chroma_send_set_led_color_command(m, logo_led)))
+		return err;
+
+	return 0;
+}
+
+static int deathadder_chroma_commit(struct razer_mouse *m, int force)
+{
+	int err;
+	struct deathadder_chroma_driver_data *drv_data;
+
+	drv_data = m->drv_data;
+
+	if (force) {
+		err = deathadder_chroma_queue_settings(m);
+		if (err)
+			return err;
+	}
+
+	return razer_chroma_flush(&drv_data->chroma);
 }
 
 static int deathadder_chroma_get_fw_version(struct razer_mouse *m)
@@ -467,33 +421,20 @@ deathadder_chroma_supported_dpimappings(struct razer_mouse *m,
 
 static int
 deathadder_chroma_supported_resolutions(struct razer_mouse *m,
-					enum razer_mouse_res **res_ptr)
+					const enum razer_mouse_res **res_ptr)
 {
-	size_t i;
-	size_t step_number;
-
-	step_number = DEATHADDER_CHROMA_MAX_RESOLUTION /
-		      DEATHADDER_CHROMA_RESOLUTION_STEP;
-
-	*res_ptr = calloc(step_number, sizeof(enum razer_mouse_res));
-	if (!*res_ptr)
-		return -ENOMEM;
-
-	for (i = 0; i < step_number; ++i)
-		(*res_ptr)[i] = (i + 1) * DEATHADDER_CHROMA_RESOLUTION_STEP;
+	BUILD_BUG_ON(DEATHADDER_CHROMA_MAX_RESOLUTION /
+		     DEATHADDER_CHROMA_RESOLUTION_STEP > RAZER_NR_RES_STEPS_100DPI);
 
-	return step_number;
+	*res_ptr = razer_res_steps_100dpi;
+	return DEATHADDER_CHROMA_MAX_RESOLUTION /
+	       DEATHADDER_CHROMA_RESOLUTION_STEP;
 }
 
 static int deathadder_chroma_supported_freqs(struct razer_mouse *m,
-					     enum razer_mouse_freq **res_ptr)
+					     const enum razer_mouse_freq **res_ptr)
 {
-	*res_ptr = malloc(sizeof(deathadder_chroma_freqs_list));
-	if (!*res_ptr)
-		return -ENOMEM;
-
-	memcpy(*res_ptr, deathadder_chroma_freqs_list,
-	       sizeof(deathadder_chroma_freqs_list));
+	*res_ptr = deathadder_chroma_freqs_list;
 	return DEATHADDER_CHROMA_SUPPORTED_FREQ_NUM;
 }
 
@@ -743,22 +684,17 @@ static int deathadder_chroma_get_leds(struct razer_mouse *m,
 	return DEATHADDER_CHROMA_LED_NUM;
 }
 
-int razer_deathadder_chroma_init(struct razer_mouse *m,
-				 struct libusb_device *usbdev)
+int razer_deathadder_chroma_init(struct razer_mouse *m)
 {
 	int err;
 	size_t i;
 	struct deathadder_chroma_driver_data *drv_data;
-	struct deathadder_chroma_led *scroll_led, *logo_led;
-
-	BUILD_BUG_ON(sizeof(struct deathadder_chroma_command) != 90);
 
 	drv_data = zalloc(sizeof(*drv_data));
 	if (!drv_data)
 		return -ENOMEM;
 
-	razer_event_spacing_init(&drv_data->packet_spacing,
-				 DEATHADDER_CHROMA_PACKET_SPACING_MS);
+	razer_chroma_init(&drv_data->chroma, m, "razer-deathadder-chroma");
 
 	for (i = 0; i < DEATHADDER_CHROMA_DPIMAPPINGS_NUM; ++i) {
 		drv_data->dpimappings[i] = (struct razer_mouse_dpimapping){
@@ -792,6 +728,7 @@ int razer_deathadder_chroma_init(struct razer_mouse *m,
 			0);
 
 	m->drv_data = drv_data;
+	m->commit = deathadder_chroma_commit;
 
 	if ((err = razer_usb_add_used_interface(m->usb_ctx, 0, 0)) ||
 	    (err = m->claim(m))) {
@@ -799,23 +736,12 @@ int razer_deathadder_chroma_init(struct razer_mouse *m,
 		return err;
 	}
 
-	scroll_led = &drv_data->scroll_led;
-	logo_led = &drv_data->logo_led;
-
+	/* The initial settings stay queued. The initial configuration
+	 * overrides them and commits them in one go. */
 	if ((err = deathadder_chroma_send_init_command(m)) ||
-	    (err = deathadder_chroma_send_set_resolution_command(m)) ||
 	    (err = deathadder_chroma_send_get_firmware_command(m)) ||
 	    (err = deathadder_chroma_send_get_serial_no_command(m)) ||
-	    (err = deathadder_chroma_send_set_frequency_command(m)) ||
-	    (err =
-		 deathadder_chroma_send_set_led_state_command(m, scroll_led)) ||
-	    (err =
-		 deathadder_chroma_send_set_led_mode_command(m, scroll_led)) ||
-	    (err =
-		 deathadder_chroma_send_set_led_color_command(m, scroll_led)) ||
-	    (err = deathadder_chroma_send_set_led_state_command(m, logo_led)) ||
-	    (err = deathadder_chroma_send_set_led_mode_command(m, logo_led)) ||
-	    (err = deathadder_chroma_send_set_led_color_command(m, logo_led))) {
+	    (err = deathadder_chroma_queue_settings(m))) {
 		m->release(m);
 		free(drv_data);
 		return err;
@@ -830,8 +756,7 @@ int razer_deathadder_chroma_init(struct razer_mouse *m,
 	    .get_dpimapping = deathadder_chroma_get_dpimapping,
 	    .set_dpimapping = deathadder_chroma_set_dpimapping};
 
-	razer_generic_usb_gen_idstr(usbdev, m->usb_ctx->h,
-				    DEATHADDER_CHROMA_DEVICE_NAME, false,
+	razer_generic_usb_gen_idstr(m->usb_ctx, DEATHADDER_CHROMA_DEVICE_NAME, false,
 				    drv_data->serial, m->idstr);
 
 	m->type = RAZER_MOUSETYPE_DEATHADDER;
@@ -20,6 +20,7 @@
 
 #include "hw_diamondback_chroma.h"
 #include "razer_private.h"
+#include "chroma.h"
 
 #include <errno.h>
 #include <stdlib.h>
@@ -27,7 +28,7 @@
 #include <stdint.h>
 #include <string.h>
 
-static enum razer_mouse_freq diamondback_chroma_freqs_list[] =
+static const enum razer_mouse_freq diamondback_chroma_freqs_list[] =
 {
 	RAZER_MOUSE_FREQ_125HZ,
 	RAZER_MOUSE_FREQ_500HZ,
@@ -74,6 +75,16 @@ enum diamondback_chroma_led_state_option
 	DIAMONDBACK_CHROMA_LED_STATE_OPTION_3		= 0x03,
 };
 
+enum diamondback_chroma_cmd_id
+{
+	DIAMONDBACK_CHROMA_CMD_INIT,
+	DIAMONDBACK_CHROMA_CMD_SET_RESOLUTION,
+	DIAMONDBACK_CHROMA_CMD_GET_FIRMWARE,
+	DIAMONDBACK_CHROMA_CMD_GET_SERIAL_NO,
+	DIAMONDBACK_CHROMA_CMD_SET_FREQUENCY,
+	DIAMONDBACK_CHROMA_CMD_SET_LED,
+};
+
 /*
  * The 6th byte of Diamondback Chroma's command seems also to be the size of arguments
  * (size of arguments to read in case of read operations). It's not necessarily
@@ -81,30 +92,17 @@ enum diamondback_chroma_led_state_option
  * of the arguments). But when it's in customized mode, there will be 0x32 which is 50 bytes of information
  * Experiments suggest that the value given in the 'size' byte does not matter.
  * I chose to go with the values used by the Synapse driver.
+ * The LED state, mode and color are set by the same request.
+ * Request 0x030c with size 0x32 sets the customized mode colors.
  */
-enum diamondback_chroma_request_size
-{
-	DIAMONDBACK_CHROMA_REQUEST_SIZE_INIT		= 0x02,
-	DIAMONDBACK_CHROMA_REQUEST_SIZE_SET_RESOLUTION	= 0x07,
-	DIAMONDBACK_CHROMA_REQUEST_SIZE_GET_FIRMWARE	= 0x04,
-	DIAMONDBACK_CHROMA_REQUEST_SIZE_GET_SERIAL_NO	= 0x16,
-	DIAMONDBACK_CHROMA_REQUEST_SIZE_SET_FREQUENCY	= 0x01,
-	DIAMONDBACK_CHROMA_REQUEST_SIZE_SET_LED_STATE	= 0x08,
-	DIAMONDBACK_CHROMA_REQUEST_SIZE_SET_LED_MODE	= 0x08,
-	DIAMONDBACK_CHROMA_REQUEST_SIZE_SET_LED_COLOR	= 0x08,
-};
-
-enum diamondback_chroma_request
-{
-	DIAMONDBACK_CHROMA_REQUEST_INIT			= 0x0004,
-	DIAMONDBACK_CHROMA_REQUEST_SET_RESOLUTION		= 0x0405,
-	DIAMONDBACK_CHROMA_REQUEST_GET_FIRMWARE		= 0x0087,
-	DIAMONDBACK_CHROMA_REQUEST_GET_SERIAL_NO		= 0x0082,
-	DIAMONDBACK_CHROMA_REQUEST_SET_FREQUENCY		= 0x0005,
-	DIAMONDBACK_CHROMA_REQUEST_SET_LED_STATE		= 0x030a,
-	DIAMONDBACK_CHROMA_REQUEST_SET_LED_COLOR		= 0x030a,
-	DIAMONDBACK_CHROMA_REQUEST_SET_LED_MODE		= 0x030a,
-	DIAMONDBACK_CHROMA_REQUEST_SET_LED_MODE_CUSTOMIZED = 0x030c, // for further implementation
+static const struct razer_chroma_cmd diamondback_chroma_cmds[] =
+{
+	[DIAMONDBACK_CHROMA_CMD_INIT]		= { .request = 0x0004, .size = 0x02, },
+	[DIAMONDBACK_CHROMA_CMD_SET_RESOLUTION]	= { .request = 0x0405, .size = 0x07, },
+	[DIAMONDBACK_CHROMA_CMD_GET_FIRMWARE]	= { .request = 0x0087, .size = 0x04, },
+	[DIAMONDBACK_CHROMA_CMD_GET_SERIAL_NO]	= { .request = 0x0082, .size = 0x16, },
+	[DIAMONDBACK_CHROMA_CMD_SET_FREQUENCY]	= { .request = 0x0005, .size = 0x01, },
+	[DIAMONDBACK_CHROMA_CMD_SET_LED]		= { .request = 0x030a, .size = 0x08, },
 };
 
 enum diamondback_chroma_constants
@@ -118,17 +116,7 @@ enum diamondback_chroma_constants
 	DIAMONDBACK_CHROMA_SUPPORTED_FREQ_NUM		= ARRAY_SIZE(diamondback_chroma_freqs_list),
 	DIAMONDBACK_CHROMA_DPIMAPPINGS_NUM		= ARRAY_SIZE(diamondback_chroma_resolution_stages_list),
 
-	DIAMONDBACK_CHROMA_USB_SETUP_PACKET_VALUE		= 0x300,
-	DIAMONDBACK_CHROMA_SUCCESS_STATUS			= 0x02,
-	DIAMONDBACK_CHROMA_PACKET_SPACING_MS		= 35,
-
-	/*
-	 * Experiments suggest that the value in the 'magic' byte of the command
-	 * does not necessarily matter (e.g. the commands work when the 'magic'
-	 * byte equals 0x77). I chose to go with the value used by the Synapse
-	 * driver.
-	 */
-	DIAMONDBACK_CHROMA_MAGIC_BYTE			= 0xFF,
+	DIAMONDBACK_CHROMA_SERIAL_NO_LEN			= 0x16,
 
 	/*
 	 * These specific arg0 bytes are used by the Synapse driver for their
@@ -141,35 +129,6 @@ enum diamondback_chroma_constants
 	DIAMONDBACK_CHROMA_RESOLUTION_ARG0		= 0x01,
 };
 
-struct diamondback_chroma_command
-{
-	uint8_t status;
-	uint8_t magic;
-	uint8_t padding0[3];
-	uint8_t size;
-	be16_t request;
-
-	union
-	{
-		uint8_t bvalue[80];
-		struct
-		{
-			uint8_t padding1;
-			be16_t value[38];
-			uint8_t padding2;
-		}_packed;
-	}_packed;
-
-	uint8_t checksum;
-	uint8_t padding3;
-}_packed;
-
-#define DIAMONDBACK_CHROMA_COMMAND_INIT			\
-	(struct diamondback_chroma_command)		\
-	{					\
-		.magic = DIAMONDBACK_CHROMA_MAGIC_BYTE	\
-	}
-
 struct diamondback_chroma_rgb_color
 {
 	uint8_t r;
@@ -187,7 +146,7 @@ struct diamondback_chroma_led
 
 struct diamondback_chroma_driver_data
 {
-	struct razer_event_spacing packet_spacing;
+	struct razer_chroma chroma;
 	struct razer_mouse_profile profile;
 	struct razer_mouse_dpimapping *current_dpimapping;
 	enum razer_mouse_freq current_freq;
@@ -195,17 +154,9 @@ struct diamondback_chroma_driver_data
 	struct razer_mouse_dpimapping dpimappings[DIAMONDBACK_CHROMA_DPIMAPPINGS_NUM];
 	struct razer_axis axes[DIAMONDBACK_CHROMA_AXES_NUM];
 	uint16_t fw_version;
-	char serial[DIAMONDBACK_CHROMA_REQUEST_SIZE_GET_SERIAL_NO + 1];
+	char serial[DIAMONDBACK_CHROMA_SERIAL_NO_LEN + 1];
 };
 
-static uint8_t diamondback_chroma_checksum(struct diamondback_chroma_command *cmd)
-{
-	size_t control_size;
-
-	control_size = sizeof(cmd->size) + sizeof(cmd->request);
-	return razer_xor8_checksum((uint8_t *)&cmd->size, control_size + cmd->size);
-}
-
 static int diamondback_chroma_translate_frequency(enum razer_mouse_freq freq)
 {
 	switch (freq) {
@@ -221,104 +172,59 @@ static int diamondback_chroma_translate_frequency(enum razer_mouse_freq freq)
 	}
 }
 
-static int diamondback_chroma_usb_action(struct razer_mouse *m,
-			       enum libusb_endpoint_direction direction,
-			       enum libusb_standard_request request,
-			       uint16_t command,
-			       struct diamondback_chroma_command *cmd)
+static void diamondback_chroma_report_init(struct razer_chroma_report *r,
+					   enum diamondback_chroma_cmd_id id)
+{
+	razer_chroma_report_init(r, &diamondback_chroma_cmds[id]);
+}
+
+static int diamondback_chroma_run(struct razer_mouse *m,
+				  struct razer_chroma_report *r)
 {
-	int err;
 	struct diamondback_chroma_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 
-	razer_event_spacing_enter(&drv_data->packet_spacing);
-	err = libusb_control_transfer(m->usb_ctx->h,
-				      direction |
-				      LIBUSB_REQUEST_TYPE_CLASS |
-				      LIBUSB_RECIPIENT_INTERFACE,
-				      request, command, 0,
-				      (unsigned char *)cmd, sizeof(*cmd),
-				      RAZER_USB_TIMEOUT);
-	razer_event_spacing_leave(&drv_data->packet_spacing);
-	if (err != sizeof(*cmd)) {
-		razer_error("razer-diamondback-chroma: "
-			    "USB %s 0x%01X 0x%02X failed with %d\n",
-			    direction == LIBUSB_ENDPOINT_IN ? "read" : "write",
-			    request, command, err);
-		return err;
-	}
-
-	return 0;
+	return razer_chroma_run(&drv_data->chroma, r);
 }
 
-static int diamondback_chroma_send_command(struct razer_mouse *m,
-				 struct diamondback_chroma_command *cmd)
+static int diamondback_chroma_queue(struct razer_mouse *m,
+				    enum diamondback_chroma_cmd_id id,
+				    const struct razer_chroma_report *r)
 {
-	int err;
-	uint8_t checksum;
-
-	cmd->checksum = diamondback_chroma_checksum(cmd);
-	err = diamondback_chroma_usb_action(m, LIBUSB_ENDPOINT_OUT,
-				  LIBUSB_REQUEST_SET_CONFIGURATION,
-				  DIAMONDBACK_CHROMA_USB_SETUP_PACKET_VALUE, cmd);
-	if (err)
-		return err;
-	err = diamondback_chroma_usb_action(m, LIBUSB_ENDPOINT_IN,
-				  LIBUSB_REQUEST_CLEAR_FEATURE,
-				  DIAMONDBACK_CHROMA_USB_SETUP_PACKET_VALUE, cmd);
-	if (err)
-		return err;
-
-	checksum = diamondback_chroma_checksum (cmd);
-	if (checksum != cmd->checksum) {
-		razer_error("razer-diamondback-chroma: "
-			    "Command %02X %04X bad response checksum %02X "
-			    "(expected %02X)\n",
-			    cmd->size, be16_to_cpu(cmd->request),
-			    checksum, cmd->checksum);
-		return -EBADMSG;
-	}
+	struct diamondback_chroma_driver_data *drv_data;
 
-	if (cmd->status != DIAMONDBACK_CHROMA_SUCCESS_STATUS) {
-		razer_error("razer-diamondback-chroma: "
-			    "Command %02X %04X failed with %02X\n",
-			    cmd->size, be16_to_cpu(cmd->request), cmd->status);
-	}
+	drv_data = m->drv_data;
 
-	return 0;
+	return razer_chroma_queue(&drv_data->chroma, &diamondback_chroma_cmds[id], r);
 }
 
 static int diamondback_chroma_send_init_command(struct razer_mouse *m)
 {
-	struct diamondback_chroma_command cmd;
+	struct razer_chroma_report cmd;
 
-	cmd = DIAMONDBACK_CHROMA_COMMAND_INIT;
-	cmd.size = DIAMONDBACK_CHROMA_REQUEST_SIZE_INIT;
-	cmd.request = cpu_to_be16(DIAMONDBACK_CHROMA_REQUEST_INIT);
+	diamondback_chroma_report_init(&cmd, DIAMONDBACK_CHROMA_CMD_INIT);
 	cmd.bvalue[0] = DIAMONDBACK_CHROMA_INIT_ARG0;
 
-	return diamondback_chroma_send_command(m, &cmd);
+	return diamondback_chroma_queue(m, DIAMONDBACK_CHROMA_CMD_INIT, &cmd);
 }
 
 static int diamondback_chroma_send_set_resolution_command(struct razer_mouse *m)
 {
 	enum razer_mouse_res res_x, res_y;
-	struct diamondback_chroma_command cmd;
+	struct razer_chroma_report cmd;
 	struct diamondback_chroma_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 	res_x = drv_data->current_dpimapping->res[RAZER_DIM_X];
 	res_y = drv_data->current_dpimapping->res[RAZER_DIM_Y];
 
-	cmd = DIAMONDBACK_CHROMA_COMMAND_INIT;
-	cmd.size = DIAMONDBACK_CHROMA_REQUEST_SIZE_SET_RESOLUTION;
-	cmd.request = cpu_to_be16(DIAMONDBACK_CHROMA_REQUEST_SET_RESOLUTION);
+	diamondback_chroma_report_init(&cmd, DIAMONDBACK_CHROMA_CMD_SET_RESOLUTION);
 	cmd.bvalue[0] = DIAMONDBACK_CHROMA_RESOLUTION_ARG0;
 	cmd.value[0] = cpu_to_be16(res_x);
 	cmd.value[1] = cpu_to_be16(res_y);
 
-	return diamondback_chroma_send_command(m, &cmd);
+	return diamondback_chroma_queue(m, DIAMONDBACK_CHROMA_CMD_SET_RESOLUTION, &cmd);
 }
 
 static int diamondback_chroma_send_get_firmware_command(struct razer_mouse *m)
@@ -326,16 +232,14 @@ static int diamondback_chroma_send_get_firmware_command(struct razer_mouse *m)
 	int err;
 	uint8_t fw_major;
 	uint16_t fw_minor;
-	struct diamondback_chroma_command cmd;
+	struct razer_chroma_report cmd;
 	struct diamondback_chroma_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 
-	cmd = DIAMONDBACK_CHROMA_COMMAND_INIT;
-	cmd.size = DIAMONDBACK_CHROMA_REQUEST_SIZE_GET_FIRMWARE;
-	cmd.request = cpu_to_be16(DIAMONDBACK_CHROMA_REQUEST_GET_FIRMWARE);
+	diamondback_chroma_report_init(&cmd, DIAMONDBACK_CHROMA_CMD_GET_FIRMWARE);
 
-	err = diamondback_chroma_send_command(m, &cmd);
+	err = diamondback_chroma_run(m, &cmd);
 	if (err)
 		return err;
 
@@ -349,22 +253,20 @@ static int diamondback_chroma_send_get_firmware_command(struct razer_mouse *m)
 static int diamondback_chroma_send_get_serial_no_command(struct razer_mouse *m)
 {
 	int err;
-	struct diamondback_chroma_command cmd;
+	struct razer_chroma_report cmd;
 	struct diamondback_chroma_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 
-	cmd = DIAMONDBACK_CHROMA_COMMAND_INIT;
-	cmd.size = DIAMONDBACK_CHROMA_REQUEST_SIZE_GET_SERIAL_NO;
-	cmd.request = cpu_to_be16(DIAMONDBACK_CHROMA_REQUEST_GET_SERIAL_NO);
+	diamondback_chroma_report_init(&cmd, DIAMONDBACK_CHROMA_CMD_GET_SERIAL_NO);
 
-	err = diamondback_chroma_send_command(m, &cmd);
+	err = diamondback_chroma_run(m, &cmd);
 	if (err)
 		return err;
 
 	strncpy(drv_data->serial, (const char *)cmd.bvalue,
-		DIAMONDBACK_CHROMA_REQUEST_SIZE_GET_SERIAL_NO);
-	drv_data->serial[DIAMONDBACK_CHROMA_REQUEST_SIZE_GET_SERIAL_NO] = '\0';
+		DIAMONDBACK_CHROMA_SERIAL_NO_LEN);
+	drv_data->serial[DIAMONDBACK_CHROMA_SERIAL_NO_LEN] = '\0';
 
 	return 0;
 }
@@ -372,21 +274,19 @@ static int diamondback_chroma_send_get_serial_no_command(struct razer_mouse *m)
 static int diamondback_chroma_send_set_frequency_command(struct razer_mouse *m)
 {
 	int tfreq;
-	struct diamondback_chroma_command cmd;
+	struct razer_chroma_report cmd;
 	struct diamondback_chroma_driver_data *drv_data;
 
 	drv_data = m->drv_data;
-	cmd = DIAMONDBACK_CHROMA_COMMAND_INIT;
 
 	tfreq = diamondback_chroma_translate_frequency(drv_data->current_freq);
 	if (tfreq < 0)
 		return tfreq;
 
-	cmd.size = DIAMONDBACK_CHROMA_REQUEST_SIZE_SET_FREQUENCY;
-	cmd.request = cpu_to_be16(DIAMONDBACK_CHROMA_REQUEST_SET_FREQUENCY);
+	diamondback_chroma_report_init(&cmd, DIAMONDBACK_CHROMA_CMD_SET_FREQUENCY);
 	cmd.bvalue[0] = tfreq;
 
-	return diamondback_chroma_send_command(m, &cmd);
+	return diamondback_chroma_queue(m, DIAMONDBACK_CHROMA_CMD_SET_FREQUENCY, &cmd);
 }
 
 static struct diamondback_chroma_led *diamondback_chroma_get_led(struct diamondback_chroma_driver_data *d)
@@ -394,15 +294,13 @@ static struct diamondback_chroma_led *diamondback_chroma_get_led(struct diamondb
 	return &d->led;
 }
 
-static int diamondback_chroma_send_set_led_state_command(struct razer_mouse *m,
-					       struct diamondback_chroma_led *led)
+/* Set the LED state, mode and color. */
+static int diamondback_chroma_send_set_led_command(struct razer_mouse *m,
+						   struct diamondback_chroma_led *led)
 {
-	struct diamondback_chroma_command cmd;
-
-	cmd = DIAMONDBACK_CHROMA_COMMAND_INIT;
-	cmd.size = DIAMONDBACK_CHROMA_REQUEST_SIZE_SET_LED_STATE;
-	cmd.request = cpu_to_be16(DIAMONDBACK_CHROMA_REQUEST_SET_LED_STATE);
+	struct razer_chroma_report cmd;
 
+	diamondback_chroma_report_init(&cmd, DIAMONDBACK_CHROMA_CMD_SET_LED);
 	if (led->mode == DIAMONDBACK_CHROMA_LED_MODE_STATIC) {
 		cmd.bvalue[0] = led->mode;
 		cmd.bvalue[1] = led->color.r;
@@ -424,71 +322,38 @@ static int diamondback_chroma_send_set_led_state_command(struct razer_mouse *m,
 	cmd.bvalue[0] &= led->state;
 	cmd.bvalue[1] &= led->state;
 
-	return diamondback_chroma_send_command(m, &cmd);
+	return diamondback_chroma_queue(m, DIAMONDBACK_CHROMA_CMD_SET_LED, &cmd);
 }
 
-static int diamondback_chroma_send_set_led_mode_command(struct razer_mouse *m,
-					      struct diamondback_chroma_led *led)
+static int diamondback_chroma_queue_settings(struct razer_mouse *m)
 {
-	struct diamondback_chroma_command cmd;
+	int err;
+	struct diamondback_chroma_driver_data *drv_data;
 
-	cmd = DIAMONDBACK_CHROMA_COMMAND_INIT;
-	cmd.size = DIAMONDBACK_CHROMA_REQUEST_SIZE_SET_LED_MODE;
-	cmd.request = cpu_to_be16(DIAMONDBACK_CHROMA_REQUEST_SET_LED_MODE);
-	if (led->mode == DIAMONDBACK_CHROMA_LED_MODE_STATIC) {
-		cmd.bvalue[0] = led->mode;
-		cmd.bvalue[1] = led->color.r;
-		cmd.bvalue[2] = led->color.g;
-		cmd.bvalue[3] = led->color.b;
-	} else {
-		uint16_t tempHex;
-		uint8_t tempH, tempL;
+	drv_data = m->drv_data;
 
-		tempHex = led->mode;
-		tempH = (uint8_t)((tempHex & 0xFF00) >> 8);
-		tempL = (uint8_t)(tempHex & 0x00FF);
-		cmd.bvalue[0] = tempH;
-		cmd.bvalue[1] = tempL;
-		cmd.bvalue[2] = led->color.r;
-		cmd.bvalue[3] = led->color.g;
-		cmd.bvalue[4] = led->color.b;
-	}
-	cmd.bvalue[0] &= led->state;
-	cmd.bvalue[1] &= led->state;
+	if ((err = diamondback_chroma_send_set_resolution_command(m)) ||
+	    (err = diamondback_chroma_send_set_frequency_command(m)) ||
+	    (err = diamondback_chroma_send_set_led_command(m, &drv_data->led)))
+		return err;
 
-	return diamondback_chroma_send_command(m, &cmd);
+	return 0;
 }
 
-static int diamondback_chroma_send_set_led_color_command(struct razer_mouse *m,
-					       struct diamondback_chroma_led *led)
+static int diamondback_chroma_commit(struct razer_mouse *m, int force)
 {
-	struct diamondback_chroma_command cmd;
+	int err;
+	struct diamondback_chroma_driver_data *drv_data;
 
-	cmd = DIAMONDBACK_CHROMA_COMMAND_INIT;
-	cmd.size = DIAMONDBACK_CHROMA_REQUEST_SIZE_SET_LED_COLOR;
-	cmd.request = cpu_to_be16(DIAMONDBACK_CHROMA_REQUEST_SET_LED_COLOR);
-	if (led->mode == DIAMONDBACK_CHROMA_LED_MODE_STATIC) {
-		cmd.bvalue[0] = led->mode;
-		cmd.bvalue[1] = led->color.r;
-		cmd.bvalue[2] = led->color.g;
-		cmd.bvalue[3] = led->color.b;
-	} else {
-		uint16_t tempHex;
-		uint8_t tempH, tempL;
+	drv_data = m->drv_data;
 
-		tempHex = led->mode;
-		tempH = (uint8_t)((tempHex & 0xFF00) >> 8);
-		tempL = (uint8_t)(tempHex & 0x00FF);
-		cmd.bvalue[0] = tempH;
-		cmd.bvalue[1] = tempL;
-		cmd.bvalue[2] = led->color.r;
-		cmd.bvalue[3] = led->color.g;
-		cmd.bvalue[4] = led->color.b;
+	if (force) {
+		err = diamondback_chroma_queue_settings(m);
+		if (err)
+			return err;
 	}
-	cmd.bvalue[0] &= led->state;
-	cmd.bvalue[1] &= led->state;
 
-	return diamondback_chroma_send_command(m, &cmd);
+	return razer_chroma_flush(&drv_data->chroma);
 }
 
 static int diamondback_chroma_get_fw_version(struct razer_mouse *m)
@@ -532,29 +397,20 @@ static int diamondback_chroma_supported_dpimappings(struct razer_mouse *m,
 }
 
 static int diamondback_chroma_supported_resolutions(struct razer_mouse *m,
-					  enum razer_mouse_res **res_ptr)
+					  const enum razer_mouse_res **res_ptr)
 {
-	size_t i;
-	size_t step_number;
+	BUILD_BUG_ON(DIAMONDBACK_CHROMA_MAX_RESOLUTION / DIAMONDBACK_CHROMA_RESOLUTION_STEP >
+		     RAZER_NR_RES_STEPS_100DPI);
 
-	step_number = DIAMONDBACK_CHROMA_MAX_RESOLUTION / DIAMONDBACK_CHROMA_RESOLUTION_STEP;
+	*res_ptr = razer_res_steps_100dpi;
 
-	*res_ptr = calloc(step_number, sizeof(enum razer_mouse_res));
-	if (!*res_ptr)
-		return -ENOMEM;
-	for (i = 0; i < step_number; i++)
-		(*res_ptr)[i] = (i + 1) * DIAMONDBACK_CHROMA_RESOLUTION_STEP;
-
-	return step_number;
+	return DIAMONDBACK_CHROMA_MAX_RESOLUTION / DIAMONDBACK_CHROMA_RESOLUTION_STEP;
 }
 
 static int diamondback_chroma_supported_freqs(struct razer_mouse *m,
-				    enum razer_mouse_freq **res_ptr)
+				    const enum razer_mouse_freq **res_ptr)
 {
-	*res_ptr = malloc(sizeof(diamondback_chroma_freqs_list));
-	if (!*res_ptr)
-		return -ENOMEM;
-	memcpy(*res_ptr, diamondback_chroma_freqs_list, sizeof(diamondback_chroma_freqs_list));
+	*res_ptr = diamondback_chroma_freqs_list;
 
 	return DIAMONDBACK_CHROMA_SUPPORTED_FREQ_NUM;
 }
@@ -623,7 +479,7 @@ static int diamondback_chroma_led_toggle_state(struct razer_led *led,
 		break;
 	}
 
-	return diamondback_chroma_send_set_led_state_command(led->u.mouse, priv_led);
+	return diamondback_chroma_send_set_led_command(led->u.mouse, priv_led);
 }
 
 static int diamondback_chroma_led_change_color(struct razer_led *led,
@@ -646,7 +502,7 @@ static int diamondback_chroma_led_change_color(struct razer_led *led,
 		.b = new_color->b,
 	};
 
-	return diamondback_chroma_send_set_led_color_command(led->u.mouse, priv_led);
+	return diamondback_chroma_send_set_led_command(led->u.mouse, priv_led);
 }
 
 static int diamondback_chroma_set_freq(struct razer_mouse_profile *p,
@@ -737,7 +593,7 @@ static int diamondback_chroma_led_set_mode(struct razer_led *led,
 		return err;
 	priv_led->mode = err;
 
-	return diamondback_chroma_send_set_led_mode_command(led->u.mouse, priv_led);
+	return diamondback_chroma_send_set_led_command(led->u.mouse, priv_led);
 }
 
 static int diamondback_chroma_get_leds(struct razer_mouse *m,
@@ -781,22 +637,17 @@ static int diamondback_chroma_get_leds(struct razer_mouse *m,
 	return DIAMONDBACK_CHROMA_LED_NUM;
 }
 
-int razer_diamondback_chroma_init(struct razer_mouse *m,
-			struct libusb_device *usbdev)
+int razer_diamondback_chroma_init(struct razer_mouse *m)
 {
 	int err;
 	size_t i;
 	struct diamondback_chroma_driver_data *drv_data;
-	struct diamondback_chroma_led *led;
-
-	BUILD_BUG_ON(sizeof(struct diamondback_chroma_command) != 90);
 
 	drv_data = zalloc(sizeof(*drv_data));
 	if (!drv_data)
 		return -ENOMEM;
 
-	razer_event_spacing_init(&drv_data->packet_spacing,
-				 DIAMONDBACK_CHROMA_PACKET_SPACING_MS);
+	razer_chroma_init(&drv_data->chroma, m, "razer-diamondback-chroma");
 
 	for (i = 0; i < DIAMONDBACK_CHROMA_DPIMAPPINGS_NUM; i++) {
 		drv_data->dpimappings[i] = (struct razer_mouse_dpimapping){
@@ -825,6 +676,7 @@ int razer_diamondback_chroma_init(struct razer_mouse *m,
 			"Scroll", 0, NULL, 0);
 
 	m->drv_data = drv_data;
+	m->commit = diamondback_chroma_commit;
 
 	if ((err = razer_usb_add_used_interface(m->usb_ctx, 0, 0)) ||
 	    (err = m->claim(m))) {
@@ -832,15 +684,12 @@ int razer_diamondback_chroma_init(struct razer_mouse *m,
 		return err;
 	}
 
-	led = &drv_data->led;
-
-	if ((err = diamondback_chroma_send_init_command (m)) ||
-	    (err = diamondback_chroma_send_set_resolution_command (m)) ||
-	    (err = diamondback_chroma_send_get_firmware_command (m)) ||
-	    (err = diamondback_chroma_send_get_serial_no_command (m)) ||
-	    (err = diamondback_chroma_send_set_frequency_command (m)) ||
-	    (err = diamondback_chroma_send_set_led_mode_command (m, led)) ||
-	    (err = diamondback_chroma_send_set_led_color_command (m, led))) {
+	/* The initial settings stay queued. The initial configuration
+	 * overrides them and commits them in one go. */
+	if ((err = diamondback_chroma_send_init_command(m)) ||
+	    (err = diamondback_chroma_send_get_firmware_command(m)) ||
+	    (err = diamondback_chroma_send_get_serial_no_command(m)) ||
+	    (err = diamondback_chroma_queue_settings(m))) {
 		m->release(m);
 		free(drv_data);
 		return err;
@@ -855,8 +704,7 @@ int razer_diamondback_chroma_init(struct razer_mouse *m,
 		.set_dpimapping = diamondback_chroma_set_dpimapping,
 	};
 
-	razer_generic_usb_gen_idstr(usbdev, m->usb_ctx->h,
-				    DIAMONDBACK_CHROMA_DEVICE_NAME, false,
+	razer_generic_usb_gen_idstr(m->usb_ctx, DIAMONDBACK_CHROMA_DEVICE_NAME, false,
 				    drv_data->serial, m->idstr);
 
 	m->type = RAZER_MOUSETYPE_DIAMONDBACK_CHROMA;
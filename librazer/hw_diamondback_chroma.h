@@ -3,8 +3,7 @@
 
 #include "razer_private.h"
 
-int razer_diamondback_chroma_init(struct razer_mouse *m,
-				 struct libusb_device *usbdev);
+int razer_diamondback_chroma_init(struct razer_mouse *m);
 
 void razer_diamondback_chroma_release(struct razer_mouse *m);
 
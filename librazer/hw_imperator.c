@@ -23,8 +23,7 @@
 #include "razer_private.h"
 
 
-int razer_imperator_init(struct razer_mouse *m,
-			 struct libusb_device *usbdev)
+int razer_imperator_init(struct razer_mouse *m)
 {
 	int err;
 
@@ -32,7 +31,7 @@ int razer_imperator_init(struct razer_mouse *m,
 	if (err)
 		return err;
 
-	razer_generic_usb_gen_idstr(usbdev, m->usb_ctx->h, "Imperator", 1,
+	razer_generic_usb_gen_idstr(m->usb_ctx, "Imperator", 1,
 				    razer_synapse_get_serial(m), m->idstr);
 
 	return 0;
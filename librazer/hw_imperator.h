@@ -4,8 +4,7 @@
 #include "razer_private.h"
 
 
-int razer_imperator_init(struct razer_mouse *m,
-			 struct libusb_device *udev);
+int razer_imperator_init(struct razer_mouse *m);
 void razer_imperator_release(struct razer_mouse *m);
 
 #endif /* RAZER_HW_IMPERATOR_H_ */
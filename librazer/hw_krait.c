@@ -45,8 +45,8 @@ static int krait_usb_write(struct krait_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, 0,
@@ -64,8 +64,8 @@ static int krait_usb_read(struct krait_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, 0,
@@ -116,22 +116,17 @@ static int krait_commit(struct razer_mouse *m, int force)
 	return err;
 }
 
+static const enum razer_mouse_res krait_resolutions[] = {
+	RAZER_MOUSE_RES_400DPI,
+	RAZER_MOUSE_RES_1600DPI,
+};
+
 static int krait_supported_resolutions(struct razer_mouse *m,
-				       enum razer_mouse_res **res_list)
+				       const enum razer_mouse_res **res_list)
 {
-	enum razer_mouse_res *list;
-	const int count = 2;
-
-	list = zalloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
-
-	list[0] = RAZER_MOUSE_RES_400DPI;
-	list[1] = RAZER_MOUSE_RES_1600DPI;
-
-	*res_list = list;
+	*res_list = krait_resolutions;
 
-	return count;
+	return ARRAY_SIZE(krait_resolutions);
 }
 
 static struct razer_mouse_profile * krait_get_profiles(struct razer_mouse *m)
@@ -174,8 +169,7 @@ static int krait_set_dpimapping(struct razer_mouse_profile *p,
 	return 0;
 }
 
-int razer_krait_init(struct razer_mouse *m,
-		     struct libusb_device *usbdev)
+int razer_krait_init(struct razer_mouse *m)
 {
 	struct krait_private *priv;
 	int err;
@@ -212,7 +206,7 @@ int razer_krait_init(struct razer_mouse *m,
 	priv->cur_dpimapping = &priv->dpimapping[1];
 
 	m->type = RAZER_MOUSETYPE_KRAIT;
-	razer_generic_usb_gen_idstr(usbdev, NULL, "Krait", 1,
+	razer_generic_usb_gen_idstr(m->usb_ctx, "Krait", 1,
 				    NULL, m->idstr);
 
 	m->commit = krait_commit;
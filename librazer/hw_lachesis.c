@@ -92,6 +92,16 @@ struct lachesis_buttons {
 };
 
 /* Context data structure */
+/* The settings as they are known to be on the device. */
+struct lachesis_hwstate {
+	unsigned int profile;
+	enum razer_led_state led_states[LACHESIS_NR_LEDS];
+	unsigned int dpisel[LACHESIS_NR_PROFILES];
+	enum razer_mouse_res dpimappings[LACHESIS_NR_DPIMAPPINGS];
+	enum razer_mouse_freq freq[LACHESIS_NR_PROFILES];
+	struct lachesis_buttons buttons[LACHESIS_NR_PROFILES];
+};
+
 struct lachesis_private {
 	struct razer_mouse *m;
 
@@ -119,6 +129,14 @@ struct lachesis_private {
 	/* The active button mapping; per profile. */
 	struct lachesis_buttons buttons[LACHESIS_NR_PROFILES];
 
+	/* The profiles that were read from the device.
+	 * The other profiles are read on first access. */
+	bool prof_loaded[LACHESIS_NR_PROFILES];
+
+	/* Used to skip commits that would not change anything. */
+	struct lachesis_hwstate hwstate;
+	bool hwstate_valid;
+
 	bool commit_pending;
 };
 
@@ -183,8 +201,8 @@ static int lachesis_usb_write(struct lachesis_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, index,
@@ -205,8 +223,8 @@ static int lachesis_usb_read(struct lachesis_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, index,
@@ -235,6 +253,38 @@ static int lachesis_read_devinfo(struct lachesis_private *priv)
 	return 0;
 }
 
+static void lachesis_get_global_hwstate(struct lachesis_private *priv,
+					struct lachesis_hwstate *state)
+{
+	unsigned int i;
+
+	state->profile = priv->cur_profile->nr;
+	for (i = 0; i < LACHESIS_NR_LEDS; i++)
+		state->led_states[i] = priv->led_states[i];
+	for (i = 0; i < LACHESIS_NR_DPIMAPPINGS; i++)
+		state->dpimappings[i] = priv->dpimappings[i].res[RAZER_DIM_0];
+}
+
+static void lachesis_get_profile_hwstate(struct lachesis_private *priv,
+					 unsigned int i,
+					 struct lachesis_hwstate *state)
+{
+	state->dpisel[i] = priv->cur_dpimapping[i]->nr;
+	state->freq[i] = priv->cur_freq[i];
+	state->buttons[i] = priv->buttons[i];
+}
+
+static void lachesis_get_hwstate(struct lachesis_private *priv,
+				 struct lachesis_hwstate *state)
+{
+	unsigned int i;
+
+	memset(state, 0, sizeof(*state));
+	lachesis_get_global_hwstate(priv, state);
+	for (i = 0; i < LACHESIS_NR_PROFILES; i++)
+		lachesis_get_profile_hwstate(priv, i, state);
+}
+
 static int lachesis_do_commit(struct lachesis_private *priv)
 {
 	unsigned int i;
@@ -314,13 +364,133 @@ static int lachesis_do_commit(struct lachesis_private *priv)
 	return 0;
 }
 
+static bool lachesis_all_profiles_loaded(struct lachesis_private *priv)
+{
+	unsigned int i;
+
+	for (i = 0; i < LACHESIS_NR_PROFILES; i++) {
+		if (!priv->prof_loaded[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Read the config of the profile that is selected on the device. */
+static int lachesis_read_profile(struct lachesis_private *priv, unsigned int i)
+{
+	struct lachesis_profcfg_cmd profcfg;
+	int err;
+
+	err = lachesis_usb_read(priv, LIBUSB_REQUEST_CLEAR_FEATURE,
+				0x03, 1, &profcfg, sizeof(profcfg));
+	if (err)
+		return err;
+	if (profcfg.dpisel < 1 || profcfg.dpisel > LACHESIS_NR_DPIMAPPINGS) {
+		razer_error("hw_lachesis: Got invalid DPI selection\n");
+		return -EIO;
+	}
+	razer_debug("hw_lachesis: Got profile config %d "
+		"(magic 0x%04X, prof %u, freq %u, dpisel %u)\n",
+		i + 1, profcfg.magic, profcfg.profile, profcfg.freq, profcfg.dpisel);
+	priv->cur_dpimapping[i] = &priv->dpimappings[profcfg.dpisel - 1];
+	switch (profcfg.freq) {
+	case 1:
+		priv->cur_freq[i] = RAZER_MOUSE_FREQ_1000HZ;
+		break;
+	case 2:
+		priv->cur_freq[i] = RAZER_MOUSE_FREQ_500HZ;
+		break;
+	case 3:
+		priv->cur_freq[i] = RAZER_MOUSE_FREQ_125HZ;
+		break;
+	default:
+		razer_error("hw_lachesis: "
+			"Read invalid frequency value from device (%u)\n",
+			profcfg.freq);
+		return -EINVAL;
+	}
+	err = razer_parse_buttonmap(profcfg.buttonmap, sizeof(profcfg.buttonmap),
+				    priv->buttons[i].mapping,
+				    ARRAY_SIZE(priv->buttons[i].mapping), 33);
+	if (err)
+		return err;
+
+	priv->prof_loaded[i] = 1;
+	lachesis_get_profile_hwstate(priv, i, &priv->hwstate);
+	/* The hwstate is complete with the last profile. */
+	priv->hwstate_valid = lachesis_all_profiles_loaded(priv);
+
+	return 0;
+}
+
+/* Select a profile on the device for reading its config. */
+static int lachesis_select_profile(struct lachesis_private *priv, unsigned int i)
+{
+	unsigned char value = i + 1;
+
+	return lachesis_usb_write(priv, LIBUSB_REQUEST_SET_CONFIGURATION,
+				  0x08, 0, &value, sizeof(value));
+}
+
+/* Read all profiles, that were not read, yet. The device must be claimed. */
+static int lachesis_load_profiles(struct lachesis_private *priv)
+{
+	unsigned int i;
+	int err;
+
+	if (lachesis_all_profiles_loaded(priv))
+		return 0;
+	for (i = 0; i < LACHESIS_NR_PROFILES; i++) {
+		if (priv->prof_loaded[i])
+			continue;
+		/* Change to the profile */
+		err = lachesis_select_profile(priv, i);
+		if (err)
+			return err;
+		/* And read the profile config */
+		err = lachesis_read_profile(priv, i);
+		if (err)
+			return err;
+	}
+	/* Select original profile */
+	return lachesis_select_profile(priv, priv->hwstate.profile);
+}
+
+/** lachesis_need_profile - Make sure a profile was read from the device.
+ * The device is claimed, if it is not claimed by the caller.
+ * Claiming waits for the config job, which reads all profiles.
+ */
+static int lachesis_need_profile(struct lachesis_private *priv, unsigned int i)
+{
+	struct razer_mouse *m = priv->m;
+	int err;
+
+	if (priv->prof_loaded[i])
+		return 0;
+	err = m->claim(m);
+	if (err)
+		return err;
+	if (!priv->prof_loaded[i]) {
+		err = lachesis_load_profiles(priv);
+		if (err) {
+			razer_error("hw_lachesis: Failed to read profile %u "
+				    "from hardware\n", i + 1);
+		}
+	}
+	m->release(m);
+
+	return err;
+}
+
+/* Read the global config and the active profile.
+ * The other profiles are read later by lachesis_load_profiles(). */
 static int lachesis_read_config_from_hw(struct lachesis_private *priv)
 {
 	int err;
 	unsigned char value;
 	unsigned int i;
 	struct lachesis_dpimap_cmd dpimap;
-	struct lachesis_profcfg_cmd profcfg;
 
 	value = 0x01;
 	err = lachesis_usb_write(priv, LIBUSB_REQUEST_SET_CONFIGURATION,
@@ -338,56 +508,7 @@ static int lachesis_read_config_from_hw(struct lachesis_private *priv)
 		return -EIO;
 	}
 	priv->cur_profile = &priv->profiles[value - 1];
-
-	/* Get the profile configuration */
-	for (i = 0; i < LACHESIS_NR_PROFILES; i++) {
-		/* Change to the profile */
-		value = i + 1;
-		err = lachesis_usb_write(priv, LIBUSB_REQUEST_SET_CONFIGURATION,
-					 0x08, 0, &value, sizeof(value));
-		if (err)
-			return err;
-		/* And read the profile config */
-		err = lachesis_usb_read(priv, LIBUSB_REQUEST_CLEAR_FEATURE,
-					0x03, 1, &profcfg, sizeof(profcfg));
-		if (err)
-			return err;
-		if (profcfg.dpisel < 1 || profcfg.dpisel > LACHESIS_NR_DPIMAPPINGS) {
-			razer_error("hw_lachesis: Got invalid DPI selection\n");
-			return -EIO;
-		}
-		razer_debug("hw_lachesis: Got profile config %d "
-			"(magic 0x%04X, prof %u, freq %u, dpisel %u)\n",
-			i + 1, profcfg.magic, profcfg.profile, profcfg.freq, profcfg.dpisel);
-		priv->cur_dpimapping[i] = &priv->dpimappings[profcfg.dpisel - 1];
-		switch (profcfg.freq) {
-		case 1:
-			priv->cur_freq[i] = RAZER_MOUSE_FREQ_1000HZ;
-			break;
-		case 2:
-			priv->cur_freq[i] = RAZER_MOUSE_FREQ_500HZ;
-			break;
-		case 3:
-			priv->cur_freq[i] = RAZER_MOUSE_FREQ_125HZ;
-			break;
-		default:
-			razer_error("hw_lachesis: "
-				"Read invalid frequency value from device (%u)\n",
-				profcfg.freq);
-			return -EINVAL;
-		}
-		err = razer_parse_buttonmap(profcfg.buttonmap, sizeof(profcfg.buttonmap),
-					    priv->buttons[i].mapping,
-					    ARRAY_SIZE(priv->buttons[i].mapping), 33);
-		if (err)
-			return err;
-	}
-	/* Select original profile */
-	value = priv->cur_profile->nr + 1;
-	err = lachesis_usb_write(priv, LIBUSB_REQUEST_SET_CONFIGURATION,
-				 0x08, 0, &value, sizeof(value));
-	if (err)
-		return err;
+	priv->hwstate.profile = priv->cur_profile->nr;
 
 	/* Get the LED states */
 	err = lachesis_usb_read(priv, LIBUSB_REQUEST_CLEAR_FEATURE,
@@ -405,7 +526,25 @@ static int lachesis_read_config_from_hw(struct lachesis_private *priv)
 	for (i = 0; i < LACHESIS_NR_DPIMAPPINGS; i++)
 		priv->dpimappings[i].res[RAZER_DIM_0] = (dpimap.mappings[i].dpival0 + 1) * 125;
 
-	return 0;
+	lachesis_get_global_hwstate(priv, &priv->hwstate);
+
+	/* The active profile is selected. Read it right away. */
+	return lachesis_read_profile(priv, priv->cur_profile->nr);
+}
+
+static int lachesis_late_init(struct razer_mouse *m)
+{
+	struct lachesis_private *priv = m->drv_data;
+	int err;
+
+	/* Read the remaining profiles in the background. */
+	err = lachesis_load_profiles(priv);
+	if (err) {
+		razer_error("hw_lachesis: "
+			    "Failed to read the configuration from hardware\n");
+	}
+
+	return err;
 }
 
 static int lachesis_get_fw_version(struct razer_mouse *m)
@@ -418,14 +557,30 @@ static int lachesis_get_fw_version(struct razer_mouse *m)
 static int lachesis_commit(struct razer_mouse *m, int force)
 {
 	struct lachesis_private *priv = m->drv_data;
+	struct lachesis_hwstate state;
 	int err = 0;
 
 	if (!m->claim_count)
 		return -EBUSY;
 	if (priv->commit_pending || force) {
+		/* All profiles are written. */
+		err = lachesis_load_profiles(priv);
+		if (err)
+			return err;
+		lachesis_get_hwstate(priv, &state);
+		if (!force && priv->hwstate_valid &&
+		    memcmp(&state, &priv->hwstate, sizeof(state)) == 0) {
+			razer_debug("hw_lachesis: Settings unchanged. "
+				    "Nothing to commit.\n");
+			priv->commit_pending = 0;
+			return 0;
+		}
 		err = lachesis_do_commit(priv);
-		if (!err)
+		if (!err) {
 			priv->commit_pending = 0;
+			priv->hwstate = state;
+		}
+		priv->hwstate_valid = !err;
 	}
 
 	return err;
@@ -500,23 +655,18 @@ static int lachesis_supported_axes(struct razer_mouse *m,
 	return ARRAY_SIZE(priv->axes);
 }
 
+static const enum razer_mouse_freq lachesis_freqs[] = {
+	RAZER_MOUSE_FREQ_1000HZ,
+	RAZER_MOUSE_FREQ_500HZ,
+	RAZER_MOUSE_FREQ_125HZ,
+};
+
 static int lachesis_supported_freqs(struct razer_mouse *m,
-				    enum razer_mouse_freq **freq_list)
+				    const enum razer_mouse_freq **freq_list)
 {
-	enum razer_mouse_freq *list;
-	const int count = 3;
-
-	list = malloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
-
-	list[0] = RAZER_MOUSE_FREQ_1000HZ;
-	list[1] = RAZER_MOUSE_FREQ_500HZ;
-	list[2] = RAZER_MOUSE_FREQ_125HZ;
-
-	*freq_list = list;
+	*freq_list = lachesis_freqs;
 
-	return count;
+	return ARRAY_SIZE(lachesis_freqs);
 }
 
 static enum razer_mouse_freq lachesis_get_freq(struct razer_mouse *m,
@@ -526,6 +676,8 @@ static enum razer_mouse_freq lachesis_get_freq(struct razer_mouse *m,
 
 	if (profile_nr >= ARRAY_SIZE(priv->cur_freq))
 		return -EINVAL;
+	if (lachesis_need_profile(priv, profile_nr))
+		return -EIO;
 
 	return priv->cur_freq[profile_nr];
 }
@@ -540,11 +692,15 @@ static int lachesis_set_freq(struct razer_mouse *m,
 			     enum razer_mouse_freq freq)
 {
 	struct lachesis_private *priv = m->drv_data;
+	int err;
 
 	if (!priv->m->claim_count)
 		return -EBUSY;
 	if (profile_nr >= ARRAY_SIZE(priv->cur_freq))
 		return -EINVAL;
+	err = lachesis_need_profile(priv, profile_nr);
+	if (err)
+		return err;
 
 	priv->cur_freq[profile_nr] = freq;
 	priv->commit_pending = 1;
@@ -559,27 +715,11 @@ static int lachesis_profile_set_freq(struct razer_mouse_profile *p,
 }
 
 static int lachesis_supported_resolutions(struct razer_mouse *m,
-					  enum razer_mouse_res **res_list)
+					  const enum razer_mouse_res **res_list)
 {
-	enum razer_mouse_res *list;
-	unsigned int i, count = 0, res, step = 0;
-
-	count = 32;
-	step = RAZER_MOUSE_RES_125DPI;
-
-	list = malloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
+	*res_list = razer_res_steps_125dpi;
 
-	res = step;
-	for (i = 0; i < count; i++) {
-		list[i] = res;
-		res += step;
-	}
-
-	*res_list = list;
-
-	return count;
+	return RAZER_NR_RES_STEPS_125DPI;
 }
 
 static struct razer_mouse_profile * lachesis_get_profiles(struct razer_mouse *m)
@@ -627,6 +767,8 @@ static struct razer_mouse_dpimapping * lachesis_get_dpimapping(struct razer_mous
 
 	if (p->nr >= ARRAY_SIZE(priv->cur_dpimapping))
 		return NULL;
+	if (lachesis_need_profile(priv, p->nr))
+		return NULL;
 
 	return priv->cur_dpimapping[p->nr];
 }
@@ -637,11 +779,15 @@ static int lachesis_set_dpimapping(struct razer_mouse_profile *p,
 {
 	struct lachesis_private *priv = p->mouse->drv_data;
 	razer_id_mask_t idmask;
+	int err;
 
 	if (!priv->m->claim_count)
 		return -EBUSY;
 	if (p->nr >= ARRAY_SIZE(priv->cur_dpimapping))
 		return -EINVAL;
+	err = lachesis_need_profile(priv, p->nr);
+	if (err)
+		return err;
 
 	razer_id_mask_zero(&idmask);
 	if (d->profile_mask != idmask)
@@ -693,6 +839,8 @@ static struct razer_button_function * lachesis_get_button_function(struct razer_
 
 	if (p->nr > ARRAY_SIZE(priv->buttons))
 		return NULL;
+	if (lachesis_need_profile(priv, p->nr))
+		return NULL;
 	buttons = &priv->buttons[p->nr];
 
 	return razer_get_buttonfunction_by_button(
@@ -708,11 +856,15 @@ static int lachesis_set_button_function(struct razer_mouse_profile *p,
 	struct lachesis_private *priv = p->mouse->drv_data;
 	struct lachesis_buttons *buttons;
 	struct razer_buttonmapping *mapping;
+	int err;
 
 	if (!priv->m->claim_count)
 		return -EBUSY;
 	if (p->nr > ARRAY_SIZE(priv->buttons))
 		return -EINVAL;
+	err = lachesis_need_profile(priv, p->nr);
+	if (err)
+		return err;
 	buttons = &priv->buttons[p->nr];
 
 	mapping = razer_get_buttonmapping_by_physid(
@@ -727,23 +879,15 @@ static int lachesis_set_button_function(struct razer_mouse_profile *p,
 	return 0;
 }
 
-int razer_lachesis_init(struct razer_mouse *m,
-			struct libusb_device *usbdev)
+int razer_lachesis_init(struct razer_mouse *m)
 {
 	struct lachesis_private *priv;
-	struct libusb_device_descriptor desc;
 	unsigned int i, j;
 	int err;
 
 	BUILD_BUG_ON(sizeof(struct lachesis_profcfg_cmd) != 0x18C);
 	BUILD_BUG_ON(sizeof(struct lachesis_dpimap_cmd) != 0x60);
 
-	err = libusb_get_device_descriptor(usbdev, &desc);
-	if (err) {
-		razer_error("hw_lachesis: Failed to get device descriptor\n");
-		return -EIO;
-	}
-
 	priv = zalloc(sizeof(struct lachesis_private));
 	if (!priv)
 		return -ENOMEM;
@@ -795,18 +939,21 @@ int razer_lachesis_init(struct razer_mouse *m,
 		goto err_release;
 	}
 
+	/* The config job reads the other profiles
+	 * after the device was published. */
 	err = lachesis_read_config_from_hw(priv);
 	if (err) {
 		razer_error("hw_lachesis: "
 			    "Failed to read the configuration from hardware\n");
 		goto err_release;
 	}
-	razer_generic_usb_gen_idstr(usbdev, m->usb_ctx->h, "Lachesis Classic", 1,
+	razer_generic_usb_gen_idstr(m->usb_ctx, "Lachesis Classic", 1,
 				    NULL, m->idstr);
 
 	m->type = RAZER_MOUSETYPE_LACHESIS;
 
 	m->get_fw_version = lachesis_get_fw_version;
+	m->late_init = lachesis_late_init;
 	m->commit = lachesis_commit;
 	m->global_get_leds = lachesis_global_get_leds;
 	m->nr_profiles = ARRAY_SIZE(priv->profiles);
@@ -820,11 +967,8 @@ int razer_lachesis_init(struct razer_mouse *m,
 	m->supported_buttons = lachesis_supported_buttons;
 	m->supported_button_functions = lachesis_supported_button_functions;
 
-	err = lachesis_do_commit(priv);
-	if (err) {
-		razer_error("hw_lachesis: Failed to commit initial settings\n");
-		goto err_release;
-	}
+	/* The initial settings are committed by the config job. */
+	priv->commit_pending = 1;
 	m->release(m);
 
 	return 0;
@@ -4,8 +4,7 @@
 #include "razer_private.h"
 
 
-int razer_lachesis5k6_init(struct razer_mouse *m,
-			   struct libusb_device *udev);
+int razer_lachesis5k6_init(struct razer_mouse *m);
 void razer_lachesis5k6_release(struct razer_mouse *m);
 
 #endif /* RAZER_HW_LACHESIS5K6_H_ */
@@ -20,6 +20,7 @@
 
 #include "hw_mamba_tournament_edition.h"
 #include "razer_private.h"
+#include "chroma.h"
 
 #include <errno.h>
 #include <stdlib.h>
@@ -27,7 +28,7 @@
 #include <stdint.h>
 #include <string.h>
 
-static enum razer_mouse_freq mamba_te_freqs_list[] =
+static const enum razer_mouse_freq mamba_te_freqs_list[] =
 {
 	RAZER_MOUSE_FREQ_125HZ,
 	RAZER_MOUSE_FREQ_500HZ,
@@ -74,6 +75,16 @@ enum mamba_te_led_state_option
 	MAMBA_TE_LED_STATE_OPTION_3		= 0x03,
 };
 
+enum mamba_te_cmd_id
+{
+	MAMBA_TE_CMD_INIT,
+	MAMBA_TE_CMD_SET_RESOLUTION,
+	MAMBA_TE_CMD_GET_FIRMWARE,
+	MAMBA_TE_CMD_GET_SERIAL_NO,
+	MAMBA_TE_CMD_SET_FREQUENCY,
+	MAMBA_TE_CMD_SET_LED,
+};
+
 /*
  * The 6th byte of MAMBA TE's command seems also to be the size of arguments
  * (size of arguments to read in case of read operations). It's not necessarily
@@ -81,30 +92,17 @@ enum mamba_te_led_state_option
  * of the arguments). But when it's in customized mode, there will be 0x32 which is 50 bytes of information
  * Experiments suggest that the value given in the 'size' byte does not matter.
  * I chose to go with the values used by the Synapse driver.
+ * The LED state, mode and color are set by the same request.
+ * Request 0x030c with size 0x32 sets the customized mode colors.
  */
-enum mamba_te_request_size
-{
-	MAMBA_TE_REQUEST_SIZE_INIT		= 0x02,
-	MAMBA_TE_REQUEST_SIZE_SET_RESOLUTION	= 0x07,
-	MAMBA_TE_REQUEST_SIZE_GET_FIRMWARE	= 0x04,
-	MAMBA_TE_REQUEST_SIZE_GET_SERIAL_NO	= 0x16,
-	MAMBA_TE_REQUEST_SIZE_SET_FREQUENCY	= 0x01,
-	MAMBA_TE_REQUEST_SIZE_SET_LED_STATE	= 0x08,
-	MAMBA_TE_REQUEST_SIZE_SET_LED_MODE	= 0x08,
-	MAMBA_TE_REQUEST_SIZE_SET_LED_COLOR	= 0x08,
-};
-
-enum mamba_te_request
-{
-	MAMBA_TE_REQUEST_INIT			= 0x0004,
-	MAMBA_TE_REQUEST_SET_RESOLUTION		= 0x0405,
-	MAMBA_TE_REQUEST_GET_FIRMWARE		= 0x0087,
-	MAMBA_TE_REQUEST_GET_SERIAL_NO		= 0x0082,
-	MAMBA_TE_REQUEST_SET_FREQUENCY		= 0x0005,
-	MAMBA_TE_REQUEST_SET_LED_STATE		= 0x030a,
-	MAMBA_TE_REQUEST_SET_LED_COLOR		= 0x030a,
-	MAMBA_TE_REQUEST_SET_LED_MODE		= 0x030a,
-	MAMBA_TE_REQUEST_SET_LED_MODE_CUSTOMIZED = 0x030c, // for further implementation
+static const struct razer_chroma_cmd mamba_te_cmds[] =
+{
+	[MAMBA_TE_CMD_INIT]		= { .request = 0x0004, .size = 0x02, },
+	[MAMBA_TE_CMD_SET_RESOLUTION]	= { .request = 0x0405, .size = 0x07, },
+	[MAMBA_TE_CMD_GET_FIRMWARE]	= { .request = 0x0087, .size = 0x04, },
+	[MAMBA_TE_CMD_GET_SERIAL_NO]	= { .request = 0x0082, .size = 0x16, },
+	[MAMBA_TE_CMD_SET_FREQUENCY]	= { .request = 0x0005, .size = 0x01, },
+	[MAMBA_TE_CMD_SET_LED]		= { .request = 0x030a, .size = 0x08, },
 };
 
 enum mamba_te_constants
@@ -118,17 +116,7 @@ enum mamba_te_constants
 	MAMBA_TE_SUPPORTED_FREQ_NUM		= ARRAY_SIZE(mamba_te_freqs_list),
 	MAMBA_TE_DPIMAPPINGS_NUM		= ARRAY_SIZE(mamba_te_resolution_stages_list),
 
-	MAMBA_TE_USB_SETUP_PACKET_VALUE		= 0x300,
-	MAMBA_TE_SUCCESS_STATUS			= 0x02,
-	MAMBA_TE_PACKET_SPACING_MS		= 35,
-
-	/*
-	 * Experiments suggest that the value in the 'magic' byte of the command
-	 * does not necessarily matter (e.g. the commands work when the 'magic'
-	 * byte equals 0x77). I chose to go with the value used by the Synapse
-	 * driver.
-	 */
-	MAMBA_TE_MAGIC_BYTE			= 0xFF,
+	MAMBA_TE_SERIAL_NO_LEN			= 0x16,
 
 	/*
 	 * These specific arg0 bytes are used by the Synapse driver for their
@@ -141,35 +129,6 @@ enum mamba_te_constants
 	MAMBA_TE_RESOLUTION_ARG0		= 0x01,
 };
 
-struct mamba_te_command
-{
-	uint8_t status;
-	uint8_t magic;
-	uint8_t padding0[3];
-	uint8_t size;
-	be16_t request;
-
-	union
-	{
-		uint8_t bvalue[80];
-		struct
-		{
-			uint8_t padding1;
-			be16_t value[38];
-			uint8_t padding2;
-		}_packed;
-	}_packed;
-
-	uint8_t checksum;
-	uint8_t padding3;
-}_packed;
-
-#define MAMBA_TE_COMMAND_INIT			\
-	(struct mamba_te_command)		\
-	{					\
-		.magic = MAMBA_TE_MAGIC_BYTE	\
-	}
-
 struct mamba_te_rgb_color
 {
 	uint8_t r;
@@ -187,7 +146,7 @@ struct mamba_te_led
 
 struct mamba_te_driver_data
 {
-	struct razer_event_spacing packet_spacing;
+	struct razer_chroma chroma;
 	struct razer_mouse_profile profile;
 	struct razer_mouse_dpimapping *current_dpimapping;
 	enum razer_mouse_freq current_freq;
@@ -195,17 +154,9 @@ struct mamba_te_driver_data
 	struct razer_mouse_dpimapping dpimappings[MAMBA_TE_DPIMAPPINGS_NUM];
 	struct razer_axis axes[MAMBA_TE_AXES_NUM];
 	uint16_t fw_version;
-	char serial[MAMBA_TE_REQUEST_SIZE_GET_SERIAL_NO + 1];
+	char serial[MAMBA_TE_SERIAL_NO_LEN + 1];
 };
 
-static uint8_t mamba_te_checksum(struct mamba_te_command *cmd)
-{
-	size_t control_size;
-
-	control_size = sizeof(cmd->size) + sizeof(cmd->request);
-	return razer_xor8_checksum((uint8_t *)&cmd->size, control_size + cmd->size);
-}
-
 static int mamba_te_translate_frequency(enum razer_mouse_freq freq)
 {
 	switch (freq) {
@@ -221,104 +172,59 @@ static int mamba_te_translate_frequency(enum razer_mouse_freq freq)
 	}
 }
 
-static int mamba_te_usb_action(struct razer_mouse *m,
-			       enum libusb_endpoint_direction direction,
-			       enum libusb_standard_request request,
-			       uint16_t command,
-			       struct mamba_te_command *cmd)
+static void mamba_te_report_init(struct razer_chroma_report *r,
+				 enum mamba_te_cmd_id id)
+{
+	razer_chroma_report_init(r, &mamba_te_cmds[id]);
+}
+
+static int mamba_te_run(struct razer_mouse *m,
+			struct razer_chroma_report *r)
 {
-	int err;
 	struct mamba_te_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 
-	razer_event_spacing_enter(&drv_data->packet_spacing);
-	err = libusb_control_transfer(m->usb_ctx->h,
-				      direction |
-				      LIBUSB_REQUEST_TYPE_CLASS |
-				      LIBUSB_RECIPIENT_INTERFACE,
-				      request, command, 0,
-				      (unsigned char *)cmd, sizeof(*cmd),
-				      RAZER_USB_TIMEOUT);
-	razer_event_spacing_leave(&drv_data->packet_spacing);
-	if (err != sizeof(*cmd)) {
-		razer_error("razer-mamba-tournament-edition: "
-			    "USB %s 0x%01X 0x%02X failed with %d\n",
-			    direction == LIBUSB_ENDPOINT_IN ? "read" : "write",
-			    request, command, err);
-		return err;
-	}
-
-	return 0;
+	return razer_chroma_run(&drv_data->chroma, r);
 }
 
-static int mamba_te_send_command(struct razer_mouse *m,
-				 struct mamba_te_command *cmd)
+static int mamba_te_queue(struct razer_mouse *m,
+			  enum mamba_te_cmd_id id,
+			  const struct razer_chroma_report *r)
 {
-	int err;
-	uint8_t checksum;
-
-	cmd->checksum = mamba_te_checksum(cmd);
-	err = mamba_te_usb_action(m, LIBUSB_ENDPOINT_OUT,
-				  LIBUSB_REQUEST_SET_CONFIGURATION,
-				  MAMBA_TE_USB_SETUP_PACKET_VALUE, cmd);
-	if (err)
-		return err;
-	err = mamba_te_usb_action(m, LIBUSB_ENDPOINT_IN,
-				  LIBUSB_REQUEST_CLEAR_FEATURE,
-				  MAMBA_TE_USB_SETUP_PACKET_VALUE, cmd);
-	if (err)
-		return err;
-
-	checksum = mamba_te_checksum (cmd);
-	if (checksum != cmd->checksum) {
-		razer_error("razer-mamba-tournament-edition: "
-			    "Command %02X %04X bad response checksum %02X "
-			    "(expected %02X)\n",
-			    cmd->size, be16_to_cpu(cmd->request),
-			    checksum, cmd->checksum);
-		return -EBADMSG;
-	}
+	struct mamba_te_driver_data *drv_data;
 
-	if (cmd->status != MAMBA_TE_SUCCESS_STATUS) {
-		razer_error("razer-mamba-tournament-edition: "
-			    "Command %02X %04X failed with %02X\n",
-			    cmd->size, be16_to_cpu(cmd->request), cmd->status);
-	}
+	drv_data = m->drv_data;
 
-	return 0;
+	return razer_chroma_queue(&drv_data->chroma, &mamba_te_cmds[id], r);
 }
 
 static int mamba_te_send_init_command(struct razer_mouse *m)
 {
-	struct mamba_te_command cmd;
+	struct razer_chroma_report cmd;
 
-	cmd = MAMBA_TE_COMMAND_INIT;
-	cmd.size = MAMBA_TE_REQUEST_SIZE_INIT;
-	cmd.request = cpu_to_be16(MAMBA_TE_REQUEST_INIT);
+	mamba_te_report_init(&cmd, MAMBA_TE_CMD_INIT);
 	cmd.bvalue[0] = MAMBA_TE_INIT_ARG0;
 
-	return mamba_te_send_command(m, &cmd);
+	return mamba_te_queue(m, MAMBA_TE_CMD_INIT, &cmd);
 }
 
 static int mamba_te_send_set_resolution_command(struct razer_mouse *m)
 {
 	enum razer_mouse_res res_x, res_y;
-	struct mamba_te_command cmd;
+	struct razer_chroma_report cmd;
 	struct mamba_te_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 	res_x = drv_data->current_dpimapping->res[RAZER_DIM_X];
 	res_y = drv_data->current_dpimapping->res[RAZER_DIM_Y];
 
-	cmd = MAMBA_TE_COMMAND_INIT;
-	cmd.size = MAMBA_TE_REQUEST_SIZE_SET_RESOLUTION;
-	cmd.request = cpu_to_be16(MAMBA_TE_REQUEST_SET_RESOLUTION);
+	mamba_te_report_init(&cmd, MAMBA_TE_CMD_SET_RESOLUTION);
 	cmd.bvalue[0] = MAMBA_TE_RESOLUTION_ARG0;
 	cmd.value[0] = cpu_to_be16(res_x);
 	cmd.value[1] = cpu_to_be16(res_y);
 
-	return mamba_te_send_command(m, &cmd);
+	return mamba_te_queue(m, MAMBA_TE_CMD_SET_RESOLUTION, &cmd);
 }
 
 static int mamba_te_send_get_firmware_command(struct razer_mouse *m)
@@ -326,16 +232,14 @@ static int mamba_te_send_get_firmware_command(struct razer_mouse *m)
 	int err;
 	uint8_t fw_major;
 	uint16_t fw_minor;
-	struct mamba_te_command cmd;
+	struct razer_chroma_report cmd;
 	struct mamba_te_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 
-	cmd = MAMBA_TE_COMMAND_INIT;
-	cmd.size = MAMBA_TE_REQUEST_SIZE_GET_FIRMWARE;
-	cmd.request = cpu_to_be16(MAMBA_TE_REQUEST_GET_FIRMWARE);
+	mamba_te_report_init(&cmd, MAMBA_TE_CMD_GET_FIRMWARE);
 
-	err = mamba_te_send_command(m, &cmd);
+	err = mamba_te_run(m, &cmd);
 	if (err)
 		return err;
 
@@ -349,22 +253,20 @@ static int mamba_te_send_get_firmware_command(struct razer_mouse *m)
 static int mamba_te_send_get_serial_no_command(struct razer_mouse *m)
 {
 	int err;
-	struct mamba_te_command cmd;
+	struct razer_chroma_report cmd;
 	struct mamba_te_driver_data *drv_data;
 
 	drv_data = m->drv_data;
 
-	cmd = MAMBA_TE_COMMAND_INIT;
-	cmd.size = MAMBA_TE_REQUEST_SIZE_GET_SERIAL_NO;
-	cmd.request = cpu_to_be16(MAMBA_TE_REQUEST_GET_SERIAL_NO);
+	mamba_te_report_init(&cmd, MAMBA_TE_CMD_GET_SERIAL_NO);
 
-	err = mamba_te_send_command(m, &cmd);
+	err = mamba_te_run(m, &cmd);
 	if (err)
 		return err;
 
 	strncpy(drv_data->serial, (const char *)cmd.bvalue,
-		MAMBA_TE_REQUEST_SIZE_GET_SERIAL_NO);
-	drv_data->serial[MAMBA_TE_REQUEST_SIZE_GET_SERIAL_NO] = '\0';
+		MAMBA_TE_SERIAL_NO_LEN);
+	drv_data->serial[MAMBA_TE_SERIAL_NO_LEN] = '\0';
 
 	return 0;
 }
@@ -372,21 +274,19 @@ static int mamba_te_send_get_serial_no_command(struct razer_mouse *m)
 static int mamba_te_send_set_frequency_command(struct razer_mouse *m)
 {
 	int tfreq;
-	struct mamba_te_command cmd;
+	struct razer_chroma_report cmd;
 	struct mamba_te_driver_data *drv_data;
 
 	drv_data = m->drv_data;
-	cmd = MAMBA_TE_COMMAND_INIT;
 
 	tfreq = mamba_te_translate_frequency(drv_data->current_freq);
 	if (tfreq < 0)
 		return tfreq;
 
-	cmd.size = MAMBA_TE_REQUEST_SIZE_SET_FREQUENCY;
-	cmd.request = cpu_to_be16(MAMBA_TE_REQUEST_SET_FREQUENCY);
+	mamba_te_report_init(&cmd, MAMBA_TE_CMD_SET_FREQUENCY);
 	cmd.bvalue[0] = tfreq;
 
-	return mamba_te_send_command(m, &cmd);
+	return mamba_te_queue(m, MAMBA_TE_CMD_SET_FREQUENCY, &cmd);
 }
 
 static struct mamba_te_led *mamba_te_get_led(struct mamba_te_driver_data *d)
@@ -394,15 +294,13 @@ static struct mamba_te_led *mamba_te_get_led(struct mamba_te_driver_data *d)
 	return &d->led;
 }
 
-static int mamba_te_send_set_led_state_command(struct razer_mouse *m,
-					       struct mamba_te_led *led)
+/* Set the LED state, mode and color. */
+static int mamba_te_send_set_led_command(struct razer_mouse *m,
+					 struct mamba_te_led *led)
 {
-	struct mamba_te_command cmd;
-
-	cmd = MAMBA_TE_COMMAND_INIT;
-	cmd.size = MAMBA_TE_REQUEST_SIZE_SET_LED_STATE;
-	cmd.request = cpu_to_be16(MAMBA_TE_REQUEST_SET_LED_STATE);
+	struct razer_chroma_report cmd;
 
+	mamba_te_report_init(&cmd, MAMBA_TE_CMD_SET_LED);
 	if (led->mode == MAMBA_TE_LED_MODE_STATIC) {
 		cmd.bvalue[0] = led->mode;
 		cmd.bvalue[1] = led->color.r;
@@ -424,71 +322,38 @@ static int mamba_te_send_set_led_state_command(struct razer_mouse *m,
 	cmd.bvalue[0] &= led->state;
 	cmd.bvalue[1] &= led->state;
 
-	return mamba_te_send_command(m, &cmd);
+	return mamba_te_queue(m, MAMBA_TE_CMD_SET_LED, &cmd);
 }
 
-static int mamba_te_send_set_led_mode_command(struct razer_mouse *m,
-					      struct mamba_te_led *led)
+static int mamba_te_queue_settings(struct razer_mouse *m)
 {
-	struct mamba_te_command cmd;
+	int err;
+	struct mamba_te_driver_data *drv_data;
 
-	cmd = MAMBA_TE_COMMAND_INIT;
-	cmd.size = MAMBA_TE_REQUEST_SIZE_SET_LED_MODE;
-	cmd.request = cpu_to_be16(MAMBA_TE_REQUEST_SET_LED_MODE);
-	if (led->mode == MAMBA_TE_LED_MODE_STATIC) {
-		cmd.bvalue[0] = led->mode;
-		cmd.bvalue[1] = led->color.r;
-		cmd.bvalue[2] = led->color.g;
-		cmd.bvalue[3] = led->color.b;
-	} else {
-		uint16_t tempHex;
-		uint8_t tempH, tempL;
+	drv_data = m->drv_data;
 
-		tempHex = led->mode;
-		tempH = (uint8_t)((tempHex & 0xFF00) >> 8);
-		tempL = (uint8_t)(tempHex & 0x00FF);
-		cmd.bvalue[0] = tempH;
-		cmd.bvalue[1] = tempL;
-		cmd.bvalue[2] = led->color.r;
-		cmd.bvalue[3] = led->color.g;
-		cmd.bvalue[4] = led->color.b;
-	}
-	cmd.bvalue[0] &= led->state;
-	cmd.bvalue[1] &= led->state;
+	if ((err = mamba_te_send_set_resolution_command(m)) ||
+	    (err = mamba_te_send_set_frequency_command(m)) ||
+	    (err = mamba_te_send_set_led_command(m, &drv_data->led)))
+		return err;
 
-	return mamba_te_send_command(m, &cmd);
+	return 0;
 }
 
-static int mamba_te_send_set_led_color_command(struct razer_mouse *m,
-					       struct mamba_te_led *led)
+static int mamba_te_commit(struct razer_mouse *m, int force)
 {
-	struct mamba_te_command cmd;
+	int err;
+	struct mamba_te_driver_data *drv_data;
 
-	cmd = MAMBA_TE_COMMAND_INIT;
-	cmd.size = MAMBA_TE_REQUEST_SIZE_SET_LED_COLOR;
-	cmd.request = cpu_to_be16(MAMBA_TE_REQUEST_SET_LED_COLOR);
-	if (led->mode == MAMBA_TE_LED_MODE_STATIC) {
-		cmd.bvalue[0] = led->mode;
-		cmd.bvalue[1] = led->color.r;
-		cmd.bvalue[2] = led->color.g;
-		cmd.bvalue[3] = led->color.b;
-	} else {
-		uint16_t tempHex;
-		uint8_t tempH, tempL;
+	drv_data = m->drv_data;
 
-		tempHex = led->mode;
-		tempH = (uint8_t)((tempHex & 0xFF00) >> 8);
-		tempL = (uint8_t)(tempHex & 0x00FF);
-		cmd.bvalue[0] = tempH;
-		cmd.bvalue[1] = tempL;
-		cmd.bvalue[2] = led->color.r;
-		cmd.bvalue[3] = led->color.g;
-		cmd.bvalue[4] = led->color.b;
+	if (force) {
+		err = mamba_te_queue_settings(m);
+		if (err)
+			return err;
 	}
-	cmd.bvalue[0] &= led->state;
-	cmd.bvalue[1] &= led->state;
 
-	return mamba_te_send_command(m, &cmd);
+	return razer_chroma_flush(&drv_data->chroma);
 }
 
 static int mamba_te_get_fw_version(struct razer_mouse *m)
@@ -532,29 +397,20 @@ static int mamba_te_supported_dpimappings(struct razer_mouse *m,
 }
 
 static int mamba_te_supported_resolutions(struct razer_mouse *m,
-					  enum razer_mouse_res **res_ptr)
+					  const enum razer_mouse_res **res_ptr)
 {
-	size_t i;
-	size_t step_number;
+	BUILD_BUG_ON(MAMBA_TE_MAX_RESOLUTION / MAMBA_TE_RESOLUTION_STEP >
+		     RAZER_NR_RES_STEPS_100DPI);
 
-	step_number = MAMBA_TE_MAX_RESOLUTION / MAMBA_TE_RESOLUTION_STEP;
+	*res_ptr = razer_res_steps_100dpi;
 
-	*res_ptr = calloc(step_number, sizeof(enum razer_mouse_res));
-	if (!*res_ptr)
-		return -ENOMEM;
-	for (i = 0; i < step_number; i++)
-		(*res_ptr)[i] = (i + 1) * MAMBA_TE_RESOLUTION_STEP;
-
-	return step_number;
+	return MAMBA_TE_MAX_RESOLUTION / MAMBA_TE_RESOLUTION_STEP;
 }
 
 static int mamba_te_supported_freqs(struct razer_mouse *m,
-				    enum razer_mouse_freq **res_ptr)
+				    const enum razer_mouse_freq **res_ptr)
 {
-	*res_ptr = malloc(sizeof(mamba_te_freqs_list));
-	if (!*res_ptr)
-		return -ENOMEM;
-	memcpy(*res_ptr, mamba_te_freqs_list, sizeof(mamba_te_freqs_list));
+	*res_ptr = mamba_te_freqs_list;
 
 	return MAMBA_TE_SUPPORTED_FREQ_NUM;
 }
@@ -623,7 +479,7 @@ static int mamba_te_led_toggle_state(struct razer_led *led,
 		break;
 	}
 
-	return mamba_te_send_set_led_state_command(led->u.mouse, priv_led);
+	return mamba_te_send_set_led_command(led->u.mouse, priv_led);
 }
 
 static int mamba_te_led_change_color(struct razer_led *led,
@@ -646,7 +502,7 @@ static int mamba_te_led_change_color(struct razer_led *led,
 		.b = new_color->b,
 	};
 
-	return mamba_te_send_set_led_color_command(led->u.mouse, priv_led);
+	return mamba_te_send_set_led_command(led->u.mouse, priv_led);
 }
 
 static int mamba_te_set_freq(struct razer_mouse_profile *p,
@@ -737,7 +593,7 @@ static int mamba_te_led_set_mode(struct razer_led *led,
 		return err;
 	priv_led->mode = err;
 
-	return mamba_te_send_set_led_mode_command(led->u.mouse, priv_led);
+	return mamba_te_send_set_led_command(led->u.mouse, priv_led);
 }
 
 static int mamba_te_get_leds(struct razer_mouse *m,
@@ -781,22 +637,17 @@ static int mamba_te_get_leds(struct razer_mouse *m,
 	return MAMBA_TE_LED_NUM;
 }
 
-int razer_mamba_te_init(struct razer_mouse *m,
-			struct libusb_device *usbdev)
+int razer_mamba_te_init(struct razer_mouse *m)
 {
 	int err;
 	size_t i;
 	struct mamba_te_driver_data *drv_data;
-	struct mamba_te_led *led;
-
-	BUILD_BUG_ON(sizeof(struct mamba_te_command) != 90);
 
 	drv_data = zalloc(sizeof(*drv_data));
 	if (!drv_data)
 		return -ENOMEM;
 
-	razer_event_spacing_init(&drv_data->packet_spacing,
-				 MAMBA_TE_PACKET_SPACING_MS);
+	razer_chroma_init(&drv_data->chroma, m, "razer-mamba-tournament-edition");
 
 	for (i = 0; i < MAMBA_TE_DPIMAPPINGS_NUM; i++) {
 		drv_data->dpimappings[i] = (struct razer_mouse_dpimapping){
@@ -825,6 +676,7 @@ int razer_mamba_te_init(struct razer_mouse *m,
 			"Scroll", 0, NULL, 0);
 
 	m->drv_data = drv_data;
+	m->commit = mamba_te_commit;
 
 	if ((err = razer_usb_add_used_interface(m->usb_ctx, 0, 0)) ||
 	    (err = m->claim(m))) {
@@ -832,15 +684,12 @@ int razer_mamba_te_init(struct razer_mouse *m,
 		return err;
 	}
 
-	led = &drv_data->led;
-
-	if ((err = mamba_te_send_init_command (m)) ||
-	    (err = mamba_te_send_set_resolution_command (m)) ||
-	    (err = mamba_te_send_get_firmware_command (m)) ||
-	    (err = mamba_te_send_get_serial_no_command (m)) ||
-	    (err = mamba_te_send_set_frequency_command (m)) ||
-	    (err = mamba_te_send_set_led_mode_command (m, led)) ||
-	    (err = mamba_te_send_set_led_color_command (m, led))) {
+	/* The initial settings stay queued. The initial configuration
+	 * overrides them and commits them in one go. */
+	if ((err = mamba_te_send_init_command(m)) ||
+	    (err = mamba_te_send_get_firmware_command(m)) ||
+	    (err = mamba_te_send_get_serial_no_command(m)) ||
+	    (err = mamba_te_queue_settings(m))) {
 		m->release(m);
 		free(drv_data);
 		return err;
@@ -855,8 +704,7 @@ int razer_mamba_te_init(struct razer_mouse *m,
 		.set_dpimapping = mamba_te_set_dpimapping,
 	};
 
-	razer_generic_usb_gen_idstr(usbdev, m->usb_ctx->h,
-				    MAMBA_TE_DEVICE_NAME, false,
+	razer_generic_usb_gen_idstr(m->usb_ctx, MAMBA_TE_DEVICE_NAME, false,
 				    drv_data->serial, m->idstr);
 
 	m->type = RAZER_MOUSETYPE_MAMBA_TE;
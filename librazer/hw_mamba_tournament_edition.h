@@ -5,8 +5,7 @@
 #include "razer_private.h"
 
 
-int razer_mamba_te_init(struct razer_mouse *m,
-			 struct libusb_device *udev);
+int razer_mamba_te_init(struct razer_mouse *m);
 void razer_mamba_te_release(struct razer_mouse *m);
 
 #endif /* RAZER_MAMBA_TOURNAMENT_EDITION_ */
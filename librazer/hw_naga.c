@@ -142,8 +142,8 @@ static int naga_usb_write(struct naga_private *priv,
 	int err;
 
 	razer_event_spacing_enter(&priv->packet_spacing);
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, 0,
@@ -168,8 +168,8 @@ static int naga_usb_read(struct naga_private *priv,
 
 	for (try = 0; try < 3; try++) {
 		razer_event_spacing_enter(&priv->packet_spacing);
-		err = libusb_control_transfer(
-			priv->m->usb_ctx->h,
+		err = razer_usb_control(
+			priv->m->usb_ctx,
 			LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS |
 			LIBUSB_RECIPIENT_INTERFACE,
 			request, command, 0,
@@ -381,23 +381,18 @@ static int naga_get_leds(struct razer_mouse *m,
 	return nb_leds;
 }
 
+static const enum razer_mouse_freq naga_freqs[] = {
+	RAZER_MOUSE_FREQ_125HZ,
+	RAZER_MOUSE_FREQ_500HZ,
+	RAZER_MOUSE_FREQ_1000HZ,
+};
+
 static int naga_supported_freqs(struct razer_mouse *m,
-				      enum razer_mouse_freq **freq_list)
+				      const enum razer_mouse_freq **freq_list)
 {
-	enum razer_mouse_freq *list;
-	const int count = 3;
-
-	list = zalloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
+	*freq_list = naga_freqs;
 
-	list[0] = RAZER_MOUSE_FREQ_125HZ;
-	list[1] = RAZER_MOUSE_FREQ_500HZ;
-	list[2] = RAZER_MOUSE_FREQ_1000HZ;
-
-	*freq_list = list;
-
-	return count;
+	return ARRAY_SIZE(naga_freqs);
 }
 
 static enum razer_mouse_freq naga_get_freq(struct razer_mouse_profile *p)
@@ -432,18 +427,13 @@ static int naga_supported_axes(struct razer_mouse *m,
 }
 
 static int naga_supported_resolutions(struct razer_mouse *m,
-					    enum razer_mouse_res **res_list)
+					    const enum razer_mouse_res **res_list)
 {
 	struct naga_private *priv = m->drv_data;
-	enum razer_mouse_res *list;
-	int i;
 
-	list = zalloc(sizeof(*list) * priv->nb_dpimappings);
-	if (!list)
-		return -ENOMEM;
-	for (i = 0; i < priv->nb_dpimappings; i++)
-		list[i] = (enum razer_mouse_res)((i + 1) * 100);
-	*res_list = list;
+	BUILD_BUG_ON(NAGA_NR_DPIMAPPINGS > RAZER_NR_RES_STEPS_100DPI);
+
+	*res_list = razer_res_steps_100dpi;
 
 	return priv->nb_dpimappings;
 }
@@ -507,8 +497,7 @@ static int naga_set_dpimapping(struct razer_mouse_profile *p,
 	return 0;
 }
 
-int razer_naga_init(struct razer_mouse *m,
-		    struct libusb_device *usbdev)
+int razer_naga_init(struct razer_mouse *m)
 {
 	struct naga_private *priv;
 	struct libusb_device_descriptor desc;
@@ -517,11 +506,7 @@ int razer_naga_init(struct razer_mouse *m,
 
 	BUILD_BUG_ON(sizeof(struct naga_command) != 90);
 
-	err = libusb_get_device_descriptor(usbdev, &desc);
-	if (err) {
-		razer_error("hw_naga: Failed to get device descriptor\n");
-		return -EIO;
-	}
+	desc = m->usb_ctx->desc;
 
 	priv = zalloc(sizeof(struct naga_private));
 	if (!priv)
@@ -619,7 +604,7 @@ int razer_naga_init(struct razer_mouse *m,
 	    model = "Naga 2014";
 	    break;
 	}
-	razer_generic_usb_gen_idstr(usbdev, m->usb_ctx->h, model, 1,
+	razer_generic_usb_gen_idstr(m->usb_ctx, model, 1,
 				    NULL, m->idstr);
 
 	m->get_fw_version = naga_get_fw_version;
@@ -631,11 +616,8 @@ int razer_naga_init(struct razer_mouse *m,
 	m->supported_freqs = naga_supported_freqs;
 	m->supported_dpimappings = naga_supported_dpimappings;
 
-	err = naga_do_commit(priv);
-	if (err) {
-		razer_error("hw_naga: Failed to commit initial settings\n");
-		goto err_release;
-	}
+	/* The initial settings are committed by the config job. */
+	priv->commit_pending = 1;
 
 	m->release(m);
 
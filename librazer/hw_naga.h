@@ -12,8 +12,7 @@
 #define RAZER_NAGA_PID_HEX_2014 0x0041
 
 
-int razer_naga_init(struct razer_mouse *m,
-		    struct libusb_device *udev);
+int razer_naga_init(struct razer_mouse *m);
 void razer_naga_release(struct razer_mouse *m);
 
 #endif /* RAZER_HW_NAGA_H_ */
@@ -84,8 +84,8 @@ static int taipan_usb_write(struct taipan_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, 0,
@@ -106,8 +106,8 @@ static int taipan_usb_read(struct taipan_private *priv,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		priv->m->usb_ctx->h,
+	err = razer_usb_control(
+		priv->m->usb_ctx,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, 0,
@@ -321,23 +321,18 @@ static int taipan_get_leds(struct razer_mouse *m,
 	return TAIPAN_NR_LEDS;
 }
 
+static const enum razer_mouse_freq taipan_freqs[] = {
+	RAZER_MOUSE_FREQ_125HZ,
+	RAZER_MOUSE_FREQ_500HZ,
+	RAZER_MOUSE_FREQ_1000HZ,
+};
+
 static int taipan_supported_freqs(struct razer_mouse *m,
-				  enum razer_mouse_freq **freq_list)
+				  const enum razer_mouse_freq **freq_list)
 {
-	enum razer_mouse_freq *list;
-	const int count = 3;
-
-	list = zalloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
-
-	list[0] = RAZER_MOUSE_FREQ_125HZ;
-	list[1] = RAZER_MOUSE_FREQ_500HZ;
-	list[2] = RAZER_MOUSE_FREQ_1000HZ;
-
-	*freq_list = list;
+	*freq_list = taipan_freqs;
 
-	return count;
+	return ARRAY_SIZE(taipan_freqs);
 }
 
 static enum razer_mouse_freq taipan_get_freq(struct razer_mouse_profile *p)
@@ -372,20 +367,13 @@ static int taipan_supported_axes(struct razer_mouse *m,
 }
 
 static int taipan_supported_resolutions(struct razer_mouse *m,
-					enum razer_mouse_res **res_list)
+					const enum razer_mouse_res **res_list)
 {
-	enum razer_mouse_res *list;
-	unsigned int i;
-	const unsigned int count = TAIPAN_NR_DPIMAPPINGS;
+	BUILD_BUG_ON(TAIPAN_NR_DPIMAPPINGS > RAZER_NR_RES_STEPS_100DPI);
 
-	list = zalloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
-	for (i = 0; i < count; i++)
-		list[i] = (i + 1) * 100;
-	*res_list = list;
+	*res_list = razer_res_steps_100dpi;
 
-	return count;
+	return TAIPAN_NR_DPIMAPPINGS;
 }
 
 static struct razer_mouse_profile * taipan_get_profiles(struct razer_mouse *m)
@@ -447,8 +435,7 @@ static int taipan_set_dpimapping(struct razer_mouse_profile *p,
 	return 0;
 }
 
-int razer_taipan_init(struct razer_mouse *m,
-		      struct libusb_device *usbdev)
+int razer_taipan_init(struct razer_mouse *m)
 {
 	struct taipan_private *priv;
 	unsigned int i;
@@ -508,7 +495,7 @@ int razer_taipan_init(struct razer_mouse *m,
 			"Scroll", 0);
 
 	m->type = RAZER_MOUSETYPE_TAIPAN;
-	razer_generic_usb_gen_idstr(usbdev, m->usb_ctx->h, "Taipan", 1,
+	razer_generic_usb_gen_idstr(m->usb_ctx, "Taipan", 1,
 				    NULL, m->idstr);
 
 	m->get_fw_version = taipan_get_fw_version;
@@ -520,11 +507,8 @@ int razer_taipan_init(struct razer_mouse *m,
 	m->supported_freqs = taipan_supported_freqs;
 	m->supported_dpimappings = taipan_supported_dpimappings;
 
-	err = taipan_do_commit(priv);
-	if (err) {
-		razer_error("hw_taipan: Failed to commit initial settings\n");
-		goto err_release;
-	}
+	/* The initial settings are committed by the config job. */
+	priv->commit_pending = 1;
 
 	m->release(m);
 
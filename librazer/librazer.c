@@ -17,6 +17,8 @@
 #include "librazer.h"
 #include "razer_private.h"
 #include "config.h"
+#include "devcache.h"
+#include "transport.h"
 #include "profile_emulation.h"
 
 #include "hw_deathadder.h"
@@ -38,7 +40,9 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/ioctl.h>
 
 
@@ -51,12 +55,13 @@ enum razer_devtype {
  * @type: The type ID.
  *
  * @init: Initialize the device and its private data structures.
+ *        The device is accessed through m->usb_ctx.
  *
  * @release: Release device and data structures.
  */
 struct razer_mouse_base_ops {
 	enum razer_mouse_type type;
-	int (*init)(struct razer_mouse *m, struct libusb_device *udev);
+	int (*init)(struct razer_mouse *m);
 	void (*release)(struct razer_mouse *m);
 };
 
@@ -188,11 +193,22 @@ static const struct razer_usb_device razer_usbdev_table[] = {
 
 
 static struct libusb_context *libusb_ctx;
+/* The transport backend for all devices. */
+static const struct razer_transport *razer_transport;
+/* The transport spec set by razer_set_transport(). */
+static char *requested_transport;
 static struct razer_mouse *mice_list = NULL;
 /* We currently only have one handler. */
 static razer_event_handler_t event_handler;
 static struct config_file *razer_config_file = NULL;
 static bool profile_emu_enabled;
+/* Wakes up the library user, if a config job finished. */
+static int event_pipe[2] = { -1, -1 };
+/* The mouse that is configured by the current thread, if any. */
+static __thread struct razer_mouse *config_job_mouse;
+
+/* USB traffic statistics of all devices. */
+struct razer_usb_stats razer_usb_stats;
 
 razer_logfunc_t razer_logfunc_info;
 razer_logfunc_t razer_logfunc_error;
@@ -277,16 +293,14 @@ static void mouse_list_del(struct razer_mouse **base, struct razer_mouse *del_en
 }
 
 static struct razer_mouse * mouse_list_find(struct razer_mouse *base,
-					    struct libusb_device *udev)
+					    const struct razer_usb_devinfo *info)
 {
 	struct razer_mouse *m, *next;
-	uint8_t busnr = libusb_get_bus_number(udev);
-	uint8_t devaddr = libusb_get_device_address(udev);
 
 	razer_for_each_mouse(m, next, base) {
 		if (m->usb_ctx) {
-			if (libusb_get_bus_number(m->usb_ctx->dev) == busnr &&
-			    libusb_get_device_address(m->usb_ctx->dev) == devaddr)
+			if (m->usb_ctx->busnr == info->busnr &&
+			    m->usb_ctx->devaddr == info->devaddr)
 				return m;
 		}
 	}
@@ -487,8 +501,7 @@ static bool mouse_apply_one_config(struct config_file *f,
 		}
 		goto invalid; /* res is invalid. Ignore it. */
 	} else if (strcasecmp(item, "freq") == 0) {
-		int profile, freq, i;
-		enum razer_mouse_freq *freqs;
+		int profile, freq;
 
 		err = parse_int_int_pair(value, &profile, &freq);
 		if (err == 1) {
@@ -501,22 +514,14 @@ static bool mouse_apply_one_config(struct config_file *f,
 		prof = find_prof(m, profile - 1);
 		if (!prof)
 			goto error;
-		nr = m->supported_freqs(m, &freqs);
-		if (nr <= 0)
+		if (!razer_mouse_has_caps(m, razer_mouse_freq_cap(freq)))
 			goto error;
-		for (i = 0; i < nr; i++) {
-			if (freqs[i] != (enum razer_mouse_freq)freq)
-				continue;
-			if (!prof->set_freq)
-				goto invalid;
-			err = prof->set_freq(prof, freqs[i]);
-			razer_free_freq_list(freqs, nr);
-			if (err)
-				goto error;
-			goto ok;
-		}
-		razer_free_freq_list(freqs, nr);
-		goto error;
+		if (!prof->set_freq)
+			goto invalid;
+		err = prof->set_freq(prof, freq);
+		if (err)
+			goto error;
+		goto ok;
 	} else if (strcasecmp(item, "led") == 0) {
 		bool on;
 		struct razer_led *leds, *led;
@@ -709,6 +714,9 @@ static bool mouse_apply_one_config(struct config_file *f,
 		goto error;
 	} else if (strcasecmp(item, "disabled") == 0) {
 		goto ok;
+	} else if (strcasecmp(item, "appprofile") == 0) {
+		/* Handled by razer_get_appprofile_rules(). */
+		goto ok;
 	} else
 		goto invalid;
 ok:
@@ -721,56 +729,186 @@ invalid:
 	return *error_status ? 0 : 1;
 }
 
-static void mouse_apply_initial_config(struct razer_mouse *m)
+static bool mouse_count_one_config(struct config_file *f,
+				   void *context, void *data,
+				   const char *section,
+				   const char *item,
+				   const char *value)
 {
-	const char *section = NULL;
+	unsigned int *count = data;
+
+	(*count)++;
+
+	return 1;
+}
+
+/* Apply the settings from new_conf that differ from old_conf.
+ * If old_conf is NULL, the whole matching section of new_conf is applied. */
+static int mouse_apply_config(struct razer_mouse *m,
+			      struct config_file *old_conf,
+			      struct config_file *new_conf)
+{
+	const char *section = NULL, *old_section = NULL;
+	unsigned int nr_changed = 0;
 	int err;
 	bool error_status = 0;
 
-	config_for_each_section(razer_config_file,
+	config_for_each_section(new_conf,
 				m, &section,
 				mouse_idstr_glob_match);
 	if (!section)
-		return;
-	if (config_get_bool(razer_config_file, section,
+		return 0;
+	if (config_get_bool(new_conf, section,
 			    "disabled", 0, CONF_NOCASE)) {
-		razer_debug("Initial config for \"%s\" is disabled. Not applying.\n",
+		razer_debug("Config for \"%s\" is disabled. Not applying.\n",
 			    m->idstr);
-		return;
+		return 0;
 	}
-	razer_debug("Applying config section \"%s\" to \"%s\"\n",
-		section, m->idstr);
+	if (old_conf) {
+		config_for_each_section(old_conf,
+					m, &old_section,
+					mouse_idstr_glob_match);
+		if (old_section &&
+		    config_get_bool(old_conf, old_section,
+				    "disabled", 0, CONF_NOCASE))
+			old_section = NULL;
+	}
+	config_for_each_changed_item(old_conf, old_section,
+				     new_conf, section,
+				     m, &nr_changed,
+				     mouse_count_one_config);
+	if (!nr_changed) {
+		razer_debug("Config for \"%s\" unchanged\n", m->idstr);
+		return 0;
+	}
+	razer_debug("Applying %u item(s) of config section \"%s\" to \"%s\"\n",
+		nr_changed, section, m->idstr);
 	err = m->claim(m);
 	if (err) {
 		razer_error("Failed to claim \"%s\"\n", m->idstr);
-		return;
+		return err;
 	}
-	config_for_each_item(razer_config_file,
-			     m, &error_status,
-			     section,
-			     mouse_apply_one_config);
-	m->release(m);
-	if (error_status) {
-		razer_error("Failed to apply initial config "
+	config_for_each_changed_item(old_conf, old_section,
+				     new_conf, section,
+				     m, &error_status,
+				     mouse_apply_one_config);
+	err = m->release(m);
+	if (error_status || err) {
+		razer_error("Failed to apply config "
 			"to \"%s\"\n", m->idstr);
+		return err ? err : -EIO;
 	}
+
+	return 0;
 }
 
-static struct razer_usb_context * razer_create_usb_ctx(struct libusb_device *dev)
+static struct razer_usb_context * razer_create_usb_ctx(const struct razer_usb_devinfo *info)
 {
 	struct razer_usb_context *ctx;
 
 	ctx = zalloc(sizeof(*ctx));
 	if (!ctx)
 		return NULL;
-	ctx->dev = dev;
+	ctx->transport = razer_transport;
+	ctx->desc = info->desc;
+	ctx->busnr = info->busnr;
+	ctx->devaddr = info->devaddr;
 	ctx->bConfigurationValue = 1;
+	if (ctx->transport->attach(ctx, info)) {
+		razer_free(ctx, sizeof(*ctx));
+		return NULL;
+	}
 
 	return ctx;
 }
 
+static void razer_free_usb_ctx(struct razer_usb_context *ctx)
+{
+	ctx->transport->detach(ctx);
+	razer_free(ctx, sizeof(*ctx));
+}
+
+/* struct razer_mouse_config_job - Initial configuration of a new mouse.
+ * The driver init and the initial config are committed to the device
+ * by a background thread, so that razer_rescan_mice() does not block
+ * on the device's commit latency. */
+struct razer_mouse_config_job {
+	struct razer_mouse *mouse;
+	pthread_t thread;
+	bool threaded;
+	/* Commits are deferred until the job applied the config. */
+	bool defer_commit;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool done;
+	int err;
+};
+
+static struct razer_mouse_config_job * mouse_config_job_alloc(struct razer_mouse *m)
+{
+	struct razer_mouse_config_job *job;
+
+	job = zalloc(sizeof(*job));
+	if (!job)
+		return NULL;
+	job->mouse = m;
+	job->defer_commit = 1;
+	pthread_mutex_init(&job->lock, NULL);
+	pthread_cond_init(&job->cond, NULL);
+
+	return job;
+}
+
+static void mouse_config_job_free(struct razer_mouse_config_job *job)
+{
+	pthread_mutex_destroy(&job->lock);
+	pthread_cond_destroy(&job->cond);
+	razer_free(job, sizeof(*job));
+}
+
+static bool mouse_config_job_done(struct razer_mouse_config_job *job)
+{
+	bool done;
+
+	pthread_mutex_lock(&job->lock);
+	done = job->done;
+	pthread_mutex_unlock(&job->lock);
+
+	return done;
+}
+
+/* Wait for the initial configuration of the mouse to finish. */
+static void mouse_wait_configured(struct razer_mouse *m)
+{
+	struct razer_mouse_config_job *job = m->config_job;
+
+	if (!job || !job->threaded || config_job_mouse == m)
+		return;
+	pthread_mutex_lock(&job->lock);
+	while (!job->done)
+		pthread_cond_wait(&job->cond, &job->lock);
+	pthread_mutex_unlock(&job->lock);
+}
+
+int razer_mouse_is_configuring(struct razer_mouse *m)
+{
+	/* The job is reaped by razer_handle_events(),
+	 * right before RAZER_EV_MOUSE_CONFIGURED is sent. */
+	return m->config_job != NULL;
+}
+
+static void mice_wait_configured(void)
+{
+	struct razer_mouse *m, *next;
+
+	razer_for_each_mouse(m, next, mice_list)
+		mouse_wait_configured(m);
+}
+
 static int mouse_default_claim(struct razer_mouse *m)
 {
+	mouse_wait_configured(m);
 	return razer_generic_usb_claim_refcount(m->usb_ctx, &m->claim_count);
 }
 
@@ -778,7 +916,8 @@ static int mouse_default_release(struct razer_mouse *m)
 {
 	int err = 0;
 
-	if (m->claim_count == 1) {
+	if (m->claim_count == 1 &&
+	    !(m->config_job && m->config_job->defer_commit)) {
 		if (m->commit)
 			err = m->commit(m, 0);
 	}
@@ -787,21 +926,128 @@ static int mouse_default_release(struct razer_mouse *m)
 	return err;
 }
 
+static void * mouse_config_thread(void *arg)
+{
+	struct razer_mouse_config_job *job = arg;
+	struct razer_mouse *m = job->mouse;
+	int err, rel_err;
+	char c = 0;
+
+	config_job_mouse = m;
+
+	err = m->claim(m);
+	if (err) {
+		razer_error("Failed to claim \"%s\"\n", m->idstr);
+		job->defer_commit = 0;
+	} else {
+		err = 0;
+		if (m->late_init) {
+			err = m->late_init(m);
+			if (err) {
+				razer_error("Failed to initialize \"%s\"\n",
+					    m->idstr);
+			}
+		}
+		if (!err)
+			err = mouse_apply_config(m, NULL, razer_config_file);
+		job->defer_commit = 0;
+		/* Commits the driver's initial settings and the config. */
+		rel_err = m->release(m);
+		if (rel_err) {
+			razer_error("Failed to commit initial settings "
+				"to \"%s\"\n", m->idstr);
+			if (!err)
+				err = rel_err;
+		}
+	}
+
+	config_job_mouse = NULL;
+
+	pthread_mutex_lock(&job->lock);
+	job->err = err;
+	job->done = 1;
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->lock);
+
+	if (event_pipe[1] >= 0) {
+		if (write(event_pipe[1], &c, 1) < 0 && errno != EAGAIN)
+			razer_error("Failed to signal config job completion\n");
+	}
+
+	return NULL;
+}
+
+static void mouse_start_config_job(struct razer_mouse *m)
+{
+	struct razer_mouse_config_job *job = m->config_job;
+
+	job->threaded = !pthread_create(&job->thread, NULL,
+					mouse_config_thread, job);
+	if (!job->threaded) {
+		razer_debug("Failed to create config thread. "
+			    "Configuring \"%s\" synchronously.\n",
+			    m->idstr);
+		mouse_config_thread(job);
+	}
+}
+
+static void mouse_reap_config_job(struct razer_mouse *m)
+{
+	struct razer_mouse_config_job *job = m->config_job;
+
+	if (!job)
+		return;
+	if (job->threaded)
+		pthread_join(job->thread, NULL);
+	m->config_job = NULL;
+	mouse_config_job_free(job);
+}
+
+/* Compute the capability bits once, so that users don't have to
+ * probe the callbacks and fetch the lists on every query. */
+static void mouse_init_caps(struct razer_mouse *m)
+{
+	const enum razer_mouse_freq *freqs;
+	struct razer_mouse_profile *profiles;
+	int i, count;
+
+	m->caps = 0;
+	if (m->supported_freqs) {
+		count = m->supported_freqs(m, &freqs);
+		for (i = 0; i < count; i++)
+			m->caps |= razer_mouse_freq_cap(freqs[i]);
+	}
+	if (m->global_get_leds)
+		m->caps |= RAZER_MOUSECAP_GLOBAL_LEDS;
+	if (m->global_get_freq)
+		m->caps |= RAZER_MOUSECAP_GLOBAL_FREQ;
+	profiles = m->get_profiles ? m->get_profiles(m) : NULL;
+	if (profiles) {
+		if (profiles[0].get_leds)
+			m->caps |= RAZER_MOUSECAP_PROFILE_LEDS;
+		if (profiles[0].get_freq)
+			m->caps |= RAZER_MOUSECAP_PROFILE_FREQ;
+		if (profiles[0].set_name)
+			m->caps |= RAZER_MOUSECAP_PROFNAME_MUTABLE;
+	}
+}
+
 static struct razer_mouse * mouse_new(const struct razer_usb_device *id,
-				      struct libusb_device *udev)
+				      const struct razer_usb_devinfo *info)
 {
 	struct razer_event_data ev;
 	struct razer_mouse *m;
 	int err;
 
-	libusb_ref_device(udev);
-
 	m = zalloc(sizeof(*m));
 	if (!m)
 		return NULL;
-	m->usb_ctx = razer_create_usb_ctx(udev);
+	m->usb_ctx = razer_create_usb_ctx(info);
 	if (!m->usb_ctx)
 		goto err_free_mouse;
+	m->config_job = mouse_config_job_alloc(m);
+	if (!m->config_job)
+		goto err_free_ctx;
 
 	/* Set default values and callbacks */
 	m->nr_profiles = 1;
@@ -810,10 +1056,9 @@ static struct razer_mouse * mouse_new(const struct razer_usb_device *id,
 
 	/* Call the driver init */
 	m->base_ops = id->u.mouse_ops;
-	err = m->base_ops->init(m, udev);
+	err = m->base_ops->init(m);
 	if (err)
-		goto err_free_ctx;
-	udev = m->usb_ctx->dev;
+		goto err_free_job;
 
 	if (WARN_ON(m->nr_profiles <= 0))
 		goto err_release;
@@ -824,8 +1069,7 @@ static struct razer_mouse * mouse_new(const struct razer_usb_device *id,
 		if (err)
 			goto err_release;
 	}
-
-	mouse_apply_initial_config(m);
+	mouse_init_caps(m);
 
 	razer_debug("Allocated and initialized new mouse \"%s\"\n",
 		m->idstr);
@@ -837,11 +1081,12 @@ static struct razer_mouse * mouse_new(const struct razer_usb_device *id,
 
 err_release:
 	m->base_ops->release(m);
+err_free_job:
+	mouse_config_job_free(m->config_job);
 err_free_ctx:
-	razer_free(m->usb_ctx, sizeof(*(m->usb_ctx)));
+	razer_free_usb_ctx(m->usb_ctx);
 err_free_mouse:
 	razer_free(m, sizeof(*m));
-	libusb_unref_device(udev);
 
 	return NULL;
 }
@@ -853,6 +1098,8 @@ static void razer_free_mouse(struct razer_mouse *m)
 	razer_debug("Freeing mouse (type=%d)\n",
 		m->base_ops->type);
 
+	mouse_reap_config_job(m);
+
 	ev.u.mouse = m;
 	razer_notify_event(RAZER_EV_MOUSE_REMOVE, &ev);
 
@@ -863,9 +1110,7 @@ static void razer_free_mouse(struct razer_mouse *m)
 	razer_mouse_exit_profile_emulation(m);
 	m->base_ops->release(m);
 
-	libusb_unref_device(m->usb_ctx->dev);
-
-	razer_free(m->usb_ctx, sizeof(*(m->usb_ctx)));
+	razer_free_usb_ctx(m->usb_ctx);
 	razer_free(m, sizeof(*m));
 }
 
@@ -887,40 +1132,37 @@ struct new_razer_usb_device {
 
 struct razer_mouse * razer_rescan_mice(void)
 {
-	struct libusb_device **devlist, *dev;
-	ssize_t nr_devices;
-	unsigned int i;
-	int err;
-	struct libusb_device_descriptor desc;
+	struct razer_usb_devinfo *devlist, *info;
+	ssize_t nr_devices, i;
 	const struct razer_usb_device *id;
 	struct razer_mouse *m, *next;
 
-	nr_devices = libusb_get_device_list(libusb_ctx, &devlist);
+	/* A running config job may reconnect its device.
+	 * Let it settle before matching the device list. */
+	mice_wait_configured();
+
+	nr_devices = razer_transport->get_device_list(&devlist);
 	if (nr_devices < 0) {
 		razer_error("razer_rescan_mice: Failed to get USB device list\n");
 		return NULL;
 	}
 
 	for (i = 0; i < nr_devices; i++) {
-		dev = devlist[i];
-		err = libusb_get_device_descriptor(dev, &desc);
-		if (err) {
-			razer_error("razer_rescan_mice: Failed to get descriptor\n");
-			continue;
-		}
-		id = usbdev_lookup(&desc);
+		info = &devlist[i];
+		id = usbdev_lookup(&info->desc);
 		if (!id || id->type != RAZER_DEVTYPE_MOUSE)
 			continue;
-		m = mouse_list_find(mice_list, dev);
+		m = mouse_list_find(mice_list, info);
 		if (m) {
 			/* We already had this mouse */
 			m->flags |= RAZER_MOUSEFLG_PRESENT;
 		} else {
 			/* We don't have this mouse, yet. Create a new one */
-			m = mouse_new(id, dev);
+			m = mouse_new(id, info);
 			if (m) {
 				m->flags |= RAZER_MOUSEFLG_PRESENT;
 				mouse_list_add(&mice_list, m);
+				mouse_start_config_job(m);
 			}
 		}
 	}
@@ -934,40 +1176,157 @@ struct razer_mouse * razer_rescan_mice(void)
 		razer_free_mouse(m);
 	}
 
-	libusb_free_device_list(devlist, 1);
+	razer_transport->free_device_list(devlist, nr_devices);
 
 	return mice_list;
 }
 
-int razer_reconfig_mice(void)
+int razer_get_event_fd(void)
 {
+	if (event_pipe[0] < 0)
+		return -ENODEV;
+	return event_pipe[0];
+}
+
+void razer_handle_events(void)
+{
+	struct razer_event_data ev;
 	struct razer_mouse *m, *next;
+	char buf[64];
+
+	if (event_pipe[0] >= 0) {
+		while (read(event_pipe[0], buf, sizeof(buf)) > 0)
+			;
+	}
+	razer_for_each_mouse(m, next, mice_list) {
+		if (!m->config_job || !mouse_config_job_done(m->config_job))
+			continue;
+		mouse_reap_config_job(m);
+
+		ev.u.mouse = m;
+		razer_notify_event(RAZER_EV_MOUSE_CONFIGURED, &ev);
+	}
+}
+
+struct reconfig_job {
+	struct razer_mouse *m;
+	pthread_t thread;
+	bool threaded;
 	int err;
+};
+
+static int mouse_reconfig(struct razer_mouse *m)
+{
+	int err;
+
+	err = m->claim(m);
+	if (err)
+		return err;
+	if (m->commit)
+		err = m->commit(m, 1);
+	m->release(m);
 
+	return err;
+}
+
+static void * mouse_reconfig_thread(void *arg)
+{
+	struct reconfig_job *job = arg;
+
+	job->err = mouse_reconfig(job->m);
+
+	return NULL;
+}
+
+int razer_reconfig_mice_report(struct razer_reconfig_result **results)
+{
+	struct razer_mouse *m, *next;
+	struct reconfig_job *jobs;
+	struct razer_reconfig_result *res;
+	unsigned int i, count = 0;
+
+	*results = NULL;
+	razer_for_each_mouse(m, next, mice_list)
+		count++;
+	if (!count)
+		return 0;
+
+	jobs = calloc(count, sizeof(*jobs));
+	res = calloc(count, sizeof(*res));
+	if (!jobs || !res) {
+		free(jobs);
+		free(res);
+		return -ENOMEM;
+	}
+
+	/* Each mouse has its own USB handle and commit spacing,
+	 * so run the commits concurrently. The first mouse is
+	 * done by the calling thread. */
+	i = 0;
 	razer_for_each_mouse(m, next, mice_list) {
-		err = m->claim(m);
-		if (err)
-			return err;
-		if (m->commit)
-			err = m->commit(m, 1);
-		m->release(m);
-		if (err)
-			return err;
+		jobs[i].m = m;
+		if (i > 0) {
+			jobs[i].threaded = !pthread_create(&jobs[i].thread, NULL,
+							   mouse_reconfig_thread,
+							   &jobs[i]);
+			if (!jobs[i].threaded)
+				razer_debug("Failed to create reconfig thread. "
+					    "Reconfiguring \"%s\" inline.\n",
+					    m->idstr);
+		}
+		i++;
+	}
+	for (i = 0; i < count; i++) {
+		if (!jobs[i].threaded)
+			mouse_reconfig_thread(&jobs[i]);
+	}
+	for (i = 0; i < count; i++) {
+		if (jobs[i].threaded)
+			pthread_join(jobs[i].thread, NULL);
+		res[i].mouse = jobs[i].m;
+		res[i].err = jobs[i].err;
+		if (res[i].err) {
+			razer_error("Failed to reconfigure \"%s\" (%d)\n",
+				    jobs[i].m->idstr, jobs[i].err);
+		}
 	}
+	free(jobs);
+	*results = res;
 
-	return 0;
+	return count;
 }
 
-void razer_free_freq_list(enum razer_mouse_freq *freq_list, int count)
+void razer_free_reconfig_report(struct razer_reconfig_result *results,
+				int count)
 {
-	if (freq_list)
-		free(freq_list);
+	free(results);
 }
 
-void razer_free_resolution_list(enum razer_mouse_res *res_list, int count)
+int razer_reconfig_mice(void)
+{
+	struct razer_reconfig_result *results;
+	int i, count, err = 0;
+
+	count = razer_reconfig_mice_report(&results);
+	if (count < 0)
+		return count;
+	for (i = 0; i < count; i++) {
+		if (results[i].err) {
+			err = results[i].err;
+			break;
+		}
+	}
+	razer_free_reconfig_report(results, count);
+
+	return err;
+}
+
+void razer_free_freq_list(const enum razer_mouse_freq *freq_list, int count)
+{
+}
+
+void razer_free_resolution_list(const enum razer_mouse_res *res_list, int count)
 {
-	if (res_list)
-		free(res_list);
 }
 
 void razer_free_leds(struct razer_led *led_list)
@@ -981,16 +1340,100 @@ void razer_free_leds(struct razer_led *led_list)
 	}
 }
 
+static void razer_close_event_pipe(void)
+{
+	if (event_pipe[0] >= 0)
+		close(event_pipe[0]);
+	if (event_pipe[1] >= 0)
+		close(event_pipe[1]);
+	event_pipe[0] = event_pipe[1] = -1;
+}
+
+static const struct razer_transport *razer_transports[] = {
+	&razer_transport_libusb,
+	&razer_transport_hidraw,
+	&razer_transport_sim,
+};
+
+/* Find the transport for a "name[:options]" spec. */
+const struct razer_transport * razer_transport_find(const char *spec)
+{
+	size_t len = strcspn(spec, ":");
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(razer_transports); i++) {
+		if (strlen(razer_transports[i]->name) == len &&
+		    strncmp(razer_transports[i]->name, spec, len) == 0)
+			return razer_transports[i];
+	}
+
+	return NULL;
+}
+
+int razer_set_transport(const char *spec)
+{
+	char *copy = NULL;
+
+	if (razer_initialized())
+		return -EBUSY;
+	if (spec) {
+		if (!razer_transport_find(spec))
+			return -ENOENT;
+		copy = strdup(spec);
+		if (!copy)
+			return -ENOMEM;
+	}
+	free(requested_transport);
+	requested_transport = copy;
+
+	return 0;
+}
+
 int razer_init(int enable_profile_emu)
 {
+	const struct razer_transport *transport;
+	const char *spec, *options;
 	int err = 0;
 
-	if (!razer_initialized())
+	if (!razer_initialized()) {
+		spec = requested_transport;
+		if (!spec)
+			spec = getenv("RAZER_TRANSPORT");
+		if (!spec || !spec[0])
+			spec = razer_transport_libusb.name;
+		transport = razer_transport_find(spec);
+		if (!transport) {
+			razer_error("Unknown transport \"%s\"\n", spec);
+			return -EINVAL;
+		}
+		options = strchr(spec, ':');
+		options = options ? options + 1 : "";
 		err = libusb_init(&libusb_ctx);
-	if (!err)
-		profile_emu_enabled = enable_profile_emu;
+		if (err)
+			return -EINVAL;
+		if (transport->init) {
+			err = transport->init(options);
+			if (err) {
+				razer_error("Failed to initialize the %s transport\n",
+					    transport->name);
+				libusb_exit(libusb_ctx);
+				libusb_ctx = NULL;
+				return err;
+			}
+		}
+		razer_transport = transport;
+		razer_debug("Using the %s transport\n", transport->name);
+		razer_reset_usb_stats();
+		if (pipe(event_pipe) ||
+		    fcntl(event_pipe[0], F_SETFL, O_NONBLOCK) ||
+		    fcntl(event_pipe[1], F_SETFL, O_NONBLOCK)) {
+			razer_error("Failed to create event pipe\n");
+			razer_close_event_pipe();
+		}
+	}
+	profile_emu_enabled = enable_profile_emu;
 
-	return err ? -EINVAL : 0;
+	return 0;
 }
 
 void razer_exit(void)
@@ -1001,7 +1444,12 @@ void razer_exit(void)
 	mice_list = NULL;
 	config_file_free(razer_config_file);
 	razer_config_file = NULL;
+	razer_close_event_pipe();
+	razer_devcache_set_path(NULL);
 
+	if (razer_transport->exit)
+		razer_transport->exit();
+	razer_transport = NULL;
 	libusb_exit(libusb_ctx);
 	libusb_ctx = NULL;
 }
@@ -1053,7 +1501,62 @@ static void razer_usb_release(struct razer_usb_context *ctx,
 	razer_reattach_usb_kdrv(ctx, bInterfaceNumber);
 }
 
-int razer_generic_usb_claim(struct razer_usb_context *ctx)
+static ssize_t libusb_transport_get_device_list(struct razer_usb_devinfo **list)
+{
+	struct libusb_device **devlist, *dev;
+	struct razer_usb_devinfo *infos;
+	ssize_t nr_devices, i, count = 0;
+
+	nr_devices = libusb_get_device_list(libusb_ctx, &devlist);
+	if (nr_devices < 0)
+		return -EIO;
+	infos = calloc(nr_devices ? nr_devices : 1, sizeof(*infos));
+	if (!infos) {
+		libusb_free_device_list(devlist, 1);
+		return -ENOMEM;
+	}
+	for (i = 0; i < nr_devices; i++) {
+		dev = devlist[i];
+		if (libusb_get_device_descriptor(dev, &infos[count].desc)) {
+			razer_error("razer_rescan_mice: Failed to get descriptor\n");
+			continue;
+		}
+		infos[count].busnr = libusb_get_bus_number(dev);
+		infos[count].devaddr = libusb_get_device_address(dev);
+		infos[count].priv = libusb_ref_device(dev);
+		count++;
+	}
+	libusb_free_device_list(devlist, 1);
+	*list = infos;
+
+	return count;
+}
+
+static void libusb_transport_free_device_list(struct razer_usb_devinfo *list,
+					      ssize_t count)
+{
+	ssize_t i;
+
+	for (i = 0; i < count; i++)
+		libusb_unref_device(list[i].priv);
+	free(list);
+}
+
+static int libusb_transport_attach(struct razer_usb_context *ctx,
+				   const struct razer_usb_devinfo *info)
+{
+	ctx->dev = libusb_ref_device(info->priv);
+
+	return 0;
+}
+
+static void libusb_transport_detach(struct razer_usb_context *ctx)
+{
+	libusb_unref_device(ctx->dev);
+	ctx->dev = NULL;
+}
+
+static int libusb_transport_claim(struct razer_usb_context *ctx)
 {
 	unsigned int tries, i;
 	int err, config;
@@ -1149,6 +1652,71 @@ err_close:
 	return err;
 }
 
+static void libusb_transport_release(struct razer_usb_context *ctx)
+{
+	int i;
+
+	for (i = ctx->nr_interfaces - 1; i >= 0; i--)
+		razer_usb_release(ctx, ctx->interfaces[i].bInterfaceNumber);
+	libusb_close(ctx->h);
+	ctx->h = NULL;
+}
+
+static int libusb_transport_control(struct razer_usb_context *ctx,
+				    uint8_t request_type, uint8_t request,
+				    uint16_t value, uint16_t index,
+				    unsigned char *data, uint16_t length,
+				    unsigned int timeout)
+{
+	return libusb_control_transfer(ctx->h, request_type, request,
+				       value, index, data, length, timeout);
+}
+
+static int libusb_transport_bulk(struct razer_usb_context *ctx, unsigned char endpoint,
+				 unsigned char *data, int length, int *transferred,
+				 unsigned int timeout)
+{
+	return libusb_bulk_transfer(ctx->h, endpoint, data, length,
+				    transferred, timeout);
+}
+
+static int libusb_transport_get_string(struct razer_usb_context *ctx, uint8_t index,
+				       char *buf, size_t size)
+{
+	return libusb_get_string_descriptor_ascii(ctx->h, index,
+						  (unsigned char *)buf, size);
+}
+
+const struct razer_transport razer_transport_libusb = {
+	.name			= "libusb",
+	.get_device_list	= libusb_transport_get_device_list,
+	.free_device_list	= libusb_transport_free_device_list,
+	.attach			= libusb_transport_attach,
+	.detach			= libusb_transport_detach,
+	.claim			= libusb_transport_claim,
+	.release		= libusb_transport_release,
+	.control		= libusb_transport_control,
+	.bulk			= libusb_transport_bulk,
+	.get_string		= libusb_transport_get_string,
+};
+
+static inline const struct razer_transport * ctx_transport(const struct razer_usb_context *ctx)
+{
+	/* Private contexts, like the cypress bootloader's, are always libusb. */
+	return ctx->transport ? ctx->transport : &razer_transport_libusb;
+}
+
+int razer_generic_usb_claim(struct razer_usb_context *ctx)
+{
+	int err;
+
+	err = ctx_transport(ctx)->claim(ctx);
+	if (!err)
+		ctx->claimed = 1;
+
+	return err;
+}
+
 int razer_generic_usb_claim_refcount(struct razer_usb_context *ctx,
 				     unsigned int *refcount)
 {
@@ -1166,11 +1734,8 @@ int razer_generic_usb_claim_refcount(struct razer_usb_context *ctx,
 
 void razer_generic_usb_release(struct razer_usb_context *ctx)
 {
-	int i;
-
-	for (i = ctx->nr_interfaces - 1; i >= 0; i--)
-		razer_usb_release(ctx, ctx->interfaces[i].bInterfaceNumber);
-	libusb_close(ctx->h);
+	ctx_transport(ctx)->release(ctx);
+	ctx->claimed = 0;
 }
 
 void razer_generic_usb_release_refcount(struct razer_usb_context *ctx,
@@ -1183,8 +1748,77 @@ void razer_generic_usb_release_refcount(struct razer_usb_context *ctx,
 	}
 }
 
-void razer_generic_usb_gen_idstr(struct libusb_device *udev,
-				 struct libusb_device_handle *h,
+/** razer_usb_control - Do a control transfer on the device.
+ *
+ * This has the semantics of libusb_control_transfer(), but goes through
+ * the device's transport backend.
+ */
+int razer_usb_control(struct razer_usb_context *ctx,
+		      uint8_t request_type, uint8_t request,
+		      uint16_t value, uint16_t index,
+		      unsigned char *data, uint16_t length,
+		      unsigned int timeout)
+{
+	int res;
+
+	res = ctx_transport(ctx)->control(ctx, request_type, request,
+					  value, index, data, length, timeout);
+	razer_usb_stats_add(control_transfers, 1);
+	if (res < 0)
+		razer_usb_stats_add(errors, 1);
+	else
+		razer_usb_stats_add(bytes, res);
+
+	return res;
+}
+
+/** razer_usb_bulk - Do a bulk transfer on the device.
+ *
+ * This has the semantics of libusb_bulk_transfer(), but goes through
+ * the device's transport backend.
+ */
+int razer_usb_bulk(struct razer_usb_context *ctx, unsigned char endpoint,
+		   unsigned char *data, int length, int *transferred,
+		   unsigned int timeout)
+{
+	const struct razer_transport *t = ctx_transport(ctx);
+	int err;
+
+	*transferred = 0;
+	if (!t->bulk)
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+
+	err = t->bulk(ctx, endpoint, data, length, transferred, timeout);
+	razer_usb_stats_add(bulk_transfers, 1);
+	if (err)
+		razer_usb_stats_add(errors, 1);
+	razer_usb_stats_add(bytes, *transferred);
+
+	return err;
+}
+
+void razer_get_usb_stats(struct razer_usb_stats *stats)
+{
+	stats->control_transfers = __atomic_load_n(&razer_usb_stats.control_transfers,
+						   __ATOMIC_RELAXED);
+	stats->bulk_transfers = __atomic_load_n(&razer_usb_stats.bulk_transfers,
+						__ATOMIC_RELAXED);
+	stats->bytes = __atomic_load_n(&razer_usb_stats.bytes, __ATOMIC_RELAXED);
+	stats->errors = __atomic_load_n(&razer_usb_stats.errors, __ATOMIC_RELAXED);
+	stats->sleep_msec = __atomic_load_n(&razer_usb_stats.sleep_msec,
+					    __ATOMIC_RELAXED);
+}
+
+void razer_reset_usb_stats(void)
+{
+	__atomic_store_n(&razer_usb_stats.control_transfers, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&razer_usb_stats.bulk_transfers, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&razer_usb_stats.bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&razer_usb_stats.errors, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&razer_usb_stats.sleep_msec, 0, __ATOMIC_RELAXED);
+}
+
+void razer_generic_usb_gen_idstr(struct razer_usb_context *ctx,
 				 const char *devname,
 				 bool include_devicenr,
 				 const char *serial,
@@ -1197,18 +1831,8 @@ void razer_generic_usb_gen_idstr(struct libusb_device *udev,
 	size_t i;
 	unsigned int serial_index = 0;
 	int err;
-	struct libusb_device_descriptor devdesc;
-	struct razer_usb_context usbctx = {
-		.dev = udev,
-		.h = h,
-	};
-
-	err = libusb_get_device_descriptor(udev, &devdesc);
-	if (err) {
-		razer_error("razer_generic_usb_gen_idstr: Failed to get "
-			"device descriptor (%d)\n", err);
-		return;
-	}
+	bool claimed = ctx->claimed;
+	const struct libusb_device_descriptor *devdesc = &ctx->desc;
 
 	if (serial && strlen(serial)) {
 		/* Enforce ASCII characters. */
@@ -1225,20 +1849,19 @@ void razer_generic_usb_gen_idstr(struct libusb_device *udev,
 		serial = serial_buf;
 	} else {
 		serial_buf[0] = '\0';
-		serial_index = devdesc.iSerialNumber;
+		serial_index = devdesc->iSerialNumber;
 		err = -EINVAL;
 		if (serial_index) {
 			err = 0;
-			if (!h)
-				err = razer_generic_usb_claim(&usbctx);
+			if (!claimed)
+				err = razer_generic_usb_claim(ctx);
 			if (err) {
 				razer_error("Failed to claim device for serial fetching.\n");
 			} else {
-				err = libusb_get_string_descriptor_ascii(
-					usbctx.h, serial_index,
-					(unsigned char *)serial_buf, sizeof(serial_buf));
-				if (!h)
-					razer_generic_usb_release(&usbctx);
+				err = ctx_transport(ctx)->get_string(ctx, serial_index,
+						serial_buf, sizeof(serial_buf));
+				if (!claimed)
+					razer_generic_usb_release(ctx);
 				/* Enforce ASCII characters. */
 				for (i = 0; i < ARRAY_SIZE(serial_buf); i++) {
 					if (serial_buf[i] == '\0')
@@ -1254,15 +1877,14 @@ void razer_generic_usb_gen_idstr(struct libusb_device *udev,
 	}
 
 	snprintf(devid, sizeof(devid), "%04X-%04X-%s",
-		 devdesc.idVendor,
-		 devdesc.idProduct, serial);
+		 devdesc->idVendor,
+		 devdesc->idProduct, serial);
 	if (include_devicenr) {
 		snprintf(buspos, sizeof(buspos), "%03d-%03d",
-			 libusb_get_bus_number(udev),
-			 libusb_get_device_address(udev));
+			 ctx->busnr, ctx->devaddr);
 	} else {
 		snprintf(buspos, sizeof(buspos), "%03d",
-			 libusb_get_bus_number(udev));
+			 ctx->busnr);
 	}
 
 	razer_create_idstr(idstr_buf, BUSTYPESTR_USB, buspos,
@@ -1282,6 +1904,13 @@ int razer_usb_force_hub_reset(struct razer_usb_context *device_ctx)
 	struct libusb_device **devlist;
 	ssize_t devlist_size, i;
 
+	if (!razer_transport_is_libusb(device_ctx)) {
+		/* The kernel driver keeps the device bound. No reinit needed. */
+		razer_debug("Skipping the hub reset on the %s transport\n",
+			    device_ctx->transport->name);
+		return 0;
+	}
+
 	razer_debug("Forcing hub reset for device %03u:%03u\n",
 		libusb_get_bus_number(device_ctx->dev),
 		libusb_get_device_address(device_ctx->dev));
@@ -1342,17 +1971,10 @@ error:
 int razer_usb_reconnect_guard_init(struct razer_usb_reconnect_guard *guard,
 				   struct razer_usb_context *ctx)
 {
-	int err;
-
 	guard->ctx = ctx;
-	err = libusb_get_device_descriptor(ctx->dev, &guard->old_desc);
-	if (err) {
-		razer_error("razer_usb_reconnect_guard_init: Failed to "
-			"get device descriptor\n");
-		return err;
-	}
-	guard->old_busnr = libusb_get_bus_number(ctx->dev);
-	guard->old_devaddr = libusb_get_device_address(ctx->dev);
+	guard->old_desc = ctx->desc;
+	guard->old_busnr = ctx->busnr;
+	guard->old_devaddr = ctx->devaddr;
 
 	return 0;
 }
@@ -1405,6 +2027,33 @@ found_dev:
 	return dev;
 }
 
+/* Reconnect handling for transports without libusb bus tracking.
+ * These find the device by a stable path, so just reopen it. */
+static int guard_wait_reclaim(struct razer_usb_reconnect_guard *guard, bool hub_reset)
+{
+	struct timeval now, timeout;
+	int err;
+
+	if (hub_reset)
+		return 0;
+	razer_generic_usb_release(guard->ctx);
+
+	gettimeofday(&timeout, NULL);
+	razer_timeval_add_msec(&timeout, 3000);
+	while (1) {
+		razer_msleep(50);
+		err = razer_generic_usb_claim(guard->ctx);
+		if (!err)
+			return 0;
+		gettimeofday(&now, NULL);
+		if (razer_timeval_after(&now, &timeout))
+			break;
+	}
+	razer_error("razer_usb_reconnect_guard: Reclaim failed.\n");
+
+	return err;
+}
+
 /** razer_usb_reconnect_guard_wait - Protect against a firmware reconnect.
  *
  * If the firmware does a reconnect of the device on the USB bus, this
@@ -1425,6 +2074,9 @@ int razer_usb_reconnect_guard_wait(struct razer_usb_reconnect_guard *guard, bool
 	struct libusb_device *dev;
 	struct timeval now, timeout;
 
+	if (!razer_transport_is_libusb(guard->ctx))
+		return guard_wait_reclaim(guard, hub_reset);
+
 	if (!hub_reset) {
 		/* Release the device, so the kernel can detect the bus reconnect. */
 		razer_generic_usb_release(guard->ctx);
@@ -1479,6 +2131,8 @@ int razer_usb_reconnect_guard_wait(struct razer_usb_reconnect_guard *guard, bool
 	/* Update the USB context. */
 	libusb_unref_device(guard->ctx->dev);
 	guard->ctx->dev = dev;
+	guard->ctx->busnr = libusb_get_bus_number(dev);
+	guard->ctx->devaddr = libusb_get_device_address(dev);
 
 reclaim:
 	if (!hub_reset) {
@@ -1493,6 +2147,199 @@ out:
 	return errorcode;
 }
 
+/** razer_usb_get_location - Get the physical USB location of a device.
+ *
+ * The location is the bus number and the port path. Unlike the
+ * device address, it stays the same when the device re-enumerates
+ * on the same port.
+ */
+int razer_usb_get_location(struct libusb_device *dev,
+			   struct razer_usb_location *loc)
+{
+	int nr_ports;
+
+	memset(loc, 0, sizeof(*loc));
+	if (!dev)
+		return -ENODEV;
+	nr_ports = libusb_get_port_numbers(dev, loc->ports,
+					   ARRAY_SIZE(loc->ports));
+	if (nr_ports < 0)
+		return -EIO;
+	loc->busnr = libusb_get_bus_number(dev);
+	loc->nr_ports = nr_ports;
+
+	return 0;
+}
+
+static bool usb_device_at(struct libusb_device *dev,
+			  const struct razer_usb_location *loc)
+{
+	struct razer_usb_location dev_loc;
+
+	if (razer_usb_get_location(dev, &dev_loc))
+		return false;
+
+	return dev_loc.busnr == loc->busnr &&
+	       dev_loc.nr_ports == loc->nr_ports &&
+	       memcmp(dev_loc.ports, loc->ports, loc->nr_ports) == 0;
+}
+
+struct usb_wait_context {
+	uint16_t vendor;
+	uint16_t product;
+	const struct razer_usb_location *loc;
+	struct libusb_device *dev;
+};
+
+static int usb_wait_hotplug_cb(libusb_context *ctx, libusb_device *dev,
+			       libusb_hotplug_event event, void *user_data)
+{
+	struct usb_wait_context *wait = user_data;
+
+	if (event != LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED || wait->dev)
+		return 0;
+	if (!usb_device_at(dev, wait->loc))
+		return 0;
+	wait->dev = libusb_ref_device(dev);
+
+	return 0;
+}
+
+static struct libusb_device * usb_find_device(const struct usb_wait_context *wait)
+{
+	struct libusb_device_descriptor desc;
+	struct libusb_device **devlist, *dev = NULL;
+	ssize_t nr_devices, i;
+
+	nr_devices = libusb_get_device_list(libusb_ctx, &devlist);
+	if (nr_devices < 0)
+		return NULL;
+	for (i = 0; i < nr_devices; i++) {
+		if (libusb_get_device_descriptor(devlist[i], &desc))
+			continue;
+		if (desc.idVendor != wait->vendor ||
+		    desc.idProduct != wait->product)
+			continue;
+		if (!usb_device_at(devlist[i], wait->loc))
+			continue;
+		dev = libusb_ref_device(devlist[i]);
+		break;
+	}
+	libusb_free_device_list(devlist, 1);
+
+	return dev;
+}
+
+/** razer_usb_wait_for_device - Wait for a USB device to appear on the bus.
+ *
+ * Returns a referenced device or NULL, if no device with the IDs
+ * appeared at the location within timeout_msec. Devices with the IDs
+ * on other ports are ignored. An already present device at the
+ * location is returned immediately.
+ * Hotplug events are used, if libusb supports them. Otherwise the bus
+ * is polled.
+ */
+struct libusb_device * razer_usb_wait_for_device(uint16_t vendor, uint16_t product,
+						 const struct razer_usb_location *loc,
+						 unsigned int timeout_msec)
+{
+	struct usb_wait_context wait = {
+		.vendor		= vendor,
+		.product	= product,
+		.loc		= loc,
+	};
+	libusb_hotplug_callback_handle handle;
+	struct timeval now, deadline, tv;
+	int msec, err;
+
+	gettimeofday(&deadline, NULL);
+	razer_timeval_add_msec(&deadline, timeout_msec);
+
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+		goto poll;
+	err = libusb_hotplug_register_callback(libusb_ctx,
+			LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED,
+			LIBUSB_HOTPLUG_ENUMERATE,
+			vendor, product, LIBUSB_HOTPLUG_MATCH_ANY,
+			usb_wait_hotplug_cb, &wait, &handle);
+	if (err) {
+		razer_debug("Failed to register the hotplug callback (%d)\n", err);
+		goto poll;
+	}
+	while (!wait.dev) {
+		gettimeofday(&now, NULL);
+		msec = razer_timeval_msec_diff(&deadline, &now);
+		if (msec <= 0)
+			break;
+		tv.tv_sec = msec / 1000;
+		tv.tv_usec = (msec % 1000) * 1000;
+		err = libusb_handle_events_timeout(libusb_ctx, &tv);
+		if (err && err != LIBUSB_ERROR_INTERRUPTED)
+			break;
+	}
+	libusb_hotplug_deregister_callback(libusb_ctx, handle);
+
+	return wait.dev;
+
+poll:
+	while (1) {
+		wait.dev = usb_find_device(&wait);
+		if (wait.dev)
+			break;
+		gettimeofday(&now, NULL);
+		if (razer_timeval_after(&now, &deadline))
+			break;
+		razer_msleep(20);
+	}
+
+	return wait.dev;
+}
+
+int razer_flash_firmware(struct razer_mouse *m,
+			 const char *data, size_t len,
+			 razer_flash_progress_t progress, void *priv)
+{
+	int err;
+
+	if (!m->flash_firmware)
+		return -EOPNOTSUPP;
+	m->flash_progress = progress;
+	m->flash_progress_priv = priv;
+	err = m->flash_firmware(m, data, len, RAZER_FW_FLASH_MAGIC);
+	m->flash_progress = NULL;
+	m->flash_progress_priv = NULL;
+
+	return err;
+}
+
+/** razer_flash_report - Report firmware flash progress.
+ * m may be NULL. Returns -ECANCELED, if the flash shall be cancelled.
+ * That is only possible in the prepare phase and right before
+ * the first block is written.
+ */
+int razer_flash_report(struct razer_mouse *m, enum razer_flash_phase phase,
+		       unsigned int done, unsigned int total)
+{
+	int cancel;
+
+	if (!m || !m->flash_progress)
+		return 0;
+	cancel = m->flash_progress(m, phase, done, total,
+				   m->flash_progress_priv);
+	if (cancel && (phase == RAZER_FLASH_PREPARE ||
+		       (phase == RAZER_FLASH_WRITE && done == 0))) {
+		razer_info("Firmware flash cancelled\n");
+		return -ECANCELED;
+	}
+
+	return 0;
+}
+
+int razer_set_state_cache(const char *path)
+{
+	return razer_devcache_set_path(path);
+}
+
 int razer_load_config(const char *path)
 {
 	struct config_file *conf = NULL;
@@ -1507,12 +2354,139 @@ int razer_load_config(const char *path)
 		if (!conf)
 			return -ENOENT;
 	}
+	mice_wait_configured();
 	config_file_free(razer_config_file);
 	razer_config_file = conf;
 
 	return 0;
 }
 
+int razer_reload_config(const char *path)
+{
+	struct config_file *conf = NULL, *old_conf;
+	struct razer_mouse *m, *next;
+	int err, ret = 0;
+
+	if (!razer_initialized())
+		return -EINVAL;
+
+	if (!path)
+		path = RAZER_DEFAULT_CONFIG;
+	if (strlen(path)) {
+		conf = config_file_parse(path, 1);
+		if (!conf)
+			return -ENOENT;
+	}
+	mice_wait_configured();
+	old_conf = razer_config_file;
+	razer_config_file = conf;
+
+	razer_for_each_mouse(m, next, mice_list) {
+		err = mouse_apply_config(m, old_conf, conf);
+		if (err && !ret)
+			ret = err;
+	}
+	config_file_free(old_conf);
+
+	return ret;
+}
+
+struct appprofile_rules_context {
+	struct razer_appprofile_rule **tail;
+	int count;
+	int err;
+};
+
+static bool mouse_get_one_appprofile(struct config_file *f,
+				     void *context, void *data,
+				     const char *section,
+				     const char *item,
+				     const char *value)
+{
+	struct appprofile_rules_context *ctx = data;
+	struct razer_appprofile_rule *rule;
+	static const size_t tmplen = RAZER_APPPROFILE_PATTERN_MAX_SIZE;
+	char a[tmplen], b[tmplen], c[tmplen];
+	const char *match;
+	int err, profile;
+
+	if (strcasecmp(item, "appprofile") != 0)
+		return 1;
+	err = razer_split_tuple(value, ':', tmplen, a, b, c, NULL);
+	if (err || !strlen(razer_string_strip(b)))
+		goto invalid;
+	err = razer_string_to_int(razer_string_strip(c), &profile);
+	if (err || profile < 1)
+		goto invalid;
+
+	rule = zalloc(sizeof(*rule));
+	if (!rule) {
+		ctx->err = -ENOMEM;
+		return 0;
+	}
+	match = razer_string_strip(a);
+	if (strcasecmp(match, "exe") == 0)
+		rule->match = RAZER_APPPROFILE_EXE;
+	else if (strcasecmp(match, "cgroup") == 0)
+		rule->match = RAZER_APPPROFILE_CGROUP;
+	else {
+		free(rule);
+		goto invalid;
+	}
+	razer_strlcpy(rule->pattern, razer_string_strip(b), sizeof(rule->pattern));
+	rule->profile = profile - 1;
+
+	*ctx->tail = rule;
+	ctx->tail = &rule->next;
+	ctx->count++;
+
+	return 1;
+invalid:
+	razer_error("Config section \"%s\" item \"%s\" "
+		"invalid.\n", section, item);
+	return 1;
+}
+
+int razer_get_appprofile_rules(struct razer_mouse *m,
+			       struct razer_appprofile_rule **rules)
+{
+	struct appprofile_rules_context ctx = { .tail = rules, };
+	const char *section = NULL;
+
+	*rules = NULL;
+	if (!razer_config_file)
+		return 0;
+	config_for_each_section(razer_config_file,
+				m, &section,
+				mouse_idstr_glob_match);
+	if (!section)
+		return 0;
+	if (config_get_bool(razer_config_file, section,
+			    "disabled", 0, CONF_NOCASE))
+		return 0;
+	config_for_each_item(razer_config_file,
+			     m, &ctx, section,
+			     mouse_get_one_appprofile);
+	if (ctx.err) {
+		razer_free_appprofile_rules(*rules);
+		*rules = NULL;
+		return ctx.err;
+	}
+
+	return ctx.count;
+}
+
+void razer_free_appprofile_rules(struct razer_appprofile_rule *rules)
+{
+	struct razer_appprofile_rule *rule, *next;
+
+	for (rule = rules; rule; ) {
+		next = rule->next;
+		free(rule);
+		rule = next;
+	}
+}
+
 void razer_set_logging(razer_logfunc_t info_callback,
 		       razer_logfunc_t error_callback,
 		       razer_logfunc_t debug_callback)
@@ -1542,6 +2516,27 @@ void razer_init_axes(struct razer_axis *axes,
 	do_init_axis(&axes[2], 2, name2, flags2);
 }
 
+#define RES_STEPS_8(step, first)					\
+	(first), (first) + (step), (first) + 2 * (step),		\
+	(first) + 3 * (step), (first) + 4 * (step),			\
+	(first) + 5 * (step), (first) + 6 * (step), (first) + 7 * (step)
+#define RES_STEPS_32(step, first)					\
+	RES_STEPS_8(step, first), RES_STEPS_8(step, (first) + 8 * (step)),	\
+	RES_STEPS_8(step, (first) + 16 * (step)),			\
+	RES_STEPS_8(step, (first) + 24 * (step))
+
+const enum razer_mouse_res razer_res_steps_100dpi[RAZER_NR_RES_STEPS_100DPI] = {
+	RES_STEPS_32(100, 100),
+	RES_STEPS_32(100, 3300),
+	RES_STEPS_32(100, 6500),
+	RES_STEPS_32(100, 9700),
+	RES_STEPS_32(100, 12900),
+};
+
+const enum razer_mouse_res razer_res_steps_125dpi[RAZER_NR_RES_STEPS_125DPI] = {
+	RES_STEPS_32(125, 125),
+};
+
 struct razer_mouse_dpimapping * razer_mouse_get_dpimapping_by_res(
 		struct razer_mouse_dpimapping *mappings, size_t nr_mappings,
 		enum razer_dimension dim, enum razer_mouse_res res)
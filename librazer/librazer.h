@@ -32,11 +32,13 @@
 #define RAZER_IDSTR_MAX_SIZE	128
 #define RAZER_LEDNAME_MAX_SIZE	64
 #define RAZER_DEFAULT_CONFIG	"/etc/razer.conf"
+#define RAZER_DEFAULT_STATE_CACHE	"/var/cache/razer/devstate"
 
 /* Opaque internal data structures */
 struct razer_usb_context;
 struct razer_mouse_base_ops;
 struct razer_mouse_profile_emu;
+struct razer_mouse_config_job;
 
 struct razer_mouse;
 
@@ -430,6 +432,35 @@ enum razer_mouse_flags {
 	RAZER_MOUSEFLG_PRESENT		= (1 << 15),
 };
 
+/** enum razer_mouse_caps - Capabilities of a mouse
+ *
+ * @RAZER_MOUSECAP_FREQ_125HZ: 125 Hz scan frequency is supported.
+ *
+ * @RAZER_MOUSECAP_FREQ_500HZ: 500 Hz scan frequency is supported.
+ *
+ * @RAZER_MOUSECAP_FREQ_1000HZ: 1000 Hz scan frequency is supported.
+ *
+ * @RAZER_MOUSECAP_GLOBAL_FREQ: The scan frequency is managed globally.
+ *
+ * @RAZER_MOUSECAP_PROFILE_FREQ: The scan frequency is managed per profile.
+ *
+ * @RAZER_MOUSECAP_GLOBAL_LEDS: The LEDs are managed globally.
+ *
+ * @RAZER_MOUSECAP_PROFILE_LEDS: The LEDs are managed per profile.
+ *
+ * @RAZER_MOUSECAP_PROFNAME_MUTABLE: The profile names can be changed.
+ */
+enum razer_mouse_caps {
+	RAZER_MOUSECAP_FREQ_125HZ	= (1 << 0),
+	RAZER_MOUSECAP_FREQ_500HZ	= (1 << 1),
+	RAZER_MOUSECAP_FREQ_1000HZ	= (1 << 2),
+	RAZER_MOUSECAP_GLOBAL_FREQ	= (1 << 3),
+	RAZER_MOUSECAP_PROFILE_FREQ	= (1 << 4),
+	RAZER_MOUSECAP_GLOBAL_LEDS	= (1 << 5),
+	RAZER_MOUSECAP_PROFILE_LEDS	= (1 << 6),
+	RAZER_MOUSECAP_PROFNAME_MUTABLE	= (1 << 7),
+};
+
 /** enum - Various constants
  *
  * @RAZER_FW_FLASH_MAGIC: Magic parameter to flash_firmware callback.
@@ -441,6 +472,38 @@ enum {
 	RAZER_NR_EMULATED_PROFILES	= 20,
 };
 
+/** enum razer_flash_phase - Firmware flashing phases
+ *
+ * @RAZER_FLASH_PREPARE: The flash is about to start.
+ *
+ * @RAZER_FLASH_REENUM: Waiting for the device to re-enumerate
+ *	in bootloader mode.
+ *
+ * @RAZER_FLASH_WRITE: Writing the image. The progress is reported in blocks.
+ *
+ * @RAZER_FLASH_VERIFY: Verifying the written image.
+ *
+ * @RAZER_FLASH_FINISH: Finalizing and leaving the bootloader.
+ */
+enum razer_flash_phase {
+	RAZER_FLASH_PREPARE,
+	RAZER_FLASH_REENUM,
+	RAZER_FLASH_WRITE,
+	RAZER_FLASH_VERIFY,
+	RAZER_FLASH_FINISH,
+};
+
+/** razer_flash_progress_t - Firmware flash progress callback.
+ * @done and @total are the progress within the phase.
+ * Return nonzero to cancel the flash. Cancellation is only possible
+ * in the prepare phase and right before the first block of the image
+ * is written. Other requests are ignored.
+ */
+typedef int (*razer_flash_progress_t)(struct razer_mouse *m,
+				      enum razer_flash_phase phase,
+				      unsigned int done, unsigned int total,
+				      void *priv);
+
 /** struct razer_mouse - Representation of a mouse device
   *
   * @next: Linked list to the next mouse.
@@ -451,6 +514,9 @@ enum {
   *
   * @flags: Various ORed enum razer_mouse_flags.
   *
+  * @caps: Various ORed enum razer_mouse_caps.
+  *	Computed by librazer after the driver init. Read-only.
+  *
   * @claim: Claim and open the backend device (USB).
   * 	As long as the device is claimed, it is not operable by the user!
   *	Claim can be called multiple times before release, but it must always
@@ -503,12 +569,12 @@ enum {
   * @supported_resolutions: Returns a list of supported scan resolutions
   *	for this mouse in res_ptr.
   *	The return value is a positive list length or a negative error code.
-  *	The caller is responsible to free res_ptr.
+  *	The list is a static table of the driver. Do not free or modify it.
   *
   * @supported_freqs: Get an array of supported scan frequencies.
   * 	Returns the array size or a negative error code.
   * 	freq_ptr points to the array.
-  * 	The caller is responsible to free freq_ptr.
+  *	The array is a static table of the driver. Do not free or modify it.
   *
   * @supported_dpimappings: Returns a list of supported scan resolution
   *	mappings in res_ptr.
@@ -534,6 +600,7 @@ struct razer_mouse {
 
 	enum razer_mouse_type type;
 	unsigned int flags;
+	unsigned int caps;
 
 	int (*claim)(struct razer_mouse *m);
 	int (*release)(struct razer_mouse *m);
@@ -561,9 +628,9 @@ struct razer_mouse {
 	int (*supported_axes)(struct razer_mouse *m,
 			      struct razer_axis **res_ptr);
 	int (*supported_resolutions)(struct razer_mouse *m,
-				     enum razer_mouse_res **res_ptr);
+				     const enum razer_mouse_res **res_ptr);
 	int (*supported_freqs)(struct razer_mouse *m,
-			       enum razer_mouse_freq **freq_ptr);
+			       const enum razer_mouse_freq **freq_ptr);
 	int (*supported_dpimappings)(struct razer_mouse *m,
 				     struct razer_mouse_dpimapping **res_ptr);
 	int (*supported_buttons)(struct razer_mouse *m,
@@ -576,6 +643,12 @@ struct razer_mouse {
 	struct razer_usb_context *usb_ctx;
 	unsigned int claim_count;
 	struct razer_mouse_profile_emu *profemu;
+	struct razer_mouse_config_job *config_job;
+	razer_flash_progress_t flash_progress;
+	void *flash_progress_priv;
+	/* Optional. Called by the config job with the device claimed,
+	 * before the config is applied. */
+	int (*late_init)(struct razer_mouse *m);
 	void *drv_data; /* For use by the hardware driver */
 };
 
@@ -591,17 +664,46 @@ void razer_msleep(unsigned int msecs);
  */
 void razer_strlcpy(char *dst, const char *src, size_t dst_size);
 
+/** razer_mouse_freq_cap - Get the capability bit of a scan frequency.
+  * Returns the RAZER_MOUSECAP_FREQ_... bit or 0 for an unknown frequency.
+  */
+static inline unsigned int razer_mouse_freq_cap(enum razer_mouse_freq freq)
+{
+	switch (freq) {
+	case RAZER_MOUSE_FREQ_125HZ:
+		return RAZER_MOUSECAP_FREQ_125HZ;
+	case RAZER_MOUSE_FREQ_500HZ:
+		return RAZER_MOUSECAP_FREQ_500HZ;
+	case RAZER_MOUSE_FREQ_1000HZ:
+		return RAZER_MOUSECAP_FREQ_1000HZ;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/** razer_mouse_has_caps - Check the capabilities of a mouse.
+  * Returns nonzero, if the mouse has all capabilities in the ORed
+  * enum razer_mouse_caps mask. An empty mask is never supported.
+  */
+static inline int razer_mouse_has_caps(const struct razer_mouse *m,
+					unsigned int caps)
+{
+	return caps && (m->caps & caps) == caps;
+}
+
 /** razer_free_freq_list - Free an array of frequencies.
-  * This function frees a whole array of frequencies as returned
-  * by the device methods.
+  * The frequency lists of the drivers are static. This does nothing.
+  * It is kept for existing callers.
   */
-void razer_free_freq_list(enum razer_mouse_freq *freq_list, int count);
+void razer_free_freq_list(const enum razer_mouse_freq *freq_list, int count);
 
 /** razer_free_resolution_list - Free an array of resolutions.
-  * This function frees a whole array of resolutions as returned
-  * by the device methods.
+  * The resolution lists of the drivers are static. This does nothing.
+  * It is kept for existing callers.
   */
-void razer_free_resolution_list(enum razer_mouse_res *res_list, int count);
+void razer_free_resolution_list(const enum razer_mouse_res *res_list, int count);
 
 /** razer_free_leds - Free a linked list of struct razer_led.
   * This function frees a whole linked list of struct razer_led,
@@ -617,11 +719,54 @@ void razer_free_leds(struct razer_led *led_list);
   */
 struct razer_mouse * razer_rescan_mice(void);
 
+/** razer_mouse_is_configuring - Check for the initial configuration.
+  * Returns nonzero, while the initial configuration of the mouse runs
+  * in the background. The driver state must not be read without
+  * claiming the mouse until RAZER_EV_MOUSE_CONFIGURED was delivered.
+  */
+int razer_mouse_is_configuring(struct razer_mouse *m);
+
+/** struct razer_reconfig_result - Reconfiguration result of one mouse.
+  *
+  * @mouse: The mouse.
+  *
+  * @err: 0 on success or a negative error code.
+  */
+struct razer_reconfig_result {
+	struct razer_mouse *mouse;
+	int err;
+};
+
 /** razer_reconfig_mice - Reconfigure all detected razer mice.
-  * Returns 0 on success or an error code.
+  * The mice are reconfigured concurrently. A failure on one mouse
+  * does not stop the reconfiguration of the others.
+  * Returns 0 on success or the error code of the first failed mouse.
   */
 int razer_reconfig_mice(void);
 
+/** razer_reconfig_mice_report - Reconfigure all detected razer mice.
+  * Same as razer_reconfig_mice(), but returns a per-mouse report.
+  * The report is allocated and put into results. It must be freed
+  * with razer_free_reconfig_report().
+  * Returns the number of entries in the report or a negative error code.
+  */
+int razer_reconfig_mice_report(struct razer_reconfig_result **results);
+
+/** razer_free_reconfig_report - Free a report returned by
+  * razer_reconfig_mice_report().
+  */
+void razer_free_reconfig_report(struct razer_reconfig_result *results,
+				int count);
+
+/** razer_flash_firmware - Flash a firmware image with progress reports.
+ * The mouse must be claimed. progress may be NULL.
+ * Returns 0 on success, -ECANCELED if the flash was cancelled
+ * by the progress callback, or another negative error code.
+ */
+int razer_flash_firmware(struct razer_mouse *m,
+			 const char *data, size_t len,
+			 razer_flash_progress_t progress, void *priv);
+
 /** razer_for_each_mouse - Convenience helper for traversing a mouse list
  *
  * @mouse: 'struct razer_mouse' pointer used as a list pointer.
@@ -636,10 +781,19 @@ int razer_reconfig_mice(void);
 	     mouse = next, next = (mouse) ? (mouse)->next : NULL)
 
 /** enum razer_event - The type of an event.
+ *
+ * @RAZER_EV_MOUSE_ADD: A new mouse was detected. The mouse is usable,
+ *	but its initial configuration may still be in progress.
+ *
+ * @RAZER_EV_MOUSE_REMOVE: A mouse was removed.
+ *
+ * @RAZER_EV_MOUSE_CONFIGURED: The initial configuration of a new mouse
+ *	finished. This event is delivered from razer_handle_events().
  */
 enum razer_event {
 	RAZER_EV_MOUSE_ADD,
 	RAZER_EV_MOUSE_REMOVE,
+	RAZER_EV_MOUSE_CONFIGURED,
 };
 
 /** struct razer_event_data - Context data for an event.
@@ -663,6 +817,18 @@ int razer_register_event_handler(razer_event_handler_t handler);
  */
 void razer_unregister_event_handler(razer_event_handler_t handler);
 
+/** razer_get_event_fd - Get the asynchronous event file descriptor.
+ * The returned file descriptor becomes readable, if asynchronous
+ * events are pending. razer_handle_events() must be called then.
+ * Returns the file descriptor or a negative error code.
+ */
+int razer_get_event_fd(void);
+
+/** razer_handle_events - Handle pending asynchronous events.
+ * This calls the registered event handler for every pending event.
+ */
+void razer_handle_events(void);
+
 /** razer_load_config - Load a configuration file.
  * If path is NULL, the default config is loaded.
  * If path is an empty string, the current config (if any) will be
@@ -670,8 +836,112 @@ void razer_unregister_event_handler(razer_event_handler_t handler);
  */
 int razer_load_config(const char *path);
 
+/** razer_reload_config - Reload the configuration file.
+ * The path argument is interpreted as for razer_load_config().
+ * The new file is compared to the currently loaded one and only
+ * items that were added or changed are applied to the matching mice.
+ * Mice without changes are not touched at all. Settings of removed
+ * items are left as they are on the device.
+ * If the new file cannot be parsed, the current config is kept.
+ * Returns 0 on success or the first error code. All mice are
+ * processed, even if applying the config to one of them failed.
+ */
+int razer_reload_config(const char *path);
+
+/** enum razer_appprofile_match - What an application profile rule matches.
+ * @RAZER_APPPROFILE_EXE: The file name of the executable.
+ * @RAZER_APPPROFILE_CGROUP: The cgroup path of the process.
+ */
+enum razer_appprofile_match {
+	RAZER_APPPROFILE_EXE,
+	RAZER_APPPROFILE_CGROUP,
+};
+
+#define RAZER_APPPROFILE_PATTERN_MAX_SIZE	128
+
+/** struct razer_appprofile_rule - Select a profile while an application runs.
+ * The rules come from the "appprofile" items of the config section
+ * of a mouse: appprofile=exe:PATTERN:PROF or appprofile=cgroup:PATTERN:PROF
+ *
+ * @next: The next rule in the linked list.
+ * @match: What the pattern is matched against.
+ * @pattern: The fnmatch() pattern.
+ * @profile: The ID of the profile (struct razer_mouse_profile nr).
+ */
+struct razer_appprofile_rule {
+	struct razer_appprofile_rule *next;
+	enum razer_appprofile_match match;
+	char pattern[RAZER_APPPROFILE_PATTERN_MAX_SIZE];
+	unsigned int profile;
+};
+
+/** razer_get_appprofile_rules - Get the application profile rules of a mouse.
+ * Returns the number of rules in the linked list or a negative error code.
+ * Free the list with razer_free_appprofile_rules().
+ */
+int razer_get_appprofile_rules(struct razer_mouse *m,
+			       struct razer_appprofile_rule **rules);
+
+/** razer_free_appprofile_rules - Free a linked list of application profile rules. */
+void razer_free_appprofile_rules(struct razer_appprofile_rule *rules);
+
+/** razer_set_state_cache - Set the device state cache file.
+ * Drivers use the cache to skip reading the device state
+ * on initialization. The cached state is verified by the first commit.
+ * If path is NULL, the default cache file is used.
+ * If path is an empty string, the cache is disabled.
+ * Must be called before razer_rescan_mice().
+ */
+int razer_set_state_cache(const char *path);
+
+/** razer_set_transport - Select the device transport backend.
+ * The spec is "name" or "name:options".
+ * "libusb" claims the devices through libusb and detaches the kernel driver.
+ * "hidraw" uses the Linux hidraw feature reports. The kernel driver stays bound.
+ * "sim" uses simulated devices, which emulate the protocols of the
+ * real hardware. The options list the devices and the bus behavior,
+ * for example "sim:dev=1532:0016,dev=1532:0043,latency=500,error=100".
+ * latency=USEC and jitter=USEC set the time of one transfer,
+ * error=N fails one in N transfers and reconnect=MSEC sets the time
+ * a device is gone after a firmware reboot.
+ * Without dev= options one device of each protocol is simulated.
+ * If no transport is set, the RAZER_TRANSPORT environment variable
+ * is used. The default is "libusb".
+ * Must be called before razer_init(). NULL resets to the default.
+ */
+int razer_set_transport(const char *spec);
+
 typedef void (*razer_logfunc_t)(const char *fmt, ...);
 
+/** struct razer_usb_stats - USB traffic statistics.
+ *
+ * @control_transfers: The number of control transfers.
+ *
+ * @bulk_transfers: The number of bulk transfers.
+ *
+ * @bytes: The number of bytes in the data stages.
+ *
+ * @errors: The number of failed transfers.
+ *
+ * @sleep_msec: The time spent in razer_msleep().
+ */
+struct razer_usb_stats {
+	unsigned long control_transfers;
+	unsigned long bulk_transfers;
+	unsigned long bytes;
+	unsigned long errors;
+	unsigned long sleep_msec;
+};
+
+/** razer_get_usb_stats - Get the USB traffic statistics.
+ * The counters cover all devices and threads since razer_init()
+ * or the last call to razer_reset_usb_stats().
+ */
+void razer_get_usb_stats(struct razer_usb_stats *stats);
+
+/** razer_reset_usb_stats - Reset the USB traffic statistics. */
+void razer_reset_usb_stats(void);
+
 /** razer_set_logging - Set log callbacks.
  * Callbacks may be NULL to suppress messages.
  */
@@ -18,18 +18,72 @@
 #include "profile_emulation.h"
 
 
+/* Get the settings of an emulated profile that differ from the hardware. */
+static uint32_t mouse_profemu_calc_delta(struct razer_mouse_profile_emu *emu,
+					 const struct razer_mouse_profile_emu_data *data)
+{
+	struct razer_mouse_profile *hw_profile = emu->hw_profile;
+	const struct razer_mouse_profile_emu_data *hw = &emu->hw_data;
+	uint32_t delta = 0;
+	unsigned int i;
+
+	if (hw_profile->set_dpimapping) {
+		for (i = 0; i < data->nr_dpimappings; i++) {
+			if (!data->dpimappings[i])
+				continue;
+			if (!emu->hw_data_valid ||
+			    data->dpimappings[i] != hw->dpimappings[i])
+				delta |= PROFEMU_DELTA_DPIMAPPING(i);
+		}
+	}
+	if (hw_profile->set_button_function) {
+		for (i = 0; i < data->nr_butfuncs; i++) {
+			if (!data->butfuncs[i])
+				continue;
+			if (!emu->hw_data_valid ||
+			    data->butfuncs[i] != hw->butfuncs[i])
+				delta |= PROFEMU_DELTA_BUTFUNC(i);
+		}
+	}
+	if (hw_profile->set_freq) {
+		if (!emu->hw_data_valid || data->freq != hw->freq)
+			delta |= PROFEMU_DELTA_FREQ;
+	}
+
+	return delta;
+}
+
+static void mouse_profemu_update_delta(struct razer_mouse_profile_emu *emu,
+				       unsigned int prof_nr)
+{
+	emu->delta[prof_nr] = mouse_profemu_calc_delta(emu, &emu->data[prof_nr]);
+}
+
+static void mouse_profemu_update_all_deltas(struct razer_mouse_profile_emu *emu)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(emu->data); i++)
+		mouse_profemu_update_delta(emu, i);
+}
+
+/* Write the settings of the active profile, that differ from the hardware. */
 static int mouse_profemu_commit(struct razer_mouse_profile_emu *emu)
 {
 	struct razer_mouse_profile *hw_profile = emu->hw_profile;
 	unsigned int active_prof_nr = emu->active_profile->nr;
-	struct razer_mouse_profile_emu_data *data;
+	struct razer_mouse_profile_emu_data *data, *hw = &emu->hw_data;
 	struct razer_mouse *mouse = emu->mouse;
 	unsigned int i;
+	uint32_t delta;
 	int err;
 
 	if (WARN_ON(active_prof_nr >= ARRAY_SIZE(emu->data)))
 		return -EINVAL;
 	data = &emu->data[active_prof_nr];
+	delta = emu->delta[active_prof_nr];
+	if (!delta)
+		return 0;
 
 	err = mouse->claim(mouse);
 	if (err) {
@@ -37,60 +91,53 @@ static int mouse_profemu_commit(struct razer_mouse_profile_emu *emu)
 		return err;
 	}
 
-	if (hw_profile->set_dpimapping) {
-		struct razer_axis *axes = NULL;
-
-		if (mouse->supported_axes) {
-			err = mouse->supported_axes(mouse, &axes);
-			if (err < 0)
-				goto error;
-			WARN_ON((unsigned int)err != data->nr_dpimappings);
-		}
-		for (i = 0; i < data->nr_dpimappings; i++) {
-			if (!data->dpimappings[i])
-				continue;
-			err = hw_profile->set_dpimapping(
-						hw_profile,
-						axes ? &axes[i] : NULL,
-						data->dpimappings[i]);
-			if (err)
-				goto error;
-		}
+	for (i = 0; i < data->nr_dpimappings; i++) {
+		if (!(delta & PROFEMU_DELTA_DPIMAPPING(i)))
+			continue;
+		err = hw_profile->set_dpimapping(
+					hw_profile,
+					emu->axes ? &emu->axes[i] : NULL,
+					data->dpimappings[i]);
+		if (err)
+			goto error;
+		hw->dpimappings[i] = data->dpimappings[i];
 	}
-	if (hw_profile->set_button_function) {
-		struct razer_button *buttons = NULL;
-
-		if (mouse->supported_buttons) {
-			err = mouse->supported_buttons(mouse, &buttons);
-			if (err < 0)
-				goto error;
-			WARN_ON((unsigned int)err != data->nr_butfuncs);
-		}
-		for (i = 0; i < data->nr_butfuncs; i++) {
-			if (!data->butfuncs[i])
-				continue;
-			err = hw_profile->set_button_function(
-						hw_profile,
-						buttons ? &buttons[i] : NULL,
-						data->butfuncs[i]);
-			if (err)
-				goto error;
-		}
+	for (i = 0; i < data->nr_butfuncs; i++) {
+		if (!(delta & PROFEMU_DELTA_BUTFUNC(i)))
+			continue;
+		err = hw_profile->set_button_function(
+					hw_profile,
+					emu->buttons ? &emu->buttons[i] : NULL,
+					data->butfuncs[i]);
+		if (err)
+			goto error;
+		hw->butfuncs[i] = data->butfuncs[i];
 	}
-	if (hw_profile->set_freq) {
+	if (delta & PROFEMU_DELTA_FREQ) {
 		err = hw_profile->set_freq(hw_profile, data->freq);
 		if (err)
 			goto error;
+		hw->freq = data->freq;
 	}
 
-	mouse->release(mouse);
-	razer_debug("profile emulation: Committed active profile\n");
+	err = mouse->release(mouse);
+	if (err) {
+		razer_error("profile emulation: Failed to commit settings\n");
+		/* The hardware state is unknown now. */
+		emu->hw_data_valid = 0;
+	} else {
+		razer_debug("profile emulation: Committed active profile "
+			    "(delta 0x%X)\n", (unsigned int)delta);
+	}
+	mouse_profemu_update_all_deltas(emu);
 
-	return 0;
+	return err;
 
 error:
 	razer_error("profile emulation: Failed to commit settings\n");
 	mouse->release(mouse);
+	emu->hw_data_valid = 0;
+	mouse_profemu_update_all_deltas(emu);
 
 	return err;
 }
@@ -140,6 +187,7 @@ static int mouse_profemu_set_freq(struct razer_mouse_profile *p,
 
 	emu->data[p->nr].freq = freq;
 
+	mouse_profemu_update_delta(emu, p->nr);
 	if (p == emu->active_profile)
 		return mouse_profemu_commit(emu);
 	return 0;
@@ -188,6 +236,7 @@ static int mouse_profemu_set_dpimapping(struct razer_mouse_profile *p,
 		}
 	}
 
+	mouse_profemu_update_delta(emu, p->nr);
 	if (p == emu->active_profile)
 		return mouse_profemu_commit(emu);
 	return 0;
@@ -226,6 +275,7 @@ static int mouse_profemu_set_button_function(struct razer_mouse_profile *p,
 
 	data->butfuncs[b->id] = f;
 
+	mouse_profemu_update_delta(emu, p->nr);
 	if (p == emu->active_profile)
 		return mouse_profemu_commit(emu);
 	return 0;
@@ -285,7 +335,6 @@ int razer_mouse_init_profile_emulation(struct razer_mouse *m)
 	struct razer_mouse_profile_emu_data *data;
 	struct razer_mouse_profile *prof, *hw_profile;
 	unsigned int i, j;
-	int err;
 	struct razer_axis *axes = NULL;
 	int nr_axes = 1;
 	struct razer_button *buttons = NULL;
@@ -312,6 +361,8 @@ int razer_mouse_init_profile_emulation(struct razer_mouse *m)
 		if (WARN_ON(nr_buttons < 0))
 			goto err_free;
 	}
+	emu->axes = axes;
+	emu->buttons = buttons;
 
 	for (i = 0; i < ARRAY_SIZE(emu->profiles); i++) {
 		prof = &emu->profiles[i];
@@ -366,10 +417,10 @@ int razer_mouse_init_profile_emulation(struct razer_mouse *m)
 		}
 	}
 	emu->active_profile = &emu->profiles[0];
-
-	err = mouse_profemu_commit(emu);
-	if (err)
-		goto err_free;
+	/* All profiles start with the settings of the hardware profile. */
+	emu->hw_data = emu->data[0];
+	emu->hw_data_valid = 1;
+	mouse_profemu_update_all_deltas(emu);
 
 	m->nr_profiles = ARRAY_SIZE(emu->profiles);
 	m->get_profiles = mouse_profemu_get;
@@ -19,14 +19,27 @@ struct razer_mouse_profile_emu_data {
 	unsigned int nr_butfuncs;
 };
 
+/* Delta bits. Settings that differ from the hardware profile. */
+#define PROFEMU_DELTA_FREQ		(1u << 0)
+#define PROFEMU_DELTA_DPIMAPPING(i)	(1u << (1 + (i)))
+#define PROFEMU_DELTA_BUTFUNC(i)	(1u << (4 + (i)))
+
 struct razer_mouse_profile_emu {
 	struct razer_mouse *mouse;
 	/* Emulated profiles */
 	struct razer_mouse_profile profiles[RAZER_NR_EMULATED_PROFILES];
 	struct razer_mouse_profile_emu_data data[RAZER_NR_EMULATED_PROFILES];
+	/* Per emulated profile: PROFEMU_DELTA_... bits */
+	uint32_t delta[RAZER_NR_EMULATED_PROFILES];
 	struct razer_mouse_profile *active_profile;
 	/* The hardware profile. This is what the driver uses. */
 	struct razer_mouse_profile *hw_profile;
+	/* The settings of the hardware profile. */
+	struct razer_mouse_profile_emu_data hw_data;
+	bool hw_data_valid;
+	/* The axes and buttons of the driver. */
+	struct razer_axis *axes;
+	struct razer_button *buttons;
 };
 
 
@@ -44,11 +44,23 @@ struct razer_usb_interface {
 
 #define RAZER_MAX_NR_INTERFACES		2
 
+struct razer_transport;
+
 struct razer_usb_context {
-	/* Device pointer. */
+	/* The transport backend. NULL means libusb. */
+	const struct razer_transport *transport;
+	/* Transport private device data. */
+	void *transport_priv;
+	/* Device pointer. Only used by the libusb transport. */
 	struct libusb_device *dev;
-	/* The handle for all operations. */
+	/* The libusb handle for all operations. */
 	struct libusb_device_handle *h;
+	/* The device descriptor and the bus position. */
+	struct libusb_device_descriptor desc;
+	uint8_t busnr;
+	uint8_t devaddr;
+	/* True, if the device is claimed. */
+	bool claimed;
 	/* The configuration we want to use. Defaults to 1. */
 	uint8_t bConfigurationValue;
 	/* The interfaces we use. */
@@ -67,6 +79,20 @@ void razer_generic_usb_release(struct razer_usb_context *ctx);
 void razer_generic_usb_release_refcount(struct razer_usb_context *ctx,
 					unsigned int *refcount);
 
+int razer_usb_control(struct razer_usb_context *ctx,
+		      uint8_t request_type, uint8_t request,
+		      uint16_t value, uint16_t index,
+		      unsigned char *data, uint16_t length,
+		      unsigned int timeout);
+int razer_usb_bulk(struct razer_usb_context *ctx, unsigned char endpoint,
+		   unsigned char *data, int length, int *transferred,
+		   unsigned int timeout);
+
+extern struct razer_usb_stats razer_usb_stats;
+
+#define razer_usb_stats_add(member, value)	\
+	__atomic_fetch_add(&razer_usb_stats.member, (value), __ATOMIC_RELAXED)
+
 struct razer_usb_reconnect_guard {
 	struct razer_usb_context *ctx;
 	struct libusb_device_descriptor old_desc;
@@ -78,6 +104,23 @@ int razer_usb_reconnect_guard_init(struct razer_usb_reconnect_guard *guard,
 				   struct razer_usb_context *ctx);
 int razer_usb_reconnect_guard_wait(struct razer_usb_reconnect_guard *guard, bool hub_reset);
 
+int razer_flash_report(struct razer_mouse *m, enum razer_flash_phase phase,
+		       unsigned int done, unsigned int total);
+
+/* The physical position of a USB device: bus number and port path. */
+struct razer_usb_location {
+	uint8_t busnr;
+	uint8_t ports[7];
+	uint8_t nr_ports;
+};
+
+int razer_usb_get_location(struct libusb_device *dev,
+			   struct razer_usb_location *loc);
+
+struct libusb_device * razer_usb_wait_for_device(uint16_t vendor, uint16_t product,
+						 const struct razer_usb_location *loc,
+						 unsigned int timeout_msec);
+
 int razer_usb_force_hub_reset(struct razer_usb_context *ctx);
 
 #define BUSTYPESTR_USB		"USB"
@@ -93,8 +136,7 @@ static inline void razer_create_idstr(char *buf,
 		 devtype, devname, bustype, busposition, devid);
 }
 
-void razer_generic_usb_gen_idstr(struct libusb_device *udev,
-				 struct libusb_device_handle *h,
+void razer_generic_usb_gen_idstr(struct razer_usb_context *ctx,
 				 const char *devname,
 				 bool include_devicenr,
 				 const char *serial,
@@ -109,6 +151,15 @@ struct razer_mouse_dpimapping * razer_mouse_get_dpimapping_by_res(
 		struct razer_mouse_dpimapping *mappings, size_t nr_mappings,
 		enum razer_dimension dim, enum razer_mouse_res res);
 
+/* Static resolution tables for the supported_resolutions callback.
+ * razer_res_steps_100dpi is 100, 200, ... 16000 DPI and
+ * razer_res_steps_125dpi is 125, 250, ... 4000 DPI.
+ * Drivers return a prefix of a table. */
+#define RAZER_NR_RES_STEPS_100DPI	160
+#define RAZER_NR_RES_STEPS_125DPI	32
+extern const enum razer_mouse_res razer_res_steps_100dpi[RAZER_NR_RES_STEPS_100DPI];
+extern const enum razer_mouse_res razer_res_steps_125dpi[RAZER_NR_RES_STEPS_125DPI];
+
 struct razer_event_spacing {
 	unsigned int spacing_msec;
 	struct timeval last_event;
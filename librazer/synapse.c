@@ -20,6 +20,7 @@
 
 #include "librazer.h"
 #include "synapse.h"
+#include "devcache.h"
 #include "razer_private.h"
 #include "util.h"
 #include "buttonmapping.h"
@@ -113,6 +114,13 @@ struct synapse_request_hwconfig {
 	struct synapse_led_color led_colors[SYNAPSE_NR_LEDS];
 } _packed;
 
+/* The configuration requests of the device. */
+struct synapse_hwstate {
+	struct synapse_request_globconfig globconfig;
+	struct synapse_request_profname profname[SYNAPSE_NR_PROFILES];
+	struct synapse_request_hwconfig hwconfig[SYNAPSE_NR_PROFILES];
+} _packed;
+
 
 struct synapse_buttons {
 	struct razer_buttonmapping mapping[NR_SYNAPSE_PHYSBUT];
@@ -166,6 +174,22 @@ struct razer_synapse {
 	/* The active button mapping; per profile. */
 	struct synapse_buttons buttons[SYNAPSE_NR_PROFILES];
 
+	/* The profiles that were read from the device (or the cache).
+	 * The other profiles are read on first access. */
+	bool prof_loaded[SYNAPSE_NR_PROFILES];
+
+	/* The raw requests as they are known to be on the device.
+	 * Used to skip writes of unchanged requests. The read-back
+	 * requests are kept as-is, because parsing them is lossy.
+	 * The profile requests are only valid for loaded profiles. */
+	struct synapse_hwstate shadow;
+	bool shadow_valid;
+	/* The settings were loaded from the state cache
+	 * and still have to be verified against the device. */
+	bool cache_unverified;
+	/* The config job committed the initial settings. */
+	bool initial_committed;
+
 	bool commit_pending;
 };
 
@@ -251,8 +275,8 @@ static int synapse_usb_write(struct razer_synapse *s,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		s->m->usb_ctx->h,
+	err = razer_usb_control(
+		s->m->usb_ctx,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, index,
@@ -273,8 +297,8 @@ static int synapse_usb_read(struct razer_synapse *s,
 {
 	int err;
 
-	err = libusb_control_transfer(
-		s->m->usb_ctx->h,
+	err = razer_usb_control(
+		s->m->usb_ctx,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS |
 		LIBUSB_RECIPIENT_INTERFACE,
 		request, command, index,
@@ -421,25 +445,161 @@ static int synapse_request_read(struct razer_synapse *s,
 	return 0;
 }
 
-static int synapse_read_config_from_hw(struct razer_synapse *s)
+static int synapse_build_hwconfig(struct razer_synapse *s, unsigned int i,
+				  struct synapse_request_hwconfig *hwconfig)
 {
-	unsigned int i, j;
+	unsigned int j;
 	int err;
-	struct synapse_request_profname profname;
-	struct synapse_request_globconfig globconfig;
-	struct synapse_request_hwconfig hwconfig;
-	enum razer_mouse_res res_x, res_y;
 
-	/* Get global config */
-	memset(&globconfig, 0, sizeof(globconfig));
-	err = synapse_request_read(s, 5, 1,
-				   &globconfig, sizeof(globconfig));
+	memset(hwconfig, 0, sizeof(*hwconfig));
+	hwconfig->profile = i + 1;
+	hwconfig->leds = 0x04; /* Bit 2 is always set */
+	for (j = 0; j < SYNAPSE_NR_LEDS; j++) {
+		if (s->led_states[i][j])
+			hwconfig->leds |= (1 << j);
+	}
+	hwconfig->dpisel = (s->cur_dpimapping[i]->nr % 10) + 1;
+	hwconfig->nr_dpimappings = SYNAPSE_NR_DPIMAPPINGS;
+	for (j = 0; j < SYNAPSE_NR_DPIMAPPINGS; j++) {
+		hwconfig->dpimappings[j].dpival0 = ((s->dpimappings[i][j].res[RAZER_DIM_X] / 100) - 1) * 4;
+		hwconfig->dpimappings[j].dpival1 = ((s->dpimappings[i][j].res[RAZER_DIM_Y] / 100) - 1) * 4;
+	}
+	err = razer_create_buttonmap(hwconfig->buttonmap, sizeof(hwconfig->buttonmap),
+				     s->buttons[i].mapping,
+				     ARRAY_SIZE(s->buttons[i].mapping), 2);
 	if (err)
 		return err;
+	if (s->features & RAZER_SYNFEAT_RGBLEDS) {
+		for (j = 0; j < SYNAPSE_NR_LEDS; j++) {
+			hwconfig->led_colors[j].padding = SYNAPSE_LED_COLOR_PADDING;
+			hwconfig->led_colors[j].r = s->led_colors[i][j].r;
+			hwconfig->led_colors[j].g = s->led_colors[i][j].g;
+			hwconfig->led_colors[j].b = s->led_colors[i][j].b;
+		}
+	}
+
+	return 0;
+}
+
+static void synapse_build_profname(struct razer_synapse *s, unsigned int i,
+				   struct synapse_request_profname *profname)
+{
+	unsigned int j;
+
+	memset(profname, 0, sizeof(*profname));
+	profname->profile = i + 1;
+	for (j = 0; j < SYNAPSE_PROFNAME_MAX_LEN; j++) {
+		le16_t c = cpu_to_le16(s->profile_names[i].name[j]);
+		profname->name_le16[j] = c;
+	}
+}
+
+static void synapse_build_globconfig(struct razer_synapse *s,
+				     struct synapse_request_globconfig *globconfig)
+{
+	memset(globconfig, 0, sizeof(*globconfig));
+	globconfig->profile = s->cur_profile->nr + 1;
+	switch (s->cur_freq) {
+	default:
+	case RAZER_MOUSE_FREQ_1000HZ:
+		globconfig->freq = 1;
+		break;
+	case RAZER_MOUSE_FREQ_500HZ:
+		globconfig->freq = 2;
+		break;
+	case RAZER_MOUSE_FREQ_125HZ:
+		globconfig->freq = 8;
+		break;
+	}
+	globconfig->dpisel = (s->cur_dpimapping[s->cur_profile->nr]->nr % 10) + 1;
+	globconfig->dpival0 = ((s->cur_dpimapping[s->cur_profile->nr]->res[RAZER_DIM_X] / 100) - 1) * 4;
+	globconfig->dpival1 = ((s->cur_dpimapping[s->cur_profile->nr]->res[RAZER_DIM_Y] / 100) - 1) * 4;
+}
+
+static bool synapse_all_profiles_loaded(struct razer_synapse *s)
+{
+	unsigned int i;
+
+	for (i = 0; i < SYNAPSE_NR_PROFILES; i++) {
+		if (!s->prof_loaded[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Returns true, if the request has to be written to the device. */
+static bool synapse_shadow_differs(struct razer_synapse *s, bool force,
+				   const void *shadow, const void *req,
+				   size_t size)
+{
+	return force || !s->shadow_valid || memcmp(shadow, req, size) != 0;
+}
+
+static int synapse_read_globconfig(struct razer_synapse *s,
+				   struct synapse_request_globconfig *globconfig)
+{
+	memset(globconfig, 0, sizeof(*globconfig));
+
+	return synapse_request_read(s, 5, 1,
+				    globconfig, sizeof(*globconfig));
+}
+
+static int synapse_read_profile(struct razer_synapse *s, unsigned int i,
+				struct synapse_request_profname *profname,
+				struct synapse_request_hwconfig *hwconfig)
+{
+	int err;
+
+	memset(profname, 0, sizeof(*profname));
+	profname->profile = i + 1;
+	err = synapse_request_read(s, 0x22, 1,
+				   profname, sizeof(*profname));
+	if (err)
+		return err;
+
+	memset(hwconfig, 0, sizeof(*hwconfig));
+	hwconfig->profile = i + 1;
+
+	return synapse_request_read(s, 6, 1,
+				    hwconfig, sizeof(*hwconfig));
+}
+
+static int synapse_read_hwstate(struct razer_synapse *s,
+				struct synapse_hwstate *hw)
+{
+	unsigned int i;
+	int err;
+
+	err = synapse_read_globconfig(s, &hw->globconfig);
+	if (err)
+		return err;
+	for (i = 0; i < SYNAPSE_NR_PROFILES; i++) {
+		err = synapse_read_profile(s, i, &hw->profname[i],
+					   &hw->hwconfig[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/* Load the global settings from the globconfig request.
+ * Returns 0, if the settings exactly represent the request,
+ * or 1, if some values had to be replaced. */
+static int synapse_parse_globconfig(struct razer_synapse *s,
+				    const struct synapse_request_globconfig *hw)
+{
+	struct synapse_request_globconfig globconfig = *hw;
+	struct razer_mouse_dpimapping *d;
+	unsigned int nr;
+	bool exact = 1;
+
 	if (globconfig.profile < 1 || globconfig.profile > SYNAPSE_NR_PROFILES) {
 		razer_error("synapse: Got invalid profile number: %u\n",
 			    (unsigned int)globconfig.profile);
 		globconfig.profile = 1;
+		exact = 0;
 	}
 	s->cur_profile = &s->profiles[globconfig.profile - 1];
 	switch (globconfig.freq) {
@@ -457,77 +617,264 @@ static int synapse_read_config_from_hw(struct razer_synapse *s)
 			"Read invalid frequency value from device (%u)\n",
 			globconfig.freq);
 		s->cur_freq = RAZER_MOUSE_FREQ_125HZ;
+		exact = 0;
 	}
 
-	/* Get the profile names */
-	for (i = 0; i < SYNAPSE_NR_PROFILES; i++) {
-		memset(&profname, 0, sizeof(profname));
-		profname.profile = i + 1;
-		err = synapse_request_read(s, 0x22, 1,
-					   &profname, sizeof(profname));
-		if (err)
-			return err;
-		memset(&s->profile_names[i], 0, sizeof(s->profile_names[i]));
-		for (j = 0; j < SYNAPSE_PROFNAME_MAX_LEN; j++) {
-			s->profile_names[i].name[j] = profname.name_raw[j * 2 + 0];
-			s->profile_names[i].name[j] |= (uint16_t)profname.name_raw[j * 2 + 1] << 8;
+	/* The globconfig also holds the DPI mapping of the active profile.
+	 * That is all we know about the profile until it is loaded. */
+	nr = s->cur_profile->nr;
+	if (!s->prof_loaded[nr]) {
+		if (globconfig.dpisel < 1 ||
+		    globconfig.dpisel > SYNAPSE_NR_DPIMAPPINGS) {
+			razer_error("synapse: Got invalid DPI selection: %u\n",
+				    globconfig.dpisel);
+			globconfig.dpisel = 1;
+			exact = 0;
 		}
+		d = &s->dpimappings[nr][globconfig.dpisel - 1];
+		d->res[RAZER_DIM_X] = ((globconfig.dpival0 / 4) + 1) * 100;
+		d->res[RAZER_DIM_Y] = ((globconfig.dpival1 / 4) + 1) * 100;
+		s->cur_dpimapping[nr] = d;
 	}
 
-	/* Get the profile configs */
-	for (i = 0; i < SYNAPSE_NR_PROFILES; i++) {
-		memset(&hwconfig, 0, sizeof(hwconfig));
+	return exact ? 0 : 1;
+}
+
+/* Load the settings of a profile from its requests and mark it loaded.
+ * Returns 0, if the settings exactly represent the requests,
+ * 1, if some values had to be replaced, or a negative error code. */
+static int synapse_parse_profile(struct razer_synapse *s, unsigned int i,
+				 const struct synapse_request_profname *profname,
+				 const struct synapse_request_hwconfig *hw)
+{
+	struct synapse_request_hwconfig hwconfig = *hw;
+	enum razer_mouse_res res_x, res_y;
+	unsigned int j;
+	bool exact = 1;
+	int err;
+
+	memset(&s->profile_names[i], 0, sizeof(s->profile_names[i]));
+	for (j = 0; j < SYNAPSE_PROFNAME_MAX_LEN; j++) {
+		s->profile_names[i].name[j] = profname->name_raw[j * 2 + 0];
+		s->profile_names[i].name[j] |= (uint16_t)profname->name_raw[j * 2 + 1] << 8;
+	}
+
+	if (hwconfig.profile != i + 1) {
+		razer_error("synapse: Failed to read hw config (%u vs %u)\n",
+			    hwconfig.profile, i + 1);
 		hwconfig.profile = i + 1;
-		err = synapse_request_read(s, 6, 1,
-					   &hwconfig, sizeof(hwconfig));
-		if (err)
-			return err;
-		if (hwconfig.profile != i + 1) {
-			razer_error("synapse: Failed to read hw config (%u vs %u)\n",
-				    hwconfig.profile, i + 1);
-			hwconfig.profile = i + 1;
-		}
-		for (j = 0; j < SYNAPSE_NR_LEDS; j++)
-			s->led_states[i][j] = !!(hwconfig.leds & (1 << j));
-
-		if (hwconfig.nr_dpimappings < 1 ||
-		    hwconfig.nr_dpimappings > SYNAPSE_NR_DPIMAPPINGS) {
-			razer_error("synapse: Got invalid nr_dpimappings: %u\n",
-				    hwconfig.nr_dpimappings);
-			hwconfig.nr_dpimappings = SYNAPSE_NR_DPIMAPPINGS;
-		}
-		if (hwconfig.dpisel < 1 || hwconfig.dpisel > SYNAPSE_NR_DPIMAPPINGS ||
-		    hwconfig.dpisel > hwconfig.nr_dpimappings) {
-			razer_error("synapse: Got invalid DPI selection: %u\n",
-				    hwconfig.dpisel);
-			hwconfig.dpisel = 1;
-		}
-		s->cur_dpimapping[i] = &s->dpimappings[i][hwconfig.dpisel - 1];
+		exact = 0;
+	}
+	for (j = 0; j < SYNAPSE_NR_LEDS; j++)
+		s->led_states[i][j] = !!(hwconfig.leds & (1 << j));
 
-		for (j = 0; j < SYNAPSE_NR_DPIMAPPINGS; j++) {
-			if (j + 1 > hwconfig.nr_dpimappings) {
-				res_x = RAZER_MOUSE_RES_5600DPI;
-				res_y = res_x;
-			} else {
-				res_x = ((hwconfig.dpimappings[j].dpival0 / 4) + 1) * 100;
-				res_y = ((hwconfig.dpimappings[j].dpival1 / 4) + 1) * 100;
-			}
-			s->dpimappings[i][j].res[RAZER_DIM_X] = res_x;
-			s->dpimappings[i][j].res[RAZER_DIM_Y] = res_y;
+	if (hwconfig.nr_dpimappings < 1 ||
+	    hwconfig.nr_dpimappings > SYNAPSE_NR_DPIMAPPINGS) {
+		razer_error("synapse: Got invalid nr_dpimappings: %u\n",
+			    hwconfig.nr_dpimappings);
+		hwconfig.nr_dpimappings = SYNAPSE_NR_DPIMAPPINGS;
+	}
+	if (hwconfig.nr_dpimappings != SYNAPSE_NR_DPIMAPPINGS)
+		exact = 0;
+	if (hwconfig.dpisel < 1 || hwconfig.dpisel > SYNAPSE_NR_DPIMAPPINGS ||
+	    hwconfig.dpisel > hwconfig.nr_dpimappings) {
+		razer_error("synapse: Got invalid DPI selection: %u\n",
+			    hwconfig.dpisel);
+		hwconfig.dpisel = 1;
+		exact = 0;
+	}
+	s->cur_dpimapping[i] = &s->dpimappings[i][hwconfig.dpisel - 1];
+
+	for (j = 0; j < SYNAPSE_NR_DPIMAPPINGS; j++) {
+		if (j + 1 > hwconfig.nr_dpimappings) {
+			res_x = RAZER_MOUSE_RES_5600DPI;
+			res_y = res_x;
+		} else {
+			res_x = ((hwconfig.dpimappings[j].dpival0 / 4) + 1) * 100;
+			res_y = ((hwconfig.dpimappings[j].dpival1 / 4) + 1) * 100;
 		}
-		err = razer_parse_buttonmap(hwconfig.buttonmap, sizeof(hwconfig.buttonmap),
-					    s->buttons[i].mapping,
-					    ARRAY_SIZE(s->buttons[i].mapping), 2);
+		s->dpimappings[i][j].res[RAZER_DIM_X] = res_x;
+		s->dpimappings[i][j].res[RAZER_DIM_Y] = res_y;
+	}
+	err = razer_parse_buttonmap(hwconfig.buttonmap, sizeof(hwconfig.buttonmap),
+				    s->buttons[i].mapping,
+				    ARRAY_SIZE(s->buttons[i].mapping), 2);
+	if (err)
+		return err;
+	for (j = 0; j < SYNAPSE_NR_LEDS; j++) {
+		s->led_colors[i][j].r = hwconfig.led_colors[j].r;
+		s->led_colors[i][j].g = hwconfig.led_colors[j].g;
+		s->led_colors[i][j].b = hwconfig.led_colors[j].b;
+		s->led_colors[i][j].valid = !!(s->features & RAZER_SYNFEAT_RGBLEDS);
+	}
+	s->prof_loaded[i] = 1;
+
+	return exact ? 0 : 1;
+}
+
+/* Load the settings from the device requests.
+ * Returns 0, if the settings exactly represent the requests,
+ * 1, if some values had to be replaced, or a negative error code. */
+static int synapse_parse_hwstate(struct razer_synapse *s,
+				 const struct synapse_hwstate *hw)
+{
+	unsigned int i;
+	int err;
+	bool exact = 1;
+
+	if (synapse_parse_globconfig(s, &hw->globconfig))
+		exact = 0;
+	for (i = 0; i < SYNAPSE_NR_PROFILES; i++) {
+		err = synapse_parse_profile(s, i, &hw->profname[i],
+					    &hw->hwconfig[i]);
+		if (err < 0)
+			return err;
+		if (err)
+			exact = 0;
+	}
+
+	return exact ? 0 : 1;
+}
+
+static void synapse_store_cache(struct razer_synapse *s)
+{
+	/* The device state is unknown. Drop the stale entry. */
+	if (!s->shadow_valid) {
+		razer_devcache_delete("synapse", s->serial, s->fw_version);
+		return;
+	}
+	/* The cache holds the state of all profiles. */
+	if (!synapse_all_profiles_loaded(s))
+		return;
+	razer_devcache_store("synapse", s->serial, s->fw_version,
+			     &s->shadow, sizeof(s->shadow));
+}
+
+/* Verify the cached settings against the device.
+ * If the cache was stale, the device state becomes the shadow.
+ * The settings are kept, because clients already saw them.
+ * The commit then writes all requests that differ. */
+static int synapse_verify_cache(struct razer_synapse *s)
+{
+	struct synapse_hwstate hw;
+	int err;
+
+	err = synapse_read_hwstate(s, &hw);
+	if (err)
+		return err;
+	if (memcmp(&hw, &s->shadow, sizeof(hw)) != 0) {
+		razer_debug("synapse: Cached settings of %s were stale\n",
+			    s->serial);
+		s->shadow = hw;
+	}
+	s->shadow_valid = 1;
+	s->cache_unverified = 0;
+
+	return 0;
+}
+
+/* Read only the global config. This is enough for the active
+ * profile, frequency and DPI mapping.
+ * The profiles are read later by synapse_load_profile(). */
+static int synapse_read_globconfig_from_hw(struct razer_synapse *s)
+{
+	struct synapse_request_globconfig globconfig;
+	int err;
+
+	err = synapse_read_globconfig(s, &globconfig);
+	if (err)
+		return err;
+	synapse_parse_globconfig(s, &globconfig);
+	s->shadow.globconfig = globconfig;
+	s->shadow_valid = 1;
+
+	return 0;
+}
+
+/* Read a profile from the device. The device must be claimed. */
+static int synapse_load_profile(struct razer_synapse *s, unsigned int i)
+{
+	struct synapse_request_profname profname;
+	struct synapse_request_hwconfig hwconfig;
+	int err;
+
+	err = synapse_read_profile(s, i, &profname, &hwconfig);
+	if (err)
+		return err;
+	err = synapse_parse_profile(s, i, &profname, &hwconfig);
+	if (err < 0)
+		return err;
+	s->shadow.profname[i] = profname;
+	s->shadow.hwconfig[i] = hwconfig;
+
+	return 0;
+}
+
+/* Read all profiles, that were not read, yet. The device must be claimed. */
+static int synapse_load_profiles(struct razer_synapse *s)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < SYNAPSE_NR_PROFILES; i++) {
+		if (s->prof_loaded[i])
+			continue;
+		err = synapse_load_profile(s, i);
 		if (err)
 			return err;
-		for (j = 0; j < SYNAPSE_NR_LEDS; j++) {
-			s->led_colors[i][j].r = hwconfig.led_colors[j].r;
-			s->led_colors[i][j].g = hwconfig.led_colors[j].g;
-			s->led_colors[i][j].b = hwconfig.led_colors[j].b;
-			s->led_colors[i][j].valid = !!(s->features & RAZER_SYNFEAT_RGBLEDS);
+	}
+
+	return 0;
+}
 
+/** synapse_need_profile - Make sure a profile was read from the device.
+ * This is called on access to the profile settings.
+ * The device is claimed, if it is not claimed by the caller.
+ * Claiming waits for the config job, which reads all profiles.
+ */
+static int synapse_need_profile(struct razer_synapse *s, unsigned int i)
+{
+	struct razer_mouse *m = s->m;
+	int err;
+
+	if (s->prof_loaded[i])
+		return 0;
+	err = m->claim(m);
+	if (err)
+		return err;
+	if (!s->prof_loaded[i]) {
+		err = synapse_load_profile(s, i);
+		if (err) {
+			razer_error("synapse: Failed to read profile %u "
+				    "from hardware\n", i + 1);
 		}
 	}
+	m->release(m);
+
+	return err;
+}
+
+/* Optimistically load the last known settings from the state cache.
+ * They are served right away and verified against the device
+ * by the first commit after the initial one. */
+static int synapse_load_config_from_cache(struct razer_synapse *s)
+{
+	struct synapse_hwstate hw;
+	int err;
+
+	err = razer_devcache_load("synapse", s->serial, s->fw_version,
+				  &hw, sizeof(hw));
+	if (err)
+		return err;
+	err = synapse_parse_hwstate(s, &hw);
+	if (err < 0) {
+		memset(s->prof_loaded, 0, sizeof(s->prof_loaded));
+		return -EINVAL;
+	}
+	s->shadow = hw;
+	s->shadow_valid = 1;
+	s->cache_unverified = 1;
+	razer_debug("synapse: Loaded settings of %s from cache\n", s->serial);
 
 	return 0;
 }
@@ -559,86 +906,89 @@ static int synapse_get_fw_version(struct razer_mouse *m)
 	return s->fw_version;
 }
 
-static int synapse_do_commit(struct razer_synapse *s)
+static int synapse_do_commit(struct razer_synapse *s, bool force)
 {
 	struct synapse_request_profname profname;
 	struct synapse_request_globconfig globconfig;
 	struct synapse_request_hwconfig hwconfig;
+	unsigned int i, nr_written = 0;
 	int err;
-	unsigned int i, j;
+
+	/* Nobody changed the profiles that were not loaded, yet.
+	 * They only have to be read for a forced commit. */
+	if (force) {
+		err = synapse_load_profiles(s);
+		if (err)
+			goto error;
+	}
+	/* The initial commit only writes the changes of the config
+	 * against the cache, so that the device is available
+	 * without reading its whole state first. A forced commit
+	 * writes everything and needs no verification. */
+	if (s->cache_unverified && s->initial_committed && !force) {
+		err = synapse_verify_cache(s);
+		if (err)
+			goto error;
+	}
 
 	/* Commit profile configs */
 	for (i = 0; i < SYNAPSE_NR_PROFILES; i++) {
-		memset(&hwconfig, 0, sizeof(hwconfig));
-		hwconfig.profile = i + 1;
-		hwconfig.leds = 0x04; /* Bit 2 is always set */
-		for (j = 0; j < SYNAPSE_NR_LEDS; j++) {
-			if (s->led_states[i][j])
-				hwconfig.leds |= (1 << j);
-		}
-		hwconfig.dpisel = (s->cur_dpimapping[i]->nr % 10) + 1;
-		hwconfig.nr_dpimappings = SYNAPSE_NR_DPIMAPPINGS;
-		for (j = 0; j < SYNAPSE_NR_DPIMAPPINGS; j++) {
-			hwconfig.dpimappings[j].dpival0 = ((s->dpimappings[i][j].res[RAZER_DIM_X] / 100) - 1) * 4;
-			hwconfig.dpimappings[j].dpival1 = ((s->dpimappings[i][j].res[RAZER_DIM_Y] / 100) - 1) * 4;
-		}
-		err = razer_create_buttonmap(hwconfig.buttonmap, sizeof(hwconfig.buttonmap),
-					     s->buttons[i].mapping,
-					     ARRAY_SIZE(s->buttons[i].mapping), 2);
+		if (!s->prof_loaded[i])
+			continue;
+		err = synapse_build_hwconfig(s, i, &hwconfig);
 		if (err)
-			return err;
-		if (s->features & RAZER_SYNFEAT_RGBLEDS) {
-			for (j = 0; j < SYNAPSE_NR_LEDS; j++) {
-				hwconfig.led_colors[j].padding = SYNAPSE_LED_COLOR_PADDING;
-				hwconfig.led_colors[j].r = s->led_colors[i][j].r;
-				hwconfig.led_colors[j].g = s->led_colors[i][j].g;
-				hwconfig.led_colors[j].b = s->led_colors[i][j].b;
-			}
-		}
+			goto error;
+		if (!synapse_shadow_differs(s, force, &s->shadow.hwconfig[i],
+					    &hwconfig, sizeof(hwconfig)))
+			continue;
 		err = synapse_request_write(s, 6, 0x48,
 					    &hwconfig, sizeof(hwconfig));
 		if (err)
-			return err;
+			goto error;
+		s->shadow.hwconfig[i] = hwconfig;
+		nr_written++;
 	}
 
 	/* Commit profile names */
 	for (i = 0; i < SYNAPSE_NR_PROFILES; i++) {
-		memset(&profname, 0, sizeof(profname));
-		profname.profile = i + 1;
-		for (j = 0; j < SYNAPSE_PROFNAME_MAX_LEN; j++) {
-			le16_t c = cpu_to_le16(s->profile_names[i].name[j]);
-			profname.name_le16[j] = c;
-		}
+		if (!s->prof_loaded[i])
+			continue;
+		synapse_build_profname(s, i, &profname);
+		if (!synapse_shadow_differs(s, force, &s->shadow.profname[i],
+					    &profname, sizeof(profname)))
+			continue;
 		err = synapse_request_write(s, 0x22, 0x29,
 					    &profname, sizeof(profname));
 		if (err)
-			return err;
+			goto error;
+		s->shadow.profname[i] = profname;
+		nr_written++;
 	}
 
 	/* Commit global config */
-	memset(&globconfig, 0, sizeof(globconfig));
-	globconfig.profile = s->cur_profile->nr + 1;
-	switch (s->cur_freq) {
-	default:
-	case RAZER_MOUSE_FREQ_1000HZ:
-		globconfig.freq = 1;
-		break;
-	case RAZER_MOUSE_FREQ_500HZ:
-		globconfig.freq = 2;
-		break;
-	case RAZER_MOUSE_FREQ_125HZ:
-		globconfig.freq = 8;
-		break;
+	synapse_build_globconfig(s, &globconfig);
+	if (synapse_shadow_differs(s, force, &s->shadow.globconfig,
+				   &globconfig, sizeof(globconfig))) {
+		err = synapse_request_write(s, 5, 5,
+					    &globconfig, sizeof(globconfig));
+		if (err)
+			goto error;
+		s->shadow.globconfig = globconfig;
+		nr_written++;
 	}
-	globconfig.dpisel = (s->cur_dpimapping[s->cur_profile->nr]->nr % 10) + 1;
-	globconfig.dpival0 = ((s->cur_dpimapping[s->cur_profile->nr]->res[RAZER_DIM_X] / 100) - 1) * 4;
-	globconfig.dpival1 = ((s->cur_dpimapping[s->cur_profile->nr]->res[RAZER_DIM_Y] / 100) - 1) * 4;
-	err = synapse_request_write(s, 5, 5,
-				    &globconfig, sizeof(globconfig));
-	if (err)
-		return err;
+	s->shadow_valid = 1;
+
+	if (nr_written)
+		synapse_store_cache(s);
+	else
+		razer_debug("synapse: Settings unchanged. Nothing to commit.\n");
 
 	return 0;
+
+error:
+	s->shadow_valid = 0;
+	synapse_store_cache(s);
+	return err;
 }
 
 static int synapse_commit(struct razer_mouse *m, int force)
@@ -649,14 +999,40 @@ static int synapse_commit(struct razer_mouse *m, int force)
 	if (!m->claim_count)
 		return -EBUSY;
 	if (s->commit_pending || force) {
-		err = synapse_do_commit(s);
-		if (!err)
+		err = synapse_do_commit(s, !!force);
+		if (!err) {
 			s->commit_pending = 0;
+			if (force)
+				s->cache_unverified = 0;
+		}
 	}
+	s->initial_committed = 1;
 
 	return err;
 }
 
+static int synapse_late_init(struct razer_mouse *m)
+{
+	struct razer_synapse *s = m->drv_data;
+	int err;
+
+	/* The cached settings are served right away.
+	 * They are verified by the first commit from a client. */
+	if (s->cache_unverified)
+		return 0;
+
+	/* Read the remaining profiles in the background. */
+	err = synapse_load_profiles(s);
+	if (err) {
+		razer_error("synapse: "
+			    "Failed to read the profiles from hardware\n");
+		return err;
+	}
+	synapse_store_cache(s);
+
+	return 0;
+}
+
 static enum razer_mouse_freq synapse_global_get_freq(struct razer_mouse *m)
 {
 	struct razer_synapse *s = m->drv_data;
@@ -685,6 +1061,8 @@ static const razer_utf16_t * synapse_profile_get_name(struct razer_mouse_profile
 
 	if (p->nr >= SYNAPSE_NR_PROFILES)
 		return NULL;
+	if (synapse_need_profile(s, p->nr))
+		return NULL;
 
 	return s->profile_names[p->nr].name;
 }
@@ -701,6 +1079,9 @@ static int synapse_profile_set_name(struct razer_mouse_profile *p,
 
 	if (!m->claim_count)
 		return -EBUSY;
+	err = synapse_need_profile(s, p->nr);
+	if (err)
+		return err;
 
 	err = razer_utf16_cpy(s->profile_names[p->nr].name,
 			      new_name, SYNAPSE_PROFNAME_MAX_LEN);
@@ -774,9 +1155,13 @@ static int synapse_set_active_profile(struct razer_mouse *m,
 				      struct razer_mouse_profile *p)
 {
 	struct razer_synapse *s = m->drv_data;
+	int err;
 
 	if (!s->m->claim_count)
 		return -EBUSY;
+	err = synapse_need_profile(s, p->nr);
+	if (err)
+		return err;
 
 	s->cur_profile = p;
 	s->commit_pending = 1;
@@ -788,7 +1173,14 @@ static int synapse_supported_dpimappings(struct razer_mouse *m,
 					 struct razer_mouse_dpimapping **res_ptr)
 {
 	struct razer_synapse *s = m->drv_data;
+	unsigned int i;
+	int err;
 
+	for (i = 0; i < SYNAPSE_NR_PROFILES; i++) {
+		err = synapse_need_profile(s, i);
+		if (err)
+			return err;
+	}
 	*res_ptr = &s->dpimappings[0][0];
 
 	return SYNAPSE_NR_PROFILES * SYNAPSE_NR_DPIMAPPINGS;
@@ -801,6 +1193,10 @@ static struct razer_mouse_dpimapping * synapse_get_dpimapping(struct razer_mouse
 
 	if (p->nr >= ARRAY_SIZE(s->cur_dpimapping))
 		return NULL;
+	/* The active DPI mapping of the active profile is known
+	 * without reading the profile. */
+	if (!s->cur_dpimapping[p->nr] && synapse_need_profile(s, p->nr))
+		return NULL;
 
 	return s->cur_dpimapping[p->nr];
 }
@@ -811,11 +1207,15 @@ static int synapse_set_dpimapping(struct razer_mouse_profile *p,
 {
 	struct razer_synapse *s = p->mouse->drv_data;
 	razer_id_mask_t idmask;
+	int err;
 
 	if (!s->m->claim_count)
 		return -EBUSY;
 	if (p->nr >= ARRAY_SIZE(s->cur_dpimapping))
 		return -EINVAL;
+	err = synapse_need_profile(s, p->nr);
+	if (err)
+		return err;
 
 	razer_id_mask_zero(&idmask);
 	razer_id_mask_set(&idmask, p->nr);
@@ -833,12 +1233,16 @@ static int synapse_dpimapping_modify(struct razer_mouse_dpimapping *d,
 				     enum razer_mouse_res res)
 {
 	struct razer_synapse *s = d->mouse->drv_data;
+	int err;
 
 	if ((int)dim < 0 || (unsigned int)dim >= ARRAY_SIZE(d->res))
 		return -EINVAL;
 
 	if (!s->m->claim_count)
 		return -EBUSY;
+	err = synapse_need_profile(s, d->nr / 10);
+	if (err)
+		return err;
 
 	d->res[dim] = res;
 	s->commit_pending = 1;
@@ -851,10 +1255,13 @@ static int synapse_profile_get_leds(struct razer_mouse_profile *p,
 {
 	struct razer_synapse *s = p->mouse->drv_data;
 	struct razer_led *leds[SYNAPSE_NR_LEDS];
-	int i;
+	int i, err;
 
 	if (p->nr >= SYNAPSE_NR_PROFILES)
 		return -EINVAL;
+	err = synapse_need_profile(s, p->nr);
+	if (err)
+		return err;
 
 	for (i = 0; i < SYNAPSE_NR_LEDS; i++) {
 		leds[i] = zalloc(sizeof(struct razer_led));
@@ -895,47 +1302,27 @@ static int synapse_supported_axes(struct razer_mouse *m,
 	return ARRAY_SIZE(s->axes);
 }
 
+static const enum razer_mouse_freq synapse_freqs[] = {
+	RAZER_MOUSE_FREQ_1000HZ,
+	RAZER_MOUSE_FREQ_500HZ,
+	RAZER_MOUSE_FREQ_125HZ,
+};
+
 static int synapse_supported_freqs(struct razer_mouse *m,
-				   enum razer_mouse_freq **freq_list)
+				   const enum razer_mouse_freq **freq_list)
 {
-	enum razer_mouse_freq *list;
-	const int count = 3;
-
-	list = malloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
-
-	list[0] = RAZER_MOUSE_FREQ_1000HZ;
-	list[1] = RAZER_MOUSE_FREQ_500HZ;
-	list[2] = RAZER_MOUSE_FREQ_125HZ;
+	*freq_list = synapse_freqs;
 
-	*freq_list = list;
-
-	return count;
+	return ARRAY_SIZE(synapse_freqs);
 }
 
 static int synapse_supported_resolutions(struct razer_mouse *m,
-					 enum razer_mouse_res **res_list)
+					 const enum razer_mouse_res **res_list)
 {
-	enum razer_mouse_res *list;
-	unsigned int i, count = 0, res, step = 0;
-
-	count = 56;
-	step = RAZER_MOUSE_RES_100DPI;
+	/* 100 DPI up to 5600 DPI */
+	*res_list = razer_res_steps_100dpi;
 
-	list = malloc(sizeof(*list) * count);
-	if (!list)
-		return -ENOMEM;
-
-	res = step;
-	for (i = 0; i < count; i++) {
-		list[i] = res;
-		res += step;
-	}
-
-	*res_list = list;
-
-	return count;
+	return 56;
 }
 
 static int synapse_supported_buttons(struct razer_mouse *m,
@@ -960,6 +1347,8 @@ static struct razer_button_function * synapse_get_button_function(struct razer_m
 
 	if (p->nr > ARRAY_SIZE(s->buttons))
 		return NULL;
+	if (synapse_need_profile(s, p->nr))
+		return NULL;
 	buttons = &s->buttons[p->nr];
 
 	return razer_get_buttonfunction_by_button(
@@ -975,11 +1364,15 @@ static int synapse_set_button_function(struct razer_mouse_profile *p,
 	struct razer_synapse *s = p->mouse->drv_data;
 	struct synapse_buttons *buttons;
 	struct razer_buttonmapping *mapping;
+	int err;
 
 	if (!s->m->claim_count)
 		return -EBUSY;
 	if (p->nr > ARRAY_SIZE(s->buttons))
 		return -EINVAL;
+	err = synapse_need_profile(s, p->nr);
+	if (err)
+		return err;
 	buttons = &s->buttons[p->nr];
 
 	mapping = razer_get_buttonmapping_by_physid(
@@ -1069,14 +1462,20 @@ int razer_synapse_init(struct razer_mouse *m,
 		goto err_release;
 	}
 
-	err = synapse_read_config_from_hw(s);
+	/* The profiles are read by the config job
+	 * after the device was published. */
+	err = synapse_load_config_from_cache(s);
 	if (err) {
-		razer_error("synapse: "
-			    "Failed to read the configuration from hardware\n");
-		goto err_release;
+		err = synapse_read_globconfig_from_hw(s);
+		if (err) {
+			razer_error("synapse: "
+				    "Failed to read the configuration from hardware\n");
+			goto err_release;
+		}
 	}
 
 	m->get_fw_version = synapse_get_fw_version;
+	m->late_init = synapse_late_init;
 	m->commit = synapse_commit;
 	m->global_get_freq = synapse_global_get_freq;
 	m->global_set_freq = synapse_global_set_freq;
@@ -1091,11 +1490,8 @@ int razer_synapse_init(struct razer_mouse *m,
 	m->supported_buttons = synapse_supported_buttons;
 	m->supported_button_functions = synapse_supported_button_functions;
 
-	err = synapse_do_commit(s);
-	if (err) {
-		razer_error("synapse: Failed to commit initial settings\n");
-		goto err_release;
-	}
+	/* The initial settings are committed by the config job. */
+	s->commit_pending = 1;
 	m->release(m);
 
 	return 0;
@@ -0,0 +1,99 @@
+#ifndef RAZER_TRANSPORT_H_
+#define RAZER_TRANSPORT_H_
+
+#include "razer_private.h"
+
+#include <sys/types.h>
+
+
+/** struct razer_usb_devinfo - A device found by a transport scan.
+ *
+ * @desc: The USB device descriptor. Transports that do not
+ *        see the real descriptor fill in the IDs only.
+ *
+ * @busnr: The bus number.
+ *
+ * @devaddr: The device address on the bus.
+ *
+ * @priv: Transport private device reference.
+ */
+struct razer_usb_devinfo {
+	struct libusb_device_descriptor desc;
+	uint8_t busnr;
+	uint8_t devaddr;
+	void *priv;
+};
+
+/** struct razer_transport - A device transport backend.
+ *
+ * @name: The name used to select the transport.
+ *
+ * @init: Initialize the backend. Called from razer_init().
+ *        options is the part of the transport spec after the colon
+ *        ("sim:dev=1532:0016" passes "dev=1532:0016"). May be empty.
+ *
+ * @exit: Cleanup the backend. Called from razer_exit().
+ *
+ * @get_device_list: Get a list of all devices. Returns the number
+ *                   of devices or a negative error code.
+ *
+ * @free_device_list: Free a list from get_device_list().
+ *
+ * @attach: Take a reference to the device described by info
+ *          and store it in the USB context.
+ *
+ * @detach: Drop the reference taken by attach.
+ *
+ * @claim: Open the device for transfers.
+ *
+ * @release: Close the device.
+ *
+ * @control: Do a control transfer. The return value is the number of
+ *           transferred bytes or a LIBUSB_ERROR code.
+ *
+ * @bulk: Do a bulk transfer. Returns 0 or a LIBUSB_ERROR code.
+ *        May be NULL, if the transport has no bulk endpoints.
+ *
+ * @get_string: Fetch a string descriptor as ASCII. The return value is
+ *              the string length or a LIBUSB_ERROR code.
+ */
+struct razer_transport {
+	const char *name;
+
+	int (*init)(const char *options);
+	void (*exit)(void);
+
+	ssize_t (*get_device_list)(struct razer_usb_devinfo **list);
+	void (*free_device_list)(struct razer_usb_devinfo *list, ssize_t count);
+
+	int (*attach)(struct razer_usb_context *ctx,
+		      const struct razer_usb_devinfo *info);
+	void (*detach)(struct razer_usb_context *ctx);
+
+	int (*claim)(struct razer_usb_context *ctx);
+	void (*release)(struct razer_usb_context *ctx);
+
+	int (*control)(struct razer_usb_context *ctx,
+		       uint8_t request_type, uint8_t request,
+		       uint16_t value, uint16_t index,
+		       unsigned char *data, uint16_t length,
+		       unsigned int timeout);
+	int (*bulk)(struct razer_usb_context *ctx, unsigned char endpoint,
+		    unsigned char *data, int length, int *transferred,
+		    unsigned int timeout);
+	int (*get_string)(struct razer_usb_context *ctx, uint8_t index,
+			  char *buf, size_t size);
+};
+
+extern const struct razer_transport razer_transport_libusb;
+extern const struct razer_transport razer_transport_hidraw;
+extern const struct razer_transport razer_transport_sim;
+
+const struct razer_transport * razer_transport_find(const char *spec);
+
+static inline bool razer_transport_is_libusb(const struct razer_usb_context *ctx)
+{
+	return !ctx->transport || ctx->transport == &razer_transport_libusb;
+}
+
+#endif /* RAZER_TRANSPORT_H_ */
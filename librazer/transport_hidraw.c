@@ -0,0 +1,470 @@
+/*
+ *   Linux hidraw transport
+ *
+ *   Copyright (C) 2026 Michael Buesch <m@bues.ch>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation; either version 2
+ *   of the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "transport.h"
+#include "razer_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+
+
+/* The HID devices are accessed through the feature report ioctls
+ * of the hidraw nodes. This keeps the kernel HID driver bound,
+ * so the input device does not go away while we talk to the mouse.
+ * Virtual HID devices (uhid) are supported as well. These have no
+ * USB parent and are reported on bus 0.
+ */
+
+#define HIDRAW_SYSFS_CLASS	"/sys/class/hidraw"
+#define HIDRAW_MAX_REPORT	512
+#define HIDRAW_MAX_DEVICES	64
+
+#define HID_BUS_USB		0x03
+
+/* HID class requests and report types (HID spec 7.2) */
+#define HID_REQ_GET_REPORT	0x01
+#define HID_REQ_SET_REPORT	0x09
+#define HID_REPORT_OUTPUT	0x02
+#define HID_REPORT_FEATURE	0x03
+
+/** struct hidraw_device - A device on the hidraw transport.
+ *
+ * @syspath: The sysfs path of the USB device. For virtual HID devices
+ *           this is the path of the HID device.
+ *
+ * @usb: True, if syspath is a USB device.
+ *
+ * @serial: The serial number string. Empty, if unknown.
+ *
+ * @fd: The open hidraw node or -1.
+ */
+struct hidraw_device {
+	char syspath[PATH_MAX];
+	bool usb;
+	char serial[64];
+	int fd;
+};
+
+static int read_sysfs_attr(const char *dir, const char *attr,
+			   char *buf, size_t size)
+{
+	char path[PATH_MAX + 32];
+	size_t len;
+	FILE *fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, attr);
+	fd = fopen(path, "r");
+	if (!fd)
+		return -errno;
+	if (!fgets(buf, size, fd)) {
+		fclose(fd);
+		return -EIO;
+	}
+	fclose(fd);
+	len = strlen(buf);
+	while (len && (buf[len - 1] == '\n' || buf[len - 1] == '\r'))
+		buf[--len] = '\0';
+
+	return 0;
+}
+
+static int read_sysfs_uint(const char *dir, const char *attr,
+			   int base, unsigned int *value)
+{
+	char buf[32], *end;
+	int err;
+
+	err = read_sysfs_attr(dir, attr, buf, sizeof(buf));
+	if (err)
+		return err;
+	*value = strtoul(buf, &end, base);
+	if (end == buf)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void path_strip_last(char *path)
+{
+	char *slash;
+
+	slash = strrchr(path, '/');
+	if (slash && slash != path)
+		*slash = '\0';
+}
+
+/** struct hidraw_node - Information about one hidraw node.
+ *
+ * @minor: The N of /dev/hidrawN.
+ *
+ * @hidpath: The sysfs path of the HID device.
+ *
+ * @vendor, @product: The HID IDs.
+ *
+ * @uniq: The HID unique ID (serial number).
+ *
+ * @interface: The USB interface number or -1.
+ */
+struct hidraw_node {
+	unsigned int minor;
+	char hidpath[PATH_MAX];
+	uint16_t vendor;
+	uint16_t product;
+	char uniq[64];
+	int interface;
+};
+
+static int hidraw_read_node(const char *name, struct hidraw_node *node)
+{
+	char path[PATH_MAX + 32], line[256], intfpath[PATH_MAX];
+	unsigned int bus, vendor, product, interface;
+	bool have_id = 0;
+	FILE *fd;
+
+	memset(node, 0, sizeof(*node));
+	if (sscanf(name, "hidraw%u", &node->minor) != 1)
+		return -EINVAL;
+
+	snprintf(path, sizeof(path), "%s/%s/device", HIDRAW_SYSFS_CLASS, name);
+	if (!realpath(path, node->hidpath))
+		return -errno;
+
+	snprintf(path, sizeof(path), "%s/uevent", node->hidpath);
+	fd = fopen(path, "r");
+	if (!fd)
+		return -errno;
+	while (fgets(line, sizeof(line), fd)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (sscanf(line, "HID_ID=%x:%x:%x", &bus, &vendor, &product) == 3) {
+			have_id = 1;
+		} else if (strncmp(line, "HID_UNIQ=", 9) == 0) {
+			strncpy(node->uniq, line + 9, sizeof(node->uniq) - 1);
+			node->uniq[sizeof(node->uniq) - 1] = '\0';
+		}
+	}
+	fclose(fd);
+	if (!have_id || bus != HID_BUS_USB)
+		return -ENODEV;
+	node->vendor = vendor;
+	node->product = product;
+
+	node->interface = -1;
+	strcpy(intfpath, node->hidpath);
+	path_strip_last(intfpath);
+	if (!read_sysfs_uint(intfpath, "bInterfaceNumber", 16, &interface))
+		node->interface = interface;
+
+	return 0;
+}
+
+/* Get the USB device directory of a node. Returns false for virtual devices. */
+static bool hidraw_node_usbpath(const struct hidraw_node *node, char *usbpath)
+{
+	unsigned int busnum;
+
+	if (node->interface < 0)
+		return 0;
+	strcpy(usbpath, node->hidpath);
+	path_strip_last(usbpath);
+	path_strip_last(usbpath);
+
+	return !read_sysfs_uint(usbpath, "busnum", 10, &busnum);
+}
+
+static int hidraw_get_info(const struct hidraw_node *node,
+			   struct razer_usb_devinfo *info)
+{
+	struct hidraw_device *hd;
+	unsigned int value;
+
+	hd = zalloc(sizeof(*hd));
+	if (!hd)
+		return -ENOMEM;
+	hd->fd = -1;
+
+	memset(info, 0, sizeof(*info));
+	info->desc.bLength = LIBUSB_DT_DEVICE_SIZE;
+	info->desc.bDescriptorType = LIBUSB_DT_DEVICE;
+	info->desc.idVendor = node->vendor;
+	info->desc.idProduct = node->product;
+
+	hd->usb = hidraw_node_usbpath(node, hd->syspath);
+	if (hd->usb) {
+		if (!read_sysfs_uint(hd->syspath, "busnum", 10, &value))
+			info->busnr = value;
+		if (!read_sysfs_uint(hd->syspath, "devnum", 10, &value))
+			info->devaddr = value;
+		if (!read_sysfs_uint(hd->syspath, "bcdDevice", 16, &value))
+			info->desc.bcdDevice = value;
+		read_sysfs_attr(hd->syspath, "serial", hd->serial, sizeof(hd->serial));
+	} else {
+		strcpy(hd->syspath, node->hidpath);
+		info->busnr = 0;
+		info->devaddr = node->minor;
+		strcpy(hd->serial, node->uniq);
+	}
+	/* The real string index is unknown. Any index fetches the serial. */
+	info->desc.iSerialNumber = hd->serial[0] ? 1 : 0;
+	info->priv = hd;
+
+	return 0;
+}
+
+static ssize_t hidraw_get_device_list(struct razer_usb_devinfo **list)
+{
+	struct razer_usb_devinfo *infos;
+	struct hidraw_node node;
+	struct hidraw_device *hd;
+	struct dirent *dent;
+	ssize_t count = 0, i;
+	char usbpath[PATH_MAX];
+	DIR *dir;
+
+	dir = opendir(HIDRAW_SYSFS_CLASS);
+	if (!dir) {
+		/* No hidraw support in the kernel, or no HID devices. */
+		*list = NULL;
+		return 0;
+	}
+	infos = calloc(HIDRAW_MAX_DEVICES, sizeof(*infos));
+	if (!infos) {
+		closedir(dir);
+		return -ENOMEM;
+	}
+	while ((dent = readdir(dir)) != NULL && count < HIDRAW_MAX_DEVICES) {
+		if (hidraw_read_node(dent->d_name, &node))
+			continue;
+		/* A USB device has one node per HID interface. List it once. */
+		if (hidraw_node_usbpath(&node, usbpath)) {
+			for (i = 0; i < count; i++) {
+				hd = infos[i].priv;
+				if (hd->usb && strcmp(hd->syspath, usbpath) == 0)
+					break;
+			}
+			if (i < count)
+				continue;
+		}
+		if (hidraw_get_info(&node, &infos[count]))
+			continue;
+		count++;
+	}
+	closedir(dir);
+	*list = infos;
+
+	return count;
+}
+
+static void hidraw_free_device_list(struct razer_usb_devinfo *list, ssize_t count)
+{
+	ssize_t i;
+
+	for (i = 0; i < count; i++)
+		free(list[i].priv);
+	free(list);
+}
+
+static int hidraw_attach(struct razer_usb_context *ctx,
+			 const struct razer_usb_devinfo *info)
+{
+	struct hidraw_device *hd;
+
+	hd = malloc(sizeof(*hd));
+	if (!hd)
+		return -ENOMEM;
+	memcpy(hd, info->priv, sizeof(*hd));
+	hd->fd = -1;
+	ctx->transport_priv = hd;
+
+	return 0;
+}
+
+static void hidraw_detach(struct razer_usb_context *ctx)
+{
+	struct hidraw_device *hd = ctx->transport_priv;
+
+	if (hd->fd >= 0)
+		close(hd->fd);
+	free(hd);
+	ctx->transport_priv = NULL;
+}
+
+/* Find the hidraw node of the first interface the driver uses. */
+static int hidraw_find_node(struct razer_usb_context *ctx)
+{
+	struct hidraw_device *hd = ctx->transport_priv;
+	struct hidraw_node node;
+	struct dirent *dent;
+	char usbpath[PATH_MAX];
+	int interface = -1, minor = -ENODEV;
+	DIR *dir;
+
+	if (ctx->nr_interfaces)
+		interface = ctx->interfaces[0].bInterfaceNumber;
+
+	dir = opendir(HIDRAW_SYSFS_CLASS);
+	if (!dir)
+		return -ENODEV;
+	while ((dent = readdir(dir)) != NULL) {
+		if (hidraw_read_node(dent->d_name, &node))
+			continue;
+		if (hd->usb) {
+			if (!hidraw_node_usbpath(&node, usbpath) ||
+			    strcmp(usbpath, hd->syspath) != 0)
+				continue;
+			if (interface >= 0 && node.interface != interface)
+				continue;
+		} else {
+			if (strcmp(node.hidpath, hd->syspath) != 0)
+				continue;
+		}
+		minor = node.minor;
+		break;
+	}
+	closedir(dir);
+
+	return minor;
+}
+
+static int hidraw_claim(struct razer_usb_context *ctx)
+{
+	struct hidraw_device *hd = ctx->transport_priv;
+	char path[32];
+	int minor;
+
+	minor = hidraw_find_node(ctx);
+	if (minor < 0) {
+		razer_debug("hidraw: No node for %s\n", hd->syspath);
+		return -ENODEV;
+	}
+	snprintf(path, sizeof(path), "/dev/hidraw%d", minor);
+	hd->fd = open(path, O_RDWR | O_CLOEXEC);
+	if (hd->fd < 0) {
+		razer_error("hidraw: Failed to open %s: %s\n",
+			    path, strerror(errno));
+		return errno == EACCES ? -EPERM : -ENODEV;
+	}
+
+	return 0;
+}
+
+static void hidraw_release(struct razer_usb_context *ctx)
+{
+	struct hidraw_device *hd = ctx->transport_priv;
+
+	if (hd->fd >= 0)
+		close(hd->fd);
+	hd->fd = -1;
+}
+
+static int hidraw_errno_to_libusb(int error)
+{
+	switch (error) {
+	case ETIMEDOUT:
+		return LIBUSB_ERROR_TIMEOUT;
+	case ENODEV:
+		return LIBUSB_ERROR_NO_DEVICE;
+	case EPIPE:
+		return LIBUSB_ERROR_PIPE;
+	case EINVAL:
+		return LIBUSB_ERROR_INVALID_PARAM;
+	case EACCES:
+	case EPERM:
+		return LIBUSB_ERROR_ACCESS;
+	}
+	return LIBUSB_ERROR_IO;
+}
+
+static int hidraw_control(struct razer_usb_context *ctx,
+			  uint8_t request_type, uint8_t request,
+			  uint16_t value, uint16_t index,
+			  unsigned char *data, uint16_t length,
+			  unsigned int timeout)
+{
+	struct hidraw_device *hd = ctx->transport_priv;
+	unsigned char buf[HIDRAW_MAX_REPORT + 1];
+	uint8_t report_type = value >> 8;
+	ssize_t res;
+
+	if (hd->fd < 0)
+		return LIBUSB_ERROR_NO_DEVICE;
+	/* Only the HID class reports can be mapped to hidraw. */
+	if ((request_type & 0x60) != LIBUSB_REQUEST_TYPE_CLASS)
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+	if (length > HIDRAW_MAX_REPORT)
+		return LIBUSB_ERROR_OVERFLOW;
+
+	/* The first byte is the report ID. The kernel strips ID 0. */
+	buf[0] = value & 0xFF;
+	if ((request_type & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT) {
+		if (request != HID_REQ_SET_REPORT)
+			return LIBUSB_ERROR_NOT_SUPPORTED;
+		memcpy(buf + 1, data, length);
+		if (report_type == HID_REPORT_FEATURE)
+			res = ioctl(hd->fd, HIDIOCSFEATURE(length + 1), buf);
+		else if (report_type == HID_REPORT_OUTPUT)
+			res = write(hd->fd, buf, length + 1);
+		else
+			return LIBUSB_ERROR_NOT_SUPPORTED;
+		if (res < 0)
+			return hidraw_errno_to_libusb(errno);
+		return length;
+	}
+
+	if (request != HID_REQ_GET_REPORT || report_type != HID_REPORT_FEATURE)
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+	res = ioctl(hd->fd, HIDIOCGFEATURE(length + 1), buf);
+	if (res < 0)
+		return hidraw_errno_to_libusb(errno);
+	if (res <= 1)
+		return 0;
+	res = min((size_t)(res - 1), (size_t)length);
+	memcpy(data, buf + 1, res);
+
+	return res;
+}
+
+static int hidraw_get_string(struct razer_usb_context *ctx, uint8_t index,
+			     char *buf, size_t size)
+{
+	struct hidraw_device *hd = ctx->transport_priv;
+
+	if (!hd->serial[0] || !size)
+		return LIBUSB_ERROR_NOT_FOUND;
+	strncpy(buf, hd->serial, size - 1);
+	buf[size - 1] = '\0';
+
+	return strlen(buf);
+}
+
+const struct razer_transport razer_transport_hidraw = {
+	.name			= "hidraw",
+	.get_device_list	= hidraw_get_device_list,
+	.free_device_list	= hidraw_free_device_list,
+	.attach			= hidraw_attach,
+	.detach			= hidraw_detach,
+	.claim			= hidraw_claim,
+	.release		= hidraw_release,
+	.control		= hidraw_control,
+	.get_string		= hidraw_get_string,
+};
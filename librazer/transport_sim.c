@@ -0,0 +1,1228 @@
+/*
+ *   Simulated device transport
+ *
+ *   Copyright (C) 2026 Michael Buesch <m@bues.ch>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation; either version 2
+ *   of the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "transport.h"
+#include "razer_private.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+
+/* The simulated devices live in the library. They are created from
+ * the transport options, e.g. "sim:dev=1532:0016,dev=1532:0043".
+ * Each device emulates the protocol of the real firmware, so the
+ * drivers run their normal code paths against it.
+ *
+ * Options:
+ *	dev=VID:PID		Add a device. Without any dev= option
+ *				one device per protocol is created.
+ *	latency=USEC		Time of one transfer. Defaults to 1000.
+ *	jitter=USEC		Random extra time of one transfer.
+ *	error=N			Fail one in N transfers with a pipe error.
+ *	seed=N			Seed of the jitter and error generator.
+ *	reconnect=MSEC		Time a device is gone from the bus after
+ *				a firmware reboot. 0 disables reboots.
+ */
+
+#define SIM_MAX_DEVICES		16
+#define SIM_MAX_REPORTS		16
+#define SIM_MAX_REPORT_SIZE	512
+#define SIM_NR_PROFILES		8
+#define SIM_PROFILE_SIZE	512
+#define SIM_MAX_STATUS		4
+
+/* The simulated devices are on this bus number. */
+#define SIM_BUSNR		0xFE
+
+/* Size of Synapse requests and 90-byte command reports. */
+#define SIM_REPORT_LEN		90
+#define SIM_REPORT_VALUE	0x300
+
+enum sim_protocol {
+	SIM_PROTO_REGISTER,	/* Plain register file */
+	SIM_PROTO_DEATHADDER,	/* Classic DeathAdder registers */
+	SIM_PROTO_LACHESIS,	/* Lachesis registers and profiles */
+	SIM_PROTO_COPPERHEAD,	/* Copperhead and Boomslang CE chunked profiles */
+	SIM_PROTO_SYNAPSE,	/* Synapse 90-byte requests */
+	SIM_PROTO_REPORT,	/* 90-byte command reports (Naga, Taipan, Chroma) */
+	SIM_PROTO_CYPRESS,	/* Cypress bootloader */
+};
+
+#define SIM_FLG_FREQ_RECONNECT	(1 << 0) /* Firmware reboots on frequency change */
+
+struct sim_model {
+	uint16_t vendor;
+	uint16_t product;
+	enum sim_protocol protocol;
+	uint16_t fw_version;
+	unsigned int flags;
+};
+
+static const struct sim_model sim_models[] = {
+	{ 0x1532, 0x0003, SIM_PROTO_REGISTER,	0x0100, 0, },			/* Krait */
+	{ 0x1532, 0x0005, SIM_PROTO_COPPERHEAD,	0x0100, 0, },			/* Boomslang CE */
+	{ 0x1532, 0x0007, SIM_PROTO_DEATHADDER,	0x0119, SIM_FLG_FREQ_RECONNECT, },
+	{ 0x1532, 0x000C, SIM_PROTO_LACHESIS,	0x0100, 0, },
+	{ 0x1532, 0x0015, SIM_PROTO_REPORT,	0x0104, 0, },			/* Naga */
+	{ 0x1532, 0x0016, SIM_PROTO_DEATHADDER,	0x0201, SIM_FLG_FREQ_RECONNECT, },
+	{ 0x1532, 0x0017, SIM_PROTO_SYNAPSE,	0x0100, 0, },			/* Imperator */
+	{ 0x1532, 0x001E, SIM_PROTO_SYNAPSE,	0x0100, 0, },			/* Lachesis 5600 */
+	{ 0x1532, 0x001F, SIM_PROTO_REPORT,	0x0104, 0, },			/* Naga Epic */
+	{ 0x1532, 0x0029, SIM_PROTO_DEATHADDER,	0x0201, 0, },			/* DeathAdder Black */
+	{ 0x1532, 0x002E, SIM_PROTO_REPORT,	0x0104, 0, },			/* Naga 2012 */
+	{ 0x1532, 0x0034, SIM_PROTO_REPORT,	0x0104, 0, },			/* Taipan */
+	{ 0x1532, 0x0036, SIM_PROTO_REPORT,	0x0104, 0, },			/* Naga Hex */
+	{ 0x1532, 0x0037, SIM_PROTO_REPORT,	0x0104, 0, },			/* DeathAdder 2013 */
+	{ 0x1532, 0x0038, SIM_PROTO_REPORT,	0x0104, 0, },			/* DeathAdder 1800 */
+	{ 0x1532, 0x0040, SIM_PROTO_REPORT,	0x0104, 0, },			/* Naga 2014 */
+	{ 0x1532, 0x0041, SIM_PROTO_REPORT,	0x0104, 0, },			/* Naga Hex 2014 */
+	{ 0x1532, 0x0043, SIM_PROTO_REPORT,	0x0104, 0, },			/* DeathAdder Chroma */
+	{ 0x1532, 0x0046, SIM_PROTO_REPORT,	0x0104, 0, },			/* Mamba TE */
+	{ 0x1532, 0x004C, SIM_PROTO_REPORT,	0x0104, 0, },			/* Diamondback Chroma */
+	{ 0x1532, 0x0101, SIM_PROTO_COPPERHEAD,	0x0100, 0, },
+	{ 0x04B4, 0xE006, SIM_PROTO_CYPRESS,	0x0000, 0, },
+};
+
+/* Devices of the default set. One per protocol. */
+static const uint16_t sim_default_products[] = {
+	0x0016, 0x000C, 0x0101, 0x0017, 0x0015, 0x0043, 0x0003,
+};
+
+/* Unknown devices are plain register files. */
+static const struct sim_model sim_model_generic = {
+	.protocol	= SIM_PROTO_REGISTER,
+	.fw_version	= 0x0100,
+};
+
+struct sim_report {
+	bool valid;
+	uint16_t value;
+	uint16_t index;
+	uint16_t length;
+	unsigned char data[SIM_MAX_REPORT_SIZE];
+};
+
+struct sim_status {
+	uint8_t status;
+	struct timeval ready;
+};
+
+/** struct sim_device - A simulated device.
+ *
+ * @model: The emulated hardware.
+ *
+ * @desc: The device descriptor.
+ *
+ * @devaddr: The device address on the simulated bus.
+ *           It changes on every reconnect.
+ *
+ * @serial: The serial number string.
+ *
+ * @claimed: True, if a USB context claimed the device.
+ *
+ * @seed: State of the jitter and error generator.
+ *
+ * @disconnected: True, while the device is gone from the bus.
+ *
+ * @reconnect_at: The time the device comes back.
+ *
+ * @reports: The register file. Command reports store their
+ *           arguments here, too.
+ *
+ * @profile: The active profile (1-based).
+ *
+ * @sel_profile: The profile selected for readout (1-based).
+ *
+ * @result: The result of the last profile write.
+ *
+ * @freq: The current frequency setting.
+ *
+ * @profiles: The profile storage.
+ *
+ * @chunks: Profile data being uploaded in chunks.
+ *
+ * @globconfig: The Synapse global configuration.
+ *
+ * @profnames: The Synapse profile names.
+ *
+ * @reply: The reply to the last request.
+ *
+ * @blmode: True, if the bootloader accepts flash commands.
+ *
+ * @status: Pending bootloader status reports.
+ */
+struct sim_device {
+	pthread_mutex_t lock;
+	const struct sim_model *model;
+	struct libusb_device_descriptor desc;
+	unsigned int index;
+	uint8_t devaddr;
+	char serial[32];
+	bool claimed;
+	unsigned int seed;
+
+	bool disconnected;
+	unsigned int generation;
+	struct timeval reconnect_at;
+
+	struct sim_report reports[SIM_MAX_REPORTS];
+
+	uint8_t profile;
+	uint8_t sel_profile;
+	uint8_t result;
+	uint8_t freq;
+	unsigned char profiles[SIM_NR_PROFILES][SIM_PROFILE_SIZE];
+	unsigned char chunks[SIM_PROFILE_SIZE];
+	bool chunks_dirty;
+
+	unsigned char globconfig[80];
+	unsigned char profnames[SIM_NR_PROFILES][80];
+
+	unsigned char reply[SIM_REPORT_LEN];
+
+	bool blmode;
+	unsigned int nr_status;
+	struct sim_status status[SIM_MAX_STATUS];
+};
+
+/** struct sim_protocol_ops - The emulation of one protocol.
+ *
+ * @reset: Load the factory state.
+ *
+ * @write: Handle an OUT control transfer.
+ *         Returns the transferred length or a LIBUSB_ERROR code.
+ *
+ * @read: Handle an IN control transfer.
+ *        Returns the transferred length or a LIBUSB_ERROR code.
+ */
+struct sim_protocol_ops {
+	void (*reset)(struct sim_device *sd);
+	int (*write)(struct sim_device *sd, uint16_t value, uint16_t index,
+		     const unsigned char *data, uint16_t length);
+	int (*read)(struct sim_device *sd, uint16_t value, uint16_t index,
+		    unsigned char *data, uint16_t length);
+};
+
+static struct {
+	unsigned int latency;		/* usec */
+	unsigned int jitter;		/* usec */
+	unsigned int error_rate;	/* One in N transfers fails. 0 = never */
+	unsigned int seed;
+	unsigned int reconnect;		/* msec */
+} sim_config;
+
+static struct sim_device *sim_devices[SIM_MAX_DEVICES];
+static unsigned int sim_nr_devices;
+
+
+static void sim_udelay(unsigned int usecs)
+{
+	struct timespec time;
+	int err;
+
+	time.tv_sec = usecs / 1000000;
+	time.tv_nsec = (long)(usecs % 1000000) * 1000;
+	do {
+		err = nanosleep(&time, &time);
+	} while (err && errno == EINTR);
+}
+
+static struct sim_report * sim_find_report(struct sim_device *sd,
+					   uint16_t value, uint16_t index,
+					   bool create)
+{
+	struct sim_report *r, *unused = NULL;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sd->reports); i++) {
+		r = &sd->reports[i];
+		if (!r->valid) {
+			if (!unused)
+				unused = r;
+			continue;
+		}
+		if (r->value == value && r->index == index)
+			return r;
+	}
+	if (!create)
+		return NULL;
+	if (!unused) /* Recycle the first slot. */
+		unused = &sd->reports[0];
+	memset(unused, 0, sizeof(*unused));
+	unused->valid = 1;
+	unused->value = value;
+	unused->index = index;
+
+	return unused;
+}
+
+static void sim_store(struct sim_device *sd, uint16_t value, uint16_t index,
+		      const void *data, uint16_t length)
+{
+	struct sim_report *r;
+
+	r = sim_find_report(sd, value, index, 1);
+	length = min(length, (uint16_t)sizeof(r->data));
+	memcpy(r->data, data, length);
+	r->length = length;
+}
+
+/* Copy a stored report to data. Missing data reads as zero. */
+static void sim_fetch(struct sim_device *sd, uint16_t value, uint16_t index,
+		      void *data, uint16_t length)
+{
+	struct sim_report *r;
+
+	memset(data, 0, length);
+	r = sim_find_report(sd, value, index, 0);
+	if (r)
+		memcpy(data, r->data, min(r->length, length));
+}
+
+/* Take the device off the bus, as the firmware does on a reboot. */
+static void sim_disconnect(struct sim_device *sd)
+{
+	if (!sim_config.reconnect)
+		return;
+	razer_debug("sim: Device %s reconnects\n", sd->serial);
+	sd->disconnected = 1;
+	sd->claimed = 0;
+	gettimeofday(&sd->reconnect_at, NULL);
+	razer_timeval_add_msec(&sd->reconnect_at, sim_config.reconnect);
+}
+
+/* Bring a disconnected device back, if its reboot finished.
+ * It comes back on a new device address. */
+static void sim_update_connection(struct sim_device *sd)
+{
+	struct timeval now;
+
+	if (!sd->disconnected)
+		return;
+	gettimeofday(&now, NULL);
+	if (!razer_timeval_after(&now, &sd->reconnect_at))
+		return;
+	sd->disconnected = 0;
+	sd->generation++;
+	sd->devaddr = 1 + (sd->index + sd->generation * SIM_MAX_DEVICES) % 127;
+}
+
+static int sim_register_write(struct sim_device *sd, uint16_t value, uint16_t index,
+			      const unsigned char *data, uint16_t length)
+{
+	sim_store(sd, value, index, data, length);
+
+	return length;
+}
+
+static int sim_register_read(struct sim_device *sd, uint16_t value, uint16_t index,
+			     unsigned char *data, uint16_t length)
+{
+	sim_fetch(sd, value, index, data, length);
+
+	return length;
+}
+
+static void sim_put_fw_version(struct sim_device *sd,
+			       unsigned char *data, uint16_t length)
+{
+	memset(data, 0, length);
+	if (length >= 1)
+		data[0] = sd->model->fw_version >> 8;
+	if (length >= 2)
+		data[1] = sd->model->fw_version;
+}
+
+/* DeathAdder classic.
+ * Register 0x05 holds the firmware version. 0x07 and 0x10 hold the
+ * frequency, which reboots the firmware on some models. */
+
+static void sim_deathadder_reset(struct sim_device *sd)
+{
+	sd->freq = 1; /* 1000 Hz */
+}
+
+static int sim_deathadder_write(struct sim_device *sd, uint16_t value, uint16_t index,
+				const unsigned char *data, uint16_t length)
+{
+	if ((value == 0x07 || value == 0x10) && length >= 1 &&
+	    data[0] != sd->freq) {
+		sd->freq = data[0];
+		if (sd->model->flags & SIM_FLG_FREQ_RECONNECT)
+			sim_disconnect(sd);
+	}
+
+	return sim_register_write(sd, value, index, data, length);
+}
+
+static int sim_deathadder_read(struct sim_device *sd, uint16_t value, uint16_t index,
+			       unsigned char *data, uint16_t length)
+{
+	if (value == 0x05) {
+		sim_put_fw_version(sd, data, length);
+		return length;
+	}
+
+	return sim_register_read(sd, value, index, data, length);
+}
+
+/* Lachesis.
+ * Profile configurations are written to 0x01 and read from 0x03
+ * for the profile selected through 0x08. Most other settings are
+ * read back from a different register than they are written to. */
+
+#define SIM_LACHESIS_NR_PROFILES	5
+
+static void sim_lachesis_reset(struct sim_device *sd)
+{
+	unsigned char dpimap[96] = { 0, };
+	unsigned char leds = 0x03;
+	unsigned int i;
+	unsigned char *p;
+
+	sd->profile = 1;
+	for (i = 0; i < SIM_LACHESIS_NR_PROFILES; i++) {
+		p = sd->profiles[i];
+		p[2] = 0x02;	/* magic */
+		p[4] = i + 1;	/* profile */
+		p[6] = 1;	/* dpisel */
+		p[7] = 1;	/* freq */
+		dpimap[i * 3 + 0] = 0x01;
+		dpimap[i * 3 + 1] = (i + 1) * 4 - 1;
+		dpimap[i * 3 + 2] = (i + 1) * 4 - 1;
+	}
+	sim_store(sd, 0x04, 0, &leds, sizeof(leds));
+	sim_store(sd, 0x12, 0, dpimap, sizeof(dpimap));
+}
+
+static int sim_lachesis_write(struct sim_device *sd, uint16_t value, uint16_t index,
+			      const unsigned char *data, uint16_t length)
+{
+	switch (value) {
+	case 0x01:
+		sd->result = 0;
+		if (length >= 5 && data[4] >= 1 && data[4] <= SIM_LACHESIS_NR_PROFILES &&
+		    length <= SIM_PROFILE_SIZE) {
+			memcpy(sd->profiles[data[4] - 1], data, length);
+			sd->result = 1;
+		}
+		return length;
+	case 0x08:
+		if (length >= 1 && data[0] >= 1 && data[0] <= SIM_LACHESIS_NR_PROFILES)
+			sd->profile = data[0];
+		return length;
+	}
+
+	return sim_register_write(sd, value, index, data, length);
+}
+
+static int sim_lachesis_read(struct sim_device *sd, uint16_t value, uint16_t index,
+			     unsigned char *data, uint16_t length)
+{
+	memset(data, 0, length);
+	switch (value) {
+	case 0x02:
+		if (length >= 1)
+			data[0] = sd->result;
+		return length;
+	case 0x03:
+		memcpy(data, sd->profiles[sd->profile - 1],
+		       min(length, (uint16_t)SIM_PROFILE_SIZE));
+		return length;
+	case 0x05:
+		return sim_register_read(sd, 0x04, 0, data, length);
+	case 0x06:
+		sim_put_fw_version(sd, data, length);
+		return length;
+	case 0x09:
+		if (length >= 1)
+			data[0] = sd->profile;
+		return length;
+	case 0x10:
+		return sim_register_read(sd, 0x12, 0, data, length);
+	}
+
+	return sim_register_read(sd, value, index, data, length);
+}
+
+/* Copperhead and Boomslang CE.
+ * A profile is uploaded in six 64-byte chunks to 1..6 and committed
+ * with a write to 2/3. That write also selects the profile for
+ * readout from 1. Profile data reads back with the reply header and
+ * a checksum over the reply. */
+
+#define SIM_COPPERHEAD_NR_PROFILES	5
+#define SIM_COPPERHEAD_PROFILE_SIZE	0x15C
+
+static void sim_copperhead_reset(struct sim_device *sd)
+{
+	unsigned int i;
+	unsigned char *p;
+
+	sd->profile = 1;
+	sd->sel_profile = 1;
+	for (i = 0; i < SIM_COPPERHEAD_NR_PROFILES; i++) {
+		p = sd->profiles[i];
+		p[0] = SIM_COPPERHEAD_PROFILE_SIZE & 0xFF;
+		p[1] = SIM_COPPERHEAD_PROFILE_SIZE >> 8;
+		p[2] = 0x02;	/* magic */
+		p[4] = i + 1;	/* profile */
+		p[12] = 2;	/* dpisel */
+		p[13] = 1;	/* freq */
+	}
+}
+
+static int sim_copperhead_write(struct sim_device *sd, uint16_t value, uint16_t index,
+				const unsigned char *data, uint16_t length)
+{
+	uint8_t nr = length ? data[0] : 0;
+	bool valid_nr = (nr >= 1 && nr <= SIM_COPPERHEAD_NR_PROFILES);
+
+	if (index == 0 && value >= 1 && value <= 6) {
+		if (length > 64)
+			return LIBUSB_ERROR_OVERFLOW;
+		memcpy(&sd->chunks[(value - 1) * 64], data, length);
+		sd->chunks_dirty = 1;
+		return length;
+	}
+	if (value == 0x02 && index == 3) {
+		if (!valid_nr)
+			return LIBUSB_ERROR_PIPE;
+		if (sd->chunks_dirty) {
+			memcpy(sd->profiles[nr - 1], sd->chunks,
+			       SIM_COPPERHEAD_PROFILE_SIZE);
+			sd->chunks_dirty = 0;
+		}
+		sd->sel_profile = nr;
+		return length;
+	}
+	if (value == 0x02 && index == 1) {
+		if (!valid_nr)
+			return LIBUSB_ERROR_PIPE;
+		sd->profile = nr;
+		return length;
+	}
+
+	return sim_register_write(sd, value, index, data, length);
+}
+
+static int sim_copperhead_read(struct sim_device *sd, uint16_t value, uint16_t index,
+			       unsigned char *data, uint16_t length)
+{
+	unsigned char reply[SIM_COPPERHEAD_PROFILE_SIZE];
+	le16_t checksum;
+
+	if (value != 0x01 || index != 0)
+		return sim_register_read(sd, value, index, data, length);
+
+	memset(data, 0, length);
+	if (length == 1) {
+		data[0] = sd->profile;
+		return length;
+	}
+
+	memcpy(reply, sd->profiles[sd->sel_profile - 1], sizeof(reply));
+	memcpy(&reply[6], &reply[0], 6);
+	memset(&reply[0], 0, 6);
+	checksum = razer_xor16_checksum(reply, sizeof(reply) - 2);
+	memcpy(&reply[sizeof(reply) - 2], &checksum, 2);
+	memcpy(data, &reply[6], min(length, (uint16_t)(sizeof(reply) - 6)));
+
+	return length;
+}
+
+/* Synapse.
+ * The host writes a 90-byte request to 0x300 and reads the reply
+ * from 0x300. The reply carries the TRANSOK flag, if the request
+ * checksum was valid. A null request finishes the transaction. */
+
+#define SIM_SYNAPSE_NR_PROFILES		5
+#define SIM_SYNAPSE_FLG_TRANSOK		0x02
+#define SIM_SYNAPSE_READ		0x01
+
+static uint16_t sim_synapse_checksum(const unsigned char *req)
+{
+	uint16_t checksum;
+
+	checksum = razer_xor8_checksum(req + 2, SIM_REPORT_LEN - 4);
+	if (!(req[1] & SIM_SYNAPSE_FLG_TRANSOK))
+		checksum |= 0x100;
+
+	return checksum;
+}
+
+static void sim_synapse_reset(struct sim_device *sd)
+{
+	unsigned int i;
+	unsigned char *p;
+
+	sd->globconfig[0] = 1;	/* profile */
+	sd->globconfig[1] = 1;	/* freq */
+	sd->globconfig[2] = 1;	/* dpisel */
+	for (i = 0; i < SIM_SYNAPSE_NR_PROFILES; i++) {
+		sd->profnames[i][0] = i + 1;
+		p = sd->profiles[i];
+		p[0] = i + 1;	/* profile */
+		p[1] = 0x03;	/* leds */
+		p[2] = 1;	/* dpisel */
+		p[3] = 1;	/* nr_dpimappings */
+		p[4] = 0x0F;	/* dpival0 */
+		p[5] = 0x0F;	/* dpival1 */
+	}
+}
+
+static void sim_synapse_handle(struct sim_device *sd, const unsigned char *req)
+{
+	unsigned char *reply = sd->reply;
+	unsigned char *payload = &reply[8];
+	uint8_t command = req[3], request = req[4];
+	unsigned char *store = NULL;
+	uint16_t checksum;
+	bool read = (req[2] == SIM_SYNAPSE_READ);
+
+	memcpy(reply, req, SIM_REPORT_LEN);
+	checksum = req[88] | (req[89] << 8);
+	if (checksum != sim_synapse_checksum(req)) {
+		/* Reply without TRANSOK. */
+		return;
+	}
+	if (command == 0)
+		return; /* Null request */
+
+	switch (command) {
+	case 0x02: /* devinfo */
+		if (read) {
+			memset(payload, 0, 80);
+			strncpy((char *)payload, sd->serial, 32);
+			payload[32] = sd->model->fw_version >> 8;
+			payload[33] = sd->model->fw_version;
+		}
+		break;
+	case 0x05: /* global config */
+		store = sd->globconfig;
+		break;
+	case 0x22: /* profile name */
+		if (req[8] >= 1 && req[8] <= SIM_SYNAPSE_NR_PROFILES)
+			store = sd->profnames[req[8] - 1];
+		break;
+	case 0x06: /* hardware config */
+		if (req[8] >= 1 && req[8] <= SIM_SYNAPSE_NR_PROFILES)
+			store = sd->profiles[req[8] - 1];
+		break;
+	}
+	if (store) {
+		if (read)
+			memcpy(payload, store, 80);
+		else
+			memcpy(store, &req[8], 80);
+	}
+	razer_debug("sim: Synapse %s %02X/%02X\n",
+		    read ? "read" : "write", command, request);
+
+	reply[1] |= SIM_SYNAPSE_FLG_TRANSOK;
+	checksum = sim_synapse_checksum(reply);
+	reply[88] = checksum & 0xFF;
+	reply[89] = checksum >> 8;
+}
+
+static int sim_synapse_write(struct sim_device *sd, uint16_t value, uint16_t index,
+			     const unsigned char *data, uint16_t length)
+{
+	if (value != SIM_REPORT_VALUE || length != SIM_REPORT_LEN)
+		return sim_register_write(sd, value, index, data, length);
+	sim_synapse_handle(sd, data);
+
+	return length;
+}
+
+static int sim_reply_read(struct sim_device *sd, uint16_t value, uint16_t index,
+			  unsigned char *data, uint16_t length)
+{
+	if (value != SIM_REPORT_VALUE)
+		return sim_register_read(sd, value, index, data, length);
+	memset(data, 0, length);
+	memcpy(data, sd->reply, min(length, (uint16_t)SIM_REPORT_LEN));
+
+	return length;
+}
+
+/* 90-byte command reports.
+ * Byte 0 is the status, byte 1 the transaction ID (0xFF on Chroma
+ * devices), byte 5 the argument size, bytes 6 and 7 the command class
+ * and ID and the arguments start at byte 8. Byte 88 is the checksum.
+ * Get commands have bit 7 of the ID set and read back the arguments
+ * of the matching set command. */
+
+#define SIM_REPORT_STATUS_OK		0x02
+#define SIM_REPORT_STATUS_FAIL		0x03
+#define SIM_REPORT_CHROMA_ID		0xFF
+
+static uint8_t sim_report_checksum(const unsigned char *r)
+{
+	if (r[1] == SIM_REPORT_CHROMA_ID) {
+		/* Size, class, ID and the arguments. */
+		return razer_xor8_checksum(&r[5], 3 + min(r[5], (uint8_t)80));
+	}
+	return razer_xor8_checksum(&r[2], SIM_REPORT_LEN - 4);
+}
+
+static void sim_report_handle(struct sim_device *sd, const unsigned char *req)
+{
+	unsigned char *reply = sd->reply;
+	unsigned char *args = &reply[8];
+	uint8_t size = min(req[5], (uint8_t)80);
+	uint16_t cmd = (req[6] << 8) | req[7];
+
+	memcpy(reply, req, SIM_REPORT_LEN);
+	if (req[1] == SIM_REPORT_CHROMA_ID &&
+	    req[88] != sim_report_checksum(req)) {
+		reply[0] = SIM_REPORT_STATUS_FAIL;
+		return;
+	}
+
+	switch (cmd) {
+	case 0x0081: /* Get firmware version */
+		args[0] = sd->model->fw_version >> 8;
+		args[1] = sd->model->fw_version;
+		break;
+	case 0x0087: /* Get firmware version (major, be16 minor) */
+		args[0] = sd->model->fw_version >> 8;
+		args[1] = 0;
+		args[2] = sd->model->fw_version;
+		break;
+	case 0x0082: /* Get serial number */
+		memset(args, 0, size);
+		strncpy((char *)args, sd->serial, size);
+		break;
+	default:
+		if (cmd & 0x80)
+			sim_fetch(sd, cmd & ~0x80, 0, args, size);
+		else
+			sim_store(sd, cmd, 0, args, size);
+		break;
+	}
+	reply[0] = SIM_REPORT_STATUS_OK;
+	reply[88] = sim_report_checksum(reply);
+}
+
+static int sim_report_write(struct sim_device *sd, uint16_t value, uint16_t index,
+			    const unsigned char *data, uint16_t length)
+{
+	if (value != SIM_REPORT_VALUE || length != SIM_REPORT_LEN)
+		return sim_register_write(sd, value, index, data, length);
+	sim_report_handle(sd, data);
+
+	return length;
+}
+
+/* Cypress bootloader.
+ * Commands are 64-byte bulk OUT transfers to EP 0x02. Each command
+ * queues a status report on EP 0x81, which becomes available after
+ * the command's processing time. */
+
+#define SIM_CYPRESS_EP_OUT		0x02
+#define SIM_CYPRESS_EP_IN		0x81
+#define SIM_CYPRESS_PACKET_SIZE		64
+
+#define SIM_CYPRESS_STAT_BLMODE		0x20
+#define SIM_CYPRESS_STAT_COMCHK		0x10
+#define SIM_CYPRESS_STAT_INVALKEY	0x40
+#define SIM_CYPRESS_STAT_INVALCMD	0x80
+
+static void sim_cypress_reset(struct sim_device *sd)
+{
+	sd->blmode = 0;
+	sd->nr_status = 0;
+}
+
+static int sim_cypress_command(struct sim_device *sd, const unsigned char *cmd)
+{
+	uint16_t command = (cmd[0] << 8) | cmd[1];
+	unsigned int i, busy_msec = 1;
+	uint8_t sum = 0, status;
+
+	if (sd->nr_status >= ARRAY_SIZE(sd->status))
+		return LIBUSB_ERROR_TIMEOUT; /* The device NAKs. */
+
+	for (i = 0; i < 45; i++)
+		sum += cmd[i];
+	status = sd->blmode ? SIM_CYPRESS_STAT_BLMODE : 0;
+	if (sum != cmd[45]) {
+		status |= SIM_CYPRESS_STAT_COMCHK;
+		goto queue;
+	}
+	for (i = 0; i < 8; i++) {
+		if (cmd[2 + i] != i) {
+			status |= SIM_CYPRESS_STAT_INVALKEY;
+			goto queue;
+		}
+	}
+	switch (command) {
+	case 0xFF38: /* Enter bootloader */
+		sd->blmode = 1;
+		status |= SIM_CYPRESS_STAT_BLMODE;
+		busy_msec = 20;
+		break;
+	case 0xFF39: /* Write flash */
+		busy_msec = 4;
+		/* fall through */
+	case 0xFF3A: /* Verify flash */
+	case 0xFF3C: /* Update checksum */
+		if (!sd->blmode)
+			status |= SIM_CYPRESS_STAT_INVALCMD;
+		break;
+	case 0xFF3B: /* Exit bootloader */
+		sd->blmode = 0;
+		break;
+	default:
+		status |= SIM_CYPRESS_STAT_INVALCMD;
+		break;
+	}
+queue:
+	sd->status[sd->nr_status].status = status;
+	gettimeofday(&sd->status[sd->nr_status].ready, NULL);
+	razer_timeval_add_msec(&sd->status[sd->nr_status].ready, busy_msec);
+	sd->nr_status++;
+
+	return 0;
+}
+
+/* Wait for the next status report. Called with the device locked.
+ * The lock is dropped while waiting. */
+static int sim_cypress_status(struct sim_device *sd, unsigned char *data,
+			      int length, unsigned int timeout)
+{
+	struct timeval now, deadline;
+
+	gettimeofday(&deadline, NULL);
+	razer_timeval_add_msec(&deadline, timeout);
+	while (1) {
+		gettimeofday(&now, NULL);
+		if (sd->nr_status &&
+		    !razer_timeval_after(&sd->status[0].ready, &now))
+			break;
+		if (razer_timeval_after(&now, &deadline))
+			return LIBUSB_ERROR_TIMEOUT;
+		pthread_mutex_unlock(&sd->lock);
+		razer_msleep(1);
+		pthread_mutex_lock(&sd->lock);
+	}
+
+	memset(data, 0, length);
+	data[0] = sd->status[0].status;
+	sd->nr_status--;
+	memmove(&sd->status[0], &sd->status[1],
+		sd->nr_status * sizeof(sd->status[0]));
+
+	return min(length, SIM_CYPRESS_PACKET_SIZE);
+}
+
+static const struct sim_protocol_ops sim_protocols[] = {
+	[SIM_PROTO_REGISTER] = {
+		.write		= sim_register_write,
+		.read		= sim_register_read,
+	},
+	[SIM_PROTO_DEATHADDER] = {
+		.reset		= sim_deathadder_reset,
+		.write		= sim_deathadder_write,
+		.read		= sim_deathadder_read,
+	},
+	[SIM_PROTO_LACHESIS] = {
+		.reset		= sim_lachesis_reset,
+		.write		= sim_lachesis_write,
+		.read		= sim_lachesis_read,
+	},
+	[SIM_PROTO_COPPERHEAD] = {
+		.reset		= sim_copperhead_reset,
+		.write		= sim_copperhead_write,
+		.read		= sim_copperhead_read,
+	},
+	[SIM_PROTO_SYNAPSE] = {
+		.reset		= sim_synapse_reset,
+		.write		= sim_synapse_write,
+		.read		= sim_reply_read,
+	},
+	[SIM_PROTO_REPORT] = {
+		.write		= sim_report_write,
+		.read		= sim_reply_read,
+	},
+	[SIM_PROTO_CYPRESS] = {
+		.reset		= sim_cypress_reset,
+		.write		= sim_register_write,
+		.read		= sim_register_read,
+	},
+};
+
+static const struct sim_model * sim_find_model(uint16_t vendor, uint16_t product)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sim_models); i++) {
+		if (sim_models[i].vendor == vendor &&
+		    sim_models[i].product == product)
+			return &sim_models[i];
+	}
+
+	return &sim_model_generic;
+}
+
+static int sim_add_device(uint16_t vendor, uint16_t product)
+{
+	const struct sim_protocol_ops *ops;
+	struct sim_device *sd;
+
+	if (sim_nr_devices >= ARRAY_SIZE(sim_devices))
+		return -ENOSPC;
+	sd = zalloc(sizeof(*sd));
+	if (!sd)
+		return -ENOMEM;
+	pthread_mutex_init(&sd->lock, NULL);
+	sd->model = sim_find_model(vendor, product);
+	sd->desc.bLength = LIBUSB_DT_DEVICE_SIZE;
+	sd->desc.bDescriptorType = LIBUSB_DT_DEVICE;
+	sd->desc.bcdUSB = 0x0200;
+	sd->desc.idVendor = vendor;
+	sd->desc.idProduct = product;
+	sd->desc.bcdDevice = sd->model->fw_version;
+	sd->desc.iSerialNumber = 3;
+	sd->desc.bNumConfigurations = 1;
+	sd->index = sim_nr_devices;
+	sd->devaddr = sd->index + 1;
+	sd->seed = sim_config.seed + sd->index;
+	snprintf(sd->serial, sizeof(sd->serial), "SIM%04X%02X",
+		 product, sd->devaddr);
+	ops = &sim_protocols[sd->model->protocol];
+	if (ops->reset)
+		ops->reset(sd);
+	sim_devices[sim_nr_devices++] = sd;
+
+	return 0;
+}
+
+static void sim_exit(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sim_nr_devices; i++) {
+		pthread_mutex_destroy(&sim_devices[i]->lock);
+		free(sim_devices[i]);
+		sim_devices[i] = NULL;
+	}
+	sim_nr_devices = 0;
+}
+
+static int sim_parse_option(const char *opt, size_t len, bool devices)
+{
+	unsigned int vendor, product, value;
+	char buf[64];
+
+	if (len == 0)
+		return 0;
+	if (len >= sizeof(buf))
+		return -EINVAL;
+	memcpy(buf, opt, len);
+	buf[len] = '\0';
+
+	if (sscanf(buf, "dev=%x:%x", &vendor, &product) == 2) {
+		if (devices)
+			return sim_add_device(vendor, product);
+		return 0;
+	}
+	if (devices)
+		return 0;
+	if (sscanf(buf, "latency=%u", &value) == 1) {
+		sim_config.latency = value;
+		return 0;
+	}
+	if (sscanf(buf, "jitter=%u", &value) == 1) {
+		sim_config.jitter = value;
+		return 0;
+	}
+	if (sscanf(buf, "error=%u", &value) == 1) {
+		sim_config.error_rate = value;
+		return 0;
+	}
+	if (sscanf(buf, "seed=%u", &value) == 1) {
+		sim_config.seed = value;
+		return 0;
+	}
+	if (sscanf(buf, "reconnect=%u", &value) == 1) {
+		sim_config.reconnect = value;
+		return 0;
+	}
+
+	razer_error("sim: Unknown option \"%s\"\n", buf);
+	return -EINVAL;
+}
+
+static int sim_parse_options(const char *options, bool devices)
+{
+	size_t len;
+	int err;
+
+	while (*options) {
+		len = strcspn(options, ",");
+		err = sim_parse_option(options, len, devices);
+		if (err)
+			return err;
+		options += len;
+		if (*options == ',')
+			options++;
+	}
+
+	return 0;
+}
+
+static int sim_init(const char *options)
+{
+	unsigned int i;
+	int err;
+
+	sim_config.latency = 1000;
+	sim_config.jitter = 0;
+	sim_config.error_rate = 0;
+	sim_config.seed = 1;
+	sim_config.reconnect = 100;
+
+	/* Parse the settings first. The devices depend on them. */
+	err = sim_parse_options(options, 0);
+	if (err)
+		return err;
+	err = sim_parse_options(options, 1);
+	if (err)
+		goto error;
+	if (!sim_nr_devices) {
+		for (i = 0; i < ARRAY_SIZE(sim_default_products); i++) {
+			err = sim_add_device(0x1532, sim_default_products[i]);
+			if (err)
+				goto error;
+		}
+	}
+	razer_debug("sim: %u devices, latency %u+%u usec, error rate 1/%u\n",
+		    sim_nr_devices, sim_config.latency, sim_config.jitter,
+		    sim_config.error_rate);
+
+	return 0;
+
+error:
+	sim_exit();
+	return err;
+}
+
+static ssize_t sim_get_device_list(struct razer_usb_devinfo **list)
+{
+	struct razer_usb_devinfo *infos;
+	struct sim_device *sd;
+	unsigned int i;
+	ssize_t count = 0;
+
+	infos = calloc(sim_nr_devices ? sim_nr_devices : 1, sizeof(*infos));
+	if (!infos)
+		return -ENOMEM;
+	for (i = 0; i < sim_nr_devices; i++) {
+		sd = sim_devices[i];
+		pthread_mutex_lock(&sd->lock);
+		sim_update_connection(sd);
+		if (!sd->disconnected) {
+			infos[count].desc = sd->desc;
+			infos[count].busnr = SIM_BUSNR;
+			infos[count].devaddr = sd->devaddr;
+			infos[count].priv = sd;
+			count++;
+		}
+		pthread_mutex_unlock(&sd->lock);
+	}
+	*list = infos;
+
+	return count;
+}
+
+static void sim_free_device_list(struct razer_usb_devinfo *list, ssize_t count)
+{
+	free(list);
+}
+
+static int sim_attach(struct razer_usb_context *ctx,
+		      const struct razer_usb_devinfo *info)
+{
+	ctx->transport_priv = info->priv;
+
+	return 0;
+}
+
+static void sim_detach(struct razer_usb_context *ctx)
+{
+	ctx->transport_priv = NULL;
+}
+
+static int sim_claim(struct razer_usb_context *ctx)
+{
+	struct sim_device *sd = ctx->transport_priv;
+	int err = 0;
+
+	pthread_mutex_lock(&sd->lock);
+	sim_update_connection(sd);
+	if (sd->disconnected) {
+		err = -ENODEV;
+	} else if (sd->claimed) {
+		err = -EBUSY;
+	} else {
+		sd->claimed = 1;
+		/* Follow the device to its new address after a reconnect. */
+		ctx->devaddr = sd->devaddr;
+	}
+	pthread_mutex_unlock(&sd->lock);
+
+	return err;
+}
+
+static void sim_release(struct razer_usb_context *ctx)
+{
+	struct sim_device *sd = ctx->transport_priv;
+
+	pthread_mutex_lock(&sd->lock);
+	sd->claimed = 0;
+	pthread_mutex_unlock(&sd->lock);
+}
+
+/* Spend the bus time of one transfer and lock the device.
+ * Returns a LIBUSB_ERROR code, if the transfer fails.
+ * The device is locked on success only. */
+static int sim_transfer_begin(struct sim_device *sd)
+{
+	unsigned int usecs;
+	bool fail;
+
+	pthread_mutex_lock(&sd->lock);
+	usecs = sim_config.latency;
+	if (sim_config.jitter)
+		usecs += rand_r(&sd->seed) % (sim_config.jitter + 1);
+	fail = sim_config.error_rate &&
+	       (rand_r(&sd->seed) % sim_config.error_rate) == 0;
+	pthread_mutex_unlock(&sd->lock);
+
+	if (usecs)
+		sim_udelay(usecs);
+
+	pthread_mutex_lock(&sd->lock);
+	sim_update_connection(sd);
+	if (sd->disconnected || !sd->claimed) {
+		pthread_mutex_unlock(&sd->lock);
+		return LIBUSB_ERROR_NO_DEVICE;
+	}
+	if (fail) {
+		pthread_mutex_unlock(&sd->lock);
+		razer_debug("sim: Injected transfer error on %s\n", sd->serial);
+		return LIBUSB_ERROR_PIPE;
+	}
+
+	return 0;
+}
+
+static int sim_control(struct razer_usb_context *ctx,
+		       uint8_t request_type, uint8_t request,
+		       uint16_t value, uint16_t index,
+		       unsigned char *data, uint16_t length,
+		       unsigned int timeout)
+{
+	struct sim_device *sd = ctx->transport_priv;
+	const struct sim_protocol_ops *ops;
+	int res;
+
+	if (length > SIM_MAX_REPORT_SIZE)
+		return LIBUSB_ERROR_OVERFLOW;
+	res = sim_transfer_begin(sd);
+	if (res)
+		return res;
+
+	ops = &sim_protocols[sd->model->protocol];
+	if ((request_type & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT)
+		res = ops->write(sd, value, index, data, length);
+	else
+		res = ops->read(sd, value, index, data, length);
+	pthread_mutex_unlock(&sd->lock);
+
+	return res;
+}
+
+static int sim_bulk(struct razer_usb_context *ctx, unsigned char endpoint,
+		    unsigned char *data, int length, int *transferred,
+		    unsigned int timeout)
+{
+	struct sim_device *sd = ctx->transport_priv;
+	int res;
+
+	*transferred = 0;
+	res = sim_transfer_begin(sd);
+	if (res)
+		return res;
+
+	if (sd->model->protocol != SIM_PROTO_CYPRESS) {
+		res = LIBUSB_ERROR_PIPE;
+	} else if (endpoint == SIM_CYPRESS_EP_OUT) {
+		if (length != SIM_CYPRESS_PACKET_SIZE) {
+			res = LIBUSB_ERROR_PIPE;
+		} else {
+			res = sim_cypress_command(sd, data);
+			if (!res)
+				*transferred = length;
+		}
+	} else if (endpoint == SIM_CYPRESS_EP_IN) {
+		res = sim_cypress_status(sd, data, length, timeout);
+		if (res >= 0) {
+			*transferred = res;
+			res = 0;
+		}
+	} else {
+		res = LIBUSB_ERROR_PIPE;
+	}
+	pthread_mutex_unlock(&sd->lock);
+
+	return res;
+}
+
+static int sim_get_string(struct razer_usb_context *ctx, uint8_t index,
+			  char *buf, size_t size)
+{
+	struct sim_device *sd = ctx->transport_priv;
+
+	if (index != sd->desc.iSerialNumber || !size)
+		return LIBUSB_ERROR_NOT_FOUND;
+	strncpy(buf, sd->serial, size - 1);
+	buf[size - 1] = '\0';
+
+	return strlen(buf);
+}
+
+const struct razer_transport razer_transport_sim = {
+	.name			= "sim",
+	.init			= sim_init,
+	.exit			= sim_exit,
+	.get_device_list	= sim_get_device_list,
+	.free_device_list	= sim_free_device_list,
+	.attach			= sim_attach,
+	.detach			= sim_detach,
+	.claim			= sim_claim,
+	.release		= sim_release,
+	.control		= sim_control,
+	.bulk			= sim_bulk,
+	.get_string		= sim_get_string,
+};
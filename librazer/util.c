@@ -229,6 +229,7 @@ void razer_msleep(unsigned int msecs)
 	int err;
 	struct timespec time;
 
+	razer_usb_stats_add(sleep_msec, msecs);
 	time.tv_sec = 0;
 	while (msecs >= 1000) {
 		time.tv_sec++;
@@ -0,0 +1,1144 @@
+/*
+ *   razerd client library
+ *
+ *   Copyright (C) 2026 Michael Buesch <m@bues.ch>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation; either version 2
+ *   of the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "librazerd.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+#define ARRAY_SIZE(x)		(sizeof(x) / sizeof((x)[0]))
+
+#define COMMAND_MAX_SIZE	512
+#define TXBUF_SIZE		4096
+#define RXBUF_SIZE		4096
+#define MAX_NOTIFICATIONS	64
+
+enum {
+	COMMAND_ID_GETREV = 0,
+	COMMAND_ID_RESCANMICE,
+	COMMAND_ID_GETMICE,
+	COMMAND_ID_GETFWVER,
+	COMMAND_ID_SUPPFREQS,
+	COMMAND_ID_SUPPRESOL,
+	COMMAND_ID_SUPPDPIMAPPINGS,
+	COMMAND_ID_CHANGEDPIMAPPING,
+	COMMAND_ID_GETDPIMAPPING,
+	COMMAND_ID_SETDPIMAPPING,
+	COMMAND_ID_GETLEDS,
+	COMMAND_ID_SETLED,
+	COMMAND_ID_GETFREQ,
+	COMMAND_ID_SETFREQ,
+	COMMAND_ID_GETPROFILES,
+	COMMAND_ID_GETACTIVEPROF,
+	COMMAND_ID_SETACTIVEPROF,
+	COMMAND_ID_SUPPBUTTONS,
+	COMMAND_ID_SUPPBUTFUNCS,
+	COMMAND_ID_GETBUTFUNC,
+	COMMAND_ID_SETBUTFUNC,
+	COMMAND_ID_SUPPAXES,
+	COMMAND_ID_RECONFIGMICE,
+	COMMAND_ID_GETMOUSEINFO,
+	COMMAND_ID_GETPROFNAME,
+	COMMAND_ID_SETPROFNAME,
+	COMMAND_ID_CLAIMMOUSE,
+	COMMAND_ID_RELEASEMOUSE,
+	COMMAND_ID_GETAPPSTATS,
+};
+
+enum {
+	REPLY_ID_U32 = 0,
+	REPLY_ID_STR,
+
+	NOTIFY_ID_FIRST = 128,
+	NOTIFY_ID_NEWMOUSE = NOTIFY_ID_FIRST,
+	NOTIFY_ID_DELMOUSE,
+	NOTIFY_ID_MOUSECONFIGURED,
+	NOTIFY_ID_FLASHRESULT,
+	NOTIFY_ID_FLASHPROGRESS,
+	NOTIFY_ID_CMDRESULT,
+};
+
+enum {
+	STRING_ENC_ASCII,
+	STRING_ENC_UTF8,
+	STRING_ENC_UTF16BE,
+};
+
+struct razerd {
+	int fd;
+	uint32_t next_request_id;
+
+	/* Queued commands */
+	size_t txlen;
+	uint8_t txbuf[TXBUF_SIZE];
+	/* Commands whose replies were not received, yet */
+	unsigned int in_flight;
+
+	/* Received data. Valid from rxpos to rxlen. */
+	size_t rxpos;
+	size_t rxlen;
+	uint8_t rxbuf[RXBUF_SIZE];
+
+	/* Notifications received while waiting for replies */
+	unsigned int notify_first;
+	unsigned int notify_count;
+	struct razerd_notification notifications[MAX_NOTIFICATIONS];
+};
+
+struct command {
+	size_t len;
+	uint8_t data[COMMAND_MAX_SIZE];
+};
+
+static const char *error_strings[] = {
+	[RAZERD_ERR_NONE]	= "Success",
+	[RAZERD_ERR_CMDSIZE]	= "Invalid command size",
+	[RAZERD_ERR_NOMEM]	= "Out of memory",
+	[RAZERD_ERR_NOMOUSE]	= "Could not find mouse",
+	[RAZERD_ERR_NOLED]	= "Could not find LED",
+	[RAZERD_ERR_CLAIM]	= "Failed to claim device",
+	[RAZERD_ERR_FAIL]	= "Failure",
+	[RAZERD_ERR_PAYLOAD]	= "Payload error",
+	[RAZERD_ERR_NOTSUPP]	= "Operation not supported",
+	[RAZERD_ERR_NOIMAGE]	= "Unknown firmware image",
+	[RAZERD_ERR_CANCELED]	= "Cancelled",
+};
+
+const char * razerd_strerror(uint32_t errorcode)
+{
+	if (errorcode >= ARRAY_SIZE(error_strings) || !error_strings[errorcode])
+		return "Unknown error";
+	return error_strings[errorcode];
+}
+
+static inline uint32_t get_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline uint16_t get_be16(const uint8_t *p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static int rx_fill(struct razerd *rd);
+static int rx_notification(struct razerd *rd, uint8_t id);
+
+/* Wait until the socket takes more commands.
+ * razerd stops reading commands, while we do not read its replies.
+ * So the replies and notifications are received meanwhile. */
+static int tx_wait(struct razerd *rd)
+{
+	struct pollfd pfd = { .fd = rd->fd, };
+	uint8_t id;
+	int res;
+
+	if (rd->rxpos == 0 && rd->rxlen == sizeof(rd->rxbuf)) {
+		/* The receive buffer is full. Only notifications
+		 * can be moved out of the way. */
+		id = rd->rxbuf[rd->rxpos];
+		if (id < NOTIFY_ID_FIRST)
+			return -ENOBUFS;
+		rd->rxpos++;
+		return rx_notification(rd, id);
+	}
+	pfd.events = POLLOUT | POLLIN;
+	res = poll(&pfd, 1, -1);
+	if (res < 0)
+		return (errno == EINTR) ? 0 : -errno;
+	if (pfd.revents & POLLIN)
+		return rx_fill(rd);
+
+	return 0;
+}
+
+int razerd_flush(struct razerd *rd)
+{
+	size_t pos = 0;
+	ssize_t res;
+	int err = 0;
+
+	while (pos < rd->txlen) {
+		res = send(rd->fd, rd->txbuf + pos, rd->txlen - pos,
+			   MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN) {
+				err = -errno;
+				break;
+			}
+			err = tx_wait(rd);
+			if (err)
+				break;
+			continue;
+		}
+		pos += (size_t)res;
+	}
+	/* Keep the rest for the next try. */
+	rd->txlen -= pos;
+	memmove(rd->txbuf, rd->txbuf + pos, rd->txlen);
+
+	return err;
+}
+
+/* Read more data into the receive buffer. This blocks. */
+static int rx_fill(struct razerd *rd)
+{
+	ssize_t res;
+
+	if (rd->rxpos == rd->rxlen) {
+		rd->rxpos = 0;
+		rd->rxlen = 0;
+	} else if (rd->rxlen == sizeof(rd->rxbuf)) {
+		memmove(rd->rxbuf, rd->rxbuf + rd->rxpos, rd->rxlen - rd->rxpos);
+		rd->rxlen -= rd->rxpos;
+		rd->rxpos = 0;
+	}
+	do {
+		res = recv(rd->fd, rd->rxbuf + rd->rxlen,
+			   sizeof(rd->rxbuf) - rd->rxlen, 0);
+	} while (res < 0 && errno == EINTR);
+	if (res < 0)
+		return -errno;
+	if (res == 0)
+		return -ECONNRESET;
+	rd->rxlen += (size_t)res;
+
+	return 0;
+}
+
+/* Receive len bytes into buf. buf may be NULL to discard them. */
+static int rx_bytes(struct razerd *rd, void *buf, size_t len)
+{
+	size_t count;
+	int err;
+
+	while (len) {
+		if (rd->rxpos == rd->rxlen) {
+			err = rx_fill(rd);
+			if (err)
+				return err;
+		}
+		count = rd->rxlen - rd->rxpos;
+		if (count > len)
+			count = len;
+		if (buf) {
+			memcpy(buf, rd->rxbuf + rd->rxpos, count);
+			buf = (uint8_t *)buf + count;
+		}
+		rd->rxpos += count;
+		len -= count;
+	}
+
+	return 0;
+}
+
+static int rx_be32(struct razerd *rd, uint32_t *value)
+{
+	uint8_t buf[4];
+	int err;
+
+	err = rx_bytes(rd, buf, sizeof(buf));
+	if (err)
+		return err;
+	*value = get_be32(buf);
+
+	return 0;
+}
+
+static void queue_notification(struct razerd *rd,
+			       const struct razerd_notification *notification)
+{
+	unsigned int index;
+
+	if (rd->notify_count == ARRAY_SIZE(rd->notifications)) {
+		/* Full. Drop the oldest one. */
+		rd->notify_first = (rd->notify_first + 1) % ARRAY_SIZE(rd->notifications);
+		rd->notify_count--;
+	}
+	index = (rd->notify_first + rd->notify_count) % ARRAY_SIZE(rd->notifications);
+	rd->notifications[index] = *notification;
+	rd->notify_count++;
+}
+
+/* Receive the payload of the notification id. */
+static int rx_notification(struct razerd *rd, uint8_t id)
+{
+	struct razerd_notification notification = { .id = id, };
+	uint8_t buf[8];
+	int err;
+
+	switch (id) {
+	case NOTIFY_ID_NEWMOUSE:
+	case NOTIFY_ID_DELMOUSE:
+		break;
+	case NOTIFY_ID_MOUSECONFIGURED:
+		err = rx_bytes(rd, notification.idstr, RAZERD_IDSTR_MAX_SIZE);
+		if (err)
+			return err;
+		break;
+	case NOTIFY_ID_CMDRESULT:
+		err = rx_bytes(rd, buf, 8);
+		if (err)
+			return err;
+		notification.request_id = get_be32(buf);
+		notification.errorcode = get_be32(buf + 4);
+		break;
+	case NOTIFY_ID_FLASHRESULT:
+		/* Only sent on the privileged socket. */
+		return rx_bytes(rd, NULL, 4 + RAZERD_IDSTR_MAX_SIZE);
+	case NOTIFY_ID_FLASHPROGRESS:
+		return rx_bytes(rd, NULL, 12 + RAZERD_IDSTR_MAX_SIZE);
+	default:
+		return -EPROTO;
+	}
+	queue_notification(rd, &notification);
+
+	return 0;
+}
+
+/* Flush the commands and receive the header of the next reply.
+ * Notifications on the way are queued. */
+static int rx_reply_hdr(struct razerd *rd, uint8_t expected_id)
+{
+	uint8_t id;
+	int err;
+
+	err = razerd_flush(rd);
+	if (err)
+		return err;
+	while (1) {
+		err = rx_bytes(rd, &id, 1);
+		if (err)
+			return err;
+		if (id < NOTIFY_ID_FIRST)
+			break;
+		err = rx_notification(rd, id);
+		if (err)
+			return err;
+	}
+	if (id != expected_id)
+		return -EPROTO;
+
+	return 0;
+}
+
+int razerd_read_notification(struct razerd *rd,
+			     struct razerd_notification *notification)
+{
+	struct pollfd pfd = { .fd = rd->fd, .events = POLLIN, };
+	uint8_t id;
+	int err, res;
+
+	while (!rd->notify_count) {
+		if (rd->rxpos == rd->rxlen) {
+			res = poll(&pfd, 1, 0);
+			if (res < 0)
+				return (errno == EINTR) ? 0 : -errno;
+			if (res == 0)
+				return 0;
+			err = rx_fill(rd);
+			if (err)
+				return err;
+		}
+		id = rd->rxbuf[rd->rxpos];
+		if (id < NOTIFY_ID_FIRST) {
+			/* A reply to a pipelined command. Leave it. */
+			return 0;
+		}
+		rd->rxpos++;
+		err = rx_notification(rd, id);
+		if (err)
+			return err;
+	}
+	*notification = rd->notifications[rd->notify_first];
+	rd->notify_first = (rd->notify_first + 1) % ARRAY_SIZE(rd->notifications);
+	rd->notify_count--;
+
+	return 1;
+}
+
+/* A complete reply was received. Returns ret. */
+static int reply_done(struct razerd *rd, int ret)
+{
+	if (rd->in_flight)
+		rd->in_flight--;
+
+	return ret;
+}
+
+static int rx_u32(struct razerd *rd, uint32_t *value)
+{
+	int err;
+
+	err = rx_reply_hdr(rd, REPLY_ID_U32);
+	if (err)
+		return err;
+
+	return rx_be32(rd, value);
+}
+
+int razerd_recv_u32(struct razerd *rd, uint32_t *value)
+{
+	int err;
+
+	err = rx_u32(rd, value);
+	if (err)
+		return err;
+
+	return reply_done(rd, 0);
+}
+
+/* Append the UTF-8 encoding of c, if it fits. */
+static bool put_utf8(char *buf, size_t buf_size, size_t *pos, uint32_t c)
+{
+	uint8_t seq[4];
+	size_t i, len;
+
+	if (c < 0x80) {
+		seq[0] = (uint8_t)c;
+		len = 1;
+	} else if (c < 0x800) {
+		seq[0] = (uint8_t)(0xC0 | (c >> 6));
+		seq[1] = (uint8_t)(0x80 | (c & 0x3F));
+		len = 2;
+	} else if (c < 0x10000) {
+		seq[0] = (uint8_t)(0xE0 | (c >> 12));
+		seq[1] = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+		seq[2] = (uint8_t)(0x80 | (c & 0x3F));
+		len = 3;
+	} else {
+		seq[0] = (uint8_t)(0xF0 | (c >> 18));
+		seq[1] = (uint8_t)(0x80 | ((c >> 12) & 0x3F));
+		seq[2] = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+		seq[3] = (uint8_t)(0x80 | (c & 0x3F));
+		len = 4;
+	}
+	/* Keep one byte for the NUL terminator. */
+	if (*pos + len >= buf_size)
+		return false;
+	for (i = 0; i < len; i++)
+		buf[(*pos)++] = (char)seq[i];
+
+	return true;
+}
+
+static int rx_string(struct razerd *rd, char *buf, size_t buf_size)
+{
+	uint8_t hdr[3], unit[2];
+	unsigned int i, len;
+	uint32_t c, low;
+	size_t pos = 0;
+	bool fits = true;
+	int err;
+
+	err = rx_reply_hdr(rd, REPLY_ID_STR);
+	if (err)
+		return err;
+	err = rx_bytes(rd, hdr, sizeof(hdr));
+	if (err)
+		return err;
+	len = get_be16(hdr + 1);
+
+	switch (hdr[0]) {
+	case STRING_ENC_ASCII:
+	case STRING_ENC_UTF8:
+		for (i = 0; i < len; i++) {
+			err = rx_bytes(rd, unit, 1);
+			if (err)
+				return err;
+			if (pos + 1 < buf_size)
+				buf[pos++] = (char)unit[0];
+		}
+		/* Do not end in a truncated UTF-8 sequence. */
+		if (pos < len && hdr[0] == STRING_ENC_UTF8) {
+			while (pos && ((uint8_t)buf[pos - 1] & 0xC0) == 0x80)
+				pos--;
+			if (pos && ((uint8_t)buf[pos - 1] & 0x80))
+				pos--;
+		}
+		break;
+	case STRING_ENC_UTF16BE:
+		for (i = 0; i < len; i++) {
+			err = rx_bytes(rd, unit, 2);
+			if (err)
+				return err;
+			c = get_be16(unit);
+			if (c >= 0xD800 && c < 0xDC00 && i + 1 < len) {
+				err = rx_bytes(rd, unit, 2);
+				if (err)
+					return err;
+				i++;
+				low = get_be16(unit);
+				if (low >= 0xDC00 && low < 0xE000)
+					c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				else
+					c = '?';
+			} else if (c >= 0xD800 && c < 0xE000) {
+				c = '?';
+			}
+			if (fits)
+				fits = put_utf8(buf, buf_size, &pos, c);
+		}
+		break;
+	default:
+		return -EPROTO;
+	}
+	if (buf_size)
+		buf[pos] = '\0';
+
+	return 0;
+}
+
+int razerd_recv_string(struct razerd *rd, char *buf, size_t buf_size)
+{
+	int err;
+
+	err = rx_string(rd, buf, buf_size);
+	if (err)
+		return err;
+
+	return reply_done(rd, 0);
+}
+
+int razerd_recv_u32_list(struct razerd *rd, uint32_t *values,
+			 unsigned int max_count)
+{
+	uint32_t i, count, value;
+	int err;
+
+	err = rx_u32(rd, &count);
+	if (err)
+		return err;
+	for (i = 0; i < count; i++) {
+		err = rx_u32(rd, &value);
+		if (err)
+			return err;
+		if (i < max_count)
+			values[i] = value;
+	}
+
+	return reply_done(rd, (int)count);
+}
+
+int razerd_recv_mice(struct razerd *rd, struct razerd_mouse *mice,
+		     unsigned int max_count)
+{
+	struct razerd_mouse scratch, *mouse;
+	uint32_t i, count;
+	int err;
+
+	err = rx_u32(rd, &count);
+	if (err)
+		return err;
+	for (i = 0; i < count; i++) {
+		mouse = (i < max_count) ? &mice[i] : &scratch;
+		err = rx_u32(rd, &mouse->handle);
+		if (err)
+			return err;
+		err = rx_string(rd, mouse->idstr, sizeof(mouse->idstr));
+		if (err)
+			return err;
+	}
+
+	return reply_done(rd, (int)count);
+}
+
+int razerd_recv_leds(struct razerd *rd, struct razerd_led *leds,
+		     unsigned int max_count)
+{
+	struct razerd_led scratch, *led;
+	uint32_t i, count;
+	int err;
+
+	err = rx_u32(rd, &count);
+	if (err)
+		return err;
+	for (i = 0; i < count; i++) {
+		led = (i < max_count) ? &leds[i] : &scratch;
+		err = rx_u32(rd, &led->flags);
+		if (!err)
+			err = rx_string(rd, led->name, sizeof(led->name));
+		if (!err)
+			err = rx_u32(rd, &led->state);
+		if (!err)
+			err = rx_u32(rd, &led->mode);
+		if (!err)
+			err = rx_u32(rd, &led->supported_modes);
+		if (!err)
+			err = rx_u32(rd, &led->color);
+		if (err)
+			return err;
+	}
+
+	return reply_done(rd, (int)count);
+}
+
+int razerd_recv_dpimappings(struct razerd *rd, struct razerd_dpimapping *mappings,
+			    unsigned int max_count)
+{
+	struct razerd_dpimapping scratch, *mapping;
+	uint32_t i, j, count, mask_high, mask_low;
+	int err;
+
+	err = rx_u32(rd, &count);
+	if (err)
+		return err;
+	for (i = 0; i < count; i++) {
+		mapping = (i < max_count) ? &mappings[i] : &scratch;
+		err = rx_u32(rd, &mapping->id);
+		if (!err)
+			err = rx_u32(rd, &mapping->dimension_mask);
+		for (j = 0; j < RAZERD_NR_DIMS && !err; j++)
+			err = rx_u32(rd, &mapping->res[j]);
+		if (!err)
+			err = rx_u32(rd, &mask_high);
+		if (!err)
+			err = rx_u32(rd, &mask_low);
+		if (!err)
+			err = rx_u32(rd, &mapping->is_mutable);
+		if (err)
+			return err;
+		mapping->profile_mask = ((uint64_t)mask_high << 32) | mask_low;
+	}
+
+	return reply_done(rd, (int)count);
+}
+
+static int rx_name(struct razerd *rd, struct razerd_name *name)
+{
+	int err;
+
+	err = rx_u32(rd, &name->id);
+	if (err)
+		return err;
+
+	return rx_string(rd, name->name, sizeof(name->name));
+}
+
+int razerd_recv_name(struct razerd *rd, struct razerd_name *name)
+{
+	int err;
+
+	err = rx_name(rd, name);
+	if (err)
+		return err;
+
+	return reply_done(rd, 0);
+}
+
+int razerd_recv_names(struct razerd *rd, struct razerd_name *names,
+		      unsigned int max_count)
+{
+	struct razerd_name scratch;
+	uint32_t i, count;
+	int err;
+
+	err = rx_u32(rd, &count);
+	if (err)
+		return err;
+	for (i = 0; i < count; i++) {
+		err = rx_name(rd, (i < max_count) ? &names[i] : &scratch);
+		if (err)
+			return err;
+	}
+
+	return reply_done(rd, (int)count);
+}
+
+int razerd_recv_axes(struct razerd *rd, struct razerd_axis *axes,
+		     unsigned int max_count)
+{
+	struct razerd_axis scratch, *axis;
+	uint32_t i, count;
+	int err;
+
+	err = rx_u32(rd, &count);
+	if (err)
+		return err;
+	for (i = 0; i < count; i++) {
+		axis = (i < max_count) ? &axes[i] : &scratch;
+		err = rx_u32(rd, &axis->id);
+		if (!err)
+			err = rx_string(rd, axis->name, sizeof(axis->name));
+		if (!err)
+			err = rx_u32(rd, &axis->flags);
+		if (err)
+			return err;
+	}
+
+	return reply_done(rd, (int)count);
+}
+
+static void cmd_init(struct command *cmd, uint8_t id, uint32_t mouse)
+{
+	cmd->data[0] = id;
+	cmd->len = 1;
+	cmd->data[cmd->len++] = (uint8_t)(mouse >> 24);
+	cmd->data[cmd->len++] = (uint8_t)(mouse >> 16);
+	cmd->data[cmd->len++] = (uint8_t)(mouse >> 8);
+	cmd->data[cmd->len++] = (uint8_t)mouse;
+}
+
+static void cmd_put_u8(struct command *cmd, uint8_t value)
+{
+	cmd->data[cmd->len++] = value;
+}
+
+static void cmd_put_be32(struct command *cmd, uint32_t value)
+{
+	cmd_put_u8(cmd, (uint8_t)(value >> 24));
+	cmd_put_u8(cmd, (uint8_t)(value >> 16));
+	cmd_put_u8(cmd, (uint8_t)(value >> 8));
+	cmd_put_u8(cmd, (uint8_t)value);
+}
+
+static int queue_bytes(struct razerd *rd, const struct command *cmd)
+{
+	int err;
+
+	if (rd->txlen + cmd->len > sizeof(rd->txbuf)) {
+		err = razerd_flush(rd);
+		if (err)
+			return err;
+	}
+	memcpy(rd->txbuf + rd->txlen, cmd->data, cmd->len);
+	rd->txlen += cmd->len;
+
+	return 0;
+}
+
+/* Queue a command with a reply.
+ * At most RAZERD_MAX_IN_FLIGHT replies may be outstanding. */
+static int queue_command(struct razerd *rd, const struct command *cmd)
+{
+	int err;
+
+	if (rd->in_flight >= RAZERD_MAX_IN_FLIGHT)
+		return -EBUSY;
+	err = queue_bytes(rd, cmd);
+	if (err)
+		return err;
+	rd->in_flight++;
+
+	return 0;
+}
+
+/* Queue a setter. Returns the request ID for RAZERD_NOREPLY. */
+static int queue_setter(struct razerd *rd, struct command *cmd,
+			unsigned int flags)
+{
+	uint32_t request_id;
+	int err;
+
+	if (!(flags & RAZERD_NOREPLY))
+		return queue_command(rd, cmd);
+
+	request_id = rd->next_request_id;
+	rd->next_request_id = (request_id >= 0x7FFFFFFF) ? 1 : request_id + 1;
+	cmd->data[0] |= (uint8_t)(flags & (RAZERD_NOREPLY | RAZERD_ACK));
+	cmd_put_be32(cmd, request_id);
+	err = queue_bytes(rd, cmd);
+	if (err)
+		return err;
+
+	return (int)request_id;
+}
+
+static int queue_simple(struct razerd *rd, uint8_t id, uint32_t mouse)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, id, mouse);
+
+	return queue_command(rd, &cmd);
+}
+
+int razerd_rescan(struct razerd *rd)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_RESCANMICE, 0);
+
+	return queue_bytes(rd, &cmd);
+}
+
+int razerd_reconfig(struct razerd *rd)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_RECONFIGMICE, 0);
+
+	return queue_bytes(rd, &cmd);
+}
+
+int razerd_getmice(struct razerd *rd)
+{
+	return queue_simple(rd, COMMAND_ID_GETMICE, 0);
+}
+
+int razerd_getfwver(struct razerd *rd, uint32_t mouse)
+{
+	return queue_simple(rd, COMMAND_ID_GETFWVER, mouse);
+}
+
+int razerd_getmouseinfo(struct razerd *rd, uint32_t mouse)
+{
+	return queue_simple(rd, COMMAND_ID_GETMOUSEINFO, mouse);
+}
+
+int razerd_suppfreqs(struct razerd *rd, uint32_t mouse)
+{
+	return queue_simple(rd, COMMAND_ID_SUPPFREQS, mouse);
+}
+
+int razerd_suppresol(struct razerd *rd, uint32_t mouse)
+{
+	return queue_simple(rd, COMMAND_ID_SUPPRESOL, mouse);
+}
+
+int razerd_suppdpimappings(struct razerd *rd, uint32_t mouse)
+{
+	return queue_simple(rd, COMMAND_ID_SUPPDPIMAPPINGS, mouse);
+}
+
+int razerd_changedpimapping(struct razerd *rd, uint32_t mouse,
+			    uint32_t mapping, uint32_t dimension,
+			    uint32_t resolution, unsigned int flags)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_CHANGEDPIMAPPING, mouse);
+	cmd_put_be32(&cmd, mapping);
+	cmd_put_be32(&cmd, dimension);
+	cmd_put_be32(&cmd, resolution);
+
+	return queue_setter(rd, &cmd, flags);
+}
+
+int razerd_getdpimapping(struct razerd *rd, uint32_t mouse,
+			 uint32_t profile, uint32_t axis)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_GETDPIMAPPING, mouse);
+	cmd_put_be32(&cmd, profile);
+	cmd_put_be32(&cmd, axis);
+
+	return queue_command(rd, &cmd);
+}
+
+int razerd_setdpimapping(struct razerd *rd, uint32_t mouse,
+			 uint32_t profile, uint32_t axis,
+			 uint32_t mapping, unsigned int flags)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_SETDPIMAPPING, mouse);
+	cmd_put_be32(&cmd, profile);
+	cmd_put_be32(&cmd, axis);
+	cmd_put_be32(&cmd, mapping);
+
+	return queue_setter(rd, &cmd, flags);
+}
+
+int razerd_getleds(struct razerd *rd, uint32_t mouse, uint32_t profile)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_GETLEDS, mouse);
+	cmd_put_be32(&cmd, profile);
+
+	return queue_command(rd, &cmd);
+}
+
+int razerd_setled(struct razerd *rd, uint32_t mouse, uint32_t profile,
+		  const struct razerd_led *led, unsigned int flags)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_SETLED, mouse);
+	cmd_put_be32(&cmd, profile);
+	memset(cmd.data + cmd.len, 0, RAZERD_LEDNAME_MAX_SIZE);
+	memcpy(cmd.data + cmd.len, led->name,
+	       strnlen(led->name, RAZERD_LEDNAME_MAX_SIZE));
+	cmd.len += RAZERD_LEDNAME_MAX_SIZE;
+	cmd_put_u8(&cmd, led->state ? 1 : 0);
+	cmd_put_u8(&cmd, (uint8_t)led->mode);
+	cmd_put_be32(&cmd, led->color);
+
+	return queue_setter(rd, &cmd, flags);
+}
+
+int razerd_getfreq(struct razerd *rd, uint32_t mouse, uint32_t profile)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_GETFREQ, mouse);
+	cmd_put_be32(&cmd, profile);
+
+	return queue_command(rd, &cmd);
+}
+
+int razerd_setfreq(struct razerd *rd, uint32_t mouse, uint32_t profile,
+		   uint32_t freq, unsigned int flags)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_SETFREQ, mouse);
+	cmd_put_be32(&cmd, profile);
+	cmd_put_be32(&cmd, freq);
+
+	return queue_setter(rd, &cmd, flags);
+}
+
+int razerd_getprofiles(struct razerd *rd, uint32_t mouse)
+{
+	return queue_simple(rd, COMMAND_ID_GETPROFILES, mouse);
+}
+
+int razerd_getactiveprof(struct razerd *rd, uint32_t mouse)
+{
+	return queue_simple(rd, COMMAND_ID_GETACTIVEPROF, mouse);
+}
+
+int razerd_setactiveprof(struct razerd *rd, uint32_t mouse,
+			 uint32_t profile, unsigned int flags)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_SETACTIVEPROF, mouse);
+	cmd_put_be32(&cmd, profile);
+
+	return queue_setter(rd, &cmd, flags);
+}
+
+int razerd_getprofname(struct razerd *rd, uint32_t mouse, uint32_t profile)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_GETPROFNAME, mouse);
+	cmd_put_be32(&cmd, profile);
+
+	return queue_command(rd, &cmd);
+}
+
+/* Decode the next UTF-8 character. Invalid bytes decode to '?'. */
+static uint32_t get_utf8(const uint8_t **str)
+{
+	const uint8_t *s = *str;
+	uint32_t c;
+	unsigned int i, len;
+
+	if (s[0] < 0x80) {
+		*str = s + 1;
+		return s[0];
+	}
+	if ((s[0] & 0xE0) == 0xC0) {
+		c = s[0] & 0x1F;
+		len = 2;
+	} else if ((s[0] & 0xF0) == 0xE0) {
+		c = s[0] & 0x0F;
+		len = 3;
+	} else if ((s[0] & 0xF8) == 0xF0) {
+		c = s[0] & 0x07;
+		len = 4;
+	} else {
+		*str = s + 1;
+		return '?';
+	}
+	for (i = 1; i < len; i++) {
+		if ((s[i] & 0xC0) != 0x80) {
+			*str = s + i;
+			return '?';
+		}
+		c = (c << 6) | (s[i] & 0x3F);
+	}
+	*str = s + len;
+
+	return (c > 0x10FFFF) ? '?' : c;
+}
+
+int razerd_setprofname(struct razerd *rd, uint32_t mouse, uint32_t profile,
+		       const char *name, unsigned int flags)
+{
+	struct command cmd;
+	const uint8_t *s = (const uint8_t *)name;
+	uint8_t *units;
+	unsigned int nr_units = 0;
+	const unsigned int max_units = 64;
+	uint32_t c;
+
+	cmd_init(&cmd, COMMAND_ID_SETPROFNAME, mouse);
+	cmd_put_be32(&cmd, profile);
+	units = cmd.data + cmd.len;
+	memset(units, 0, max_units * 2);
+	while (*s) {
+		c = get_utf8(&s);
+		if (c >= 0x10000) {
+			if (nr_units + 2 > max_units)
+				break;
+			c -= 0x10000;
+			units[nr_units * 2] = (uint8_t)(0xD8 | (c >> 18));
+			units[nr_units * 2 + 1] = (uint8_t)(c >> 10);
+			nr_units++;
+			c = 0xDC00 | (c & 0x3FF);
+		}
+		if (nr_units + 1 > max_units)
+			break;
+		units[nr_units * 2] = (uint8_t)(c >> 8);
+		units[nr_units * 2 + 1] = (uint8_t)c;
+		nr_units++;
+	}
+	cmd.len += max_units * 2;
+
+	return queue_setter(rd, &cmd, flags);
+}
+
+int razerd_suppbuttons(struct razerd *rd, uint32_t mouse)
+{
+	return queue_simple(rd, COMMAND_ID_SUPPBUTTONS, mouse);
+}
+
+int razerd_suppbutfuncs(struct razerd *rd, uint32_t mouse)
+{
+	return queue_simple(rd, COMMAND_ID_SUPPBUTFUNCS, mouse);
+}
+
+int razerd_getbutfunc(struct razerd *rd, uint32_t mouse,
+		      uint32_t profile, uint32_t button)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_GETBUTFUNC, mouse);
+	cmd_put_be32(&cmd, profile);
+	cmd_put_be32(&cmd, button);
+
+	return queue_command(rd, &cmd);
+}
+
+int razerd_setbutfunc(struct razerd *rd, uint32_t mouse, uint32_t profile,
+		      uint32_t button, uint32_t function, unsigned int flags)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_SETBUTFUNC, mouse);
+	cmd_put_be32(&cmd, profile);
+	cmd_put_be32(&cmd, button);
+	cmd_put_be32(&cmd, function);
+
+	return queue_setter(rd, &cmd, flags);
+}
+
+int razerd_suppaxes(struct razerd *rd, uint32_t mouse)
+{
+	return queue_simple(rd, COMMAND_ID_SUPPAXES, mouse);
+}
+
+int razerd_claim(struct razerd *rd, uint32_t mouse, unsigned int flags)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_CLAIMMOUSE, mouse);
+
+	return queue_setter(rd, &cmd, flags);
+}
+
+int razerd_release(struct razerd *rd, uint32_t mouse, unsigned int flags)
+{
+	struct command cmd;
+
+	cmd_init(&cmd, COMMAND_ID_RELEASEMOUSE, mouse);
+
+	return queue_setter(rd, &cmd, flags);
+}
+
+int razerd_getappstats(struct razerd *rd)
+{
+	return queue_simple(rd, COMMAND_ID_GETAPPSTATS, 0);
+}
+
+int razerd_fd(struct razerd *rd)
+{
+	return rd->fd;
+}
+
+int razerd_open(struct razerd **rd_ret, const char *path)
+{
+	struct razerd *rd;
+	struct sockaddr_un addr = { .sun_family = AF_UNIX, };
+	uint32_t rev;
+	int err;
+
+	if (!path)
+		path = RAZERD_SOCKET_PATH;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(addr.sun_path, path);
+
+	rd = calloc(1, sizeof(*rd));
+	if (!rd)
+		return -ENOMEM;
+	rd->next_request_id = 1;
+
+	rd->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (rd->fd < 0) {
+		err = -errno;
+		goto err_free;
+	}
+	if (connect(rd->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		err = -errno;
+		goto err_close;
+	}
+
+	err = queue_simple(rd, COMMAND_ID_GETREV, 0);
+	if (!err)
+		err = razerd_recv_u32(rd, &rev);
+	if (err)
+		goto err_close;
+	if (rev != RAZERD_INTERFACE_REVISION) {
+		err = -EPROTONOSUPPORT;
+		goto err_close;
+	}
+	*rd_ret = rd;
+
+	return 0;
+
+err_close:
+	close(rd->fd);
+err_free:
+	free(rd);
+
+	return err;
+}
+
+void razerd_close(struct razerd *rd)
+{
+	if (!rd)
+		return;
+	razerd_flush(rd);
+	close(rd->fd);
+	free(rd);
+}
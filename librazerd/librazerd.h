@@ -0,0 +1,426 @@
+/*
+ *   razerd client library.
+ *   This is the interface for applications to access the razer devices.
+ *
+ *   Copyright (C) 2026 Michael Buesch <m@bues.ch>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation; either version 2
+ *   of the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#ifndef LIB_RAZERD_H_
+#define LIB_RAZERD_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Usage:
+ *
+ * Commands are queued with the razerd_<command>() functions.
+ * No data is sent to razerd until the replies are received with the
+ * razerd_recv_...() function named in the documentation of the command.
+ * The first razerd_recv_...() call flushes all queued commands in one go.
+ * So queueing several commands before receiving their replies pipelines
+ * them. The replies must be received in the order of the commands.
+ * At most RAZERD_MAX_IN_FLIGHT commands may wait for their replies.
+ * Queueing more fails with -EBUSY until replies were received.
+ *
+ *	razerd_getfwver(rd, mouse);
+ *	razerd_getactiveprof(rd, mouse);
+ *	razerd_recv_u32(rd, &fwver);
+ *	razerd_recv_u32(rd, &profile);
+ *
+ * The replies are decoded into caller provided buffers. Nothing is
+ * allocated after razerd_open().
+ *
+ * Notifications are read with razerd_read_notification(). razerd_fd()
+ * can be polled for incoming notifications. Notifications that arrive
+ * while receiving a reply are queued in the connection and do not show up
+ * on the fd. So always drain the queue with razerd_read_notification()
+ * after receiving replies.
+ *
+ * All functions return a negative errno value on failure.
+ * A connection must not be used by several threads at the same time.
+ */
+
+#define RAZERD_SOCKET_PATH		"/run/razerd/socket"
+#define RAZERD_INTERFACE_REVISION	14
+#define RAZERD_MAX_IN_FLIGHT		32	/* Commands waiting for replies */
+
+#define RAZERD_IDSTR_MAX_SIZE		128
+#define RAZERD_LEDNAME_MAX_SIZE		64
+#define RAZERD_NAME_MAX_SIZE		64
+#define RAZERD_NR_DIMS			3
+
+/* Special profile ID */
+#define RAZERD_PROFILE_INVALID		0xFFFFFFFFu
+/* Special axis ID */
+#define RAZERD_AXIS_INVALID		0xFFFFFFFFu
+
+/** enum razerd_error - Error codes reported by razerd.
+ * Setters reply with one of these.
+ */
+enum razerd_error {
+	RAZERD_ERR_NONE = 0,
+	RAZERD_ERR_CMDSIZE,
+	RAZERD_ERR_NOMEM,
+	RAZERD_ERR_NOMOUSE,
+	RAZERD_ERR_NOLED,
+	RAZERD_ERR_CLAIM,
+	RAZERD_ERR_FAIL,
+	RAZERD_ERR_PAYLOAD,
+	RAZERD_ERR_NOTSUPP,
+	RAZERD_ERR_NOIMAGE,
+	RAZERD_ERR_CANCELED,
+};
+
+/** enum razerd_setter_flags - Flags for setter commands.
+ * @RAZERD_NOREPLY: Do not send a reply. The setter returns a request ID.
+ *                  Failures are sent as RAZERD_NOTIFY_CMDRESULT.
+ * @RAZERD_ACK: With RAZERD_NOREPLY: Also notify success.
+ */
+enum razerd_setter_flags {
+	RAZERD_NOREPLY		= 0x40,
+	RAZERD_ACK		= 0x20,
+};
+
+/** enum razerd_notification_id - Notification types.
+ * @RAZERD_NOTIFY_NEWMOUSE: A new mouse was connected.
+ * @RAZERD_NOTIFY_DELMOUSE: A mouse was removed.
+ * @RAZERD_NOTIFY_MOUSECONFIGURED: A mouse finished its configuration.
+ * @RAZERD_NOTIFY_CMDRESULT: The result of a RAZERD_NOREPLY setter.
+ */
+enum razerd_notification_id {
+	RAZERD_NOTIFY_NEWMOUSE		= 128,
+	RAZERD_NOTIFY_DELMOUSE		= 129,
+	RAZERD_NOTIFY_MOUSECONFIGURED	= 130,
+	RAZERD_NOTIFY_CMDRESULT		= 133,
+};
+
+/** enum razerd_mouseinfo_flags - Flags from razerd_getmouseinfo(). */
+enum razerd_mouseinfo_flags {
+	RAZERD_MOUSEINFO_RESULTOK	= (1 << 0), /* Other flags are ok, if this is set. */
+	RAZERD_MOUSEINFO_GLOBAL_LEDS	= (1 << 1), /* The device has global LEDs. */
+	RAZERD_MOUSEINFO_PROFILE_LEDS	= (1 << 2), /* The device has per-profile LEDs. */
+	RAZERD_MOUSEINFO_GLOBAL_FREQ	= (1 << 3), /* The device has global frequency settings. */
+	RAZERD_MOUSEINFO_PROFILE_FREQ	= (1 << 4), /* The device has per-profile frequency settings. */
+	RAZERD_MOUSEINFO_PROFNAMEMUTABLE = (1 << 5), /* Profile names can be changed. */
+	RAZERD_MOUSEINFO_SUGGESTFWUP	= (1 << 6), /* A firmware update is suggested. */
+};
+
+/** enum razerd_led_flags - Flags of struct razerd_led. */
+enum razerd_led_flags {
+	RAZERD_LED_HAVECOLOR		= (1 << 0),
+	RAZERD_LED_CHANGECOLOR		= (1 << 1),
+};
+
+/** enum razerd_axis_flags - Flags of struct razerd_axis. */
+enum razerd_axis_flags {
+	RAZERD_AXIS_INDEPENDENT_DPIMAPPING = (1 << 0),
+};
+
+/* Opaque connection */
+struct razerd;
+
+/** struct razerd_mouse - A mouse from razerd_recv_mice().
+ * @handle: The handle to address the mouse in commands.
+ * @idstr: The ID string.
+ */
+struct razerd_mouse {
+	uint32_t handle;
+	char idstr[RAZERD_IDSTR_MAX_SIZE + 1];
+};
+
+/** struct razerd_led - A LED from razerd_recv_leds().
+ * @flags: enum razerd_led_flags.
+ * @name: The LED name.
+ * @state: On/off state.
+ * @mode: The LED mode.
+ * @supported_modes: Bitmask of supported modes.
+ * @color: 0xRRGGBB color.
+ */
+struct razerd_led {
+	uint32_t flags;
+	char name[RAZERD_LEDNAME_MAX_SIZE + 1];
+	uint32_t state;
+	uint32_t mode;
+	uint32_t supported_modes;
+	uint32_t color;
+};
+
+/** struct razerd_dpimapping - A DPI mapping from razerd_recv_dpimappings().
+ * @id: The mapping ID.
+ * @dimension_mask: Bitmask of the valid entries in res.
+ * @res: The resolution of each dimension.
+ * @profile_mask: Bitmask of the profiles the mapping belongs to.
+ *                0, if it is a global mapping.
+ * @is_mutable: The resolution can be changed.
+ */
+struct razerd_dpimapping {
+	uint32_t id;
+	uint32_t dimension_mask;
+	uint32_t res[RAZERD_NR_DIMS];
+	uint64_t profile_mask;
+	uint32_t is_mutable;
+};
+
+/** struct razerd_name - A named ID from razerd_recv_names().
+ * @id: The button or button function ID.
+ * @name: The name.
+ */
+struct razerd_name {
+	uint32_t id;
+	char name[RAZERD_NAME_MAX_SIZE + 1];
+};
+
+/** struct razerd_axis - An axis from razerd_recv_axes().
+ * @id: The axis ID.
+ * @name: The axis name.
+ * @flags: enum razerd_axis_flags.
+ */
+struct razerd_axis {
+	uint32_t id;
+	char name[RAZERD_NAME_MAX_SIZE + 1];
+	uint32_t flags;
+};
+
+/** struct razerd_notification - A notification.
+ * @id: enum razerd_notification_id.
+ * @request_id: RAZERD_NOTIFY_CMDRESULT: The ID returned by the setter.
+ * @errorcode: RAZERD_NOTIFY_CMDRESULT: enum razerd_error.
+ * @idstr: RAZERD_NOTIFY_MOUSECONFIGURED: The ID string of the mouse.
+ */
+struct razerd_notification {
+	uint8_t id;
+	uint32_t request_id;
+	uint32_t errorcode;
+	char idstr[RAZERD_IDSTR_MAX_SIZE + 1];
+};
+
+/** razerd_open - Connect to razerd.
+ * @rd: Returns the connection.
+ * @path: The socket path. NULL selects RAZERD_SOCKET_PATH.
+ * Checks the interface revision. Returns -EPROTONOSUPPORT,
+ * if razerd speaks a different revision.
+ */
+int razerd_open(struct razerd **rd, const char *path);
+
+/** razerd_close - Close a connection. */
+void razerd_close(struct razerd *rd);
+
+/** razerd_fd - Get the socket file descriptor.
+ * It becomes readable, if razerd sent a notification.
+ * Do not read from it.
+ */
+int razerd_fd(struct razerd *rd);
+
+/** razerd_flush - Send all queued commands.
+ * This is done implicitly by the razerd_recv_...() functions and
+ * if the send buffer is full. Replies that arrive while sending are
+ * buffered. Returns -ENOBUFS, if that buffer is full. Receive
+ * replies and call it again then.
+ */
+int razerd_flush(struct razerd *rd);
+
+/** razerd_read_notification - Get the next notification.
+ * @notification: Returns the notification.
+ * Does not block. Returns 1, if a notification was returned
+ * and 0, if there is none.
+ */
+int razerd_read_notification(struct razerd *rd,
+			     struct razerd_notification *notification);
+
+/** razerd_strerror - Get a string for enum razerd_error. */
+const char * razerd_strerror(uint32_t errorcode);
+
+/* Reply decoders */
+
+/** razerd_recv_u32 - Receive a number. */
+int razerd_recv_u32(struct razerd *rd, uint32_t *value);
+
+/** razerd_recv_u32_list - Receive a list of numbers.
+ * @values: Buffer for max_count numbers.
+ * Returns the number of entries sent by razerd. This may be more than
+ * max_count. Only max_count entries are stored then.
+ * The same applies to all other list decoders.
+ */
+int razerd_recv_u32_list(struct razerd *rd, uint32_t *values,
+			 unsigned int max_count);
+
+/** razerd_recv_string - Receive a string.
+ * @buf: Returns the UTF-8 string. It is truncated to buf_size
+ *       and always NUL terminated.
+ */
+int razerd_recv_string(struct razerd *rd, char *buf, size_t buf_size);
+
+/** razerd_recv_mice - Receive a list of mice. */
+int razerd_recv_mice(struct razerd *rd, struct razerd_mouse *mice,
+		     unsigned int max_count);
+
+/** razerd_recv_leds - Receive a list of LEDs. */
+int razerd_recv_leds(struct razerd *rd, struct razerd_led *leds,
+		     unsigned int max_count);
+
+/** razerd_recv_dpimappings - Receive a list of DPI mappings. */
+int razerd_recv_dpimappings(struct razerd *rd, struct razerd_dpimapping *mappings,
+			    unsigned int max_count);
+
+/** razerd_recv_names - Receive a list of buttons or button functions. */
+int razerd_recv_names(struct razerd *rd, struct razerd_name *names,
+		      unsigned int max_count);
+
+/** razerd_recv_name - Receive a single button function. */
+int razerd_recv_name(struct razerd *rd, struct razerd_name *name);
+
+/** razerd_recv_axes - Receive a list of axes. */
+int razerd_recv_axes(struct razerd *rd, struct razerd_axis *axes,
+		     unsigned int max_count);
+
+/* Commands.
+ * The mouse argument is a handle from razerd_recv_mice().
+ * Setters take enum razerd_setter_flags. They reply with an enum
+ * razerd_error through razerd_recv_u32(). With RAZERD_NOREPLY there is
+ * no reply and the setter returns the positive request ID instead.
+ */
+
+/** razerd_rescan - Rescan for mice. No reply. */
+int razerd_rescan(struct razerd *rd);
+
+/** razerd_reconfig - Reconfigure all mice. No reply. */
+int razerd_reconfig(struct razerd *rd);
+
+/** razerd_getmice - Get the mice. Reply: razerd_recv_mice(). */
+int razerd_getmice(struct razerd *rd);
+
+/** razerd_getfwver - Get the firmware version (major << 8 | minor).
+ * Reply: razerd_recv_u32(). */
+int razerd_getfwver(struct razerd *rd, uint32_t mouse);
+
+/** razerd_getmouseinfo - Get enum razerd_mouseinfo_flags.
+ * Reply: razerd_recv_u32(). */
+int razerd_getmouseinfo(struct razerd *rd, uint32_t mouse);
+
+/** razerd_suppfreqs - Get the supported frequencies.
+ * Reply: razerd_recv_u32_list(). */
+int razerd_suppfreqs(struct razerd *rd, uint32_t mouse);
+
+/** razerd_suppresol - Get the supported resolutions.
+ * Reply: razerd_recv_u32_list(). */
+int razerd_suppresol(struct razerd *rd, uint32_t mouse);
+
+/** razerd_suppdpimappings - Get the DPI mappings.
+ * Reply: razerd_recv_dpimappings(). */
+int razerd_suppdpimappings(struct razerd *rd, uint32_t mouse);
+
+/** razerd_changedpimapping - Change the resolution of a DPI mapping dimension. */
+int razerd_changedpimapping(struct razerd *rd, uint32_t mouse,
+			    uint32_t mapping, uint32_t dimension,
+			    uint32_t resolution, unsigned int flags);
+
+/** razerd_getdpimapping - Get the DPI mapping of a profile.
+ * @axis: The axis or RAZERD_AXIS_INVALID.
+ * Reply: razerd_recv_u32(). */
+int razerd_getdpimapping(struct razerd *rd, uint32_t mouse,
+			 uint32_t profile, uint32_t axis);
+
+/** razerd_setdpimapping - Set the DPI mapping of a profile.
+ * @axis: The axis or RAZERD_AXIS_INVALID for all axes. */
+int razerd_setdpimapping(struct razerd *rd, uint32_t mouse,
+			 uint32_t profile, uint32_t axis,
+			 uint32_t mapping, unsigned int flags);
+
+/** razerd_getleds - Get the LEDs of a profile.
+ * @profile: The profile or RAZERD_PROFILE_INVALID for the global LEDs.
+ * Reply: razerd_recv_leds(). */
+int razerd_getleds(struct razerd *rd, uint32_t mouse, uint32_t profile);
+
+/** razerd_setled - Set the state of a LED.
+ * @led: The LED name, state, mode and color are used. */
+int razerd_setled(struct razerd *rd, uint32_t mouse, uint32_t profile,
+		  const struct razerd_led *led, unsigned int flags);
+
+/** razerd_getfreq - Get the scan frequency.
+ * Reply: razerd_recv_u32(). */
+int razerd_getfreq(struct razerd *rd, uint32_t mouse, uint32_t profile);
+
+/** razerd_setfreq - Set the scan frequency. */
+int razerd_setfreq(struct razerd *rd, uint32_t mouse, uint32_t profile,
+		   uint32_t freq, unsigned int flags);
+
+/** razerd_getprofiles - Get the profile IDs.
+ * Reply: razerd_recv_u32_list(). */
+int razerd_getprofiles(struct razerd *rd, uint32_t mouse);
+
+/** razerd_getactiveprof - Get the active profile.
+ * Reply: razerd_recv_u32(). */
+int razerd_getactiveprof(struct razerd *rd, uint32_t mouse);
+
+/** razerd_setactiveprof - Set the active profile. */
+int razerd_setactiveprof(struct razerd *rd, uint32_t mouse,
+			 uint32_t profile, unsigned int flags);
+
+/** razerd_getprofname - Get the name of a profile.
+ * Reply: razerd_recv_string(). */
+int razerd_getprofname(struct razerd *rd, uint32_t mouse, uint32_t profile);
+
+/** razerd_setprofname - Set the name of a profile.
+ * @name: UTF-8 name. */
+int razerd_setprofname(struct razerd *rd, uint32_t mouse, uint32_t profile,
+		       const char *name, unsigned int flags);
+
+/** razerd_suppbuttons - Get the physical buttons.
+ * Reply: razerd_recv_names(). */
+int razerd_suppbuttons(struct razerd *rd, uint32_t mouse);
+
+/** razerd_suppbutfuncs - Get the supported button functions.
+ * Reply: razerd_recv_names(). */
+int razerd_suppbutfuncs(struct razerd *rd, uint32_t mouse);
+
+/** razerd_getbutfunc - Get the function of a button.
+ * Reply: razerd_recv_name(). */
+int razerd_getbutfunc(struct razerd *rd, uint32_t mouse,
+		      uint32_t profile, uint32_t button);
+
+/** razerd_setbutfunc - Set the function of a button. */
+int razerd_setbutfunc(struct razerd *rd, uint32_t mouse, uint32_t profile,
+		      uint32_t button, uint32_t function, unsigned int flags);
+
+/** razerd_suppaxes - Get the axes.
+ * Reply: razerd_recv_axes(). */
+int razerd_suppaxes(struct razerd *rd, uint32_t mouse);
+
+/** razerd_claim - Keep the mouse claimed until razerd_release().
+ * The settings changed meanwhile are committed at once, when the last
+ * claim is released. Claims are released, if the connection is closed,
+ * and 5 seconds after the last razerd_claim(). razerd_release() fails then.
+ * Calling razerd_claim() again renews the claim for another 5 seconds.
+ * Only one connection can claim a mouse. The setters of other
+ * connections fail with RAZERD_ERR_CLAIM meanwhile. */
+int razerd_claim(struct razerd *rd, uint32_t mouse, unsigned int flags);
+
+/** razerd_release - Release a claimed mouse.
+ * The reply is the commit result. */
+int razerd_release(struct razerd *rd, uint32_t mouse, unsigned int flags);
+
+/** razerd_getappstats - Get the per-application profile switch statistics.
+ * Reply: razerd_recv_u32_list() with the number of switches and
+ * the last, average and maximum switch time in microseconds. */
+int razerd_getappstats(struct razerd *rd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB_RAZERD_H_ */
@@ -0,0 +1,935 @@
+/*
+ *   Razer daemon load generator
+ *   Replays a command mix on several razerd connections and
+ *   reports the command latencies.
+ *
+ *   Copyright (C) 2026 Michael Buesch <m@bues.ch>
+ *
+ *   This program is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU General Public License
+ *   as published by the Free Software Foundation; either version 2
+ *   of the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include "librazer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+
+#define ARRAY_SIZE(x)		(sizeof(x) / sizeof((x)[0]))
+
+#define SOCKPATH		"/run/razerd/socket"
+#define INTERFACE_REVISION	14
+#define COMMAND_MAX_SIZE	512
+#define MAX_CONNECTIONS		1024
+
+/* Protocol constants. Keep in sync with razerd.c */
+enum {
+	COMMAND_ID_GETREV = 0,
+	COMMAND_ID_GETMICE = 2,
+	COMMAND_ID_GETFWVER = 3,
+	COMMAND_ID_GETLEDS = 10,
+	COMMAND_ID_SETLED = 11,
+	COMMAND_ID_GETFREQ = 12,
+	COMMAND_ID_GETPROFILES = 14,
+	COMMAND_ID_GETACTIVEPROF = 15,
+	COMMAND_ID_SETACTIVEPROF = 16,
+	COMMAND_ID_GETMOUSEINFO = 23,
+
+	COMMAND_FLG_NOREPLY = 0x40,
+};
+
+enum {
+	REPLY_ID_U32 = 0,
+	REPLY_ID_STR,
+	NOTIFY_ID_FIRST = 128,
+	NOTIFY_ID_MOUSECONFIGURED = 130,
+	NOTIFY_ID_CMDRESULT = 133,
+};
+
+enum {
+	STRING_ENC_UTF16BE = 2,
+};
+
+enum {
+	MOUSEINFOFLG_RESULTOK		= (1 << 0),
+	MOUSEINFOFLG_GLOBAL_LEDS	= (1 << 1),
+	MOUSEINFOFLG_PROFILE_FREQ	= (1 << 4),
+};
+
+#define PROFILE_INVALID		0xFFFFFFFF
+
+/* The mouse the load runs against. Filled in by setup. */
+struct target {
+	char idstr[RAZER_IDSTR_MAX_SIZE + 1];
+	uint32_t handle;
+	uint32_t led_profile;
+	uint32_t freq_profile;
+	char led_name[RAZER_LEDNAME_MAX_SIZE + 1];
+	uint32_t led_state;
+	uint32_t led_mode;
+	uint32_t led_color;
+	unsigned int nr_profiles;
+	uint32_t profiles[64];
+	bool have_leds;
+};
+
+struct connection {
+	int fd;
+	unsigned int index;
+	unsigned int seed;
+	unsigned int led_state;
+	unsigned int profile;
+	pthread_t thread;
+	/* Latencies in nanoseconds, per command */
+	struct latencies *lat;
+	unsigned int nr_lat;
+};
+
+struct latencies {
+	uint64_t *nsec;
+	size_t count;
+	size_t alloc;
+	unsigned long errors;
+};
+
+struct loadgen_cmd {
+	const char *name;
+	uint8_t id;
+	uint8_t payload_size;
+	bool needs_mouse;
+	bool setter;		/* Replies with an error code only */
+	/* Build the payload. Returns false, if the target lacks
+	 * the feature. */
+	bool (*build)(struct connection *c, const struct target *t, char *payload);
+	/* Receive the reply. Returns <0 on socket errors,
+	 * >0 if the daemon returned an error code. */
+	int (*recv_reply)(struct connection *c);
+};
+
+static struct {
+	const char *sockpath;
+	const char *idstr;
+	const char *mix;
+	unsigned int connections;
+	unsigned int duration;
+	unsigned long count;
+	bool noreply;
+} cmdargs = {
+	.sockpath	= SOCKPATH,
+	.mix		= "getmice=4,getmouseinfo=4,getleds=2,getactiveprof=2,"
+			  "setled=1,setactiveprof=1",
+	.connections	= 4,
+	.duration	= 10,
+};
+
+static struct target target;
+static unsigned int mix_weights[16];
+static unsigned int mix_total;
+static volatile int stop_load;
+
+
+static void logerr(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+}
+
+static uint64_t now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void put_be32(char *buf, uint32_t v)
+{
+	v = htonl(v);
+	memcpy(buf, &v, sizeof(v));
+}
+
+static int connect_daemon(void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -errno;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", cmdargs.sockpath);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -errno;
+	}
+
+	return fd;
+}
+
+static int recv_all(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t nr;
+
+	while (len) {
+		nr = recv(fd, p, len, 0);
+		if (nr < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (nr == 0)
+			return -ECONNRESET;
+		p += nr;
+		len -= (size_t)nr;
+	}
+
+	return 0;
+}
+
+/* Send a command. Commands are the ID, the mouse handle
+ * and the payload of the command specific size. */
+static int send_command(int fd, uint8_t id, uint32_t handle,
+			const char *payload, size_t payload_len)
+{
+	char buf[COMMAND_MAX_SIZE];
+	size_t len = 0, size = 5 + payload_len;
+	ssize_t nr;
+
+	buf[0] = (char)id;
+	put_be32(buf + 1, handle);
+	memcpy(buf + 5, payload, payload_len);
+	while (len < size) {
+		nr = send(fd, buf + len, size - len, 0);
+		if (nr < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		len += (size_t)nr;
+	}
+
+	return 0;
+}
+
+/* Count a failed NOREPLY command. The request ID is the command index. */
+static int recv_cmdresult(struct connection *c)
+{
+	uint32_t v[2];
+	int err;
+
+	err = recv_all(c->fd, v, sizeof(v));
+	if (err)
+		return err;
+	if (ntohl(v[1]) && ntohl(v[0]) < c->nr_lat)
+		c->lat[ntohl(v[0])].errors++;
+
+	return 0;
+}
+
+/* Receive one reply message. Notifications are skipped.
+ * Strings are stored as ASCII into str, if it is not NULL. */
+static int recv_message(struct connection *c, uint8_t expected_id, uint32_t *u32,
+			char *str, size_t str_size)
+{
+	unsigned char hdr[3], buf[RAZER_IDSTR_MAX_SIZE * 2];
+	int fd = c->fd;
+	uint32_t v;
+	size_t len, i, size;
+	uint8_t id;
+	int err;
+
+	while (1) {
+		err = recv_all(fd, &id, 1);
+		if (err)
+			return err;
+		if (id < NOTIFY_ID_FIRST)
+			break;
+		/* The other unprivileged notifications have no payload. */
+		if (id == NOTIFY_ID_CMDRESULT) {
+			err = recv_cmdresult(c);
+			if (err)
+				return err;
+		} else if (id == NOTIFY_ID_MOUSECONFIGURED) {
+			err = recv_all(fd, buf, RAZER_IDSTR_MAX_SIZE);
+			if (err)
+				return err;
+		}
+	}
+	if (id != expected_id)
+		return -EPROTO;
+	if (id == REPLY_ID_U32) {
+		err = recv_all(fd, &v, sizeof(v));
+		if (err)
+			return err;
+		if (u32)
+			*u32 = ntohl(v);
+		return 0;
+	}
+
+	err = recv_all(fd, hdr, sizeof(hdr));
+	if (err)
+		return err;
+	len = ((size_t)hdr[1] << 8) | hdr[2];
+	size = (hdr[0] == STRING_ENC_UTF16BE) ? len * 2 : len;
+	if (size > sizeof(buf))
+		return -EPROTO;
+	err = recv_all(fd, buf, size);
+	if (err)
+		return err;
+	if (str) {
+		for (i = 0; i < len && i + 1 < str_size; i++) {
+			if (hdr[0] == STRING_ENC_UTF16BE)
+				str[i] = buf[i * 2] ? '?' : (char)buf[i * 2 + 1];
+			else
+				str[i] = (char)buf[i];
+		}
+		str[i] = '\0';
+	}
+
+	return 0;
+}
+
+static int recv_u32(struct connection *c, uint32_t *v)
+{
+	return recv_message(c, REPLY_ID_U32, v, NULL, 0);
+}
+
+static int recv_string(struct connection *c, char *str, size_t size)
+{
+	return recv_message(c, REPLY_ID_STR, NULL, str, size);
+}
+
+/* Reply with one u32 value */
+static int reply_u32(struct connection *c)
+{
+	return recv_u32(c, NULL);
+}
+
+/* Reply with an error code */
+static int reply_errorcode(struct connection *c)
+{
+	uint32_t errorcode;
+	int err;
+
+	err = recv_u32(c, &errorcode);
+	if (err)
+		return err;
+
+	return errorcode ? 1 : 0;
+}
+
+static int reply_getmice(struct connection *c)
+{
+	uint32_t i, count;
+	int err;
+
+	err = recv_u32(c, &count);
+	for (i = 0; !err && i < count; i++) {
+		err = recv_u32(c, NULL);
+		if (!err)
+			err = recv_string(c, NULL, 0);
+	}
+
+	return err;
+}
+
+static int reply_getleds(struct connection *c)
+{
+	uint32_t i, count;
+	int err;
+
+	err = recv_u32(c, &count);
+	for (i = 0; !err && i < count; i++) {
+		err = recv_u32(c, NULL);
+		if (!err)
+			err = recv_string(c, NULL, 0);
+		if (!err)
+			err = recv_u32(c, NULL);
+		if (!err)
+			err = recv_u32(c, NULL);
+		if (!err)
+			err = recv_u32(c, NULL);
+		if (!err)
+			err = recv_u32(c, NULL);
+	}
+
+	return err;
+}
+
+static int reply_getprofiles(struct connection *c)
+{
+	uint32_t i, count;
+	int err;
+
+	err = recv_u32(c, &count);
+	for (i = 0; !err && i < count; i++)
+		err = recv_u32(c, NULL);
+
+	return err;
+}
+
+static bool build_none(struct connection *c, const struct target *t, char *payload)
+{
+	return 1;
+}
+
+static bool build_getleds(struct connection *c, const struct target *t, char *payload)
+{
+	if (!t->have_leds)
+		return 0;
+	put_be32(payload, t->led_profile);
+
+	return 1;
+}
+
+static bool build_setled(struct connection *c, const struct target *t, char *payload)
+{
+	if (!t->have_leds)
+		return 0;
+	c->led_state = !c->led_state;
+	put_be32(payload, t->led_profile);
+	memcpy(payload + 4, t->led_name,
+	       strnlen(t->led_name, RAZER_LEDNAME_MAX_SIZE));
+	payload[4 + RAZER_LEDNAME_MAX_SIZE] = (char)c->led_state;
+	payload[4 + RAZER_LEDNAME_MAX_SIZE + 1] = (char)t->led_mode;
+	put_be32(payload + 4 + RAZER_LEDNAME_MAX_SIZE + 2, t->led_color);
+
+	return 1;
+}
+
+static bool build_getfreq(struct connection *c, const struct target *t, char *payload)
+{
+	put_be32(payload, t->freq_profile);
+
+	return 1;
+}
+
+static bool build_setactiveprof(struct connection *c, const struct target *t, char *payload)
+{
+	if (t->nr_profiles <= 1)
+		return 0;
+	c->profile = (c->profile + 1) % t->nr_profiles;
+	put_be32(payload, t->profiles[c->profile]);
+
+	return 1;
+}
+
+static const struct loadgen_cmd loadgen_cmds[] = {
+	{ "getrev",		COMMAND_ID_GETREV,	  0,  0, 0, build_none,		 reply_u32, },
+	{ "getmice",		COMMAND_ID_GETMICE,	  0,  0, 0, build_none,		 reply_getmice, },
+	{ "getfwver",		COMMAND_ID_GETFWVER,	  0,  1, 0, build_none,		 reply_u32, },
+	{ "getmouseinfo",	COMMAND_ID_GETMOUSEINFO,  0,  1, 0, build_none,		 reply_u32, },
+	{ "getleds",		COMMAND_ID_GETLEDS,	  4,  1, 0, build_getleds,	 reply_getleds, },
+	{ "setled",		COMMAND_ID_SETLED,	  74, 1, 1, build_setled,	 reply_errorcode, },
+	{ "getfreq",		COMMAND_ID_GETFREQ,	  4,  1, 0, build_getfreq,	 reply_u32, },
+	{ "getprofiles",	COMMAND_ID_GETPROFILES,	  0,  1, 0, build_none,		 reply_getprofiles, },
+	{ "getactiveprof",	COMMAND_ID_GETACTIVEPROF, 0,  1, 0, build_none,		 reply_u32, },
+	{ "setactiveprof",	COMMAND_ID_SETACTIVEPROF, 4,  1, 1, build_setactiveprof, reply_errorcode, },
+};
+
+static const struct loadgen_cmd * find_cmd(const char *name, size_t len)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(loadgen_cmds); i++) {
+		if (strlen(loadgen_cmds[i].name) == len &&
+		    strncasecmp(loadgen_cmds[i].name, name, len) == 0)
+			return &loadgen_cmds[i];
+	}
+
+	return NULL;
+}
+
+/* Parse a mix like "getmice=4,setled=1". A missing weight means 1. */
+static int parse_mix(const char *mix)
+{
+	const struct loadgen_cmd *cmd;
+	const char *s = mix, *end, *eq;
+	unsigned long weight;
+	char *tail;
+
+	memset(mix_weights, 0, sizeof(mix_weights));
+	while (*s) {
+		end = strchr(s, ',');
+		if (!end)
+			end = s + strlen(s);
+		eq = memchr(s, '=', (size_t)(end - s));
+		cmd = find_cmd(s, (size_t)((eq ? eq : end) - s));
+		if (!cmd) {
+			logerr("Unknown command in mix: %.*s\n", (int)(end - s), s);
+			return -EINVAL;
+		}
+		weight = 1;
+		if (eq) {
+			weight = strtoul(eq + 1, &tail, 10);
+			if (tail != end || weight > 1000) {
+				logerr("Invalid weight in mix: %.*s\n", (int)(end - s), s);
+				return -EINVAL;
+			}
+		}
+		mix_weights[cmd - loadgen_cmds] = (unsigned int)weight;
+		s = *end ? end + 1 : end;
+	}
+
+	return 0;
+}
+
+/* Query the target mouse and drop commands it cannot run from the mix. */
+static int setup_target(void)
+{
+	char payload[COMMAND_MAX_SIZE] = { 0, };
+	char idstr[RAZER_IDSTR_MAX_SIZE + 1];
+	uint32_t i, count, flags, rev, active, handle;
+	bool found = 0;
+	struct connection c = { .fd = -1, };
+	int err;
+
+	c.fd = connect_daemon();
+	if (c.fd < 0) {
+		logerr("Failed to connect to %s: %s\n",
+		       cmdargs.sockpath, strerror(-c.fd));
+		return c.fd;
+	}
+
+	err = send_command(c.fd, COMMAND_ID_GETREV, 0, NULL, 0);
+	if (!err)
+		err = recv_u32(&c, &rev);
+	if (err)
+		goto error;
+	if (rev != INTERFACE_REVISION)
+		logerr("Warning: razerd interface revision %u, expected %u\n",
+		       rev, INTERFACE_REVISION);
+
+	err = send_command(c.fd, COMMAND_ID_GETMICE, 0, NULL, 0);
+	if (!err)
+		err = recv_u32(&c, &count);
+	for (i = 0; !err && i < count; i++) {
+		err = recv_u32(&c, &handle);
+		if (!err)
+			err = recv_string(&c, idstr, sizeof(idstr));
+		if (!err && !found &&
+		    (!cmdargs.idstr || strcmp(cmdargs.idstr, idstr) == 0)) {
+			strcpy(target.idstr, idstr);
+			target.handle = handle;
+			found = 1;
+		}
+	}
+	if (err)
+		goto error;
+	if (!found)
+		logerr("Warning: No mouse found\n");
+
+	err = send_command(c.fd, COMMAND_ID_GETMOUSEINFO, target.handle, NULL, 0);
+	if (!err)
+		err = recv_u32(&c, &flags);
+	if (!err)
+		err = send_command(c.fd, COMMAND_ID_GETPROFILES, target.handle, NULL, 0);
+	if (!err)
+		err = recv_u32(&c, &count);
+	for (i = 0; !err && i < count; i++) {
+		err = recv_u32(&c, &active);
+		if (i < ARRAY_SIZE(target.profiles))
+			target.profiles[target.nr_profiles++] = active;
+	}
+	if (!err)
+		err = send_command(c.fd, COMMAND_ID_GETACTIVEPROF, target.handle, NULL, 0);
+	if (!err)
+		err = recv_u32(&c, &active);
+	if (err)
+		goto error;
+	for (i = 0; i < target.nr_profiles; i++) {
+		if (target.profiles[i] == active)
+			c.profile = i;
+	}
+
+	target.led_profile = (flags & MOUSEINFOFLG_GLOBAL_LEDS) ? PROFILE_INVALID : active;
+	target.freq_profile = (flags & MOUSEINFOFLG_PROFILE_FREQ) ? active : PROFILE_INVALID;
+	put_be32(payload, target.led_profile);
+	err = send_command(c.fd, COMMAND_ID_GETLEDS, target.handle, payload, 4);
+	if (!err)
+		err = recv_u32(&c, &count);
+	for (i = 0; !err && i < count; i++) {
+		err = recv_u32(&c, NULL);
+		if (!err)
+			err = recv_string(&c, i ? NULL : target.led_name,
+					  sizeof(target.led_name));
+		if (!err)
+			err = recv_u32(&c, i ? NULL : &target.led_state);
+		if (!err)
+			err = recv_u32(&c, i ? NULL : &target.led_mode);
+		if (!err)
+			err = recv_u32(&c, NULL);
+		if (!err)
+			err = recv_u32(&c, i ? NULL : &target.led_color);
+	}
+	if (err)
+		goto error;
+	target.have_leds = (count > 0);
+
+	close(c.fd);
+
+	for (i = 0; i < ARRAY_SIZE(loadgen_cmds); i++) {
+		if (!mix_weights[i])
+			continue;
+		if ((loadgen_cmds[i].needs_mouse && !found) ||
+		    !loadgen_cmds[i].build(&c, &target, payload)) {
+			logerr("Warning: The mouse does not support %s. "
+			       "Removed from the mix.\n", loadgen_cmds[i].name);
+			mix_weights[i] = 0;
+		}
+		mix_total += mix_weights[i];
+	}
+	if (!mix_total) {
+		logerr("The command mix is empty\n");
+		return -EINVAL;
+	}
+	if (found)
+		printf("Mouse: %s\n", target.idstr);
+
+	return 0;
+
+error:
+	logerr("Failed to query razerd: %s\n", strerror(-err));
+	close(c.fd);
+	return err;
+}
+
+static int record(struct latencies *lat, uint64_t nsec)
+{
+	uint64_t *n;
+	size_t alloc;
+
+	if (lat->count >= lat->alloc) {
+		alloc = lat->alloc ? lat->alloc * 2 : 1024;
+		n = realloc(lat->nsec, alloc * sizeof(*n));
+		if (!n)
+			return -ENOMEM;
+		lat->nsec = n;
+		lat->alloc = alloc;
+	}
+	lat->nsec[lat->count++] = nsec;
+
+	return 0;
+}
+
+static unsigned int pick_cmd(struct connection *c)
+{
+	unsigned int i, r;
+
+	r = (unsigned int)rand_r(&c->seed) % mix_total;
+	for (i = 0; i < ARRAY_SIZE(loadgen_cmds); i++) {
+		if (r < mix_weights[i])
+			break;
+		r -= mix_weights[i];
+	}
+
+	return i;
+}
+
+static void * connection_thread(void *_c)
+{
+	struct connection *c = _c;
+	const struct loadgen_cmd *cmd;
+	char payload[COMMAND_MAX_SIZE];
+	unsigned long done = 0;
+	unsigned int i, size;
+	uint64_t start;
+	uint8_t id;
+	bool noreply;
+	int err;
+
+	while (!__atomic_load_n(&stop_load, __ATOMIC_RELAXED)) {
+		if (cmdargs.count && done >= cmdargs.count)
+			break;
+		i = pick_cmd(c);
+		cmd = &loadgen_cmds[i];
+		memset(payload, 0, sizeof(payload));
+		cmd->build(c, &target, payload);
+		id = cmd->id;
+		size = cmd->payload_size;
+		noreply = cmdargs.noreply && cmd->setter;
+		if (noreply) {
+			/* Failures come back as notifications
+			 * with the command index as request ID. */
+			id |= COMMAND_FLG_NOREPLY;
+			put_be32(payload + size, i);
+			size += 4;
+		}
+
+		start = now_nsec();
+		err = send_command(c->fd, id, target.handle, payload, size);
+		if (!err && !noreply)
+			err = cmd->recv_reply(c);
+		if (err < 0) {
+			logerr("Connection %u: %s failed: %s\n",
+			       c->index, cmd->name, strerror(-err));
+			break;
+		}
+		if (err > 0)
+			c->lat[i].errors++;
+		if (record(&c->lat[i], now_nsec() - start)) {
+			logerr("Out of memory\n");
+			break;
+		}
+		done++;
+	}
+	/* Collect the results of pending NOREPLY commands. */
+	if (cmdargs.noreply) {
+		err = send_command(c->fd, COMMAND_ID_GETREV, 0, NULL, 0);
+		if (!err)
+			recv_u32(c, NULL);
+	}
+
+	return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double percentile_usec(const struct latencies *lat, unsigned int permille)
+{
+	size_t idx;
+
+	idx = (lat->count * permille + 999) / 1000;
+	if (idx)
+		idx--;
+
+	return (double)lat->nsec[idx] / 1000.0;
+}
+
+static void report(struct connection *conns, double seconds)
+{
+	struct latencies all, *lat;
+	unsigned long total = 0, errors = 0;
+	unsigned int i, j;
+	size_t n;
+
+	printf("%-14s %9s %10s %9s %9s %9s %9s %7s\n",
+	       "command", "count", "cmds/s", "p50 us", "p99 us",
+	       "p999 us", "max us", "errors");
+	for (i = 0; i < ARRAY_SIZE(loadgen_cmds); i++) {
+		memset(&all, 0, sizeof(all));
+		for (j = 0; j < cmdargs.connections; j++)
+			all.count += conns[j].lat[i].count;
+		if (!all.count)
+			continue;
+		all.nsec = malloc(all.count * sizeof(*all.nsec));
+		if (!all.nsec) {
+			logerr("Out of memory\n");
+			return;
+		}
+		n = 0;
+		for (j = 0; j < cmdargs.connections; j++) {
+			lat = &conns[j].lat[i];
+			memcpy(all.nsec + n, lat->nsec, lat->count * sizeof(*lat->nsec));
+			n += lat->count;
+			all.errors += lat->errors;
+		}
+		qsort(all.nsec, all.count, sizeof(*all.nsec), compare_u64);
+
+		printf("%-14s %9zu %10.1f %9.1f %9.1f %9.1f %9.1f %7lu\n",
+		       loadgen_cmds[i].name, all.count,
+		       (double)all.count / seconds,
+		       percentile_usec(&all, 500),
+		       percentile_usec(&all, 990),
+		       percentile_usec(&all, 999),
+		       (double)all.nsec[all.count - 1] / 1000.0,
+		       all.errors);
+		total += all.count;
+		errors += all.errors;
+		free(all.nsec);
+	}
+	printf("%-14s %9lu %10.1f %39s %7lu\n", "total", total,
+	       (double)total / seconds, "", errors);
+	printf("%u connections, %.2f seconds\n", cmdargs.connections, seconds);
+}
+
+static void usage(FILE *fd, int argc, char **argv)
+{
+	unsigned int i;
+
+	fprintf(fd, "Razer daemon load generator\n\n");
+	fprintf(fd, "Usage: %s [OPTIONS]\n", argv[0]);
+	fprintf(fd, "\n");
+	fprintf(fd, "  -s|--socket PATH          razerd socket. Defaults to %s\n", SOCKPATH);
+	fprintf(fd, "  -c|--connections N        Number of client connections. Default 4\n");
+	fprintf(fd, "  -d|--duration SEC         Run time in seconds. Default 10\n");
+	fprintf(fd, "  -n|--count N              Commands per connection, instead of a run time\n");
+	fprintf(fd, "  -i|--idstr ID             Mouse to use. Defaults to the first mouse\n");
+	fprintf(fd, "  -m|--mix MIX              Command mix as weighted list. Defaults to\n");
+	fprintf(fd, "                            %s\n", cmdargs.mix);
+	fprintf(fd, "  -N|--noreply              Send setters without waiting for the result\n");
+	fprintf(fd, "\n");
+	fprintf(fd, "  -h|--help                 Print this help text\n");
+	fprintf(fd, "\n");
+	fprintf(fd, "Commands:");
+	for (i = 0; i < ARRAY_SIZE(loadgen_cmds); i++)
+		fprintf(fd, " %s", loadgen_cmds[i].name);
+	fprintf(fd, "\n");
+}
+
+static int parse_args(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{ "help", no_argument, 0, 'h', },
+		{ "socket", required_argument, 0, 's', },
+		{ "connections", required_argument, 0, 'c', },
+		{ "duration", required_argument, 0, 'd', },
+		{ "count", required_argument, 0, 'n', },
+		{ "idstr", required_argument, 0, 'i', },
+		{ "mix", required_argument, 0, 'm', },
+		{ "noreply", no_argument, 0, 'N', },
+		{ 0, },
+	};
+	int c, idx;
+
+	while (1) {
+		c = getopt_long(argc, argv, "hs:c:d:n:i:m:N",
+				long_options, &idx);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'h':
+			usage(stdout, argc, argv);
+			return 1;
+		case 's':
+			cmdargs.sockpath = optarg;
+			break;
+		case 'c':
+			cmdargs.connections = (unsigned int)atoi(optarg);
+			if (cmdargs.connections < 1 ||
+			    cmdargs.connections > MAX_CONNECTIONS) {
+				logerr("Invalid number of connections\n");
+				return -1;
+			}
+			break;
+		case 'd':
+			cmdargs.duration = (unsigned int)atoi(optarg);
+			break;
+		case 'n':
+			cmdargs.count = strtoul(optarg, NULL, 10);
+			break;
+		case 'i':
+			cmdargs.idstr = optarg;
+			break;
+		case 'm':
+			cmdargs.mix = optarg;
+			break;
+		case 'N':
+			cmdargs.noreply = 1;
+			break;
+		default:
+			return -1;
+		}
+	}
+	if (!cmdargs.count && !cmdargs.duration) {
+		logerr("Need a duration or a command count\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct connection *conns;
+	struct timespec ts = { 0, };
+	uint64_t start, end;
+	unsigned int i, j, started = 0;
+	int err, ret = 1;
+
+	err = parse_args(argc, argv);
+	if (err > 0)
+		return 0;
+	if (err)
+		return 1;
+	if (parse_mix(cmdargs.mix))
+		return 1;
+	if (setup_target())
+		return 1;
+
+	conns = calloc(cmdargs.connections, sizeof(*conns));
+	if (!conns) {
+		logerr("Out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < cmdargs.connections; i++) {
+		conns[i].index = i;
+		conns[i].seed = i + 1;
+		conns[i].profile = i;
+		conns[i].lat = calloc(ARRAY_SIZE(loadgen_cmds), sizeof(*conns[i].lat));
+		conns[i].nr_lat = ARRAY_SIZE(loadgen_cmds);
+		conns[i].fd = connect_daemon();
+		if (!conns[i].lat || conns[i].fd < 0) {
+			logerr("Failed to open connection %u\n", i);
+			goto out;
+		}
+	}
+
+	start = now_nsec();
+	for (i = 0; i < cmdargs.connections; i++) {
+		if (pthread_create(&conns[i].thread, NULL,
+				   connection_thread, &conns[i])) {
+			logerr("Failed to start connection %u\n", i);
+			__atomic_store_n(&stop_load, 1, __ATOMIC_RELAXED);
+			break;
+		}
+		started++;
+	}
+	if (!cmdargs.count && started == cmdargs.connections) {
+		ts.tv_sec = cmdargs.duration;
+		while (nanosleep(&ts, &ts) && errno == EINTR)
+			;
+		__atomic_store_n(&stop_load, 1, __ATOMIC_RELAXED);
+	}
+	for (i = 0; i < started; i++)
+		pthread_join(conns[i].thread, NULL);
+	end = now_nsec();
+
+	if (started == cmdargs.connections) {
+		report(conns, (double)(end - start) / 1e9);
+		ret = 0;
+	}
+out:
+	for (i = 0; i < cmdargs.connections; i++) {
+		if (conns[i].fd > 0)
+			close(conns[i].fd);
+		if (conns[i].lat) {
+			for (j = 0; j < ARRAY_SIZE(loadgen_cmds); j++)
+				free(conns[i].lat[j].nsec);
+			free(conns[i].lat);
+		}
+	}
+	free(conns);
+
+	return ret;
+}
@@ -33,6 +33,18 @@
 #include <syslog.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <libgen.h>
+#include <fnmatch.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#endif
 
 #ifdef __DragonFly__
 #include <sys/endian.h>
@@ -52,6 +64,7 @@
 				   __typeof__(y) __y = (y); \
 				   __x > __y ? __x : __y; })
 #define ARRAY_SIZE(x)		(sizeof(x) / sizeof((x)[0]))
+#define BUILD_BUG_ON(x)		((void)sizeof(char[1 - 2 * !!(x)]))
 
 #define _packed			__attribute__((__packed__))
 
@@ -65,6 +78,8 @@ enum {
 struct commandline_args {
 	bool background;
 	const char *configfile;
+	const char *statecache;
+	const char *transport;
 	const char *pidfile;
 	int loglevel;
 	bool force;
@@ -83,13 +98,20 @@ struct commandline_args {
 #define SOCKPATH		RUNDIR_RAZERD "/socket"
 #define PRIV_SOCKPATH		RUNDIR_RAZERD "/socket.privileged"
 
-#define INTERFACE_REVISION	6
+#define INTERFACE_REVISION	14
 
 #define COMMAND_MAX_SIZE	512
 #define COMMAND_HDR_SIZE	sizeof(struct command_hdr)
+#define PRIV_COMMAND_HDR_SIZE	sizeof(struct priv_command_hdr)
 #define BULK_CHUNK_SIZE		128
 
 #define MAX_FIRMWARE_SIZE	0x400000
+#define MAX_FIRMWARE_IMAGES	4	/* Images kept in the daemon */
+#define MAX_FLASH_MICE		64	/* Mice per FLASHMANY command */
+#define CLAIM_LEASE_MSEC	5000	/* CLAIMMOUSE is released after this, unless renewed */
+#define MAX_APP_SESSIONS	8	/* Applications per mouse with a profile */
+#define MAX_CLIENT_TXBUF	0x40000	/* Queued reply bytes per client */
+#define CLIENT_TXBUF_THRES	0x4000	/* Don't read commands above this */
 
 enum {
 	COMMAND_ID_GETREV = 0,		/* Get the revision number of the socket interface. */
@@ -118,11 +140,24 @@ enum {
 	COMMAND_ID_GETMOUSEINFO,	/* Get detailed information about a mouse */
 	COMMAND_ID_GETPROFNAME,		/* Get a profile name. */
 	COMMAND_ID_SETPROFNAME,		/* Set a profile name. */
+	COMMAND_ID_CLAIMMOUSE,		/* Keep a mouse claimed until RELEASEMOUSE or lease end. */
+	COMMAND_ID_RELEASEMOUSE,	/* Release a mouse and commit its settings. */
+	COMMAND_ID_GETAPPSTATS,		/* Get the application profile switch statistics. */
+	/* The unprivileged command IDs must stay below the lowest flag. */
+
+	/* Flags in the command ID of unprivileged commands */
+	COMMAND_FLG_NOREPLY = 0x40,	/* Do not send the result. Failures are
+					 * sent as NOTIFY_ID_CMDRESULT. */
+	COMMAND_FLG_ACK = 0x20,		/* With NOREPLY: Also notify success. */
+	COMMAND_FLAGS = COMMAND_FLG_NOREPLY | COMMAND_FLG_ACK,
 
 	/* Privileged commands */
-	COMMAND_PRIV_FLASHFW = 128,	/* Upload and flash a firmware image */
+	COMMAND_PRIV_FLASHFW = 128,	/* Upload and flash a firmware image (not stored) */
 	COMMAND_PRIV_CLAIM,		/* Claim the device. */
 	COMMAND_PRIV_RELEASE,		/* Release the device. */
+	COMMAND_PRIV_UPLOADFW,		/* Store a firmware image in the daemon */
+	COMMAND_PRIV_FLASHMANY,		/* Flash an uploaded image to several devices */
+	COMMAND_PRIV_FLASHCANCEL,	/* Cancel a running flash. No reply. */
 };
 
 enum {
@@ -135,6 +170,8 @@ enum {
 	ERR_FAIL,
 	ERR_PAYLOAD,
 	ERR_NOTSUPP,
+	ERR_NOIMAGE,
+	ERR_CANCELED,
 };
 
 enum mouseinfo_flags {
@@ -158,11 +195,11 @@ enum profile_special_values {
 
 struct command_hdr {
 	uint8_t id;
+	uint32_t handle;	/* Mouse handle from GETMICE */
 } _packed;
 
 struct command {
 	struct command_hdr hdr;
-	char idstr[RAZER_IDSTR_MAX_SIZE];
 	union {
 		struct {
 		} _packed getfwver;
@@ -256,6 +293,30 @@ struct command {
 			uint8_t utf16be_name[64 * 2];
 		} _packed setprofname;
 
+		struct {
+		} _packed claimmouse;
+
+		struct {
+		} _packed releasemouse;
+
+		struct {
+		} _packed getappstats;
+	} _packed;
+} _packed;
+
+#define CMD_SIZE(name)	(offsetof(struct command, name) + \
+			 sizeof(((struct command *)0)->name))
+
+/* Privileged commands address mice by ID string
+ * and are padded to COMMAND_MAX_SIZE. */
+struct priv_command_hdr {
+	uint8_t id;
+} _packed;
+
+struct priv_command {
+	struct priv_command_hdr hdr;
+	char idstr[RAZER_IDSTR_MAX_SIZE];
+	union {
 		struct {
 			uint32_t imagesize;
 		} _packed flashfw;
@@ -266,11 +327,23 @@ struct command {
 		struct {
 		} _packed release;
 
+		struct {
+			uint32_t imagesize;
+		} _packed uploadfw;
+
+		struct {
+			uint32_t image_hash;
+			uint32_t nr_mice;
+		} _packed flashmany;
+
+		struct {
+		} _packed flashcancel;
+
 	} _packed;
 } _packed;
 
-#define CMD_SIZE(name)	(offsetof(struct command, name) + \
-			 sizeof(((struct command *)0)->name))
+#define PRIV_CMD_SIZE(name)	(offsetof(struct priv_command, name) + \
+				 sizeof(((struct priv_command *)0)->name))
 
 enum {
 	REPLY_ID_U32 = 0,		/* An unsigned 32bit integer. */
@@ -279,6 +352,10 @@ enum {
 	/* Asynchonous notifications. */
 	NOTIFY_ID_NEWMOUSE = 128,	/* New mouse was connected. */
 	NOTIFY_ID_DELMOUSE,		/* A mouse was removed. */
+	NOTIFY_ID_MOUSECONFIGURED,	/* A new mouse finished its initial configuration. */
+	NOTIFY_ID_FLASHRESULT,		/* A FLASHMANY device finished. (privileged) */
+	NOTIFY_ID_FLASHPROGRESS,	/* Firmware flash progress. (privileged) */
+	NOTIFY_ID_CMDRESULT,		/* The result of a NOREPLY command. */
 };
 
 enum string_encoding {
@@ -307,6 +384,23 @@ struct reply {
 		} _packed notify_newmouse;
 		struct {
 		} _packed notify_delmouse;
+		struct {
+			char idstr[RAZER_IDSTR_MAX_SIZE];
+		} _packed notify_mouseconfigured;
+		struct {
+			uint32_t errorcode;
+			char idstr[RAZER_IDSTR_MAX_SIZE];
+		} _packed notify_flashresult;
+		struct {
+			uint32_t phase;
+			uint32_t done;
+			uint32_t total;
+			char idstr[RAZER_IDSTR_MAX_SIZE];
+		} _packed notify_flashprogress;
+		struct {
+			uint32_t request_id;
+			uint32_t errorcode;
+		} _packed notify_cmdresult;
 	} _packed;
 } _packed;
 
@@ -318,6 +412,16 @@ struct client {
 	struct sockaddr_un sockaddr;
 	socklen_t socklen;
 	int fd;
+	/* Partially received commands */
+	char cmdbuf[COMMAND_MAX_SIZE];
+	unsigned int cmdlen;
+	/* Flags and request ID of the command being handled */
+	uint8_t cmdflags;
+	uint32_t request_id;
+	/* Replies that did not fit into the socket. Sent by the main loop. */
+	char *txbuf;
+	size_t txlen;
+	bool dead;		/* Sending failed. Disconnected by the main loop. */
 };
 
 /* Control socket FDs. */
@@ -329,6 +433,127 @@ static struct client *privileged_clients;
 /* Linked list of detected mice. */
 static struct razer_mouse *mice;
 
+#define MAX_MOUSE_HANDLES	0x10000
+#define MAX_ID_TABLE_SIZE	1024
+
+/* Maps IDs from a driver list to the list entries. */
+struct id_table {
+	void **entries;
+	unsigned int size;
+};
+
+/* An application that selected a profile of a mouse. */
+struct app_session {
+	pid_t pid;
+	unsigned int profile;
+};
+
+/* Clients address mice by handle. A handle stays valid while the mouse
+ * is connected. The lower 16 bits are the slot in mouse_handles[],
+ * the upper bits are a generation count, so stale handles of removed
+ * mice do not resolve to new mice in the same slot. */
+struct mouse_handle {
+	uint32_t handle;
+	struct razer_mouse *mouse;
+	struct id_table profiles;
+	struct id_table axes;
+	struct id_table dpimappings;
+	struct id_table buttons;
+	struct id_table button_functions;
+
+	/* CLAIMMOUSE. Setters of other clients fail, while it is claimed. */
+	struct client *claim_owner;	/* NULL, if not claimed by a client */
+	uint64_t claim_expires_ns;	/* Released automatically at this time */
+
+	/* Per-application profiles */
+	struct razer_appprofile_rule *app_rules;
+	struct app_session apps[MAX_APP_SESSIONS];	/* Newest last */
+	unsigned int nr_apps;
+	unsigned int app_restore_profile;	/* Active before the first application */
+};
+static struct mouse_handle **mouse_handles;
+static unsigned int nr_mouse_handles;
+static uint16_t mouse_handle_generation;
+
+/* Firmware images uploaded by privileged clients.
+ * UPLOADFW images are kept in the image store (at most MAX_FIRMWARE_IMAGES).
+ * FLASHFW images are not stored. They are freed with their flash job. */
+struct fw_image {
+	struct fw_image *next;
+	uint32_t hash;		/* Content hash. Used as image ID. */
+	uint32_t size;
+	unsigned int users;	/* Number of flash jobs using the image */
+	bool transient;		/* Not in the image store */
+	char *data;
+};
+static struct fw_image *fw_images;
+
+struct flash_job;
+
+struct flash_target {
+	struct flash_job *job;
+	char idstr[RAZER_IDSTR_MAX_SIZE + 1];
+	struct razer_mouse *mouse;
+	uint32_t errorcode;
+	bool cancel;		/* Set by the main loop. Accessed atomically. */
+};
+
+/* A flash job flashes all targets on one USB bus, one after the other.
+ * Jobs on different buses run concurrently. */
+struct flash_job {
+	struct flash_job *next;
+	struct client *client;	/* NULL, if the client disconnected */
+	struct fw_image *image;
+	int bus;
+	bool reply_final;	/* FLASHFW: Reply with the result instead of a notification. */
+	unsigned int nr_targets;
+	struct flash_target targets[MAX_FLASH_MICE];
+	pthread_t thread;
+};
+static struct flash_job *flash_jobs;
+
+enum flash_event_type {
+	FLASH_EV_PROGRESS,	/* Progress of a target */
+	FLASH_EV_RESULT,	/* A target finished */
+	FLASH_EV_FINISHED,	/* The job finished. Sent last. */
+};
+
+/* Sent from the flash threads to the main loop. */
+struct flash_event {
+	struct flash_job *job;
+	unsigned int target;
+	enum flash_event_type type;
+	enum razer_flash_phase phase;
+	unsigned int done;
+	unsigned int total;
+};
+static int flash_event_pipe[2] = { -1, -1 };
+
+/* Operations that touch all mice are deferred while flashing. */
+static bool rescan_pending;
+static bool reconfig_pending;
+static bool config_reload_pending;
+
+/* proc connector socket for the per-application profiles */
+static int proc_events_fd = -1;
+/* The application profile rules need to be reloaded. */
+static bool app_rules_pending;
+static unsigned int nr_app_rules;
+
+/* Latency from the process start or exit to the committed profile switch */
+static struct {
+	uint32_t nr_switches;
+	uint32_t last_usec;
+	uint32_t max_usec;
+	uint64_t total_usec;
+} app_switch_stats;
+
+/* inotify watch on the config file directory */
+static int config_watch_fd = -1;
+#ifdef __linux__
+static char config_watch_name[NAME_MAX + 1];
+#endif
+
 
 static inline uint32_t cpu_to_be32(uint32_t v)
 {
@@ -548,10 +773,256 @@ err_remove_pidfile:
 	return -1;
 }
 
+static void reload_config(void)
+{
+	int err;
+
+	err = razer_reload_config(cmdargs.configfile);
+	if (err == -ENOENT)
+		logerr("Failed to reload config file. Keeping the old one.\n");
+	else if (err)
+		logerr("Failed to apply the reloaded config (%d)\n", err);
+	app_rules_pending = 1;
+}
+
+#ifdef __linux__
+static void setup_config_watch(void)
+{
+	const char *path = cmdargs.configfile;
+	char dir[PATH_MAX], name[PATH_MAX];
+	int fd, wd;
+
+	if (!path)
+		path = RAZER_DEFAULT_CONFIG;
+	if (!strlen(path))
+		return;
+	if (strlen(path) >= sizeof(dir)) {
+		logerr("Config file path too long. Not watching it.\n");
+		return;
+	}
+	strcpy(dir, path);
+	strcpy(name, path);
+	if (strlen(basename(name)) >= sizeof(config_watch_name)) {
+		logerr("Config file name too long. Not watching it.\n");
+		return;
+	}
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		logerr("Failed to initialize inotify: %s\n",
+		       strerror(errno));
+		return;
+	}
+	/* Watch the directory instead of the file, so that editors
+	 * replacing the file by rename() are caught, too. */
+	wd = inotify_add_watch(fd, dirname(dir),
+			       IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd < 0) {
+		logerr("Failed to watch config file %s: %s\n",
+		       path, strerror(errno));
+		close(fd);
+		return;
+	}
+	strcpy(config_watch_name, basename(name));
+	config_watch_fd = fd;
+}
+
+static void cleanup_config_watch(void)
+{
+	if (config_watch_fd >= 0) {
+		close(config_watch_fd);
+		config_watch_fd = -1;
+	}
+}
+
+static int check_config_watch(void)
+{
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+		__attribute__((__aligned__(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	bool changed = 0;
+	ssize_t nr;
+	size_t pos;
+
+	if (config_watch_fd < 0)
+		return 0;
+	while (1) {
+		nr = read(config_watch_fd, buf, sizeof(buf));
+		if (nr <= 0)
+			break;
+		for (pos = 0; pos + sizeof(*ev) <= (size_t)nr;
+		     pos += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *)&buf[pos];
+			if (ev->len && strcmp(ev->name, config_watch_name) == 0)
+				changed = 1;
+		}
+	}
+	if (nr < 0 && errno != EAGAIN && errno != EINTR)
+		return -1;
+	if (!changed)
+		return 0;
+
+	if (flash_jobs) {
+		loginfo("Config file changed. Reloading after flashing.\n");
+		config_reload_pending = 1;
+		return 0;
+	}
+	loginfo("Config file changed. Reloading.\n");
+	reload_config();
+
+	return 0;
+}
+#else
+static void setup_config_watch(void) { }
+static void cleanup_config_watch(void) { }
+static int check_config_watch(void) { return 0; }
+#endif /* __linux__ */
+
+#ifdef __linux__
+/* Subscribe to the process events of the kernel proc connector.
+ * This needs CAP_NET_ADMIN. */
+static int setup_proc_events(void)
+{
+	struct sockaddr_nl addr = {
+		.nl_family	= AF_NETLINK,
+		.nl_groups	= CN_IDX_PROC,
+	};
+	union {
+		struct nlmsghdr hdr;
+		char buf[NLMSG_SPACE(sizeof(struct cn_msg) +
+				     sizeof(enum proc_cn_mcast_op))];
+	} msg;
+	struct nlmsghdr *nl = &msg.hdr;
+	struct cn_msg *cn;
+	enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+	int fd;
+
+	fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		    NETLINK_CONNECTOR);
+	if (fd < 0)
+		goto error;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		goto err_close;
+
+	memset(&msg, 0, sizeof(msg));
+	nl->nlmsg_len = sizeof(msg.buf);
+	nl->nlmsg_type = NLMSG_DONE;
+	nl->nlmsg_pid = getpid();
+	cn = NLMSG_DATA(nl);
+	cn->id.idx = CN_IDX_PROC;
+	cn->id.val = CN_VAL_PROC;
+	cn->len = sizeof(op);
+	memcpy(cn->data, &op, sizeof(op));
+	if (send(fd, &msg, sizeof(msg.buf), 0) < 0)
+		goto err_close;
+	proc_events_fd = fd;
+	logdebug("Watching process events for application profiles\n");
+
+	return 0;
+
+err_close:
+	close(fd);
+error:
+	logerr("Failed to subscribe to process events: %s\n",
+	       strerror(errno));
+	return -1;
+}
+
+static void cleanup_proc_events(void)
+{
+	if (proc_events_fd >= 0) {
+		close(proc_events_fd);
+		proc_events_fd = -1;
+	}
+}
+#else /* __linux__ */
+static int setup_proc_events(void) { return -1; }
+static void cleanup_proc_events(void) { }
+#endif /* __linux__ */
+
+static void free_fw_image(struct fw_image *image)
+{
+	free(image->data);
+	free(image);
+}
+
+static void put_fw_image(struct fw_image *image)
+{
+	image->users--;
+	if (image->transient && !image->users)
+		free_fw_image(image);
+}
+
+static void reap_flash_job(struct flash_job *job)
+{
+	struct flash_job **pprev;
+
+	pthread_join(job->thread, NULL);
+	for (pprev = &flash_jobs; *pprev; pprev = &(*pprev)->next) {
+		if (*pprev == job) {
+			*pprev = job->next;
+			break;
+		}
+	}
+	put_fw_image(job->image);
+	free(job);
+}
+
+static int setup_flash_events(void)
+{
+	if (pipe(flash_event_pipe)) {
+		logerr("Failed to create flash event pipe: %s\n",
+		       strerror(errno));
+		return -1;
+	}
+	/* The write end is nonblocking, too. So progress events
+	 * can be dropped, if the main loop is behind. */
+	fcntl(flash_event_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(flash_event_pipe[1], F_SETFL, O_NONBLOCK);
+	fcntl(flash_event_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(flash_event_pipe[1], F_SETFD, FD_CLOEXEC);
+
+	return 0;
+}
+
+static void cleanup_flash_events(void)
+{
+	struct fw_image *image, *next;
+	struct flash_event ev;
+	ssize_t res;
+
+	/* Wait for the running flash jobs. Aborting a flash
+	 * would leave the device without a firmware. */
+	while (flash_jobs) {
+		res = read(flash_event_pipe[0], &ev, sizeof(ev));
+		if (res != sizeof(ev)) {
+			razer_msleep(10);
+			continue;
+		}
+		if (ev.type == FLASH_EV_FINISHED)
+			reap_flash_job(ev.job);
+	}
+	for (image = fw_images; image; image = next) {
+		next = image->next;
+		free_fw_image(image);
+	}
+	fw_images = NULL;
+	if (flash_event_pipe[0] >= 0) {
+		close(flash_event_pipe[0]);
+		close(flash_event_pipe[1]);
+		flash_event_pipe[0] = flash_event_pipe[1] = -1;
+	}
+}
+
 static int setup_environment(void)
 {
 	int err;
 
+	err = razer_set_transport(cmdargs.transport);
+	if (err) {
+		logerr("Unknown transport \"%s\"\n", cmdargs.transport);
+		return err;
+	}
 	err = razer_init(!cmdargs.no_profile_emu);
 	if (err) {
 		logerr("librazer initialization failed. (%d)\n", err);
@@ -560,6 +1031,11 @@ static int setup_environment(void)
 	razer_set_logging(cmdargs.loglevel >= LOGLEVEL_INFO ? loginfo : NULL,
 			  cmdargs.loglevel >= LOGLEVEL_ERROR ? logerr : NULL,
 			  cmdargs.loglevel >= LOGLEVEL_DEBUG ? logdebug : NULL);
+	err = razer_set_state_cache(cmdargs.statecache);
+	if (err) {
+		logerr("Failed to set the state cache (%d)\n", err);
+		goto err_exit;
+	}
 	err = razer_load_config(cmdargs.configfile);
 	if (cmdargs.configfile && err) {
 		logerr("Failed to load config file %s\n",
@@ -569,9 +1045,15 @@ static int setup_environment(void)
 	err = setup_var_run();
 	if (err)
 		goto err_exit;
+	err = setup_flash_events();
+	if (err)
+		goto err_cleanup_var_run;
+	setup_config_watch();
 
 	return 0;
 
+err_cleanup_var_run:
+	cleanup_var_run();
 err_exit:
 	razer_exit();
 	return err;
@@ -579,6 +1061,9 @@ err_exit:
 
 static void cleanup_environment(void)
 {
+	cleanup_proc_events();
+	cleanup_config_watch();
+	cleanup_flash_events();
 	cleanup_var_run();
 	razer_exit();
 }
@@ -616,6 +1101,7 @@ static void setup_sighandler(void)
 
 static void free_client(struct client *client)
 {
+	free(client->txbuf);
 	free(client);
 }
 
@@ -697,9 +1183,92 @@ static int check_control_socket(int socket_fd, struct client **client_list)
 	return 0;
 }
 
+static void flash_jobs_forget_client(struct client *client)
+{
+	struct flash_job *job;
+
+	for (job = flash_jobs; job; job = job->next) {
+		if (job->client == client)
+			job->client = NULL;
+	}
+}
+
+static struct mouse_handle * lookup_mouse_handle(uint32_t handle)
+{
+	unsigned int slot = handle & 0xFFFF;
+	struct mouse_handle *mh;
+
+	if (slot >= nr_mouse_handles)
+		return NULL;
+	mh = mouse_handles[slot];
+	if (!mh || mh->handle != handle)
+		return NULL;
+
+	return mh;
+}
+
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Drop a CLAIMMOUSE claim. The last release commits the settings. */
+static int release_mouse_claim(struct mouse_handle *mh)
+{
+	mh->claim_owner = NULL;
+
+	return mh->mouse->release(mh->mouse);
+}
+
+/* Release the mice the client claimed with CLAIMMOUSE. */
+static void release_client_claims(struct client *client)
+{
+	struct mouse_handle *mh;
+	unsigned int slot;
+
+	for (slot = 0; slot < nr_mouse_handles; slot++) {
+		mh = mouse_handles[slot];
+		if (mh && mh->claim_owner == client)
+			release_mouse_claim(mh);
+	}
+}
+
+/* Release the claims whose lease ended.
+ * Returns the milliseconds until the next lease ends or -1. */
+static int expire_claims(void)
+{
+	struct mouse_handle *mh;
+	unsigned int slot;
+	uint64_t now, next = 0;
+
+	now = monotonic_ns();
+	for (slot = 0; slot < nr_mouse_handles; slot++) {
+		mh = mouse_handles[slot];
+		if (!mh || !mh->claim_owner)
+			continue;
+		if (mh->claim_expires_ns <= now) {
+			logdebug("Claim lease of %s ended\n", mh->mouse->idstr);
+			release_mouse_claim(mh);
+			continue;
+		}
+		if (!next || mh->claim_expires_ns < next)
+			next = mh->claim_expires_ns;
+	}
+	if (!next)
+		return -1;
+
+	return (int)((next - now + 999999) / 1000000);
+}
+
 static void disconnect_client(struct client **client_list, struct client *client)
 {
 	client_list_del(client_list, client);
+	flash_jobs_forget_client(client);
+	release_client_claims(client);
 	if (client_list == &privileged_clients)
 		logdebug("Privileged client disconnected (fd=%d)\n", client->fd);
 	else
@@ -708,29 +1277,116 @@ static void disconnect_client(struct client **client_list, struct client *client
 	free_client(client);
 }
 
-static int send_reply(struct client *client, struct reply *r, size_t len)
+/* Send as much of a buffer as the socket takes.
+ * Returns the number of bytes sent or a negative error code. */
+static ssize_t send_nonblock(struct client *client, const char *buf, size_t len)
 {
-	const uint8_t *buf = (const uint8_t *)r;
-	int ret;
+	size_t sent = 0;
+	ssize_t ret;
 
-	while (len) {
-		ret = send(client->fd, buf, len, 0);
+	while (sent < len) {
+		ret = send(client->fd, buf + sent, len - sent, 0);
 		if (ret < 0) {
-			if (errno == EAGAIN ||
-			    errno == EINTR) {
-				razer_msleep(1);
+			if (errno == EINTR)
 				continue;
-			}
-			logerr("send() failed: %s", strerror(errno));
+			if (errno == EAGAIN)
+				break;
+			logerr("send() failed: %s\n", strerror(errno));
+			client->dead = 1;
 			return -errno;
 		}
-		len -= ret;
+		sent += (size_t)ret;
+	}
+
+	return (ssize_t)sent;
+}
+
+/* Send a reply. If the socket is full, the rest is queued and
+ * sent by the main loop. A client that does not read its replies
+ * is disconnected, if the queue overflows. */
+static int send_reply(struct client *client, struct reply *r, size_t len)
+{
+	const char *buf = (const char *)r;
+	char *txbuf;
+	ssize_t ret;
+
+	if (client->dead)
+		return -EPIPE;
+	if (!client->txlen) {
+		ret = send_nonblock(client, buf, len);
+		if (ret < 0)
+			return (int)ret;
 		buf += ret;
+		len -= (size_t)ret;
+		if (!len)
+			return 0;
+	}
+	if (client->txlen + len > MAX_CLIENT_TXBUF) {
+		logerr("Client (fd=%d) does not read its replies\n", client->fd);
+		client->dead = 1;
+		return -ENOSPC;
 	}
+	txbuf = realloc(client->txbuf, client->txlen + len);
+	if (!txbuf) {
+		logerr("Out of memory\n");
+		client->dead = 1;
+		return -ENOMEM;
+	}
+	memcpy(txbuf + client->txlen, buf, len);
+	client->txbuf = txbuf;
+	client->txlen += len;
 
 	return 0;
 }
 
+/* Send the queued replies of a client.
+ * Returns -1, if the client must be disconnected. */
+static int flush_client(struct client *client)
+{
+	ssize_t ret;
+
+	if (client->txlen && !client->dead) {
+		ret = send_nonblock(client, client->txbuf, client->txlen);
+		if (ret > 0) {
+			client->txlen -= (size_t)ret;
+			memmove(client->txbuf, client->txbuf + ret, client->txlen);
+		}
+	}
+
+	return client->dead ? -1 : 0;
+}
+
+/* Disconnect the clients that failed while a reply was sent to them. */
+static void reap_dead_clients(struct client **client_list)
+{
+	struct client *client, *next;
+
+	for (client = *client_list; client; client = next) {
+		next = client->next;
+		if (client->dead)
+			disconnect_client(client_list, client);
+	}
+}
+
+/* Add the socket of a client to the select() sets. The commands of a
+ * client are not read, while too many of its replies are queued. */
+static void client_set_fds(struct client *client, fd_set *rdset,
+			   fd_set *wrset, int *maxfd)
+{
+	if (client->fd < 0)
+		return;
+	if (client->fd >= FD_SETSIZE) {
+		logerr("Client fd %d >= FD_SETSIZE (%d), skipping\n",
+		       client->fd, FD_SETSIZE);
+		return;
+	}
+	if (client->txlen <= CLIENT_TXBUF_THRES)
+		FD_SET(client->fd, rdset);
+	if (client->txlen)
+		FD_SET(client->fd, wrset);
+	*maxfd = max(*maxfd, client->fd);
+}
+
 static int send_u32(struct client *client, uint32_t v)
 {
 	struct reply r;
@@ -796,6 +1452,25 @@ static int send_utf16_string(struct client *client, const razer_utf16_t *str)
 	return err;
 }
 
+/* Send the error code of a setter command.
+ * NOREPLY commands get a notification instead, if the command failed
+ * or if the client asked for an acknowledgement. */
+static int send_result(struct client *client, uint32_t errorcode)
+{
+	struct reply r;
+
+	if (!(client->cmdflags & COMMAND_FLG_NOREPLY))
+		return send_u32(client, errorcode);
+	if (errorcode == ERR_NONE && !(client->cmdflags & COMMAND_FLG_ACK))
+		return 0;
+
+	r.hdr.id = NOTIFY_ID_CMDRESULT;
+	r.notify_cmdresult.request_id = cpu_to_be32(client->request_id);
+	r.notify_cmdresult.errorcode = cpu_to_be32(errorcode);
+
+	return send_reply(client, &r, REPLY_SIZE(notify_cmdresult));
+}
+
 static int recv_bulk(struct client *client, char *buf, unsigned int len)
 {
 	unsigned int next_len, i, got;
@@ -836,140 +1511,592 @@ static int recv_bulk(struct client *client, char *buf, unsigned int len)
 	return 0;
 }
 
-struct razer_mouse * find_mouse(const char *idstr)
+static bool flash_jobs_have_mouse(struct flash_job *jobs,
+				  struct razer_mouse *m)
 {
-	struct razer_mouse *m, *next;
+	struct flash_job *job;
+	unsigned int i;
 
-	razer_for_each_mouse(m, next, mice) {
-		if (strncmp(m->idstr, idstr, RAZER_IDSTR_MAX_SIZE) == 0)
-			return m;
+	for (job = jobs; job; job = job->next) {
+		for (i = 0; i < job->nr_targets; i++) {
+			if (job->targets[i].mouse == m)
+				return 1;
+		}
 	}
 
-	return NULL;
+	return 0;
 }
 
-static struct razer_mouse_profile * find_mouse_profile(struct razer_mouse *mouse,
-						       unsigned int profile_id)
+static bool mouse_is_flashing(struct razer_mouse *m)
 {
-	struct razer_mouse_profile *list;
-	unsigned int i;
+	return flash_jobs_have_mouse(flash_jobs, m);
+}
 
-	if (!mouse->get_profiles)
-		return NULL;
-	list = mouse->get_profiles(mouse);
-	if (!list)
-		return NULL;
-	for (i = 0; i < mouse->nr_profiles; i++) {
-		if (list[i].nr == profile_id)
-			return &list[i];
+/* Mice that are being flashed are owned by the flash thread
+ * and can not be found until the flash finished. */
+static struct razer_mouse * find_mouse_idstr(const char *idstr)
+{
+	struct razer_mouse *m, *next;
+
+	razer_for_each_mouse(m, next, mice) {
+		if (strncmp(m->idstr, idstr, RAZER_IDSTR_MAX_SIZE) == 0)
+			return mouse_is_flashing(m) ? NULL : m;
 	}
 
 	return NULL;
 }
 
-static struct razer_axis * find_mouse_axis(struct razer_mouse *mouse,
-					   unsigned int axis_id)
+/* Build a table that maps the IDs of a driver list to the list entries.
+ * id_offset is the offset of the unsigned int ID in an entry. */
+static void id_table_init(struct id_table *t, void *list, int count,
+			  size_t entry_size, size_t id_offset)
 {
-	struct razer_axis *list;
-	int i, count;
+	unsigned int id, size = 0;
+	int i;
 
-	if (!mouse->supported_axes)
-		return NULL;
-	count = mouse->supported_axes(mouse, &list);
-	if (count <= 0)
-		return NULL;
+	t->entries = NULL;
+	t->size = 0;
 	for (i = 0; i < count; i++) {
-		if (list[i].id == axis_id)
-			return &list[i];
+		memcpy(&id, (char *)list + i * entry_size + id_offset, sizeof(id));
+		if (id >= MAX_ID_TABLE_SIZE) {
+			logerr("ID %u too big for the lookup table\n", id);
+			continue;
+		}
+		size = max(size, id + 1);
 	}
+	if (!size)
+		return;
+	t->entries = calloc(size, sizeof(*t->entries));
+	if (!t->entries) {
+		logerr("Out of memory\n");
+		return;
+	}
+	t->size = size;
+	for (i = 0; i < count; i++) {
+		memcpy(&id, (char *)list + i * entry_size + id_offset, sizeof(id));
+		if (id < size)
+			t->entries[id] = (char *)list + i * entry_size;
+	}
+}
 
-	return NULL;
+static void * id_table_lookup(const struct id_table *t, uint32_t id)
+{
+	if (id >= t->size)
+		return NULL;
+	return t->entries[id];
 }
 
-static struct razer_mouse_dpimapping * find_mouse_dpimapping(struct razer_mouse *mouse,
-							     unsigned int mapping_id)
+static void add_mouse_handle(struct razer_mouse *m)
 {
-	struct razer_mouse_dpimapping *list;
-	int i, count;
+	struct mouse_handle *mh, **table;
+	struct razer_mouse_profile *profiles;
+	struct razer_axis *axes;
+	struct razer_mouse_dpimapping *mappings;
+	struct razer_button *buttons;
+	struct razer_button_function *functions;
+	unsigned int slot;
+	int count;
 
-	if (!mouse->supported_dpimappings)
-		return NULL;
-	count = mouse->supported_dpimappings(mouse, &list);
-	if (count <= 0)
-		return NULL;
-	for (i = 0; i < count; i++) {
-		if (list[i].nr == mapping_id)
-			return &list[i];
+	for (slot = 0; slot < nr_mouse_handles; slot++) {
+		if (!mouse_handles[slot])
+			break;
+	}
+	if (slot >= MAX_MOUSE_HANDLES) {
+		logerr("Too many mice\n");
+		return;
+	}
+	if (slot >= nr_mouse_handles) {
+		table = realloc(mouse_handles, (slot + 1) * sizeof(*table));
+		if (!table)
+			goto err_nomem;
+		mouse_handles = table;
+		mouse_handles[slot] = NULL;
+		nr_mouse_handles = slot + 1;
 	}
+	mh = calloc(1, sizeof(*mh));
+	if (!mh)
+		goto err_nomem;
+
+	mouse_handle_generation++;
+	if (!mouse_handle_generation)
+		mouse_handle_generation++;
+	mh->handle = ((uint32_t)mouse_handle_generation << 16) | slot;
+	mh->mouse = m;
+	if (m->nr_profiles && m->get_profiles) {
+		profiles = m->get_profiles(m);
+		if (profiles)
+			id_table_init(&mh->profiles, profiles, m->nr_profiles,
+				      sizeof(*profiles),
+				      offsetof(struct razer_mouse_profile, nr));
+	}
+	if (m->supported_axes) {
+		count = m->supported_axes(m, &axes);
+		id_table_init(&mh->axes, axes, count, sizeof(*axes),
+			      offsetof(struct razer_axis, id));
+	}
+	if (m->supported_dpimappings) {
+		count = m->supported_dpimappings(m, &mappings);
+		id_table_init(&mh->dpimappings, mappings, count, sizeof(*mappings),
+			      offsetof(struct razer_mouse_dpimapping, nr));
+	}
+	if (m->supported_buttons) {
+		count = m->supported_buttons(m, &buttons);
+		id_table_init(&mh->buttons, buttons, count, sizeof(*buttons),
+			      offsetof(struct razer_button, id));
+	}
+	if (m->supported_button_functions) {
+		count = m->supported_button_functions(m, &functions);
+		id_table_init(&mh->button_functions, functions, count,
+			      sizeof(*functions),
+			      offsetof(struct razer_button_function, id));
+	}
+	mouse_handles[slot] = mh;
 
-	return NULL;
+	return;
+err_nomem:
+	logerr("Out of memory\n");
 }
 
-static struct razer_button * find_mouse_button(struct razer_mouse *mouse,
-					       unsigned int button_id)
+static void del_mouse_handle(struct razer_mouse *m)
 {
-	struct razer_button *list;
-	int i, count;
+	struct mouse_handle *mh;
+	unsigned int slot;
+
+	for (slot = 0; slot < nr_mouse_handles; slot++) {
+		mh = mouse_handles[slot];
+		if (mh && mh->mouse == m) {
+			free(mh->profiles.entries);
+			free(mh->axes.entries);
+			free(mh->dpimappings.entries);
+			free(mh->buttons.entries);
+			free(mh->button_functions.entries);
+			razer_free_appprofile_rules(mh->app_rules);
+			free(mh);
+			mouse_handles[slot] = NULL;
+			break;
+		}
+	}
+}
+
+/* Find the mouse addressed by a command. */
+static struct mouse_handle * find_mouse(const struct command *cmd)
+{
+	struct mouse_handle *mh;
 
-	if (!mouse->supported_buttons)
+	mh = lookup_mouse_handle(be32_to_cpu(cmd->hdr.handle));
+	if (!mh)
 		return NULL;
-	count = mouse->supported_buttons(mouse, &list);
-	if (count <= 0)
+
+	return mouse_is_flashing(mh->mouse) ? NULL : mh;
+}
+
+/* Find a mouse for a command that reads the driver state.
+ * The background configuration changes the state without a lock,
+ * so it can not be read until NOTIFY_ID_MOUSECONFIGURED was sent. */
+static struct mouse_handle * find_configured_mouse(const struct command *cmd)
+{
+	struct mouse_handle *mh;
+
+	mh = find_mouse(cmd);
+	if (!mh || razer_mouse_is_configuring(mh->mouse))
 		return NULL;
-	for (i = 0; i < count; i++) {
-		if (list[i].id == button_id)
-			return &list[i];
+
+	return mh;
+}
+
+static struct razer_mouse_profile * find_mouse_profile(struct mouse_handle *mh,
+						       unsigned int profile_id)
+{
+	return id_table_lookup(&mh->profiles, profile_id);
+}
+
+static struct razer_axis * find_mouse_axis(struct mouse_handle *mh,
+					   unsigned int axis_id)
+{
+	return id_table_lookup(&mh->axes, axis_id);
+}
+
+static struct razer_mouse_dpimapping * find_mouse_dpimapping(struct mouse_handle *mh,
+							     unsigned int mapping_id)
+{
+	return id_table_lookup(&mh->dpimappings, mapping_id);
+}
+
+static struct razer_button * find_mouse_button(struct mouse_handle *mh,
+					       unsigned int button_id)
+{
+	return id_table_lookup(&mh->buttons, button_id);
+}
+
+static struct razer_button_function * find_mouse_button_function(struct mouse_handle *mh,
+								 unsigned int function_id)
+{
+	return id_table_lookup(&mh->button_functions, function_id);
+}
+
+/* Reload the application profile rules of all mice.
+ * The process events are only watched, while there are rules. */
+static void update_app_rules(void)
+{
+	struct mouse_handle *mh;
+	unsigned int i;
+	int count;
+
+	app_rules_pending = 0;
+	nr_app_rules = 0;
+	for (i = 0; i < nr_mouse_handles; i++) {
+		mh = mouse_handles[i];
+		if (!mh)
+			continue;
+		razer_free_appprofile_rules(mh->app_rules);
+		count = razer_get_appprofile_rules(mh->mouse, &mh->app_rules);
+		if (count > 0)
+			nr_app_rules += (unsigned int)count;
 	}
+	if (nr_app_rules && proc_events_fd < 0)
+		setup_proc_events();
+	else if (!nr_app_rules && proc_events_fd >= 0)
+		cleanup_proc_events();
+}
 
-	return NULL;
+#ifdef __linux__
+
+/* Select a profile for an application and commit it.
+ * timestamp_ns is the time of the process event. */
+static void switch_app_profile(struct mouse_handle *mh, unsigned int profile_id,
+			       uint64_t timestamp_ns)
+{
+	struct razer_mouse *mouse = mh->mouse;
+	struct razer_mouse_profile *profile;
+	uint64_t now_ns, usec = 0;
+	int err, rel_err;
+
+	profile = find_mouse_profile(mh, profile_id);
+	if (!profile || !mouse->get_active_profile || !mouse->set_active_profile) {
+		logerr("Application profile %u not found on %s\n",
+		       profile_id + 1, mouse->idstr);
+		return;
+	}
+	if (mouse_is_flashing(mouse))
+		return;
+	if (mouse->get_active_profile(mouse) == profile)
+		return;
+	err = mouse->claim(mouse);
+	if (err) {
+		logerr("Failed to claim %s\n", mouse->idstr);
+		return;
+	}
+	err = mouse->set_active_profile(mouse, profile);
+	rel_err = mouse->release(mouse);
+	if (err || rel_err) {
+		logerr("Failed to select application profile %u on %s\n",
+		       profile_id + 1, mouse->idstr);
+		return;
+	}
+
+	now_ns = monotonic_ns();
+	if (now_ns > timestamp_ns)
+		usec = min((now_ns - timestamp_ns) / 1000, (uint64_t)UINT32_MAX);
+	app_switch_stats.nr_switches++;
+	app_switch_stats.last_usec = (uint32_t)usec;
+	app_switch_stats.max_usec = max(app_switch_stats.max_usec, (uint32_t)usec);
+	app_switch_stats.total_usec += usec;
+	logdebug("Selected application profile %u on %s in %u usec\n",
+		 profile_id + 1, mouse->idstr, (unsigned int)usec);
 }
 
-static struct razer_button_function * find_mouse_button_function(struct razer_mouse *mouse,
-								 unsigned int button_id)
+static void start_app_session(struct mouse_handle *mh, pid_t pid,
+			      unsigned int profile_id, uint64_t timestamp_ns)
 {
-	struct razer_button_function *list;
-	int i, count;
+	struct razer_mouse_profile *active;
+	unsigned int i;
 
-	if (!mouse->supported_button_functions)
-		return NULL;
-	count = mouse->supported_button_functions(mouse, &list);
-	if (count <= 0)
-		return NULL;
-	for (i = 0; i < count; i++) {
-		if (list[i].id == button_id)
-			return &list[i];
+	for (i = 0; i < mh->nr_apps; i++) {
+		if (mh->apps[i].pid != pid)
+			continue;
+		/* A tracked process called exec() again and still matches. */
+		if (mh->apps[i].profile == profile_id)
+			return;
+		mh->apps[i].profile = profile_id;
+		if (i == mh->nr_apps - 1)
+			switch_app_profile(mh, profile_id, timestamp_ns);
+		return;
+	}
+	if (!mh->nr_apps) {
+		if (!mh->mouse->get_active_profile)
+			return;
+		active = mh->mouse->get_active_profile(mh->mouse);
+		if (!active)
+			return;
+		mh->app_restore_profile = active->nr;
 	}
+	if (mh->nr_apps >= ARRAY_SIZE(mh->apps)) {
+		/* Forget the oldest application. */
+		memmove(&mh->apps[0], &mh->apps[1],
+			(mh->nr_apps - 1) * sizeof(mh->apps[0]));
+		mh->nr_apps--;
+	}
+	mh->apps[mh->nr_apps].pid = pid;
+	mh->apps[mh->nr_apps].profile = profile_id;
+	mh->nr_apps++;
+	switch_app_profile(mh, profile_id, timestamp_ns);
+}
 
-	return NULL;
+/* The application exited. Select the profile of the newest remaining
+ * application or the profile that was active before the first one. */
+static void end_app_session(struct mouse_handle *mh, pid_t pid,
+			    uint64_t timestamp_ns)
+{
+	unsigned int i, profile_id;
+
+	for (i = 0; i < mh->nr_apps; i++) {
+		if (mh->apps[i].pid == pid)
+			break;
+	}
+	if (i >= mh->nr_apps)
+		return;
+	memmove(&mh->apps[i], &mh->apps[i + 1],
+		(mh->nr_apps - i - 1) * sizeof(mh->apps[0]));
+	mh->nr_apps--;
+	if (i < mh->nr_apps)
+		return; /* Not the newest one. The profile stays. */
+	if (mh->nr_apps)
+		profile_id = mh->apps[mh->nr_apps - 1].profile;
+	else
+		profile_id = mh->app_restore_profile;
+	switch_app_profile(mh, profile_id, timestamp_ns);
+}
+
+/* Get the file name of the executable of a process. */
+static void read_proc_exe(pid_t pid, char *buf, size_t size)
+{
+	char path[64], exe[PATH_MAX];
+	const char *name;
+	ssize_t len;
+
+	buf[0] = '\0';
+	snprintf(path, sizeof(path), "/proc/%d/exe", (int)pid);
+	len = readlink(path, exe, sizeof(exe) - 1);
+	if (len <= 0)
+		return;
+	exe[len] = '\0';
+	name = strrchr(exe, '/');
+	razer_strlcpy(buf, name ? name + 1 : exe, size);
+}
+
+/* Get the contents of /proc/PID/cgroup. */
+static void read_proc_cgroups(pid_t pid, char *buf, size_t size)
+{
+	char path[64];
+	ssize_t len;
+	int fd;
+
+	buf[0] = '\0';
+	snprintf(path, sizeof(path), "/proc/%d/cgroup", (int)pid);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len > 0)
+		buf[len] = '\0';
+}
+
+/* Match the cgroup paths of the lines "ID:CONTROLLERS:PATH". */
+static bool match_proc_cgroups(const char *pattern, const char *cgroups)
+{
+	const char *line, *end, *path;
+	char buf[PATH_MAX];
+	size_t len;
+
+	for (line = cgroups; *line; line = *end ? end + 1 : end) {
+		end = strchrnul(line, '\n');
+		path = memchr(line, ':', (size_t)(end - line));
+		if (path)
+			path = memchr(path + 1, ':', (size_t)(end - path - 1));
+		if (!path)
+			continue;
+		path++;
+		len = (size_t)(end - path);
+		if (len >= sizeof(buf))
+			continue;
+		memcpy(buf, path, len);
+		buf[len] = '\0';
+		if (fnmatch(pattern, buf, 0) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void handle_app_exec(pid_t pid, uint64_t timestamp_ns)
+{
+	struct mouse_handle *mh;
+	struct razer_appprofile_rule *rule;
+	char exe[NAME_MAX + 1], cgroups[4096];
+	bool have_exe = 0, have_cgroups = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr_mouse_handles; i++) {
+		mh = mouse_handles[i];
+		if (!mh)
+			continue;
+		/* The first matching rule of a mouse wins. */
+		for (rule = mh->app_rules; rule; rule = rule->next) {
+			if (rule->match == RAZER_APPPROFILE_EXE) {
+				if (!have_exe) {
+					read_proc_exe(pid, exe, sizeof(exe));
+					have_exe = 1;
+				}
+				if (exe[0] && fnmatch(rule->pattern, exe, 0) == 0)
+					break;
+			} else {
+				if (!have_cgroups) {
+					read_proc_cgroups(pid, cgroups, sizeof(cgroups));
+					have_cgroups = 1;
+				}
+				if (match_proc_cgroups(rule->pattern, cgroups))
+					break;
+			}
+		}
+		if (rule)
+			start_app_session(mh, pid, rule->profile, timestamp_ns);
+		else if (mh->nr_apps) {
+			/* A tracked process that called exec() might
+			 * not match anymore. */
+			end_app_session(mh, pid, timestamp_ns);
+		}
+	}
+}
+
+static void handle_app_exit(pid_t pid, uint64_t timestamp_ns)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_mouse_handles; i++) {
+		if (mouse_handles[i] && mouse_handles[i]->nr_apps)
+			end_app_session(mouse_handles[i], pid, timestamp_ns);
+	}
+}
+
+/* Process events were lost. End the sessions of the exited applications. */
+static void prune_app_sessions(void)
+{
+	struct mouse_handle *mh;
+	unsigned int i, j;
+
+	for (i = 0; i < nr_mouse_handles; i++) {
+		mh = mouse_handles[i];
+		if (!mh)
+			continue;
+		for (j = mh->nr_apps; j > 0; j--) {
+			if (kill(mh->apps[j - 1].pid, 0) && errno == ESRCH)
+				end_app_session(mh, mh->apps[j - 1].pid, monotonic_ns());
+		}
+	}
+}
+
+static int check_proc_events(void)
+{
+	union {
+		struct nlmsghdr hdr;
+		char buf[4096];
+	} msg;
+	const struct nlmsghdr *nl;
+	const struct cn_msg *cn;
+	const struct proc_event *ev;
+	ssize_t res;
+	size_t len;
+
+	if (proc_events_fd < 0)
+		return 0;
+	while (1) {
+		res = recv(proc_events_fd, &msg, sizeof(msg), 0);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+			if (errno == ENOBUFS) {
+				logerr("Lost process events\n");
+				prune_app_sessions();
+				continue;
+			}
+			logerr("Failed to receive process events: %s\n",
+			       strerror(errno));
+			return -1;
+		}
+		len = (size_t)res;
+		for (nl = &msg.hdr;
+		     len >= sizeof(*nl) && nl->nlmsg_len >= sizeof(*nl) &&
+		     nl->nlmsg_len <= len;
+		     len -= min(len, (size_t)NLMSG_ALIGN(nl->nlmsg_len)),
+		     nl = (const struct nlmsghdr *)((const char *)nl + NLMSG_ALIGN(nl->nlmsg_len))) {
+			if (nl->nlmsg_len < NLMSG_LENGTH(sizeof(*cn) + sizeof(*ev)))
+				continue;
+			cn = NLMSG_DATA(nl);
+			if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC)
+				continue;
+			ev = (const struct proc_event *)cn->data;
+			switch (ev->what) {
+			case PROC_EVENT_EXEC:
+				handle_app_exec(ev->event_data.exec.process_tgid,
+						ev->timestamp_ns);
+				break;
+			case PROC_EVENT_EXIT:
+				/* Only the exit of the whole process. */
+				if (ev->event_data.exit.process_pid ==
+				    ev->event_data.exit.process_tgid)
+					handle_app_exit(ev->event_data.exit.process_tgid,
+							ev->timestamp_ns);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	return 0;
 }
+#else /* __linux__ */
+static int check_proc_events(void) { return 0; }
+#endif /* __linux__ */
 
 static void command_getmice(struct client *client, const struct command *cmd, unsigned int len)
 {
-	unsigned int count;
+	unsigned int i, count;
 	char str[RAZER_IDSTR_MAX_SIZE + 1];
-	struct razer_mouse *mouse, *next;
+	struct mouse_handle *mh;
 
 	count = 0;
-	razer_for_each_mouse(mouse, next, mice)
-		count++;
+	for (i = 0; i < nr_mouse_handles; i++) {
+		if (mouse_handles[i])
+			count++;
+	}
 	send_u32(client, count);
-	razer_for_each_mouse(mouse, next, mice) {
-		snprintf(str, sizeof(str), "%s", mouse->idstr);
+	for (i = 0; i < nr_mouse_handles; i++) {
+		mh = mouse_handles[i];
+		if (!mh)
+			continue;
+		send_u32(client, mh->handle);
+		snprintf(str, sizeof(str), "%s", mh->mouse->idstr);
 		send_string(client, str);
 	}
 }
 
 static void command_getfwver(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	uint32_t fwver = 0xFFFFFFFF;
 	int err;
 
 	if (len < CMD_SIZE(getfwver))
 		goto out;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse || !mouse->get_fw_version)
+	mh = find_configured_mouse(cmd);
+	if (!mh || !mh->mouse->get_fw_version)
 		goto out;
+	mouse = mh->mouse;
 	err = mouse->claim(mouse);
 	if (err)
 		goto out;
@@ -981,6 +2108,7 @@ out:
 
 static void command_getfreq(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_profile *profile;
 	enum razer_mouse_freq freq;
@@ -988,16 +2116,17 @@ static void command_getfreq(struct client *client, const struct command *cmd, un
 
 	if (len < CMD_SIZE(getfreq))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse)
+	mh = find_configured_mouse(cmd);
+	if (!mh)
 		goto error;
+	mouse = mh->mouse;
 	profile_id = be32_to_cpu(cmd->getfreq.profile_id);
 	if (profile_id == PROFILE_INVALID) {
 		if (!mouse->global_get_freq)
 			goto error;
 		freq = mouse->global_get_freq(mouse);
 	} else {
-		profile = find_mouse_profile(mouse, profile_id);
+		profile = find_mouse_profile(mh, profile_id);
 		if (!profile || !profile->get_freq)
 			goto error;
 		freq = profile->get_freq(profile);
@@ -1012,15 +2141,17 @@ error:
 
 static void command_suppfreqs(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
-	enum razer_mouse_freq *freq_list;
+	const enum razer_mouse_freq *freq_list;
 	int i, count;
 
 	if (len < CMD_SIZE(suppfreqs))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse || !mouse->supported_freqs)
+	mh = find_mouse(cmd);
+	if (!mh || !mh->mouse->supported_freqs)
 		goto error;
+	mouse = mh->mouse;
 	count = mouse->supported_freqs(mouse, &freq_list);
 	if (count <= 0)
 		goto error;
@@ -1028,7 +2159,6 @@ static void command_suppfreqs(struct client *client, const struct command *cmd,
 	send_u32(client, count);
 	for (i = 0; i < count; i++)
 		send_u32(client, freq_list[i]);
-	razer_free_freq_list(freq_list, count);
 
 	return;
 error:
@@ -1038,15 +2168,17 @@ error:
 
 static void command_suppresol(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
-	enum razer_mouse_res *res_list;
+	const enum razer_mouse_res *res_list;
 	int i, count;
 
 	if (len < CMD_SIZE(suppresol))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse || !mouse->supported_resolutions)
+	mh = find_mouse(cmd);
+	if (!mh || !mh->mouse->supported_resolutions)
 		goto error;
+	mouse = mh->mouse;
 	count = mouse->supported_resolutions(mouse, &res_list);
 	if (count <= 0)
 		goto error;
@@ -1054,7 +2186,6 @@ static void command_suppresol(struct client *client, const struct command *cmd,
 	send_u32(client, count);
 	for (i = 0; i < count; i++)
 		send_u32(client, res_list[i]);
-	razer_free_resolution_list(res_list, count);
 
 	return;
 error:
@@ -1064,15 +2195,17 @@ error:
 
 static void command_suppdpimappings(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_dpimapping *list;
 	int i, j, count;
 
 	if (len < CMD_SIZE(suppdpimappings))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse || !mouse->supported_dpimappings)
+	mh = find_mouse(cmd);
+	if (!mh || !mh->mouse->supported_dpimappings)
 		goto error;
+	mouse = mh->mouse;
 	count = mouse->supported_dpimappings(mouse, &list);
 	if (count <= 0)
 		goto error;
@@ -1097,6 +2230,7 @@ error:
 
 static void command_changedpimapping(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_dpimapping *mapping;
 	int err;
@@ -1106,12 +2240,13 @@ static void command_changedpimapping(struct client *client, const struct command
 		errorcode = ERR_CMDSIZE;
 		goto error;
 	}
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse) {
+	mh = find_mouse(cmd);
+	if (!mh) {
 		errorcode = ERR_NOMOUSE;
 		goto error;
 	}
-	mapping = find_mouse_dpimapping(mouse, be32_to_cpu(cmd->changedpimapping.id));
+	mouse = mh->mouse;
+	mapping = find_mouse_dpimapping(mh, be32_to_cpu(cmd->changedpimapping.id));
 	if (!mapping || !mapping->change) {
 		errorcode = ERR_FAIL;
 		goto error;
@@ -1130,25 +2265,25 @@ static void command_changedpimapping(struct client *client, const struct command
 	mouse->release(mouse);
 
 error:
-	send_u32(client, errorcode);
+	send_result(client, errorcode);
 }
 
 static void command_getdpimapping(struct client *client, const struct command *cmd, unsigned int len)
 {
-	struct razer_mouse *mouse;
+	struct mouse_handle *mh;
 	struct razer_mouse_profile *profile;
 	struct razer_axis *axis;
 	struct razer_mouse_dpimapping *mapping;
 
 	if (len < CMD_SIZE(getdpimapping))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse)
+	mh = find_configured_mouse(cmd);
+	if (!mh)
 		goto error;
-	profile = find_mouse_profile(mouse, be32_to_cpu(cmd->getdpimapping.profile_id));
+	profile = find_mouse_profile(mh, be32_to_cpu(cmd->getdpimapping.profile_id));
 	if (!profile)
 		goto error;
-	axis = find_mouse_axis(mouse, be32_to_cpu(cmd->getdpimapping.axis_id));
+	axis = find_mouse_axis(mh, be32_to_cpu(cmd->getdpimapping.axis_id));
 	mapping = profile->get_dpimapping(profile, axis);
 	if (!mapping)
 		goto error;
@@ -1162,6 +2297,7 @@ error:
 
 static void command_setdpimapping(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_profile *profile;
 	struct razer_axis *axis;
@@ -1173,18 +2309,19 @@ static void command_setdpimapping(struct client *client, const struct command *c
 		errorcode = ERR_CMDSIZE;
 		goto error;
 	}
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse) {
+	mh = find_mouse(cmd);
+	if (!mh) {
 		errorcode = ERR_NOMOUSE;
 		goto error;
 	}
-	profile = find_mouse_profile(mouse, be32_to_cpu(cmd->setdpimapping.profile_id));
+	mouse = mh->mouse;
+	profile = find_mouse_profile(mh, be32_to_cpu(cmd->setdpimapping.profile_id));
 	if (!profile || !profile->set_dpimapping) {
 		errorcode = ERR_FAIL;
 		goto error;
 	}
-	axis = find_mouse_axis(mouse, be32_to_cpu(cmd->setdpimapping.axis_id));
-	mapping = find_mouse_dpimapping(mouse, be32_to_cpu(cmd->setdpimapping.mapping_id));
+	axis = find_mouse_axis(mh, be32_to_cpu(cmd->setdpimapping.axis_id));
+	mapping = find_mouse_dpimapping(mh, be32_to_cpu(cmd->setdpimapping.mapping_id));
 	if (!mapping) {
 		errorcode = ERR_FAIL;
 		goto error;
@@ -1203,46 +2340,50 @@ static void command_setdpimapping(struct client *client, const struct command *c
 	}
 
 error:
-	send_u32(client, errorcode);
+	send_result(client, errorcode);
 }
 
 static void command_rescanmice(struct client *client, const struct command *cmd, unsigned int len)
 {
+	if (flash_jobs) {
+		rescan_pending = 1;
+		return;
+	}
 	mice = razer_rescan_mice();
 }
 
 static void command_reconfigmice(struct client *client, const struct command *cmd, unsigned int len)
 {
+	if (flash_jobs) {
+		reconfig_pending = 1;
+		return;
+	}
 	razer_reconfig_mice();
 }
 
 static void command_getmouseinfo(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
-	struct razer_mouse_profile *profiles;
 	unsigned int flags;
 
 	if (len < CMD_SIZE(getmouseinfo))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse)
+	mh = find_mouse(cmd);
+	if (!mh)
 		goto error;
+	mouse = mh->mouse;
 	flags = MOUSEINFOFLG_RESULTOK;
-	if (mouse->global_get_leds)
+	if (razer_mouse_has_caps(mouse, RAZER_MOUSECAP_GLOBAL_LEDS))
 		flags |= MOUSEINFOFLG_GLOBAL_LEDS;
-	if (mouse->global_get_freq)
+	if (razer_mouse_has_caps(mouse, RAZER_MOUSECAP_GLOBAL_FREQ))
 		flags |= MOUSEINFOFLG_GLOBAL_FREQ;
-	if (mouse->nr_profiles && mouse->get_profiles) {
-		profiles = mouse->get_profiles(mouse);
-		if (profiles) {
-			if (profiles[0].get_leds)
-				flags |= MOUSEINFOFLG_PROFILE_LEDS;
-			if (profiles[0].get_freq)
-				flags |= MOUSEINFOFLG_PROFILE_FREQ;
-			if (profiles[0].set_name)
-				flags |= MOUSEINFOFLG_PROFNAMEMUTABLE;
-		}
-	}
+	if (razer_mouse_has_caps(mouse, RAZER_MOUSECAP_PROFILE_LEDS))
+		flags |= MOUSEINFOFLG_PROFILE_LEDS;
+	if (razer_mouse_has_caps(mouse, RAZER_MOUSECAP_PROFILE_FREQ))
+		flags |= MOUSEINFOFLG_PROFILE_FREQ;
+	if (razer_mouse_has_caps(mouse, RAZER_MOUSECAP_PROFNAME_MUTABLE))
+		flags |= MOUSEINFOFLG_PROFNAMEMUTABLE;
 	if (mouse->flags & RAZER_MOUSEFLG_SUGGESTFWUP)
 		flags |= MOUSEINFOFLG_SUGGESTFWUP;
 	send_u32(client, flags);
@@ -1254,6 +2395,7 @@ error:
 
 static void command_getleds(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_profile *profile;
 	struct razer_led *leds_list, *led;
@@ -1262,16 +2404,17 @@ static void command_getleds(struct client *client, const struct command *cmd, un
 
 	if (len < CMD_SIZE(getleds))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse)
+	mh = find_configured_mouse(cmd);
+	if (!mh)
 		goto error;
+	mouse = mh->mouse;
 	profile_id = be32_to_cpu(cmd->getleds.profile_id);
 	if (profile_id == PROFILE_INVALID) {
 		if (!mouse->global_get_leds)
 			goto error;
 		count = mouse->global_get_leds(mouse, &leds_list);
 	} else {
-		profile = find_mouse_profile(mouse, profile_id);
+		profile = find_mouse_profile(mh, profile_id);
 		if (!profile)
 			goto error;
 		if (!profile->get_leds)
@@ -1320,6 +2463,7 @@ static struct razer_led * razer_mouse_find_led(struct razer_led *leds_list,
 
 static void command_setled(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_profile *profile;
 	struct razer_led *leds_list = NULL, *led;
@@ -1334,11 +2478,12 @@ static void command_setled(struct client *client, const struct command *cmd, uns
 		errorcode = ERR_CMDSIZE;
 		goto error;
 	}
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse) {
+	mh = find_mouse(cmd);
+	if (!mh) {
 		errorcode = ERR_NOMOUSE;
 		goto error;
 	}
+	mouse = mh->mouse;
 	profile_id = be32_to_cpu(cmd->setled.profile_id);
 	if (profile_id == PROFILE_INVALID) {
 		if (!mouse->global_get_leds) {
@@ -1347,7 +2492,7 @@ static void command_setled(struct client *client, const struct command *cmd, uns
 		}
 		count = mouse->global_get_leds(mouse, &leds_list);
 	} else {
-		profile = find_mouse_profile(mouse, profile_id);
+		profile = find_mouse_profile(mh, profile_id);
 		if (!profile) {
 			errorcode = ERR_NOLED;
 			goto error;
@@ -1415,11 +2560,12 @@ static void command_setled(struct client *client, const struct command *cmd, uns
 
 error:
 	razer_free_leds(leds_list);
-	send_u32(client, errorcode);
+	send_result(client, errorcode);
 }
 
 static void command_setfreq(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_profile *profile = NULL;
 	int err;
@@ -1430,11 +2576,12 @@ static void command_setfreq(struct client *client, const struct command *cmd, un
 		errorcode = ERR_CMDSIZE;
 		goto error;
 	}
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse) {
+	mh = find_mouse(cmd);
+	if (!mh) {
 		errorcode = ERR_NOMOUSE;
 		goto error;
 	}
+	mouse = mh->mouse;
 	profile_id = be32_to_cpu(cmd->setfreq.profile_id);
 	if (profile_id == PROFILE_INVALID) {
 		if (!mouse->global_set_freq) {
@@ -1442,7 +2589,7 @@ static void command_setfreq(struct client *client, const struct command *cmd, un
 			goto error;
 		}
 	} else {
-		profile = find_mouse_profile(mouse, profile_id);
+		profile = find_mouse_profile(mh, profile_id);
 		if (!profile) {
 			errorcode = ERR_FAIL;
 			goto error;
@@ -1472,20 +2619,22 @@ static void command_setfreq(struct client *client, const struct command *cmd, un
 	}
 
 error:
-	send_u32(client, errorcode);
+	send_result(client, errorcode);
 }
 
 static void command_getprofiles(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_profile *list;
 	unsigned int i;
 
 	if (len < CMD_SIZE(getprofiles))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse)
+	mh = find_mouse(cmd);
+	if (!mh)
 		goto error;
+	mouse = mh->mouse;
 	list = mouse->get_profiles(mouse);
 	if (!list)
 		goto error;
@@ -1501,7 +2650,7 @@ error:
 
 static void command_getprofname(struct client *client, const struct command *cmd, unsigned int len)
 {
-	struct razer_mouse *mouse;
+	struct mouse_handle *mh;
 	struct razer_mouse_profile *profile;
 	const razer_utf16_t *name;
 	razer_utf16_t namebuf[64] = { };
@@ -1509,10 +2658,10 @@ static void command_getprofname(struct client *client, const struct command *cmd
 
 	if (len < CMD_SIZE(getprofname))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse)
+	mh = find_configured_mouse(cmd);
+	if (!mh)
 		goto error;
-	profile = find_mouse_profile(mouse, be32_to_cpu(cmd->getprofname.profile_id));
+	profile = find_mouse_profile(mh, be32_to_cpu(cmd->getprofname.profile_id));
 	if (!profile)
 		goto error;
 	if (profile->get_name) {
@@ -1534,7 +2683,7 @@ error:
 
 static void command_setprofname(struct client *client, const struct command *cmd, unsigned int len)
 {
-	struct razer_mouse *mouse;
+	struct mouse_handle *mh;
 	struct razer_mouse_profile *profile;
 	razer_utf16_t namebuf[sizeof(cmd->setprofname.utf16be_name) / 2 + 1] = { };
 	unsigned int i;
@@ -1545,12 +2694,12 @@ static void command_setprofname(struct client *client, const struct command *cmd
 		errorcode = ERR_CMDSIZE;
 		goto error;
 	}
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse) {
+	mh = find_mouse(cmd);
+	if (!mh) {
 		errorcode = ERR_NOMOUSE;
 		goto error;
 	}
-	profile = find_mouse_profile(mouse, be32_to_cpu(cmd->setprofname.profile_id));
+	profile = find_mouse_profile(mh, be32_to_cpu(cmd->setprofname.profile_id));
 	if (!profile) {
 		errorcode = ERR_FAIL;
 		goto error;
@@ -1569,19 +2718,94 @@ static void command_setprofname(struct client *client, const struct command *cmd
 	}
 
 error:
-	send_u32(client, errorcode);
+	send_result(client, errorcode);
+}
+
+static void command_claimmouse(struct client *client, const struct command *cmd, unsigned int len)
+{
+	struct mouse_handle *mh;
+	uint32_t errorcode = ERR_NONE;
+
+	if (len < CMD_SIZE(claimmouse)) {
+		errorcode = ERR_CMDSIZE;
+		goto error;
+	}
+	mh = find_mouse(cmd);
+	if (!mh) {
+		errorcode = ERR_NOMOUSE;
+		goto error;
+	}
+	if (mh->claim_owner != client) {
+		if (mh->mouse->claim(mh->mouse)) {
+			errorcode = ERR_CLAIM;
+			goto error;
+		}
+		mh->claim_owner = client;
+	}
+	/* A repeated claim by the owner renews the lease. */
+	mh->claim_expires_ns = monotonic_ns() + CLAIM_LEASE_MSEC * 1000000ull;
+
+error:
+	send_result(client, errorcode);
+}
+
+static void command_releasemouse(struct client *client, const struct command *cmd, unsigned int len)
+{
+	struct mouse_handle *mh;
+	uint32_t errorcode = ERR_NONE;
+
+	if (len < CMD_SIZE(releasemouse)) {
+		errorcode = ERR_CMDSIZE;
+		goto error;
+	}
+	mh = find_mouse(cmd);
+	if (!mh) {
+		errorcode = ERR_NOMOUSE;
+		goto error;
+	}
+	if (mh->claim_owner != client) {
+		/* Not claimed by this client or the lease ended. */
+		errorcode = ERR_FAIL;
+		goto error;
+	}
+	if (release_mouse_claim(mh))
+		errorcode = ERR_FAIL;
+
+error:
+	send_result(client, errorcode);
+}
+
+static void command_getappstats(struct client *client, const struct command *cmd, unsigned int len)
+{
+	uint32_t avg_usec = 0;
+
+	if (len < CMD_SIZE(getappstats)) {
+		send_u32(client, 0);
+		return;
+	}
+	if (app_switch_stats.nr_switches) {
+		avg_usec = (uint32_t)(app_switch_stats.total_usec /
+				      app_switch_stats.nr_switches);
+	}
+	send_u32(client, 4);
+	send_u32(client, app_switch_stats.nr_switches);
+	send_u32(client, app_switch_stats.last_usec);
+	send_u32(client, avg_usec);
+	send_u32(client, app_switch_stats.max_usec);
 }
 
 static void command_getactiveprof(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_profile *activeprof;
 
 	if (len < CMD_SIZE(getactiveprof))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse)
+	mh = find_configured_mouse(cmd);
+	if (!mh)
 		goto error;
+	mouse = mh->mouse;
 	activeprof = mouse->get_active_profile(mouse);
 	if (!activeprof)
 		goto error;
@@ -1595,6 +2819,7 @@ error:
 
 static void command_setactiveprof(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_profile *profile;
 	int err;
@@ -1604,12 +2829,13 @@ static void command_setactiveprof(struct client *client, const struct command *c
 		errorcode = ERR_CMDSIZE;
 		goto error;
 	}
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse) {
+	mh = find_mouse(cmd);
+	if (!mh) {
 		errorcode = ERR_NOMOUSE;
 		goto error;
 	}
-	profile = find_mouse_profile(mouse, be32_to_cpu(cmd->setactiveprof.id));
+	mouse = mh->mouse;
+	profile = find_mouse_profile(mh, be32_to_cpu(cmd->setactiveprof.id));
 	if (!profile) {
 		errorcode = ERR_FAIL;
 		goto error;
@@ -1626,20 +2852,22 @@ static void command_setactiveprof(struct client *client, const struct command *c
 	mouse->release(mouse);
 
 error:
-	send_u32(client, errorcode);
+	send_result(client, errorcode);
 }
 
 static void command_suppbuttons(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_button *list;
 	int count, i;
 
 	if (len < CMD_SIZE(suppbuttons))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse || !mouse->supported_buttons)
+	mh = find_mouse(cmd);
+	if (!mh || !mh->mouse->supported_buttons)
 		goto error;
+	mouse = mh->mouse;
 	count = mouse->supported_buttons(mouse, &list);
 	if (count <= 0)
 		goto error;
@@ -1657,15 +2885,17 @@ error:
 
 static void command_suppbutfuncs(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_button_function *list;
 	int count, i;
 
 	if (len < CMD_SIZE(suppbutfuncs))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse || !mouse->supported_button_functions)
+	mh = find_mouse(cmd);
+	if (!mh || !mh->mouse->supported_button_functions)
 		goto error;
+	mouse = mh->mouse;
 	count = mouse->supported_button_functions(mouse, &list);
 	if (count <= 0)
 		goto error;
@@ -1683,20 +2913,20 @@ error:
 
 static void command_getbutfunc(struct client *client, const struct command *cmd, unsigned int len)
 {
-	struct razer_mouse *mouse;
+	struct mouse_handle *mh;
 	struct razer_mouse_profile *profile;
 	struct razer_button_function *func;
 	struct razer_button *button;
 
 	if (len < CMD_SIZE(getbutfunc))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse)
+	mh = find_configured_mouse(cmd);
+	if (!mh)
 		goto error;
-	button = find_mouse_button(mouse, be32_to_cpu(cmd->getbutfunc.button_id));
+	button = find_mouse_button(mh, be32_to_cpu(cmd->getbutfunc.button_id));
 	if (!button)
 		goto error;
-	profile = find_mouse_profile(mouse, be32_to_cpu(cmd->getbutfunc.profile_id));
+	profile = find_mouse_profile(mh, be32_to_cpu(cmd->getbutfunc.profile_id));
 	if (!profile || !profile->get_button_function)
 		goto error;
 	func = profile->get_button_function(profile, button);
@@ -1714,6 +2944,7 @@ error:
 
 static void command_setbutfunc(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_mouse_profile *profile;
 	struct razer_button_function *func;
@@ -1725,22 +2956,23 @@ static void command_setbutfunc(struct client *client, const struct command *cmd,
 		errorcode = ERR_CMDSIZE;
 		goto error;
 	}
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse) {
+	mh = find_mouse(cmd);
+	if (!mh) {
 		errorcode = ERR_NOMOUSE;
 		goto error;
 	}
-	button = find_mouse_button(mouse, be32_to_cpu(cmd->setbutfunc.button_id));
+	mouse = mh->mouse;
+	button = find_mouse_button(mh, be32_to_cpu(cmd->setbutfunc.button_id));
 	if (!button) {
 		errorcode = ERR_FAIL;
 		goto error;
 	}
-	func = find_mouse_button_function(mouse, be32_to_cpu(cmd->setbutfunc.function_id));
+	func = find_mouse_button_function(mh, be32_to_cpu(cmd->setbutfunc.function_id));
 	if (!func) {
 		errorcode = ERR_FAIL;
 		goto error;
 	}
-	profile = find_mouse_profile(mouse, be32_to_cpu(cmd->setbutfunc.profile_id));
+	profile = find_mouse_profile(mh, be32_to_cpu(cmd->setbutfunc.profile_id));
 	if (!profile || !profile->set_button_function) {
 		errorcode = ERR_FAIL;
 		goto error;
@@ -1758,20 +2990,22 @@ static void command_setbutfunc(struct client *client, const struct command *cmd,
 		goto error;
 	}
 error:
-	send_u32(client, errorcode);
+	send_result(client, errorcode);
 }
 
 static void command_suppaxes(struct client *client, const struct command *cmd, unsigned int len)
 {
+	struct mouse_handle *mh;
 	struct razer_mouse *mouse;
 	struct razer_axis *list;
 	int count, i;
 
 	if (len < CMD_SIZE(suppaxes))
 		goto error;
-	mouse = find_mouse(cmd->idstr);
-	if (!mouse || !mouse->supported_axes)
+	mh = find_mouse(cmd);
+	if (!mh || !mh->mouse->supported_axes)
 		goto error;
+	mouse = mh->mouse;
 	count = mouse->supported_axes(mouse, &list);
 	if (count <= 0)
 		goto error;
@@ -1788,19 +3022,423 @@ error:
 	send_u32(client, 0);
 }
 
-static void command_flashfw(struct client *client, const struct command *cmd, unsigned int len)
+/* FNV-1a */
+static uint32_t fw_image_hash(const char *data, uint32_t size)
 {
-	struct razer_mouse *mouse;
-	uint32_t image_size;
-	int err;
-	uint32_t errorcode = ERR_NONE;
-	char *image = NULL;
+	uint32_t i, hash = 2166136261u;
 
-	if (len < CMD_SIZE(flashfw)) {
-		errorcode = ERR_CMDSIZE;
-		goto error;
+	for (i = 0; i < size; i++) {
+		hash ^= (uint8_t)data[i];
+		hash *= 16777619u;
 	}
-	image_size = be32_to_cpu(cmd->flashfw.imagesize);
+
+	return hash;
+}
+
+static struct fw_image * find_fw_image(uint32_t hash)
+{
+	struct fw_image *image;
+
+	for (image = fw_images; image; image = image->next) {
+		if (image->hash == hash)
+			return image;
+	}
+
+	return NULL;
+}
+
+/* Make room for a new image by dropping the oldest unused one. */
+static int fw_images_make_room(void)
+{
+	struct fw_image *image, **pprev, **oldest = NULL;
+	unsigned int count = 0;
+
+	for (pprev = &fw_images; (image = *pprev); pprev = &image->next) {
+		count++;
+		if (!oldest && !image->users)
+			oldest = pprev;
+	}
+	if (count < MAX_FIRMWARE_IMAGES)
+		return 0;
+	if (!oldest)
+		return -EBUSY;
+	image = *oldest;
+	*oldest = image->next;
+	free_fw_image(image);
+
+	return 0;
+}
+
+/* Store a firmware image. This takes ownership of data.
+ * Returns the stored image, which might be an identical image that
+ * was stored earlier, or NULL on error. */
+static struct fw_image * store_fw_image(char *data, uint32_t size,
+					uint32_t *errorcode)
+{
+	struct fw_image *image, *i;
+	uint32_t hash;
+
+	hash = fw_image_hash(data, size);
+	image = find_fw_image(hash);
+	if (image) {
+		if (image->size != size ||
+		    memcmp(image->data, data, size) != 0) {
+			logerr("Firmware image hash collision (0x%08X)\n", hash);
+			*errorcode = ERR_FAIL;
+			image = NULL;
+		}
+		/* Already known. */
+		free(data);
+		return image;
+	}
+	if (fw_images_make_room()) {
+		*errorcode = ERR_NOMEM;
+		goto err_free;
+	}
+	image = calloc(1, sizeof(*image));
+	if (!image) {
+		*errorcode = ERR_NOMEM;
+		goto err_free;
+	}
+	image->hash = hash;
+	image->size = size;
+	image->data = data;
+	if (fw_images) {
+		for (i = fw_images; i->next; i = i->next)
+			;
+		i->next = image;
+	} else
+		fw_images = image;
+	logdebug("Stored firmware image 0x%08X (%u bytes)\n",
+		 hash, (unsigned int)size);
+
+	return image;
+
+err_free:
+	free(data);
+	return NULL;
+}
+
+static void command_uploadfw(struct client *client, const struct priv_command *cmd, unsigned int len)
+{
+	struct fw_image *image;
+	uint32_t image_size, hash = 0;
+	uint32_t errorcode = ERR_NONE;
+	char *data = NULL;
+	int err;
+
+	if (len < PRIV_CMD_SIZE(uploadfw)) {
+		errorcode = ERR_CMDSIZE;
+		goto error;
+	}
+	image_size = be32_to_cpu(cmd->uploadfw.imagesize);
+	if (image_size > MAX_FIRMWARE_SIZE) {
+		errorcode = ERR_CMDSIZE;
+		goto error;
+	}
+
+	data = malloc(image_size);
+	if (!data) {
+		errorcode = ERR_NOMEM;
+		goto error;
+	}
+	err = recv_bulk(client, data, image_size);
+	if (err) {
+		errorcode = ERR_PAYLOAD;
+		goto error;
+	}
+
+	image = store_fw_image(data, image_size, &errorcode);
+	data = NULL;
+	if (image)
+		hash = image->hash;
+
+error:
+	free(data);
+	send_u32(client, errorcode);
+	if (errorcode == ERR_NONE)
+		send_u32(client, hash);
+}
+
+static void send_flash_result(struct client *client, const char *idstr,
+			      uint32_t errorcode)
+{
+	struct reply r;
+
+	if (!client)
+		return;
+	memset(&r, 0, REPLY_SIZE(notify_flashresult));
+	r.hdr.id = NOTIFY_ID_FLASHRESULT;
+	r.notify_flashresult.errorcode = cpu_to_be32(errorcode);
+	memcpy(r.notify_flashresult.idstr, idstr,
+	       strnlen(idstr, sizeof(r.notify_flashresult.idstr)));
+	send_reply(client, &r, REPLY_SIZE(notify_flashresult));
+}
+
+static void send_flash_progress(struct client *client, const char *idstr,
+				enum razer_flash_phase phase,
+				unsigned int done, unsigned int total)
+{
+	struct reply r;
+
+	if (!client)
+		return;
+	memset(&r, 0, REPLY_SIZE(notify_flashprogress));
+	r.hdr.id = NOTIFY_ID_FLASHPROGRESS;
+	r.notify_flashprogress.phase = cpu_to_be32(phase);
+	r.notify_flashprogress.done = cpu_to_be32(done);
+	r.notify_flashprogress.total = cpu_to_be32(total);
+	memcpy(r.notify_flashprogress.idstr, idstr,
+	       strnlen(idstr, sizeof(r.notify_flashprogress.idstr)));
+	send_reply(client, &r, REPLY_SIZE(notify_flashprogress));
+}
+
+/* Post an event to the main loop.
+ * If reliable is false, the event is dropped, if the pipe is full. */
+static void flash_post_event(const struct flash_event *ev, bool reliable)
+{
+	ssize_t res;
+
+	while (1) {
+		res = write(flash_event_pipe[1], ev, sizeof(*ev));
+		if (res == sizeof(*ev))
+			break;
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res < 0 && errno == EAGAIN) {
+			if (!reliable)
+				break;
+			razer_msleep(1);
+			continue;
+		}
+		logerr("Failed to post flash event\n");
+		break;
+	}
+}
+
+static int flash_progress(struct razer_mouse *m, enum razer_flash_phase phase,
+			  unsigned int done, unsigned int total, void *priv)
+{
+	struct flash_target *t = priv;
+	struct flash_event ev = {
+		.job	= t->job,
+		.target	= t - t->job->targets,
+		.type	= FLASH_EV_PROGRESS,
+		.phase	= phase,
+		.done	= done,
+		.total	= total,
+	};
+
+	flash_post_event(&ev, 0);
+
+	return __atomic_load_n(&t->cancel, __ATOMIC_RELAXED);
+}
+
+static void * flash_thread(void *arg)
+{
+	struct flash_job *job = arg;
+	struct flash_target *t;
+	struct flash_event ev = {
+		.job	= job,
+	};
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < job->nr_targets; i++) {
+		t = &job->targets[i];
+		if (__atomic_load_n(&t->cancel, __ATOMIC_RELAXED)) {
+			t->errorcode = ERR_CANCELED;
+		} else if (t->mouse->claim(t->mouse)) {
+			t->errorcode = ERR_CLAIM;
+		} else {
+			loginfo("Flashing firmware 0x%08X to %s\n",
+				job->image->hash, t->idstr);
+			err = razer_flash_firmware(t->mouse, job->image->data,
+						   job->image->size,
+						   flash_progress, t);
+			t->mouse->release(t->mouse);
+			if (err == -ECANCELED)
+				t->errorcode = ERR_CANCELED;
+			else
+				t->errorcode = err ? ERR_FAIL : ERR_NONE;
+		}
+		ev.target = i;
+		ev.type = FLASH_EV_RESULT;
+		flash_post_event(&ev, 1);
+	}
+	ev.type = FLASH_EV_FINISHED;
+	flash_post_event(&ev, 1);
+
+	return NULL;
+}
+
+/* Start the flash thread of a job.
+ * On error, the job is not started and the caller still owns it. */
+static int start_flash_job(struct flash_job *job)
+{
+	int err;
+
+	/* The thread's events are only handled by the main loop,
+	 * so the job can be linked after the thread started. */
+	err = pthread_create(&job->thread, NULL, flash_thread, job);
+	if (err) {
+		logerr("Failed to create flash thread: %s\n", strerror(err));
+		return -ENOMEM;
+	}
+	job->next = flash_jobs;
+	flash_jobs = job;
+	job->image->users++;
+
+	return 0;
+}
+
+/* Get the USB bus number from the bus position in the ID string. */
+static int idstr_bus_number(const char *idstr)
+{
+	const char *pos;
+	int bus;
+
+	pos = strstr(idstr, ":USB-");
+	if (!pos || sscanf(pos + 5, "%d", &bus) != 1)
+		return -1;
+
+	return bus;
+}
+
+static struct flash_job * flash_job_for_bus(struct flash_job **list,
+					    struct fw_image *image,
+					    struct client *client, int bus)
+{
+	struct flash_job *job;
+
+	if (bus >= 0) {
+		for (job = *list; job; job = job->next) {
+			if (job->bus == bus)
+				return job;
+		}
+	}
+	job = calloc(1, sizeof(*job));
+	if (!job)
+		return NULL;
+	job->client = client;
+	job->image = image;
+	job->bus = bus;
+	job->next = *list;
+	*list = job;
+
+	return job;
+}
+
+static void command_flashmany(struct client *client, const struct priv_command *cmd, unsigned int len)
+{
+	struct flash_job *jobs = NULL, *job, *next;
+	struct flash_target *t;
+	struct fw_image *image;
+	struct razer_mouse *mouse;
+	uint32_t nr_mice = 0, i, errorcode = ERR_NONE;
+	uint32_t *results = NULL;
+	char *idstrs = NULL;
+	char idstr[RAZER_IDSTR_MAX_SIZE + 1];
+	int err;
+
+	if (len < PRIV_CMD_SIZE(flashmany)) {
+		errorcode = ERR_CMDSIZE;
+		goto error;
+	}
+	nr_mice = be32_to_cpu(cmd->flashmany.nr_mice);
+	if (nr_mice > MAX_FLASH_MICE) {
+		errorcode = ERR_CMDSIZE;
+		goto error;
+	}
+	idstrs = malloc(nr_mice * RAZER_IDSTR_MAX_SIZE + 1);
+	results = calloc(nr_mice + 1, sizeof(*results));
+	if (!idstrs || !results) {
+		errorcode = ERR_NOMEM;
+		goto error;
+	}
+	err = recv_bulk(client, idstrs, nr_mice * RAZER_IDSTR_MAX_SIZE);
+	if (err) {
+		errorcode = ERR_PAYLOAD;
+		goto error;
+	}
+	image = find_fw_image(be32_to_cpu(cmd->flashmany.image_hash));
+	if (!image) {
+		errorcode = ERR_NOIMAGE;
+		goto error;
+	}
+
+	/* Group the mice by USB bus. Mice that can not be flashed
+	 * are reported right after the reply. */
+	for (i = 0; i < nr_mice; i++) {
+		memcpy(idstr, idstrs + i * RAZER_IDSTR_MAX_SIZE,
+		       RAZER_IDSTR_MAX_SIZE);
+		idstr[RAZER_IDSTR_MAX_SIZE] = '\0';
+		mouse = find_mouse_idstr(idstr);
+		if (!mouse) {
+			results[i] = ERR_NOMOUSE;
+			continue;
+		}
+		if (!mouse->flash_firmware) {
+			results[i] = ERR_NOTSUPP;
+			continue;
+		}
+		if (flash_jobs_have_mouse(jobs, mouse)) {
+			/* Listed twice in this request. */
+			results[i] = ERR_PAYLOAD;
+			continue;
+		}
+		job = flash_job_for_bus(&jobs, image, client,
+					idstr_bus_number(idstr));
+		if (!job) {
+			results[i] = ERR_NOMEM;
+			continue;
+		}
+		t = &job->targets[job->nr_targets++];
+		t->job = job;
+		strcpy(t->idstr, idstr);
+		t->mouse = mouse;
+	}
+
+error:
+	send_u32(client, errorcode);
+	if (errorcode == ERR_NONE) {
+		for (i = 0; i < nr_mice; i++) {
+			if (results[i] != ERR_NONE) {
+				send_flash_result(client, idstrs + i * RAZER_IDSTR_MAX_SIZE,
+						  results[i]);
+			}
+		}
+	}
+	for (job = jobs; job; job = next) {
+		next = job->next;
+		if (start_flash_job(job)) {
+			for (i = 0; i < job->nr_targets; i++) {
+				send_flash_result(client, job->targets[i].idstr,
+						  ERR_NOMEM);
+			}
+			free(job);
+		}
+	}
+	free(idstrs);
+	free(results);
+}
+
+static void command_flashfw(struct client *client, const struct priv_command *cmd, unsigned int len)
+{
+	struct razer_mouse *mouse;
+	struct fw_image *fwimage;
+	struct flash_job *job;
+	struct flash_target *t;
+	uint32_t image_size;
+	int err;
+	uint32_t errorcode = ERR_NONE;
+	char *image = NULL;
+
+	if (len < PRIV_CMD_SIZE(flashfw)) {
+		errorcode = ERR_CMDSIZE;
+		goto error;
+	}
+	image_size = be32_to_cpu(cmd->flashfw.imagesize);
 	if (image_size > MAX_FIRMWARE_SIZE) {
 		errorcode = ERR_CMDSIZE;
 		goto error;
@@ -1818,7 +3456,7 @@ static void command_flashfw(struct client *client, const struct command *cmd, un
 		goto error;
 	}
 
-	mouse = find_mouse(cmd->idstr);
+	mouse = find_mouse_idstr(cmd->idstr);
 	if (!mouse) {
 		errorcode = ERR_NOMOUSE;
 		goto error;
@@ -1827,35 +3465,128 @@ static void command_flashfw(struct client *client, const struct command *cmd, un
 		errorcode = ERR_NOTSUPP;
 		goto error;
 	}
-	err = mouse->claim(mouse);
-	if (err) {
-		errorcode = ERR_CLAIM;
+	job = calloc(1, sizeof(*job));
+	fwimage = calloc(1, sizeof(*fwimage));
+	if (!job || !fwimage) {
+		free(job);
+		free(fwimage);
+		errorcode = ERR_NOMEM;
 		goto error;
 	}
-	err = mouse->flash_firmware(mouse, image, image_size,
-				    RAZER_FW_FLASH_MAGIC);
-	mouse->release(mouse);
-	if (err) {
-		errorcode = ERR_FAIL;
+	/* A one-shot image. It does not take a slot of the image store. */
+	fwimage->hash = fw_image_hash(image, image_size);
+	fwimage->size = image_size;
+	fwimage->transient = 1;
+	fwimage->data = image;
+	image = NULL;
+
+	/* Flash in the background. Progress is sent as notifications
+	 * and the result is sent as reply when the flash finished. */
+	job->client = client;
+	job->image = fwimage;
+	job->bus = -1;
+	job->reply_final = 1;
+	t = &job->targets[job->nr_targets++];
+	t->job = job;
+	strcpy(t->idstr, mouse->idstr);
+	t->mouse = mouse;
+	if (start_flash_job(job)) {
+		free(job);
+		free_fw_image(fwimage);
+		errorcode = ERR_NOMEM;
 		goto error;
 	}
 
+	return;
+
 error:
 	send_u32(client, errorcode);
 	free(image);
 }
 
-static void command_claim(struct client *client, const struct command *cmd, unsigned int len)
+static void command_flashcancel(struct client *client, const struct priv_command *cmd, unsigned int len)
+{
+	struct flash_job *job;
+	struct flash_target *t;
+	unsigned int i;
+
+	if (len < PRIV_CMD_SIZE(flashcancel))
+		return;
+	/* An empty ID string cancels all flashes of the client. */
+	for (job = flash_jobs; job; job = job->next) {
+		if (job->client != client)
+			continue;
+		for (i = 0; i < job->nr_targets; i++) {
+			t = &job->targets[i];
+			if (cmd->idstr[0] &&
+			    strncmp(t->idstr, cmd->idstr, RAZER_IDSTR_MAX_SIZE) != 0)
+				continue;
+			__atomic_store_n(&t->cancel, 1, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+static void run_deferred_operations(void)
+{
+	if (rescan_pending) {
+		rescan_pending = 0;
+		mice = razer_rescan_mice();
+	}
+	if (reconfig_pending) {
+		reconfig_pending = 0;
+		razer_reconfig_mice();
+	}
+	if (config_reload_pending) {
+		config_reload_pending = 0;
+		reload_config();
+	}
+}
+
+static void check_flash_events(void)
+{
+	struct flash_event ev;
+	struct flash_target *t;
+	ssize_t res;
+
+	while (1) {
+		res = read(flash_event_pipe[0], &ev, sizeof(ev));
+		if (res != sizeof(ev))
+			break;
+		if (ev.type == FLASH_EV_FINISHED) {
+			reap_flash_job(ev.job);
+			continue;
+		}
+		t = &ev.job->targets[ev.target];
+		if (ev.type == FLASH_EV_PROGRESS) {
+			send_flash_progress(ev.job->client, t->idstr,
+					    ev.phase, ev.done, ev.total);
+			continue;
+		}
+		if (t->errorcode == ERR_NONE)
+			loginfo("Flashed firmware to %s\n", t->idstr);
+		else
+			logerr("Failed to flash firmware to %s\n", t->idstr);
+		if (ev.job->reply_final) {
+			if (ev.job->client)
+				send_u32(ev.job->client, t->errorcode);
+		} else
+			send_flash_result(ev.job->client, t->idstr, t->errorcode);
+	}
+	if (!flash_jobs)
+		run_deferred_operations();
+}
+
+static void command_claim(struct client *client, const struct priv_command *cmd, unsigned int len)
 {
 	struct razer_mouse *mouse;
 	uint32_t errorcode = ERR_NONE;
 	int err;
 
-	if (len < CMD_SIZE(claim)) {
+	if (len < PRIV_CMD_SIZE(claim)) {
 		errorcode = ERR_CMDSIZE;
 		goto error;
 	}
-	mouse = find_mouse(cmd->idstr);
+	mouse = find_mouse_idstr(cmd->idstr);
 	if (!mouse) {
 		errorcode = ERR_NOMOUSE;
 		goto error;
@@ -1870,16 +3601,16 @@ error:
 	send_u32(client, errorcode);
 }
 
-static void command_release(struct client *client, const struct command *cmd, unsigned int len)
+static void command_release(struct client *client, const struct priv_command *cmd, unsigned int len)
 {
 	struct razer_mouse *mouse;
 	uint32_t errorcode = ERR_NONE;
 
-	if (len < CMD_SIZE(release)) {
+	if (len < PRIV_CMD_SIZE(release)) {
 		errorcode = ERR_CMDSIZE;
 		goto error;
 	}
-	mouse = find_mouse(cmd->idstr);
+	mouse = find_mouse_idstr(cmd->idstr);
 	if (!mouse) {
 		errorcode = ERR_NOMOUSE;
 		goto error;
@@ -1890,13 +3621,81 @@ error:
 	send_u32(client, errorcode);
 }
 
+/* Sizes of the unprivileged commands. */
+static const uint16_t command_sizes[] = {
+	[COMMAND_ID_GETREV]		= COMMAND_HDR_SIZE,
+	[COMMAND_ID_RESCANMICE]		= COMMAND_HDR_SIZE,
+	[COMMAND_ID_GETMICE]		= COMMAND_HDR_SIZE,
+	[COMMAND_ID_GETFWVER]		= CMD_SIZE(getfwver),
+	[COMMAND_ID_SUPPFREQS]		= CMD_SIZE(suppfreqs),
+	[COMMAND_ID_SUPPRESOL]		= CMD_SIZE(suppresol),
+	[COMMAND_ID_SUPPDPIMAPPINGS]	= CMD_SIZE(suppdpimappings),
+	[COMMAND_ID_CHANGEDPIMAPPING]	= CMD_SIZE(changedpimapping),
+	[COMMAND_ID_GETDPIMAPPING]	= CMD_SIZE(getdpimapping),
+	[COMMAND_ID_SETDPIMAPPING]	= CMD_SIZE(setdpimapping),
+	[COMMAND_ID_GETLEDS]		= CMD_SIZE(getleds),
+	[COMMAND_ID_SETLED]		= CMD_SIZE(setled),
+	[COMMAND_ID_GETFREQ]		= CMD_SIZE(getfreq),
+	[COMMAND_ID_SETFREQ]		= CMD_SIZE(setfreq),
+	[COMMAND_ID_GETPROFILES]	= CMD_SIZE(getprofiles),
+	[COMMAND_ID_GETACTIVEPROF]	= CMD_SIZE(getactiveprof),
+	[COMMAND_ID_SETACTIVEPROF]	= CMD_SIZE(setactiveprof),
+	[COMMAND_ID_SUPPBUTTONS]	= CMD_SIZE(suppbuttons),
+	[COMMAND_ID_SUPPBUTFUNCS]	= CMD_SIZE(suppbutfuncs),
+	[COMMAND_ID_GETBUTFUNC]		= CMD_SIZE(getbutfunc),
+	[COMMAND_ID_SETBUTFUNC]		= CMD_SIZE(setbutfunc),
+	[COMMAND_ID_SUPPAXES]		= CMD_SIZE(suppaxes),
+	[COMMAND_ID_RECONFIGMICE]	= COMMAND_HDR_SIZE,
+	[COMMAND_ID_GETMOUSEINFO]	= CMD_SIZE(getmouseinfo),
+	[COMMAND_ID_GETPROFNAME]	= CMD_SIZE(getprofname),
+	[COMMAND_ID_SETPROFNAME]	= CMD_SIZE(setprofname),
+	[COMMAND_ID_CLAIMMOUSE]		= CMD_SIZE(claimmouse),
+	[COMMAND_ID_RELEASEMOUSE]	= CMD_SIZE(releasemouse),
+	[COMMAND_ID_GETAPPSTATS]	= CMD_SIZE(getappstats),
+};
+
+/* Commands that reply with an error code only. They may be sent NOREPLY. */
+static bool command_is_setter(uint8_t id)
+{
+	switch (id) {
+	case COMMAND_ID_CHANGEDPIMAPPING:
+	case COMMAND_ID_SETDPIMAPPING:
+	case COMMAND_ID_SETLED:
+	case COMMAND_ID_SETFREQ:
+	case COMMAND_ID_SETACTIVEPROF:
+	case COMMAND_ID_SETBUTFUNC:
+	case COMMAND_ID_SETPROFNAME:
+	case COMMAND_ID_CLAIMMOUSE:
+	case COMMAND_ID_RELEASEMOUSE:
+		return 1;
+	}
+
+	return 0;
+}
+
 static void handle_received_command(struct client *client, const char *_cmd, unsigned int len)
 {
 	const struct command *cmd = (const struct command *)_cmd;
+	struct mouse_handle *mh;
+	uint8_t id;
 
 	if (len < COMMAND_HDR_SIZE)
 		return;
-	switch (cmd->hdr.id) {
+	id = cmd->hdr.id & (uint8_t)~COMMAND_FLAGS;
+	if ((client->cmdflags & COMMAND_FLG_NOREPLY) && !command_is_setter(id)) {
+		send_result(client, ERR_NOTSUPP);
+		return;
+	}
+	if (command_is_setter(id)) {
+		/* The settings would only be committed with the claim of
+		 * the other client. Do not report success for them. */
+		mh = lookup_mouse_handle(be32_to_cpu(cmd->hdr.handle));
+		if (mh && mh->claim_owner && mh->claim_owner != client) {
+			send_result(client, ERR_CLAIM);
+			return;
+		}
+	}
+	switch (id) {
 	case COMMAND_ID_GETREV:
 		send_u32(client, INTERFACE_REVISION);
 		break;
@@ -1975,6 +3774,15 @@ static void handle_received_command(struct client *client, const char *_cmd, uns
 	case COMMAND_ID_SETPROFNAME:
 		command_setprofname(client, cmd, len);
 		break;
+	case COMMAND_ID_CLAIMMOUSE:
+		command_claimmouse(client, cmd, len);
+		break;
+	case COMMAND_ID_RELEASEMOUSE:
+		command_releasemouse(client, cmd, len);
+		break;
+	case COMMAND_ID_GETAPPSTATS:
+		command_getappstats(client, cmd, len);
+		break;
 	default:
 		/* Unknown command. */
 		break;
@@ -1984,9 +3792,9 @@ static void handle_received_command(struct client *client, const char *_cmd, uns
 static void handle_received_privileged_command(struct client *client,
 					       const char *_cmd, unsigned int len)
 {
-	const struct command *cmd = (const struct command *)_cmd;
+	const struct priv_command *cmd = (const struct priv_command *)_cmd;
 
-	if (len < COMMAND_HDR_SIZE)
+	if (len < PRIV_COMMAND_HDR_SIZE)
 		return;
 	switch (cmd->hdr.id) {
 	case COMMAND_PRIV_FLASHFW:
@@ -1998,22 +3806,87 @@ static void handle_received_privileged_command(struct client *client,
 	case COMMAND_PRIV_RELEASE:
 		command_release(client, cmd, len);
 		break;
+	case COMMAND_PRIV_UPLOADFW:
+		command_uploadfw(client, cmd, len);
+		break;
+	case COMMAND_PRIV_FLASHMANY:
+		command_flashmany(client, cmd, len);
+		break;
+	case COMMAND_PRIV_FLASHCANCEL:
+		command_flashcancel(client, cmd, len);
+		break;
 	default:
 		/* Unknown command. */
 		break;
 	}
 }
 
+/* Handle all complete commands in the client buffer.
+ * Commands have a fixed size per command ID. */
+/* Handle all complete commands in the receive buffer.
+ * Returns -1, if the stream is out of sync and the client must be dropped. */
+static int handle_received_commands(struct client *client)
+{
+	unsigned int pos = 0, size;
+	uint32_t request_id;
+	uint8_t id, flags;
+
+	/* The flags share the ID byte. */
+	BUILD_BUG_ON(ARRAY_SIZE(command_sizes) > COMMAND_FLG_ACK);
+	BUILD_BUG_ON(COMMAND_FLG_ACK > COMMAND_FLG_NOREPLY);
+
+	while (pos < client->cmdlen) {
+		id = (uint8_t)client->cmdbuf[pos];
+		flags = id & COMMAND_FLAGS;
+		id &= (uint8_t)~COMMAND_FLAGS;
+		size = 0;
+		if (id < ARRAY_SIZE(command_sizes))
+			size = command_sizes[id];
+		if (!size) {
+			/* The command boundaries are lost. */
+			logerr("Received unknown command %u\n", id);
+			return -1;
+		}
+		/* NOREPLY commands end with the request ID. */
+		if (flags & COMMAND_FLG_NOREPLY)
+			size += sizeof(request_id);
+		if (client->cmdlen - pos < size)
+			break;
+		client->cmdflags = flags;
+		client->request_id = 0;
+		if (flags & COMMAND_FLG_NOREPLY) {
+			memcpy(&request_id, client->cmdbuf + pos + size - sizeof(request_id),
+			       sizeof(request_id));
+			client->request_id = be32_to_cpu(request_id);
+		}
+		handle_received_command(client, client->cmdbuf + pos, size);
+		client->cmdflags = 0;
+		pos += size;
+	}
+	client->cmdlen -= pos;
+	memmove(client->cmdbuf, client->cmdbuf + pos, client->cmdlen);
+
+	return 0;
+}
+
 static int check_client_connections(void)
 {
-	char command[COMMAND_MAX_SIZE + 1] = { 0, };
 	int nr;
 	struct client *client, *next;
 	int ret = 0;
 
 	for (client = clients; client; ) {
 		next = client->next;
-		nr = recv(client->fd, command, COMMAND_MAX_SIZE, 0);
+		if (flush_client(client)) {
+			disconnect_client(&clients, client);
+			goto next_client;
+		}
+		if (client->txlen > CLIENT_TXBUF_THRES) {
+			/* Wait until the client reads its replies. */
+			goto next_client;
+		}
+		nr = recv(client->fd, client->cmdbuf + client->cmdlen,
+			  sizeof(client->cmdbuf) - client->cmdlen, 0);
 		if (nr < 0) {
 			ret = -1;
 			goto next_client;
@@ -2022,7 +3895,9 @@ static int check_client_connections(void)
 			disconnect_client(&clients, client);
 			goto next_client;
 		}
-		handle_received_command(client, command, nr);
+		client->cmdlen += (unsigned int)nr;
+		if (handle_received_commands(client) || client->dead)
+			disconnect_client(&clients, client);
   next_client:
 		client = next;
 	}
@@ -2039,6 +3914,12 @@ static int check_privileged_connections(void)
 
 	for (client = privileged_clients; client; ) {
 		next = client->next;
+		if (flush_client(client)) {
+			disconnect_client(&privileged_clients, client);
+			goto next_client;
+		}
+		if (client->txlen > CLIENT_TXBUF_THRES)
+			goto next_client;
 		nr = recv(client->fd, command, COMMAND_MAX_SIZE, 0);
 		if (nr < 0) {
 			ret = -1;
@@ -2049,6 +3930,8 @@ static int check_privileged_connections(void)
 			goto next_client;
 		}
 		handle_received_privileged_command(client, command, nr);
+		if (client->dead)
+			disconnect_client(&privileged_clients, client);
   next_client:
 		client = next;
 	}
@@ -2056,15 +3939,31 @@ static int check_privileged_connections(void)
 	return ret;
 }
 
+static void broadcast_reply(struct reply *r, size_t size)
+{
+	struct client *client;
+
+	for (client = clients; client; client = client->next)
+		send_reply(client, r, size);
+}
+
 static void broadcast_notification(unsigned int notifyId, size_t size)
 {
 	struct reply r;
-	struct client *client;
 
-	for (client = clients; client; client = client->next) {
-		r.hdr.id = notifyId;
-		send_reply(client, &r, size);
-	}
+	r.hdr.id = notifyId;
+	broadcast_reply(&r, size);
+}
+
+static void broadcast_mouseconfigured(struct razer_mouse *m)
+{
+	struct reply r;
+
+	memset(&r, 0, REPLY_SIZE(notify_mouseconfigured));
+	r.hdr.id = NOTIFY_ID_MOUSECONFIGURED;
+	memcpy(r.notify_mouseconfigured.idstr, m->idstr,
+	       strnlen(m->idstr, sizeof(r.notify_mouseconfigured.idstr)));
+	broadcast_reply(&r, REPLY_SIZE(notify_mouseconfigured));
 }
 
 static void event_handler(enum razer_event event,
@@ -2072,15 +3971,23 @@ static void event_handler(enum razer_event event,
 {
 	switch (event) {
 	case RAZER_EV_MOUSE_ADD:
+		add_mouse_handle(data->u.mouse);
+		app_rules_pending = 1;
 		logdebug("Broadcasting mouse-add event\n");
 		broadcast_notification(NOTIFY_ID_NEWMOUSE,
 				       REPLY_SIZE(notify_newmouse));
 		break;
 	case RAZER_EV_MOUSE_REMOVE:
+		del_mouse_handle(data->u.mouse);
+		app_rules_pending = 1;
 		logdebug("Broadcasting mouse-remove event\n");
 		broadcast_notification(NOTIFY_ID_DELMOUSE,
 				       REPLY_SIZE(notify_delmouse));
 		break;
+	case RAZER_EV_MOUSE_CONFIGURED:
+		logdebug("Broadcasting mouse-configured event\n");
+		broadcast_mouseconfigured(data->u.mouse);
+		break;
 	}
 }
 
@@ -2089,8 +3996,9 @@ static int mainloop(void)
 	struct client *client;
 	int err;
 	int errcount = 0;
-	fd_set wait_fdset;
-	int maxfd;
+	fd_set wait_fdset, wait_wrset;
+	struct timeval timeout;
+	int maxfd, eventfd, timeout_ms;
 
 	loginfo("Razer device service daemon\n");
 
@@ -2106,9 +4014,20 @@ static int mainloop(void)
 	}
 
 	mice = razer_rescan_mice();
+	eventfd = razer_get_event_fd();
 
 	while (1) {
+		if (app_rules_pending)
+			update_app_rules();
+
+		reap_dead_clients(&clients);
+		reap_dead_clients(&privileged_clients);
+		timeout_ms = expire_claims();
+		timeout.tv_sec = timeout_ms / 1000;
+		timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
 		FD_ZERO(&wait_fdset);
+		FD_ZERO(&wait_wrset);
 
 		/* Build fdset while tracking maximum fd. Skip and log fds >= FD_SETSIZE. */
 		maxfd = -1;
@@ -2129,35 +4048,54 @@ static int mainloop(void)
 			}
 		}
 
-		for (client = clients; client; client = client->next) {
-			if (client->fd >= 0) {
-				if (client->fd < FD_SETSIZE) {
-					FD_SET(client->fd, &wait_fdset);
-					maxfd = max(maxfd, client->fd);
-				} else {
-					logerr("Client fd %d >= FD_SETSIZE (%d), skipping\n", client->fd, FD_SETSIZE);
-				}
+		if (eventfd >= 0) {
+			if (eventfd < FD_SETSIZE) {
+				FD_SET(eventfd, &wait_fdset);
+				maxfd = max(maxfd, eventfd);
+			} else {
+				logerr("Event fd %d >= FD_SETSIZE (%d), skipping\n", eventfd, FD_SETSIZE);
 			}
 		}
-		for (client = privileged_clients; client; client = client->next) {
-			if (client->fd >= 0) {
-				if (client->fd < FD_SETSIZE) {
-					FD_SET(client->fd, &wait_fdset);
-					maxfd = max(maxfd, client->fd);
-				} else {
-					logerr("Privileged client fd %d >= FD_SETSIZE (%d), skipping\n", client->fd, FD_SETSIZE);
-				}
+		if (flash_event_pipe[0] >= 0) {
+			if (flash_event_pipe[0] < FD_SETSIZE) {
+				FD_SET(flash_event_pipe[0], &wait_fdset);
+				maxfd = max(maxfd, flash_event_pipe[0]);
+			} else {
+				logerr("Flash event fd %d >= FD_SETSIZE (%d), skipping\n", flash_event_pipe[0], FD_SETSIZE);
+			}
+		}
+		if (config_watch_fd >= 0) {
+			if (config_watch_fd < FD_SETSIZE) {
+				FD_SET(config_watch_fd, &wait_fdset);
+				maxfd = max(maxfd, config_watch_fd);
+			} else {
+				logerr("Config watch fd %d >= FD_SETSIZE (%d), skipping\n", config_watch_fd, FD_SETSIZE);
+			}
+		}
+
+		if (proc_events_fd >= 0) {
+			if (proc_events_fd < FD_SETSIZE) {
+				FD_SET(proc_events_fd, &wait_fdset);
+				maxfd = max(maxfd, proc_events_fd);
+			} else {
+				logerr("Process events fd %d >= FD_SETSIZE (%d), skipping\n", proc_events_fd, FD_SETSIZE);
 			}
 		}
 
+		for (client = clients; client; client = client->next)
+			client_set_fds(client, &wait_fdset, &wait_wrset, &maxfd);
+		for (client = privileged_clients; client; client = client->next)
+			client_set_fds(client, &wait_fdset, &wait_wrset, &maxfd);
+
 		if (maxfd < 0) {
 			/* No valid fds to wait on. Avoid busy-looping. */
 			razer_msleep(100);
 			continue;
 		}
 
-		err = select(maxfd + 1, &wait_fdset, NULL, NULL, NULL);
-		if (err == 0) /* no fd ready */
+		err = select(maxfd + 1, &wait_fdset, &wait_wrset, NULL,
+			     (timeout_ms >= 0) ? &timeout : NULL);
+		if (err == 0 && timeout_ms < 0) /* no fd ready */
 			err = -1;
 		if (err > 0) {
 			err = 0;
@@ -2167,6 +4105,15 @@ static int mainloop(void)
 
 			err |= check_control_socket(ctlsock, &clients);
 			err |= check_client_connections();
+
+			err |= check_config_watch();
+
+			if (eventfd >= 0 && FD_ISSET(eventfd, &wait_fdset))
+				razer_handle_events();
+			if (FD_ISSET(flash_event_pipe[0], &wait_fdset))
+				check_flash_events();
+			if (proc_events_fd >= 0 && FD_ISSET(proc_events_fd, &wait_fdset))
+				err |= check_proc_events();
 		}
 		if (err) {
 			if (errcount >= 3)
@@ -2189,6 +4136,12 @@ static void usage(FILE *fd, int argc, char **argv)
 	fprintf(fd, "  -c|--config PATH          Use specified config file. Defaults to %s\n",
 		RAZER_DEFAULT_CONFIG);
 	fprintf(fd, "  -C|--no-config            Do not load the config file\n");
+	fprintf(fd, "  -s|--state-cache PATH     Use specified device state cache. Defaults to %s\n",
+		RAZER_DEFAULT_STATE_CACHE);
+	fprintf(fd, "  -S|--no-state-cache       Do not use the device state cache\n");
+	fprintf(fd, "  -t|--transport SPEC       Device transport: libusb (default), hidraw or sim\n");
+	fprintf(fd, "                            sim takes devices and timing, e.g.\n");
+	fprintf(fd, "                            sim:dev=1532:0016,latency=1000,error=100\n");
 	fprintf(fd, "  -p|--no-profemu           Disable profile emulation\n");
 	fprintf(fd, "  -P|--pidfile PATH         Create a PID-file\n");
 	fprintf(fd, "  -l|--loglevel LEVEL       Set the loglevel\n");
@@ -2206,6 +4159,9 @@ static int parse_args(int argc, char **argv)
 		{ "background", no_argument, 0, 'B', },
 		{ "config", required_argument, 0, 'c', },
 		{ "no-config", no_argument, 0, 'C', },
+		{ "state-cache", required_argument, 0, 's', },
+		{ "no-state-cache", no_argument, 0, 'S', },
+		{ "transport", required_argument, 0, 't', },
 		{ "no-profemu", no_argument, 0, 'p', },
 		{ "pidfile", required_argument, 0, 'P', },
 		{ "loglevel", required_argument, 0, 'l', },
@@ -2216,7 +4172,7 @@ static int parse_args(int argc, char **argv)
 	int c, idx;
 
 	while (1) {
-		c = getopt_long(argc, argv, "hvBc:CpP:l:f",
+		c = getopt_long(argc, argv, "hvBc:Cs:St:pP:l:f",
 				long_options, &idx);
 		if (c == -1)
 			break;
@@ -2234,6 +4190,15 @@ static int parse_args(int argc, char **argv)
 		case 'C':
 			cmdargs.configfile = "";
 			break;
+		case 's':
+			cmdargs.statecache = optarg;
+			break;
+		case 'S':
+			cmdargs.statecache = "";
+			break;
+		case 't':
+			cmdargs.transport = optarg;
+			break;
 		case 'p':
 			cmdargs.no_profile_emu = 1;
 			break;
@@ -0,0 +1,225 @@
+"""
+#   Razer device configuration
+#   asyncio interface library
+#
+#   This library connects to the lowlevel 'razerd' system daemon.
+#
+#   Copyright (C) 2026 Michael Buesch <m@bues.ch>
+#
+#   This program is free software; you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License
+#   as published by the Free Software Foundation; either version 2
+#   of the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+"""
+
+import asyncio
+
+from pyrazer.main import *
+
+
+class AsyncRazer(RazerProtocol):
+	"""asyncio connection to razerd.
+	Connect with
+		razer = await AsyncRazer.connect()
+	All commands of RazerProtocol are coroutines here:
+		leds = await razer.getLeds(idstr)
+	Commands from concurrent tasks are pipelined on the socket.
+	Privileged commands are not supported."""
+
+	MAX_NOTIFICATIONS = 256		# Unread notifications. Oldest are dropped.
+	MAX_COMMAND_RESULTS = 256	# Results nobody waits for. Oldest are dropped.
+
+	def __init__(self, reader, writer):
+		"Use connect() instead."
+		RazerProtocol.__init__(self)
+		self.reader = reader
+		self.writer = writer
+		self.error = None
+		self.replies = asyncio.Queue()
+		self.notificationQueue = asyncio.Queue()
+		self.commandResults = {}
+		self.commandResultWaiters = {}
+		self.lastRequest = None
+		self.readerTask = asyncio.get_running_loop().create_task(
+			self.__readMessages())
+
+	@classmethod
+	async def connect(cls, path=RazerProtocol.SOCKET_PATH):
+		"Connect to razerd."
+		try:
+			reader, writer = await asyncio.open_unix_connection(path)
+		except OSError as e:
+			raise RazerEx("Failed to connect to razerd socket: %s" % e)
+		razer = cls(reader, writer)
+		rev = await razer._command(cls.COMMAND_ID_GETREV, decode=razer._decodeU32)
+		if rev != cls.INTERFACE_REVISION:
+			await razer.close()
+			raise RazerEx("Incompatible razerd daemon socket interface revision.\n"
+				      "razerd reported revision %u, but we expected revision %u." %\
+					(rev, cls.INTERFACE_REVISION))
+		return razer
+
+	async def close(self):
+		"Close the connection."
+		self.readerTask.cancel()
+		self.writer.close()
+		await self.writer.wait_closed()
+
+	async def __aenter__(self):
+		return self
+
+	async def __aexit__(self, exc_type, exc_value, traceback):
+		await self.close()
+
+	def __connectionLost(self, error):
+		if self.error:
+			return
+		self.error = error
+		self.writer.close()
+		# Wake up everybody waiting for a message.
+		self.replies.put_nowait(None)
+		self.__queueNotification(None)
+		for future in self.commandResultWaiters.values():
+			if not future.done():
+				future.set_exception(error)
+		self.commandResultWaiters = {}
+
+	def __queueNotification(self, notification):
+		if self.notificationQueue.qsize() >= self.MAX_NOTIFICATIONS:
+			self.notificationQueue.get_nowait()
+		self.notificationQueue.put_nowait(notification)
+
+	async def __receive(self):
+		"Receive the next message."
+		parser = self._parseMessage()
+		try:
+			size = next(parser)
+			while 1:
+				size = parser.send(await self.reader.readexactly(size))
+		except StopIteration as e:
+			return e.value
+
+	async def __readMessages(self):
+		"Read all messages and dispatch them to the waiters."
+		try:
+			while 1:
+				id, payload = await self.__receive()
+				if id < self._NOTIFY_ID_FIRST:
+					self.replies.put_nowait( (id, payload) )
+					continue
+				if id == self.NOTIFY_ID_CMDRESULT:
+					requestId, error = payload
+					future = self.commandResultWaiters.pop(requestId, None)
+					if future:
+						if not future.done():
+							future.set_result(error)
+					else:
+						self.commandResults[requestId] = error
+						if len(self.commandResults) > self.MAX_COMMAND_RESULTS:
+							oldest = next(iter(self.commandResults))
+							del self.commandResults[oldest]
+					continue
+				if id in (self.NOTIFY_ID_NEWMOUSE, self.NOTIFY_ID_DELMOUSE):
+					self.mouseHandles = {}
+				self.__queueNotification( (id, payload) )
+		except (asyncio.IncompleteReadError, OSError) as e:
+			self.__connectionLost(RazerEx("Lost the connection to razerd"))
+		except RazerEx as e:
+			self.__connectionLost(e)
+		except Exception as e:
+			self.__connectionLost(RazerEx("Invalid message from razerd: %s" % e))
+
+	async def __reply(self, expectedId):
+		"Wait for the next reply to a command."
+		reply = await self.replies.get()
+		if reply is None:
+			self.replies.put_nowait(None)
+			raise self.error
+		id, payload = reply
+		if id != expectedId:
+			raise RazerEx("Received unexpected reply %u" % id)
+		return payload
+
+	async def __decode(self, previous, decode):
+		"Decode the reply after the reply of the previous command."
+		if previous:
+			await asyncio.wait( (previous,) )
+		if not decode:
+			return None
+		gen = decode()
+		try:
+			expectedId = next(gen)
+			while 1:
+				expectedId = gen.send(await self.__reply(expectedId))
+		except StopIteration as e:
+			return e.value
+		except RazerCommandFailed:
+			raise
+		except Exception as e:
+			# The rest of the reply is still queued and would be
+			# taken for the replies of the following commands.
+			self.__connectionLost(RazerEx("Failed to decode a reply: %s" % e))
+			raise self.error
+
+	async def __mouseHandle(self, idstr):
+		"Get the handle of a mouse. Returns 0, if the mouse is unknown."
+		if not idstr:
+			return 0
+		handle = self.mouseHandles.get(idstr)
+		if handle is None:
+			await self.getMice()
+			handle = self.mouseHandles.get(idstr, 0)
+		return handle
+
+	async def _command(self, commandId, idstr="", payload=b"", decode=None):
+		"Send a command and wait for the decoded reply."
+		result = await self.__commandOnce(commandId, idstr, payload, decode)
+		if self._dropStaleHandle(idstr, decode, result):
+			result = await self.__commandOnce(commandId, idstr, payload, decode)
+		return result
+
+	async def __commandOnce(self, commandId, idstr, payload, decode):
+		handle = await self.__mouseHandle(idstr)
+		if self.error:
+			raise self.error
+		self.writer.write(self._constructCommand(commandId, handle, payload))
+		# razerd replies in order. Chain the decoders, so that each one
+		# consumes the replies of its own command. The decoder keeps
+		# running, if the caller is cancelled.
+		request = asyncio.get_running_loop().create_task(
+			self.__decode(self.lastRequest, decode))
+		self.lastRequest = request
+		return await asyncio.shield(request)
+
+	async def waitCommandResult(self, requestId):
+		"""Wait for the error code of a noReply command.
+		Successes are only reported for commands sent with ack.
+		Only the last MAX_COMMAND_RESULTS results are kept,
+		if nobody waits for them."""
+		if requestId in self.commandResults:
+			return self.commandResults.pop(requestId)
+		if self.error:
+			raise self.error
+		future = self.commandResultWaiters.get(requestId)
+		if not future:
+			future = asyncio.get_running_loop().create_future()
+			self.commandResultWaiters[requestId] = future
+		return await future
+
+	async def notifications(self):
+		"""Async iterator over the notifications (id, payload):
+			async for id, payload in razer.notifications():
+		The iteration ends, if the connection to razerd is lost.
+		If the notifications are not read, only the last
+		MAX_NOTIFICATIONS are kept."""
+		while 1:
+			notification = await self.notificationQueue.get()
+			if notification is None:
+				self.notificationQueue.put_nowait(None)
+				return
+			yield notification
@@ -25,6 +25,7 @@ if sys.version_info[0] != 3:
 
 import socket
 import select
+import contextlib
 import hashlib
 import struct
 
@@ -34,6 +35,9 @@ RAZER_VERSION	= "0.44"
 class RazerEx(Exception):
 	"Exception thrown by pyrazer code."
 
+class RazerCommandFailed(RazerEx):
+	"A command failed. Its reply was received completely."
+
 __be32_struct = struct.Struct(">I")
 __be16_struct = struct.Struct(">H")
 
@@ -195,14 +199,42 @@ class RazerDpiMapping(object):
 		self.profileMask = profileMask
 		self.mutable = mutable
 
-class Razer(object):
+class RazerPending(object):
+	"The result of a command queued in a pipeline"
+
+	def __init__(self):
+		self.done = False
+		self.value = None
+		self.error = None
+
+	def complete(self, value=None, error=None):
+		self.done = True
+		self.value = value
+		self.error = error
+
+	def get(self):
+		"""Returns the result of the command.
+		Raises the RazerEx of the command, if it failed."""
+		if not self.done:
+			raise RazerEx("The pipeline was not flushed, yet")
+		if self.error:
+			raise self.error
+		return self.value
+
+class RazerProtocol(object):
+	"""The razerd socket protocol.
+	The command methods encode the command and decode the reply with a
+	generator. Running the command is left to _command() of the
+	connection classes Razer and AsyncRazer."""
+
 	SOCKET_PATH	= "/run/razerd/socket"
 	PRIVSOCKET_PATH	= "/run/razerd/socket.privileged"
 
-	INTERFACE_REVISION = 6
+	INTERFACE_REVISION = 14
 
 	COMMAND_MAX_SIZE = 512
-	COMMAND_HDR_SIZE = 1
+	COMMAND_HDR_SIZE = 5
+	PRIV_COMMAND_HDR_SIZE = 1
 	BULK_CHUNK_SIZE = 128
 	RAZER_IDSTR_MAX_SIZE = 128
 	RAZER_LEDNAME_MAX_SIZE = 64
@@ -234,18 +266,31 @@ class Razer(object):
 	COMMAND_ID_GETMOUSEINFO = 23	# Get detailed information about a mouse
 	COMMAND_ID_GETPROFNAME = 24	# Get a profile name.
 	COMMAND_ID_SETPROFNAME = 25	# Set a profile name.
+	COMMAND_ID_CLAIMMOUSE = 26	# Keep a mouse claimed until RELEASEMOUSE or lease end.
+	COMMAND_ID_RELEASEMOUSE = 27	# Release a mouse and commit its settings.
+	COMMAND_ID_GETAPPSTATS = 28	# Get the application profile switch stats.
+
+	COMMAND_FLG_NOREPLY = 0x40	# Do not wait for the result of a setter.
+	COMMAND_FLG_ACK = 0x20		# With NOREPLY: Also notify success.
 
 	COMMAND_PRIV_FLASHFW = 128	# Upload and flash a firmware image
 	COMMAND_PRIV_CLAIM = 129	# Claim the device.
 	COMMAND_PRIV_RELEASE = 130	# Release the device.
+	COMMAND_PRIV_UPLOADFW = 131	# Upload a firmware image to the daemon
+	COMMAND_PRIV_FLASHMANY = 132	# Flash an uploaded image to several devices
+	COMMAND_PRIV_FLASHCANCEL = 133	# Cancel a running flash. No reply.
 
 	# Replies to commands
 	REPLY_ID_U32 = 0		# An unsigned 32bit integer.
 	REPLY_ID_STR = 1		# A string
 	# Notifications. These go through the reply channel.
-	__NOTIFY_ID_FIRST = 128
+	_NOTIFY_ID_FIRST = 128
 	NOTIFY_ID_NEWMOUSE = 128	# New mouse was connected.
 	NOTIFY_ID_DELMOUSE = 129	# A mouse was removed.
+	NOTIFY_ID_MOUSECONFIGURED = 130	# A new mouse finished its initial configuration.
+	NOTIFY_ID_FLASHRESULT = 131	# A FLASHMANY device finished. (privileged)
+	NOTIFY_ID_FLASHPROGRESS = 132	# Firmware flash progress. (privileged)
+	NOTIFY_ID_CMDRESULT = 133	# The result of a NOREPLY command.
 
 	# String encodings
 	STRING_ENC_ASCII = 0
@@ -261,6 +306,8 @@ class Razer(object):
 	ERR_FAIL = 6
 	ERR_PAYLOAD = 7
 	ERR_NOTSUPP = 8
+	ERR_NOIMAGE = 9
+	ERR_CANCELED = 10
 
 	errorToStringMap = {
 		ERR_NONE	: "Success",
@@ -272,8 +319,17 @@ class Razer(object):
 		ERR_FAIL	: "Failure",
 		ERR_PAYLOAD	: "Payload error",
 		ERR_NOTSUPP	: "Operation not supported",
+		ERR_NOIMAGE	: "Unknown firmware image",
+		ERR_CANCELED	: "Cancelled",
 	}
 
+	# Firmware flash phases
+	FLASH_PREPARE	= 0	# The flash is about to start.
+	FLASH_REENUM	= 1	# Waiting for the bootloader device.
+	FLASH_WRITE	= 2	# Writing block "done" of "total".
+	FLASH_VERIFY	= 3	# Verifying the image.
+	FLASH_FINISH	= 4	# Leaving the bootloader.
+
 	# Axis flags
 	RAZER_AXIS_INDEPENDENT_DPIMAPPING	= (1 << 0)
 
@@ -296,91 +352,98 @@ class Razer(object):
 	@staticmethod
 	def strerror(errno):
 		try:
-			errstr = Razer.errorToStringMap[errno]
+			errstr = RazerProtocol.errorToStringMap[errno]
 		except KeyError:
 			errstr = "Unknown error"
 		return "Errorcode %d: %s" % (errno, errstr)
 
-	def __init__(self, enableNotifications=False):
-		"Connect to razerd."
-		self.enableNotifications = enableNotifications
-		self.notifications = []
-		try:
-			self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
-			self.sock.connect(self.SOCKET_PATH)
-		except socket.error as e:
-			raise RazerEx("Failed to connect to razerd socket: %s" % e)
-		try:
-			self.privsock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
-			self.privsock.connect(self.PRIVSOCKET_PATH)
-		except socket.error as e:
-			self.privsock = None # No privileged access
+	def __init__(self):
+		self.mouseHandles = {}
+		self.nextRequestId = 1
 
-		self.__sendCommand(self.COMMAND_ID_GETREV)
-		rev = self.__recvU32()
-		if (rev != self.INTERFACE_REVISION):
-			additional = ""
-			if rev < self.INTERFACE_REVISION:
-				additional = "\nThe running razerd is too old. " \
-					"Try to delete all razerd binaries and " \
-					"re-install the razercfg package."
-			raise RazerEx("Incompatible razerd daemon socket interface revision.\n"
-				      "razerd reported revision %u, but we expected revision %u."
-				      "%s" %\
-					(rev, self.INTERFACE_REVISION, additional))
+	@staticmethod
+	def _runGenerator(gen, handler):
+		"""Run the generator gen. Everything it yields is passed to
+		handler() and the result is sent back into the generator.
+		Returns the return value of the generator."""
+		try:
+			request = next(gen)
+			while 1:
+				request = gen.send(handler(request))
+		except StopIteration as e:
+			return e.value
 
-	def __constructCommand(self, commandId, idstr, payload):
+	def _constructCommand(self, commandId, handle, payload):
 		cmd = bytes((commandId,))
-		idstr = idstr.encode("UTF-8")
-		idstr += b'\0' * (self.RAZER_IDSTR_MAX_SIZE - len(idstr))
-		cmd += idstr
+		cmd += razer_int_to_be32(handle)
 		cmd += payload
-		cmd += b'\0' * (self.COMMAND_MAX_SIZE - len(cmd))
 		return cmd
 
-	def __send(self, data):
-		self.sock.sendall(data)
-
-	def __sendPrivileged(self, data):
-		try:
-			self.privsock.sendall(data)
-		except (socket.error, AttributeError) as e:
-			raise RazerEx("Privileged command failed. Do you have permission?")
-
-	def __sendBulkPrivileged(self, data):
-		for i in range(0, len(data), self.BULK_CHUNK_SIZE):
-			chunk = data[i : i + self.BULK_CHUNK_SIZE]
-			self.__sendPrivileged(chunk)
-			result = self.__recvU32Privileged()
-			if result != 0:
-				raise RazerEx("Privileged bulk write failed. %u" % result)
-
-	def __sendCommand(self, commandId, idstr="", payload=b""):
-		cmd = self.__constructCommand(commandId, idstr, payload)
-		self.__send(cmd)
-
-	def __sendPrivilegedCommand(self, commandId, idstr="", payload=b""):
-		cmd = self.__constructCommand(commandId, idstr, payload)
-		self.__sendPrivileged(cmd)
-
-	def __handleReceivedMessage(self, packet):
-		id = packet[0]
-		if id < self.__NOTIFY_ID_FIRST:
-			raise RazerEx("Received unhandled packet %u" % id)
-		if self.enableNotifications:
-			self.notifications.append(packet)
+	def _command(self, commandId, idstr="", payload=b"", decode=None):
+		"""Run a command. decode is a generator function for the reply.
+		It yields the expected REPLY_ID_... and receives the reply payload.
+		This is implemented by the connection."""
+		raise NotImplementedError
+
+	def _decodeNothing(self, value=None):
+		"Reply decoder for commands without reply. Returns value."
+		return value
+		yield # Unreachable. This makes the function a generator.
+
+	def _decodeU32(self):
+		return (yield self.REPLY_ID_U32)
+
+	def _decodeString(self):
+		return (yield self.REPLY_ID_STR)
+
+	def _decodeErrorcode(self):
+		"Reply decoder for setters. Returns the error code."
+		return (yield self.REPLY_ID_U32)
+
+	def _dropStaleHandle(self, idstr, decode, result):
+		"""Returns True, if a setter failed with ERR_NOMOUSE.
+		The cached handle might be of a mouse that was removed and
+		re-added. The handle cache is dropped and the caller retries once."""
+		if not idstr or decode != self._decodeErrorcode or \
+		   result != self.ERR_NOMOUSE:
+			return False
+		self.mouseHandles = {}
+		return True
 
-	def __receive(self, sock):
-		"Receive the next message. This will block until a message arrives."
-		hdrlen = 1
-		hdr = sock.recv(hdrlen)
-		id = hdr[0]
+	def _decodeU32List(self):
+		count = yield self.REPLY_ID_U32
+		values = []
+		for i in range(0, count):
+			values.append((yield self.REPLY_ID_U32))
+		return values
+
+	def _sendSetter(self, commandId, idstr, payload, noReply, ack):
+		"""Send a command that replies with an error code and return the code.
+		If noReply is True, do not wait and return the request ID instead.
+		The result is reported later as NOTIFY_ID_CMDRESULT. Without ack
+		only failures are reported."""
+		if not noReply:
+			return self._command(commandId, idstr, payload, self._decodeErrorcode)
+		requestId = self.nextRequestId
+		self.nextRequestId = ((requestId + 1) & 0xFFFFFFFF) or 1
+		commandId |= self.COMMAND_FLG_NOREPLY
+		if ack:
+			commandId |= self.COMMAND_FLG_ACK
+		return self._command(commandId, idstr,
+				     payload + razer_int_to_be32(requestId),
+				     lambda: self._decodeNothing(requestId))
+
+	def _parseMessage(self):
+		"""Message parser generator. It yields the number of bytes it
+		needs next and receives them. Returns (id, payload)."""
+		id = (yield 1)[0]
 		payload = None
 		if id == self.REPLY_ID_U32:
-			payload = razer_be32_to_int(sock.recv(4))
+			payload = razer_be32_to_int((yield 4))
 		elif id == self.REPLY_ID_STR:
-			encoding = sock.recv(1)[0]
-			strlen = razer_be16_to_int(sock.recv(2))
+			hdr = yield 3
+			encoding = hdr[0]
+			strlen = razer_be16_to_int(hdr, 1)
 			if encoding == self.STRING_ENC_ASCII:
 				nrbytes = strlen
 				decode = lambda pl: pl.decode("ASCII")
@@ -393,7 +456,7 @@ class Razer(object):
 			else:
 				raise RazerEx("Received invalid string encoding %d" %\
 					      encoding)
-			payload = sock.recv(nrbytes) if nrbytes else b""
+			payload = yield nrbytes
 			try:
 				payload = decode(payload)
 			except UnicodeError as e:
@@ -402,138 +465,113 @@ class Razer(object):
 			pass
 		elif id == self.NOTIFY_ID_DELMOUSE:
 			pass
+		elif id == self.NOTIFY_ID_MOUSECONFIGURED:
+			idstr = yield self.RAZER_IDSTR_MAX_SIZE
+			payload = idstr.rstrip(b'\0').decode("ASCII")
+		elif id == self.NOTIFY_ID_FLASHRESULT:
+			error = razer_be32_to_int((yield 4))
+			idstr = yield self.RAZER_IDSTR_MAX_SIZE
+			idstr = idstr.rstrip(b'\0').decode("ASCII")
+			payload = (idstr, error)
+		elif id == self.NOTIFY_ID_FLASHPROGRESS:
+			phase, done, total = struct.unpack(">3I", (yield 12))
+			idstr = yield self.RAZER_IDSTR_MAX_SIZE
+			idstr = idstr.rstrip(b'\0').decode("ASCII")
+			payload = (idstr, phase, done, total)
+		elif id == self.NOTIFY_ID_CMDRESULT:
+			payload = struct.unpack(">2I", (yield 8))
 		else:
 			raise RazerEx("Received unknown message (id=%u)" % id)
 
 		return (id, payload)
 
-	def __receiveExpectedMessage(self, sock, expectedId):
-		"""Receive messages until the expected one appears.
-		Unexpected messages will be handled by __handleReceivedMessage.
-		This function returns the payload of the expected message."""
-		while 1:
-			id, payload = self.__receive(sock)
-			if id == expectedId:
-				break
-			else:
-				self.__handleReceivedMessage((id, payload))
-		return payload
-
-	def __recvU32(self):
-		"Receive an expected REPLY_ID_U32"
-		return self.__receiveExpectedMessage(self.sock, self.REPLY_ID_U32)
-
-	def __recvU32Privileged(self):
-		"Receive an expected REPLY_ID_U32 on the privileged socket"
-		try:
-			return self.__receiveExpectedMessage(self.privsock, self.REPLY_ID_U32)
-		except (socket.error, AttributeError) as e:
-			raise RazerEx("Privileged recvU32 failed. Do you have permission?")
-
-	def __recvString(self):
-		"Receive an expected REPLY_ID_STR"
-		return self.__receiveExpectedMessage(self.sock, self.REPLY_ID_STR)
-
-	def pollNotifications(self):
-		"Returns a list of pending notifications (id, payload)"
-		if not self.enableNotifications:
-			raise RazerEx("Polled notifications while notifications were disabled")
-		while 1:
-			res = select.select([self.sock], [], [], 0.001)
-			if not res[0]:
-				break
-			pack = self.__receive(self.sock)
-			self.__handleReceivedMessage(pack)
-		notifications = self.notifications
-		self.notifications = []
-		return notifications
-
 	def rescanMice(self):
 		"Send the command to rescan for mice to the daemon."
-		self.__sendCommand(self.COMMAND_ID_RESCANMICE)
+		return self._command(self.COMMAND_ID_RESCANMICE)
 
 	def rescanDevices(self):
 		"Rescan for new devices."
-		self.rescanMice()
+		return self.rescanMice()
 
 	def getMice(self):
 		"Returns a list of ID-strings for the detected mice."
-		self.__sendCommand(self.COMMAND_ID_GETMICE)
-		count = self.__recvU32()
-		mice = []
-		for i in range(0, count):
-			mice.append(self.__recvString())
-		return mice
+		def decode():
+			count = yield self.REPLY_ID_U32
+			mice = []
+			handles = {}
+			for i in range(0, count):
+				handle = yield self.REPLY_ID_U32
+				idstr = yield self.REPLY_ID_STR
+				handles[idstr] = handle
+				mice.append(idstr)
+			self.mouseHandles = handles
+			return mice
+		return self._command(self.COMMAND_ID_GETMICE, decode=decode)
 
 	def getMouseInfo(self, idstr):
 		"Get detailed information about a mouse"
-		self.__sendCommand(self.COMMAND_ID_GETMOUSEINFO, idstr)
-		flags = self.__recvU32()
-		if (flags & self.MOUSEINFOFLG_RESULTOK) == 0:
-			raise RazerEx("Failed to get mouseinfo for " + idstr)
-		return flags
+		def decode():
+			flags = yield self.REPLY_ID_U32
+			if (flags & self.MOUSEINFOFLG_RESULTOK) == 0:
+				raise RazerCommandFailed("Failed to get mouseinfo for " + idstr)
+			return flags
+		return self._command(self.COMMAND_ID_GETMOUSEINFO, idstr, decode=decode)
 
 	def reconfigureMice(self):
 		"Reconfigure all mice."
-		self.__sendCommand(self.COMMAND_ID_RECONFIGMICE)
+		return self._command(self.COMMAND_ID_RECONFIGMICE)
 
 	def reconfigureDevices(self):
 		"Reconfigure all devices."
-		self.reconfigureMice()
+		return self.reconfigureMice()
 
 	def getFwVer(self, idstr):
 		"Returns the firmware version. The returned value is a tuple (major, minor)."
-		self.__sendCommand(self.COMMAND_ID_GETFWVER, idstr)
-		rawVer = self.__recvU32()
-		return ((rawVer >> 8) & 0xFF, rawVer & 0xFF)
+		def decode():
+			rawVer = yield self.REPLY_ID_U32
+			return ((rawVer >> 8) & 0xFF, rawVer & 0xFF)
+		return self._command(self.COMMAND_ID_GETFWVER, idstr, decode=decode)
 
 	def getSupportedFreqs(self, idstr):
 		"Returns a list of supported frequencies for a mouse."
-		self.__sendCommand(self.COMMAND_ID_SUPPFREQS, idstr)
-		count = self.__recvU32()
-		freqs = []
-		for i in range(0, count):
-			freqs.append(self.__recvU32())
-		return freqs
+		return self._command(self.COMMAND_ID_SUPPFREQS, idstr,
+				     decode=self._decodeU32List)
 
 	def getCurrentFreq(self, idstr, profileId=PROFILE_INVALID):
 		"Returns the currently selected frequency for a mouse."
 		payload = razer_int_to_be32(profileId)
-		self.__sendCommand(self.COMMAND_ID_GETFREQ, idstr, payload)
-		return self.__recvU32()
+		return self._command(self.COMMAND_ID_GETFREQ, idstr, payload,
+				     self._decodeU32)
 
 	def getSupportedRes(self, idstr):
 		"Returns a list of supported resolutions for a mouse."
-		self.__sendCommand(self.COMMAND_ID_SUPPRESOL, idstr)
-		count = self.__recvU32()
-		res = []
-		for i in range(0, count):
-			res.append(self.__recvU32())
-		return res
+		return self._command(self.COMMAND_ID_SUPPRESOL, idstr,
+				     decode=self._decodeU32List)
 
 	def getLeds(self, idstr, profileId=PROFILE_INVALID):
 		"""Returns a list of RazerLED instances for the given profile,
 		or the global LEDs, if no profile given"""
 		payload = razer_int_to_be32(profileId)
-		self.__sendCommand(self.COMMAND_ID_GETLEDS, idstr, payload)
-		count = self.__recvU32()
-		leds = []
-		for i in range(0, count):
-			flags = self.__recvU32()
-			name = self.__recvString()
-			state = self.__recvU32()
-			mode = RazerLEDMode(self.__recvU32())
-			supported_modes = RazerLEDMode.listFromSupportedModes(self.__recvU32())
-			color = self.__recvU32()
-			if (flags & self.LED_FLAG_HAVECOLOR) == 0:
-				color = None
-			else:
-				color = RazerRGB.fromU32(color)
-			canChangeColor = bool(flags & self.LED_FLAG_CHANGECOLOR)
-			leds.append(RazerLED(profileId, name, state, mode, supported_modes, color, canChangeColor))
-		return leds
-
-	def setLed(self, idstr, led):
+		def decode():
+			count = yield self.REPLY_ID_U32
+			leds = []
+			for i in range(0, count):
+				flags = yield self.REPLY_ID_U32
+				name = yield self.REPLY_ID_STR
+				state = yield self.REPLY_ID_U32
+				mode = RazerLEDMode((yield self.REPLY_ID_U32))
+				supported_modes = RazerLEDMode.listFromSupportedModes((yield self.REPLY_ID_U32))
+				color = yield self.REPLY_ID_U32
+				if (flags & self.LED_FLAG_HAVECOLOR) == 0:
+					color = None
+				else:
+					color = RazerRGB.fromU32(color)
+				canChangeColor = bool(flags & self.LED_FLAG_CHANGECOLOR)
+				leds.append(RazerLED(profileId, name, state, mode, supported_modes, color, canChangeColor))
+			return leds
+		return self._command(self.COMMAND_ID_GETLEDS, idstr, payload, decode=decode)
+
+	def setLed(self, idstr, led, noReply=False, ack=False):
 		"Set a LED to a new state."
 		if len(led.name) > self.RAZER_LEDNAME_MAX_SIZE:
 			raise RazerEx("LED name string too long")
@@ -547,44 +585,45 @@ class Razer(object):
 			payload += razer_int_to_be32(led.color.toU32())
 		else:
 			payload += razer_int_to_be32(0)
-		self.__sendCommand(self.COMMAND_ID_SETLED, idstr, payload)
-		return self.__recvU32()
+		return self._sendSetter(self.COMMAND_ID_SETLED, idstr, payload,
+					noReply, ack)
 
-	def setFrequency(self, idstr, profileId, newFrequency):
+	def setFrequency(self, idstr, profileId, newFrequency, noReply=False, ack=False):
 		"Set a new scan frequency (in Hz)."
 		payload = razer_int_to_be32(profileId) + razer_int_to_be32(newFrequency)
-		self.__sendCommand(self.COMMAND_ID_SETFREQ, idstr, payload)
-		return self.__recvU32()
+		return self._sendSetter(self.COMMAND_ID_SETFREQ, idstr, payload,
+					noReply, ack)
 
 	def getSupportedDpiMappings(self, idstr):
 		"Returns a list of supported DPI mappings. Each entry is a RazerDpiMapping() instance."
-		self.__sendCommand(self.COMMAND_ID_SUPPDPIMAPPINGS, idstr)
-		count = self.__recvU32()
-		mappings = []
-		for i in range(0, count):
-			id = self.__recvU32()
-			dimMask = self.__recvU32()
-			res = []
-			for i in range(0, self.RAZER_NR_DIMS):
-				rVal = self.__recvU32()
-				if (dimMask & (1 << i)) == 0:
-					rVal = None
-				res.append(rVal)
-			profileMaskHigh = self.__recvU32()
-			profileMaskLow = self.__recvU32()
-			profileMask = (profileMaskHigh << 32) | profileMaskLow
-			mutable = self.__recvU32()
-			mappings.append(RazerDpiMapping(
-				id, res, profileMask, mutable))
-		return mappings
-
-	def changeDpiMapping(self, idstr, mappingId, dimensionId, newResolution):
+		def decode():
+			count = yield self.REPLY_ID_U32
+			mappings = []
+			for i in range(0, count):
+				id = yield self.REPLY_ID_U32
+				dimMask = yield self.REPLY_ID_U32
+				res = []
+				for i in range(0, self.RAZER_NR_DIMS):
+					rVal = yield self.REPLY_ID_U32
+					if (dimMask & (1 << i)) == 0:
+						rVal = None
+					res.append(rVal)
+				profileMaskHigh = yield self.REPLY_ID_U32
+				profileMaskLow = yield self.REPLY_ID_U32
+				profileMask = (profileMaskHigh << 32) | profileMaskLow
+				mutable = yield self.REPLY_ID_U32
+				mappings.append(RazerDpiMapping(
+					id, res, profileMask, mutable))
+			return mappings
+		return self._command(self.COMMAND_ID_SUPPDPIMAPPINGS, idstr, decode=decode)
+
+	def changeDpiMapping(self, idstr, mappingId, dimensionId, newResolution, noReply=False, ack=False):
 		"Changes the resolution value of a DPI mapping."
 		payload = razer_int_to_be32(mappingId) +\
 			  razer_int_to_be32(dimensionId) +\
 			  razer_int_to_be32(newResolution)
-		self.__sendCommand(self.COMMAND_ID_CHANGEDPIMAPPING, idstr, payload)
-		return self.__recvU32()
+		return self._sendSetter(self.COMMAND_ID_CHANGEDPIMAPPING, idstr, payload,
+					noReply, ack)
 
 	def getDpiMapping(self, idstr, profileId, axisId=None):
 		"Gets the resolution mapping of a profile."
@@ -592,111 +631,463 @@ class Razer(object):
 			axisId = 0xFFFFFFFF
 		payload = razer_int_to_be32(profileId) +\
 			  razer_int_to_be32(axisId)
-		self.__sendCommand(self.COMMAND_ID_GETDPIMAPPING, idstr, payload)
-		return self.__recvU32()
+		return self._command(self.COMMAND_ID_GETDPIMAPPING, idstr, payload,
+				     self._decodeU32)
 
-	def setDpiMapping(self, idstr, profileId, mappingId, axisId=None):
+	def setDpiMapping(self, idstr, profileId, mappingId, axisId=None, noReply=False, ack=False):
 		"Sets the resolution mapping of a profile."
 		if axisId is None:
 			axisId = 0xFFFFFFFF
 		payload = razer_int_to_be32(profileId) +\
 			  razer_int_to_be32(axisId) +\
 			  razer_int_to_be32(mappingId)
-		self.__sendCommand(self.COMMAND_ID_SETDPIMAPPING, idstr, payload)
-		return self.__recvU32()
+		return self._sendSetter(self.COMMAND_ID_SETDPIMAPPING, idstr, payload,
+					noReply, ack)
 
 	def getProfiles(self, idstr):
 		"Returns a list of profiles. Each entry is the profile ID."
-		self.__sendCommand(self.COMMAND_ID_GETPROFILES, idstr)
-		count = self.__recvU32()
-		profiles = []
-		for i in range(0, count):
-			profiles.append(self.__recvU32())
-		return profiles
+		return self._command(self.COMMAND_ID_GETPROFILES, idstr,
+				     decode=self._decodeU32List)
 
 	def getActiveProfile(self, idstr):
 		"Returns the ID of the active profile."
-		self.__sendCommand(self.COMMAND_ID_GETACTIVEPROF, idstr)
-		return self.__recvU32()
+		return self._command(self.COMMAND_ID_GETACTIVEPROF, idstr,
+				     decode=self._decodeU32)
 
-	def setActiveProfile(self, idstr, profileId):
+	def setActiveProfile(self, idstr, profileId, noReply=False, ack=False):
 		"Selects the active profile."
 		payload = razer_int_to_be32(profileId)
-		self.__sendCommand(self.COMMAND_ID_SETACTIVEPROF, idstr, payload)
-		return self.__recvU32()
+		return self._sendSetter(self.COMMAND_ID_SETACTIVEPROF, idstr, payload,
+					noReply, ack)
+
+	def claimMouse(self, idstr, noReply=False, ack=False):
+		"""Keep the mouse claimed until releaseMouse().
+		The settings changed meanwhile are committed to the
+		hardware at once, when the last claim is released.
+		razerd releases the claims, if the connection is closed,
+		and 5 seconds after the last claimMouse(). releaseMouse() fails then.
+		Calling claimMouse() again renews the claim for another 5 seconds.
+		The setters of other connections fail with ERR_CLAIM meanwhile."""
+		return self._sendSetter(self.COMMAND_ID_CLAIMMOUSE, idstr, b"",
+					noReply, ack)
+
+	def releaseMouse(self, idstr, noReply=False, ack=False):
+		"Release a mouse claimed by claimMouse(). Returns the commit result."
+		return self._sendSetter(self.COMMAND_ID_RELEASEMOUSE, idstr, b"",
+					noReply, ack)
+
+	def getAppSwitchStats(self):
+		"""Get the statistics of the per-application profile switching:
+		[nrSwitches, lastMicroseconds, avgMicroseconds, maxMicroseconds]
+		The time is measured from the exec() of the application."""
+		return self._command(self.COMMAND_ID_GETAPPSTATS,
+				     decode=self._decodeU32List)
 
 	def getProfileName(self, idstr, profileId):
 		"Get a profile name."
 		payload = razer_int_to_be32(profileId)
-		self.__sendCommand(self.COMMAND_ID_GETPROFNAME, idstr, payload)
-		return self.__recvString()
+		return self._command(self.COMMAND_ID_GETPROFNAME, idstr, payload,
+				     self._decodeString)
 
-	def setProfileName(self, idstr, profileId, newName):
+	def setProfileName(self, idstr, profileId, newName, noReply=False, ack=False):
 		"Set a profile name. newName is expected to be unicode."
 		payload = razer_int_to_be32(profileId)
 		rawstr = newName.encode("UTF-16-BE")
 		rawstr = rawstr[:min(len(rawstr), 64 * 2)]
 		rawstr += b'\0' * (64 * 2 - len(rawstr))
 		payload += rawstr
-		self.__sendCommand(self.COMMAND_ID_SETPROFNAME, idstr, payload)
-		return self.__recvU32()
-
-	def flashFirmware(self, idstr, image):
-		"Flash a new firmware on the device. Needs high privileges!"
-		payload = razer_int_to_be32(len(image))
-		self.__sendPrivilegedCommand(self.COMMAND_PRIV_FLASHFW, idstr, payload)
-		self.__sendBulkPrivileged(image)
-		return self.__recvU32Privileged()
+		return self._sendSetter(self.COMMAND_ID_SETPROFNAME, idstr, payload,
+					noReply, ack)
 
 	def getSupportedButtons(self, idstr):
 		"Get a list of supported buttons. Each entry is a tuple (id, name)."
-		self.__sendCommand(self.COMMAND_ID_SUPPBUTTONS, idstr)
-		buttons = []
-		count = self.__recvU32()
-		for i in range(0, count):
-			id = self.__recvU32()
-			name = self.__recvString()
-			buttons.append( (id, name) )
-		return buttons
+		def decode():
+			buttons = []
+			count = yield self.REPLY_ID_U32
+			for i in range(0, count):
+				id = yield self.REPLY_ID_U32
+				name = yield self.REPLY_ID_STR
+				buttons.append( (id, name) )
+			return buttons
+		return self._command(self.COMMAND_ID_SUPPBUTTONS, idstr, decode=decode)
 
 	def getSupportedButtonFunctions(self, idstr):
 		"Get a list of possible button functions. Each entry is a tuple (id, name)."
-		self.__sendCommand(self.COMMAND_ID_SUPPBUTFUNCS, idstr)
-		funcs = []
-		count = self.__recvU32()
-		for i in range(0, count):
-			id = self.__recvU32()
-			name = self.__recvString()
-			funcs.append( (id, name) )
-		return funcs
+		def decode():
+			funcs = []
+			count = yield self.REPLY_ID_U32
+			for i in range(0, count):
+				id = yield self.REPLY_ID_U32
+				name = yield self.REPLY_ID_STR
+				funcs.append( (id, name) )
+			return funcs
+		return self._command(self.COMMAND_ID_SUPPBUTFUNCS, idstr, decode=decode)
 
 	def getButtonFunction(self, idstr, profileId, buttonId):
 		"Get a button function. Returns a tuple (id, name)."
 		payload = razer_int_to_be32(profileId) + razer_int_to_be32(buttonId)
-		self.__sendCommand(self.COMMAND_ID_GETBUTFUNC, idstr, payload)
-		id = self.__recvU32()
-		name = self.__recvString()
-		return (id, name)
+		def decode():
+			id = yield self.REPLY_ID_U32
+			name = yield self.REPLY_ID_STR
+			return (id, name)
+		return self._command(self.COMMAND_ID_GETBUTFUNC, idstr, payload, decode=decode)
 
-	def setButtonFunction(self, idstr, profileId, buttonId, functionId):
+	def setButtonFunction(self, idstr, profileId, buttonId, functionId, noReply=False, ack=False):
 		"Set a button function."
 		payload = razer_int_to_be32(profileId) +\
 			  razer_int_to_be32(buttonId) +\
 			  razer_int_to_be32(functionId)
-		self.__sendCommand(self.COMMAND_ID_SETBUTFUNC, idstr, payload)
-		return self.__recvU32()
+		return self._sendSetter(self.COMMAND_ID_SETBUTFUNC, idstr, payload,
+					noReply, ack)
 
 	def getSupportedAxes(self, idstr):
 		"Get a list of axes on the device. Each entry is a tuple (id, name, flags)."
-		self.__sendCommand(self.COMMAND_ID_SUPPAXES, idstr)
-		axes = []
-		count = self.__recvU32()
-		for i in range(0, count):
-			id = self.__recvU32()
-			name = self.__recvString()
-			flags = self.__recvU32()
-			axes.append( (id, name, flags) )
-		return axes
+		def decode():
+			axes = []
+			count = yield self.REPLY_ID_U32
+			for i in range(0, count):
+				id = yield self.REPLY_ID_U32
+				name = yield self.REPLY_ID_STR
+				flags = yield self.REPLY_ID_U32
+				axes.append( (id, name, flags) )
+			return axes
+		return self._command(self.COMMAND_ID_SUPPAXES, idstr, decode=decode)
+
+class Razer(RazerProtocol):
+	"Blocking connection to razerd"
+
+	RECV_CHUNK_SIZE = 4096
+	PIPELINE_DEPTH = 32		# Pipelined commands in flight
+
+	def __init__(self, enableNotifications=False):
+		"Connect to razerd."
+		RazerProtocol.__init__(self)
+		self.enableNotifications = enableNotifications
+		self.notifications = []
+		self.notificationCallback = None
+		self.flashResults = []
+		self.commandResults = []
+		self.flashProgressCallback = None
+		self.flashCancelled = set()
+		self.rxBuffers = {}
+		self.pipelineQueue = None
+		self.pipelineData = None
+		try:
+			self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+			self.sock.connect(self.SOCKET_PATH)
+		except socket.error as e:
+			raise RazerEx("Failed to connect to razerd socket: %s" % e)
+		try:
+			self.privsock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+			self.privsock.connect(self.PRIVSOCKET_PATH)
+		except socket.error as e:
+			self.privsock = None # No privileged access
+
+		rev = self._command(self.COMMAND_ID_GETREV, decode=self._decodeU32)
+		if (rev != self.INTERFACE_REVISION):
+			additional = ""
+			if rev < self.INTERFACE_REVISION:
+				additional = "\nThe running razerd is too old. " \
+					"Try to delete all razerd binaries and " \
+					"re-install the razercfg package."
+			raise RazerEx("Incompatible razerd daemon socket interface revision.\n"
+				      "razerd reported revision %u, but we expected revision %u."
+				      "%s" %\
+					(rev, self.INTERFACE_REVISION, additional))
+
+	def __mouseHandle(self, idstr):
+		"Get the handle of a mouse. Returns 0, if the mouse is unknown."
+		if not idstr:
+			return 0
+		handle = self.mouseHandles.get(idstr)
+		if handle is None:
+			# The lookup must not be queued in a pipeline.
+			queue, data = self.pipelineQueue, self.pipelineData
+			self.pipelineQueue, self.pipelineData = None, None
+			try:
+				self.getMice()
+			finally:
+				self.pipelineQueue, self.pipelineData = queue, data
+			handle = self.mouseHandles.get(idstr, 0)
+		return handle
+
+	def __constructPrivilegedCommand(self, commandId, idstr, payload):
+		cmd = bytes((commandId,))
+		idstr = idstr.encode("UTF-8")
+		idstr += b'\0' * (self.RAZER_IDSTR_MAX_SIZE - len(idstr))
+		cmd += idstr
+		cmd += payload
+		cmd += b'\0' * (self.COMMAND_MAX_SIZE - len(cmd))
+		return cmd
+
+	def __send(self, data):
+		self.sock.sendall(data)
+
+	def __sendPrivileged(self, data):
+		try:
+			self.privsock.sendall(data)
+		except (socket.error, AttributeError) as e:
+			raise RazerEx("Privileged command failed. Do you have permission?")
+
+	def __sendBulkPrivileged(self, data):
+		for i in range(0, len(data), self.BULK_CHUNK_SIZE):
+			chunk = data[i : i + self.BULK_CHUNK_SIZE]
+			self.__sendPrivileged(chunk)
+			result = self.__recvU32Privileged()
+			if result != 0:
+				raise RazerEx("Privileged bulk write failed. %u" % result)
+
+	def __commandNow(self, commandId, idstr, payload, decode):
+		cmd = self._constructCommand(commandId, self.__mouseHandle(idstr), payload)
+		self.__send(cmd)
+		try:
+			return self.__decode(decode)
+		finally:
+			self.__signalBuffered()
+
+	def __signalBuffered(self):
+		"""The reply might have been received together with the start
+		of a notification. Buffered data does not wake up fileno(),
+		so it is signalled through notificationCallback."""
+		if self.rxBuffers.get(self.sock) and self.notificationCallback:
+			self.notificationCallback()
+
+	def _command(self, commandId, idstr="", payload=b"", decode=None):
+		"""Send a command and return the decoded reply.
+		Inside of a pipeline the command is queued instead and
+		a RazerPending is returned."""
+		if self.pipelineQueue is None:
+			result = self.__commandNow(commandId, idstr, payload, decode)
+			if self._dropStaleHandle(idstr, decode, result):
+				result = self.__commandNow(commandId, idstr, payload, decode)
+			return result
+		cmd = self._constructCommand(commandId, self.__mouseHandle(idstr), payload)
+		pending = RazerPending()
+		self.pipelineData.append(cmd)
+		self.pipelineQueue.append( (pending, decode) )
+		return pending
+
+	def beginPipeline(self):
+		"""Queue all following commands until flushPipeline().
+		The commands return RazerPending objects instead of their results."""
+		if self.pipelineQueue is not None:
+			raise RazerEx("A pipeline is already active")
+		self.pipelineQueue = []
+		self.pipelineData = []
+
+	def abortPipeline(self):
+		"Drop all queued commands without sending them."
+		self.pipelineQueue = None
+		self.pipelineData = None
+
+	def flushPipeline(self):
+		"""Send all queued commands and receive all replies.
+		At most PIPELINE_DEPTH commands are in flight. Older replies are
+		received before more commands are sent, so neither side blocks
+		on a full socket.
+		Returns the list of RazerPending objects in queueing order."""
+		queue, data = self.pipelineQueue, self.pipelineData
+		if queue is None:
+			raise RazerEx("No pipeline is active")
+		self.abortPipeline()
+		for start in range(0, len(queue), self.PIPELINE_DEPTH):
+			end = start + self.PIPELINE_DEPTH
+			self.__send(b"".join(data[start : end]))
+			for pending, decode in queue[start : end]:
+				try:
+					pending.complete(self.__decode(decode))
+				except RazerEx as e:
+					pending.complete(error=e)
+		self.__signalBuffered()
+		return [ pending for pending, decode in queue ]
+
+	@contextlib.contextmanager
+	def pipeline(self):
+		"""Pipeline the commands of a with-block:
+			with razer.pipeline():
+				ver = razer.getFwVer(idstr)
+				leds = razer.getLeds(idstr)
+			print(ver.get(), leds.get())
+		The commands are sent when the block is left."""
+		self.beginPipeline()
+		try:
+			yield self
+		except:
+			self.abortPipeline()
+			raise
+		self.flushPipeline()
+
+	def __sendPrivilegedCommand(self, commandId, idstr="", payload=b""):
+		cmd = self.__constructPrivilegedCommand(commandId, idstr, payload)
+		self.__sendPrivileged(cmd)
+
+	def __handleReceivedMessage(self, packet):
+		id = packet[0]
+		if id < self._NOTIFY_ID_FIRST:
+			raise RazerEx("Received unhandled packet %u" % id)
+		if id == self.NOTIFY_ID_FLASHRESULT:
+			self.flashResults.append(packet[1])
+			return
+		if id == self.NOTIFY_ID_FLASHPROGRESS:
+			self.__handleFlashProgress(*packet[1])
+			return
+		if id == self.NOTIFY_ID_CMDRESULT:
+			self.commandResults.append(packet[1])
+			return
+		if id in (self.NOTIFY_ID_NEWMOUSE, self.NOTIFY_ID_DELMOUSE):
+			self.mouseHandles = {}
+		if self.enableNotifications:
+			self.notifications.append(packet)
+			if self.notificationCallback:
+				self.notificationCallback()
+
+	def __recvExact(self, sock, size):
+		"Receive exactly size bytes. This will block until they arrive."
+		buf = self.rxBuffers.setdefault(sock, bytearray())
+		while len(buf) < size:
+			data = sock.recv(max(size - len(buf), self.RECV_CHUNK_SIZE))
+			if not data:
+				raise RazerEx("razerd closed the connection")
+			buf += data
+		data = bytes(buf[:size])
+		del buf[:size]
+		return data
+
+	def __receive(self, sock):
+		"Receive the next message. This will block until a message arrives."
+		return self._runGenerator(self._parseMessage(),
+					  lambda size: self.__recvExact(sock, size))
+
+	def __receiveExpectedMessage(self, sock, expectedId):
+		"""Receive messages until the expected one appears.
+		Unexpected messages will be handled by __handleReceivedMessage.
+		This function returns the payload of the expected message."""
+		while 1:
+			id, payload = self.__receive(sock)
+			if id == expectedId:
+				break
+			else:
+				self.__handleReceivedMessage((id, payload))
+		return payload
+
+	def __decode(self, decode):
+		"Receive and decode the reply of a command."
+		if not decode:
+			return None
+		return self._runGenerator(decode(),
+			lambda expectedId: self.__receiveExpectedMessage(self.sock, expectedId))
+
+	def __recvU32Privileged(self):
+		"Receive an expected REPLY_ID_U32 on the privileged socket"
+		try:
+			return self.__receiveExpectedMessage(self.privsock, self.REPLY_ID_U32)
+		except (socket.error, AttributeError) as e:
+			raise RazerEx("Privileged recvU32 failed. Do you have permission?")
+
+	def __receivePending(self, timeout=0.001):
+		"Handle all messages that arrive within timeout seconds."
+		while 1:
+			if not self.rxBuffers.get(self.sock):
+				res = select.select([self.sock], [], [], timeout)
+				if not res[0]:
+					break
+			pack = self.__receive(self.sock)
+			self.__handleReceivedMessage(pack)
+
+	def fileno(self):
+		"""Returns the socket file descriptor for event loops.
+		It becomes readable, if razerd sent a notification.
+		Notifications that arrive during a command are not signalled
+		on the descriptor. Set notificationCallback to catch them."""
+		return self.sock.fileno()
+
+	def pollNotifications(self, timeout=0.001):
+		"Returns a list of pending notifications (id, payload)"
+		if not self.enableNotifications:
+			raise RazerEx("Polled notifications while notifications were disabled")
+		self.__receivePending(timeout)
+		notifications = self.notifications
+		self.notifications = []
+		return notifications
+
+	def pollCommandResults(self, timeout=0.001):
+		"""Returns a list of results of noReply commands as tuples
+		(requestId, errorcode). Without ack only failures are reported."""
+		self.__receivePending(timeout)
+		results = self.commandResults
+		self.commandResults = []
+		return results
+
+
+	def __handleFlashProgress(self, idstr, phase, done, total):
+		callback = self.flashProgressCallback
+		if not callback or idstr in self.flashCancelled:
+			return
+		if callback(idstr, phase, done, total):
+			self.cancelFlash(idstr)
+
+	def flashFirmware(self, idstr, image, progressCallback=None):
+		"""Flash a new firmware on the device. Needs high privileges!
+		progressCallback(idstr, phase, done, total) is called on progress
+		notifications. If it returns True, the flash is cancelled."""
+		payload = razer_int_to_be32(len(image))
+		self.flashProgressCallback = progressCallback
+		self.flashCancelled = set()
+		try:
+			self.__sendPrivilegedCommand(self.COMMAND_PRIV_FLASHFW, idstr, payload)
+			self.__sendBulkPrivileged(image)
+			return self.__recvU32Privileged()
+		finally:
+			self.flashProgressCallback = None
+
+	def cancelFlash(self, idstr=""):
+		"""Cancel a running flash. An empty idstr cancels all flashes.
+		A flash can only be cancelled before the image is written.
+		A cancelled flash finishes with ERR_CANCELED."""
+		self.flashCancelled.add(idstr)
+		self.__sendPrivilegedCommand(self.COMMAND_PRIV_FLASHCANCEL, idstr)
+
+	def uploadFirmware(self, image):
+		"""Upload a firmware image to the daemon. Needs high privileges!
+		Returns the image hash, which can be passed to flashMany()."""
+		payload = razer_int_to_be32(len(image))
+		self.__sendPrivilegedCommand(self.COMMAND_PRIV_UPLOADFW, "", payload)
+		self.__sendBulkPrivileged(image)
+		error = self.__recvU32Privileged()
+		if error:
+			raise RazerEx("Failed to upload firmware (%s)" % Razer.strerror(error))
+		return self.__recvU32Privileged()
+
+	def flashMany(self, imageHash, idstrs):
+		"""Flash an uploaded firmware image to several devices at once.
+		Needs high privileges! Returns the error code of the request.
+		The per-device results are fetched with waitFlashResults()."""
+		payload = razer_int_to_be32(imageHash) + razer_int_to_be32(len(idstrs))
+		self.__sendPrivilegedCommand(self.COMMAND_PRIV_FLASHMANY, "", payload)
+		data = b""
+		for idstr in idstrs:
+			idstr = idstr.encode("UTF-8")
+			data += idstr + b'\0' * (self.RAZER_IDSTR_MAX_SIZE - len(idstr))
+		self.__sendBulkPrivileged(data)
+		return self.__recvU32Privileged()
+
+	def waitFlashResults(self, count, progressCallback=None):
+		"""Wait for the results of count devices of flashMany().
+		progressCallback is the same as for flashFirmware().
+		Returns a list of tuples (idstr, error)."""
+		self.flashProgressCallback = progressCallback
+		self.flashCancelled = set()
+		try:
+			while len(self.flashResults) < count:
+				pack = self.__receive(self.privsock)
+				self.__handleReceivedMessage(pack)
+		except (socket.error, AttributeError) as e:
+			raise RazerEx("Privileged receive failed. Do you have permission?")
+		finally:
+			self.flashProgressCallback = None
+		results = self.flashResults[:count]
+		self.flashResults = self.flashResults[count:]
+		return results
 
 class IHEXParser(object):
 	TYPE_DATA = 0
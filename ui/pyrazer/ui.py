@@ -148,6 +148,7 @@ class OneLedConfig(QWidget):
 		self.setLayout(QGridLayout(self))
 		self.layout().setContentsMargins(QMargins())
 
+		self.modeComBox = None
 		self.stateCb = QCheckBox(led.name + " LED", self)
 		self.layout().addWidget(self.stateCb, 0, 0)
 		self.stateCb.setCheckState(Qt.CheckState.Checked if led.state else Qt.CheckState.Unchecked)
@@ -173,6 +174,19 @@ class OneLedConfig(QWidget):
 
 		self.stateCb.stateChanged.connect(self.toggled)
 
+	def update(self, led):
+		# Show the new state without writing it back to the device.
+		self.led = led
+		self.stateCb.blockSignals(True)
+		self.stateCb.setCheckState(Qt.CheckState.Checked if led.state else Qt.CheckState.Unchecked)
+		self.stateCb.blockSignals(False)
+		if self.modeComBox:
+			index = self.modeComBox.findData(led.mode.val)
+			if index >= 0:
+				self.modeComBox.blockSignals(True)
+				self.modeComBox.setCurrentIndex(index)
+				self.modeComBox.blockSignals(False)
+
 	def toggled(self, state):
 		self.led.state = bool(state)
 		razer.setLed(self.ledsWidget.mouseWidget.mouse, self.led)
@@ -214,9 +228,15 @@ class LedsWidget(QGroupBox):
 		self.show()
 
 	def updateContent(self, profileId=Razer.PROFILE_INVALID):
-		for led in razer.getLeds(self.mouseWidget.mouse, profileId):
+		leds = razer.getLeds(self.mouseWidget.mouse, profileId)
+		if self.leds and\
+		   [ led.name for led in leds ] == [ oneLed.led.name for oneLed in self.leds ]:
+			for oneLed, led in zip(self.leds, leds):
+				oneLed.update(led)
+			return
+		self.clear()
+		for led in leds:
 			self.add(led)
-			self.show()
 
 #TODO profile name
 class MouseProfileWidget(QWidget):
@@ -242,6 +262,7 @@ class MouseProfileWidget(QWidget):
 			yoff += 1
 
 		self.resSel = []
+		self.resSelMappings = None
 		axes = self.__getIndependentAxes()
 		for axis in axes:
 			axisName = axis[1] + " " if axis[1] else ""
@@ -295,8 +316,6 @@ class MouseProfileWidget(QWidget):
 			self.freqSel.updateContent()
 
 		# Resolution selection
-		for resSel in self.resSel:
-			resSel.clear()
 		supportedMappings = razer.getSupportedDpiMappings(self.mouseWidget.mouse)
 		supportedMappings = [m for m in supportedMappings if (m.profileMask == 0) or\
 						     (m.profileMask & (1 << self.profileId))]
@@ -305,15 +324,21 @@ class MouseProfileWidget(QWidget):
 			axisMappings.append(razer.getDpiMapping(self.mouseWidget.mouse,
 								self.profileId,
 								axis[0]))
+		resSelMappings = [ (m.id, m.res) for m in supportedMappings ]
+		if resSelMappings != self.resSelMappings:
+			# Only rebuild the lists, if the mappings changed.
+			self.resSelMappings = resSelMappings
+			for resSel in self.resSel:
+				resSel.clear()
+				resSel.addItem(self.tr("Unknown mapping"), 0xFFFFFFFF)
+				for mapping in supportedMappings:
+					r = [ r for r in mapping.res if r is not None ]
+					r = [ ("%u" % x) if x else self.tr("Unknown") for x in r]
+					rStr = "/".join(r)
+					resSel.addItem(self.tr("Scan resolution %u   (%s DPI)" %\
+							(mapping.id + 1, rStr)),
+							mapping.id)
 		for i, resSel in enumerate(self.resSel):
-			resSel.addItem(self.tr("Unknown mapping"), 0xFFFFFFFF)
-			for mapping in supportedMappings:
-				r = [ r for r in mapping.res if r is not None ]
-				r = [ ("%u" % x) if x else self.tr("Unknown") for x in r]
-				rStr = "/".join(r)
-				resSel.addItem(self.tr("Scan resolution %u   (%s DPI)" %\
-						(mapping.id + 1, rStr)),
-						mapping.id)
 			index = resSel.findData(axisMappings[i])
 			if index >= 0:
 				resSel.setCurrentIndex(index)
@@ -329,11 +354,9 @@ class MouseProfileWidget(QWidget):
 		self.profileActive.setChecked(activeProf == self.profileId)
 
 		# Per-profile DPI mappings (if any)
-		self.dpimappings.clear()
 		self.dpimappings.updateContent(self.profileId)
 
 		# Per-profile LEDs (if any)
-		self.leds.clear()
 		self.leds.updateContent(self.profileId)
 
 		self.mouseWidget.recurseProtect -= 1
@@ -473,10 +496,16 @@ class MouseDpiMappingsWidget(QGroupBox):
 			self.show()
 
 	def updateContent(self, profileId=Razer.PROFILE_INVALID):
-		for dpimapping in razer.getSupportedDpiMappings(self.mouseWidget.mouse):
-			if (profileId == Razer.PROFILE_INVALID and dpimapping.profileMask == 0) or\
-			   (profileId != Razer.PROFILE_INVALID and dpimapping.profileMask & (1 << profileId)):
-				self.add(dpimapping)
+		dpimappings = [ m for m in razer.getSupportedDpiMappings(self.mouseWidget.mouse)
+				if (profileId == Razer.PROFILE_INVALID and m.profileMask == 0) or\
+				   (profileId != Razer.PROFILE_INVALID and m.profileMask & (1 << profileId)) ]
+		key = lambda m: (m.id, m.res, m.mutable)
+		if self.mappings and\
+		   [ key(m) for m in dpimappings ] == [ key(w.dpimapping) for w in self.mappings ]:
+			return
+		self.clear()
+		for dpimapping in dpimappings:
+			self.add(dpimapping)
 
 class MouseScanFreqWidget(QWidget):
 	def __init__(self, parent, mouseWidget, profileId=Razer.PROFILE_INVALID):
@@ -484,6 +513,7 @@ class MouseScanFreqWidget(QWidget):
 		self.setContentsMargins(QMargins())
 		self.mouseWidget = mouseWidget
 		self.profileId = profileId
+		self.supportedFreqs = None
 
 		self.setLayout(QGridLayout(self))
 		self.layout().setContentsMargins(QMargins())
@@ -503,12 +533,14 @@ class MouseScanFreqWidget(QWidget):
 	def updateContent(self):
 		self.mouseWidget.recurseProtect += 1
 
-		self.freqSel.clear()
 		supportedFreqs = razer.getSupportedFreqs(self.mouseWidget.mouse)
 		curFreq = razer.getCurrentFreq(self.mouseWidget.mouse, self.profileId)
-		self.freqSel.addItem(self.tr("Unknown Hz"), 0)
-		for freq in supportedFreqs:
-			self.freqSel.addItem(self.tr("%u Hz" % freq), freq)
+		if supportedFreqs != self.supportedFreqs:
+			self.supportedFreqs = supportedFreqs
+			self.freqSel.clear()
+			self.freqSel.addItem(self.tr("Unknown Hz"), 0)
+			for freq in supportedFreqs:
+				self.freqSel.addItem(self.tr("%u Hz" % freq), freq)
 		index = self.freqSel.findData(curFreq)
 		if index >= 0:
 			self.freqSel.setCurrentIndex(index)
@@ -519,6 +551,8 @@ class MouseWidget(QWidget):
 	def __init__(self, parent=None):
 		QWidget.__init__(self, parent)
 		self.recurseProtect = 0
+		self.mice = []
+		self.mouse = None
 
 		self.mainwnd = parent
 
@@ -547,13 +581,23 @@ class MouseWidget(QWidget):
 		self.layout().addWidget(self.fwVer)
 
 	def updateContent(self, mice):
+		if mice == self.mice:
+			return
 		self.mice = mice
+		# Keep the selected mouse, if it is still there.
+		self.mousesel.blockSignals(True)
 		self.mousesel.clear()
 		for mouse in mice:
 			id = RazerDevId(mouse)
 			self.mousesel.addItem("%s   %s-%s %s" % \
 				(id.getDevName(), id.getBusType(),
 				 id.getBusPosition(), id.getDevId()))
+		if self.mouse in mice:
+			self.mousesel.setCurrentIndex(mice.index(self.mouse))
+			self.mousesel.blockSignals(False)
+			return
+		self.mousesel.blockSignals(False)
+		self.mouseChanged(self.mousesel.currentIndex())
 
 	def mouseChanged(self, index):
 		self.profiletab.clear()
@@ -562,6 +606,7 @@ class MouseWidget(QWidget):
 		self.leds.clear()
 		self.profiletab.setEnabled(index > -1)
 		if index == -1:
+			self.mouse = None
 			self.fwVer.clear()
 			return
 		self.mouse = self.mice[index]
@@ -606,7 +651,19 @@ class MouseWidget(QWidget):
 			self.fwVer.setText(self.tr("Firmware version: %u.%02u%s" % (ver[0], ver[1], extra)))
 			self.fwVer.show()
 
+	def reload(self):
+		# Refetch the settings of the selected mouse
+		if self.mouse is None:
+			return
+		self.reloadProfiles()
+		if not self.freqSel.isHidden():
+			self.freqSel.updateContent()
+		self.dpimappings.updateContent()
+		self.leds.updateContent()
+
 	def reloadProfiles(self):
+		if self.mouse is None:
+			return
 		for prof in self.profileWidgets:
 			prof.reload()
 		activeProf = razer.getActiveProfile(self.mouse)
@@ -615,7 +672,42 @@ class MouseWidget(QWidget):
 			name = razer.getProfileName(self.mouse, profileId)
 			if activeProf == profileId:
 				name = ">" + name + "<"
-			self.profiletab.setTabText(i, name)
+			if self.profiletab.tabText(i) != name:
+				self.profiletab.setTabText(i, name)
+
+class NotificationWatcher(QObject):
+	"Watches the razerd socket and emits the received notifications."
+
+	notified = Signal(list)
+	disconnected = Signal(str)
+
+	def __init__(self, parent):
+		QObject.__init__(self, parent)
+		self.__pending = False
+		self.__notifier = QSocketNotifier(razer.fileno(),
+						  QSocketNotifier.Type.Read, self)
+		self.__notifier.activated.connect(self.__schedule)
+		# Notifications that arrive while a command waits for its reply
+		# are read by pyrazer and do not wake up the socket notifier.
+		razer.notificationCallback = self.__schedule
+
+	def __schedule(self, *unused):
+		if not self.__pending:
+			self.__pending = True
+			QTimer.singleShot(0, self.__poll)
+
+	def __poll(self):
+		self.__pending = False
+		try:
+			notifications = razer.pollNotifications(timeout=0)
+		except RazerEx as e:
+			# The socket stays readable after EOF. Stop watching it.
+			self.__notifier.setEnabled(False)
+			razer.notificationCallback = None
+			self.disconnected.emit(str(e))
+			return
+		if notifications:
+			self.notified.emit(notifications)
 
 class StatusBar(QStatusBar):
 	def showMessage(self, msg):
@@ -625,7 +717,7 @@ class MainWindow(QMainWindow):
 	shown = Signal(QWidget)
 	hidden = Signal(QWidget)
 
-	def __init__(self, parent = None, enableNotificationPolling = True):
+	def __init__(self, parent = None, enableNotifications = True):
 		QMainWindow.__init__(self, parent)
 		self.setWindowTitle(self.tr("Razer device configuration"))
 
@@ -650,19 +742,30 @@ class MainWindow(QMainWindow):
 
 		self.mice = []
 		self.scan()
-		if enableNotificationPolling:
-			self.__notifyPollTimer = QTimer(self)
-			self.__notifyPollTimer.timeout.connect(self.pollNotifications)
-			self.__notifyPollTimer.start(300)
-
-	def pollNotifications(self):
-		n = razer.pollNotifications()
-		if n:
-			self.scan()
+		if enableNotifications:
+			self.__notificationWatcher = NotificationWatcher(self)
+			self.__notificationWatcher.notified.connect(self.handleNotifications)
+			self.__notificationWatcher.disconnected.connect(self.handleDisconnect)
+
+	def handleDisconnect(self, message):
+		QMessageBox.critical(self, self.tr("Razer device configuration"),
+				     self.tr("Lost the connection to razerd:\n%s" % message))
+
+	def handleNotifications(self, notifications):
+		ids = { n[0] for n in notifications }
+		configured = { n[1] for n in notifications
+			       if n[0] == Razer.NOTIFY_ID_MOUSECONFIGURED }
+		if ids & { Razer.NOTIFY_ID_NEWMOUSE, Razer.NOTIFY_ID_DELMOUSE }:
+			self.updateMice()
+		elif self.mousewidget.mouse in configured:
+			self.mousewidget.reload()
 
 	# Rescan for new devices
 	def scan(self):
 		razer.rescanMice()
+		self.updateMice()
+
+	def updateMice(self):
 		mice = razer.getMice()
 		if len(mice) != len(self.mice):
 			if (len(mice) == 1):
@@ -693,7 +796,7 @@ class MainWindow(QMainWindow):
 
 class AppletMainWindow(MainWindow):
 	def __init__(self, parent=None):
-		super().__init__(parent, enableNotificationPolling = False)
+		super().__init__(parent, enableNotifications = False)
 
 	def updateContent(self):
 		self.mousewidget.reloadProfiles()
@@ -720,22 +823,16 @@ class RazerApplet(QSystemTrayIcon):
 		self.menu = QMenu()
 		self.mainwnd = AppletMainWindow()
 
-		self.__pollTimer = QTimer(self)
-		self.__pollTimer.setInterval(300)
-		self.__pollTimer.stop()
-
 		self.mainwnd.scan()
 		self.mice = razer.getMice();
 		self.buildMenu()
 
 		self.setContextMenu(self.menu)
 
-		self.__pollTimer.timeout.connect(self.updateContent)
-		self.contextMenu().aboutToShow.connect(self.__contextAboutToShow)
-		self.contextMenu().aboutToHide.connect(self.__contextAboutToHide)
+		self.__notificationWatcher = NotificationWatcher(self)
+		self.__notificationWatcher.notified.connect(self.__handleNotifications)
+		self.__notificationWatcher.disconnected.connect(self.__handleDisconnect)
 		self.activated.connect(self.__handleActivate)
-		self.mainwnd.shown.connect(self.__mainwndShown)
-		self.mainwnd.hidden.connect(self.__mainwndHidden)
 
 	def __handleActivate(self, reason):
 		if reason in {QSystemTrayIcon.ActivationReason.Trigger,
@@ -743,39 +840,15 @@ class RazerApplet(QSystemTrayIcon):
 			      QSystemTrayIcon.ActivationReason.MiddleClick}:
 			self.contextMenu().popup(QCursor.pos())
 
-	def __contextAboutToShow(self):
-		self.__contextMenuIsShown = True
-		self.__setPolling()
-		self.updateContent()
+	def __handleDisconnect(self, message):
+		self.showMessage("Razer device configuration",
+				 "Lost the connection to razerd:\n%s" % message,
+				 QSystemTrayIcon.MessageIcon.Critical)
 
-	def __contextAboutToHide(self):
-		self.__contextMenuIsShown = False
-		self.__setPolling()
-
-	def __mainwndShown(self, widget):
-		self.__mainwndIsShown = True
-		self.__setPolling()
-		self.updateContent()
-
-	def __mainwndHidden(self, widget):
-		self.__mainwndIsShown = False
-		self.__setPolling()
-
-	def __setPolling(self):
-		if self.__contextMenuIsShown or self.__mainwndIsShown:
-			if not self.__pollTimer.isActive():
-				self.__pollTimer.start()
-		else:
-			if self.__pollTimer.isActive():
-				self.__pollTimer.stop()
-
-	def updateContent(self):
-		if razer.pollNotifications():
-			self.mainwnd.scan()
-			mice = razer.getMice()
-			if mice != self.mice:
-				self.mice = mice
-				self.buildMenu()
+	def __handleNotifications(self, notifications):
+		self.mainwnd.handleNotifications(notifications)
+		self.mice = self.mainwnd.mice
+		self.buildMenu()
 
 	def buildMenu(self):
 		# clear the menu